@@ -45,8 +45,6 @@ map_t database;
 
 int main(int argc , char *argv[])
 {
-    signal(SIGINT, core_close);
-
     server.pid        = getpid();
     server.lock       = HB_CORE_LOCK;
 
@@ -54,11 +52,114 @@ int main(int argc , char *argv[])
     server.backlog    = HB_NET_BACKLOG;
     server.buffer     = HB_NET_BUFFER;
 
+    server.metrics_port = HB_METRICS_PORT;
+
+    server.slow_threshold = HB_SLOW_THRESHOLD;
+    server.slow_length    = HB_SLOW_LENGTH;
+
+    server.sketch_rate    = HB_SKETCH_RATE;
+
+    server.aof        = NULL;
+    server.aof_fsync  = HB_AOF_FSYNC_EVERYSEC;
+    server.aof_rewrite_rate = HB_AOF_REWRITE_RATE;
+    server.snapshot   = HB_SAVE_FILE;
+
+    server.replicaof  = NULL;
+    server.repl_backlog = HB_REPL_BACKLOG;
+
+    server.engine     = engine_find(HB_ENGINE);
+    server.dir        = HB_CORE_DIR;
+    server.prefault   = false;
+    server.tier_after = 0;
+    server.compress_above = 0;
+
     server.daemonize  = false;
 
+    pthread_mutex_init(&server.mutex, NULL);
+
     client.size = sizeof(struct sockaddr_in);
 
+    struct ascii_t commands [] = {
+        { "inf", ascii_inf, -1, 0 },
+        { "info", ascii_inf, -1, 0 },
+        { "set", ascii_set, 3, HB_ASCII_WRITE },
+        { "get", ascii_get, 2, 0 },
+        { "del", ascii_del, 2, HB_ASCII_WRITE },
+        { "type", ascii_type, 2, 0 },
+        { "object", ascii_object, 3, 0 },
+        { "len", ascii_len, 1, 0 },
+        { "clr", ascii_clr, 1, HB_ASCII_WRITE },
+        { "compact", ascii_compact, 1, 0 },
+        { "save", ascii_save, 1, 0 },
+        { "bgsave", ascii_bgsave, 1, 0 },
+        { "bgrewriteaof", ascii_bgrewriteaof, 1, 0 },
+        { "slowlog", ascii_slowlog, -1, 0 },
+        { "hot", ascii_hot, -1, 0 },
+        { "big", ascii_big, -1, 0 },
+        { "lpush", ascii_lpush, -3, HB_ASCII_WRITE },
+        { "rpush", ascii_rpush, -3, HB_ASCII_WRITE },
+        { "lpop", ascii_lpop, 2, HB_ASCII_WRITE },
+        { "rpop", ascii_rpop, 2, HB_ASCII_WRITE },
+        { "llen", ascii_llen, 2, 0 },
+        { "lindex", ascii_lindex, 3, 0 },
+        { "lrange", ascii_lrange, 4, 0 },
+        { "blpop", ascii_blpop, -3, HB_ASCII_BLOCK },
+        { "brpop", ascii_brpop, -3, HB_ASCII_BLOCK },
+        { "hset", ascii_hset, -4, HB_ASCII_WRITE },
+        { "hget", ascii_hget, 3, 0 },
+        { "hdel", ascii_hdel, -3, HB_ASCII_WRITE },
+        { "hgetall", ascii_hgetall, 2, 0 },
+        { "hlen", ascii_hlen, 2, 0 },
+        { "hincrby", ascii_hincrby, 4, HB_ASCII_WRITE },
+        { "zadd", ascii_zadd, -4, HB_ASCII_WRITE },
+        { "zscore", ascii_zscore, 3, 0 },
+        { "zrank", ascii_zrank, 3, 0 },
+        { "zrange", ascii_zrange, -4, 0 },
+        { "zrangebyscore", ascii_zrangebyscore, -4, 0 },
+        { "zrem", ascii_zrem, -3, HB_ASCII_WRITE },
+        { "zcard", ascii_zcard, 2, 0 },
+        { "setbit", ascii_setbit, 4, HB_ASCII_WRITE },
+        { "getbit", ascii_getbit, 3, 0 },
+        { "bitcount", ascii_bitcount, -2, 0 },
+        { "bitpos", ascii_bitpos, -3, 0 },
+        { "bitop", ascii_bitop, -4, HB_ASCII_WRITE },
+        { "pfadd", ascii_pfadd, -2, HB_ASCII_WRITE },
+        { "pfcount", ascii_pfcount, -2, 0 },
+        { "pfmerge", ascii_pfmerge, -2, HB_ASCII_WRITE },
+        { "bf.reserve", ascii_bfreserve, 4, HB_ASCII_WRITE },
+        { "bf.add", ascii_bfadd, 3, HB_ASCII_WRITE },
+        { "bf.madd", ascii_bfmadd, -3, HB_ASCII_WRITE },
+        { "bf.exists", ascii_bfexists, 3, 0 },
+        { "bf.mexists", ascii_bfmexists, -3, 0 },
+        { "cf.reserve", ascii_cfreserve, 3, HB_ASCII_WRITE },
+        { "cf.add", ascii_cfadd, 3, HB_ASCII_WRITE },
+        { "cf.del", ascii_cfdel, 3, HB_ASCII_WRITE },
+        { "cf.exists", ascii_cfexists, 3, 0 },
+        { "cf.mexists", ascii_cfmexists, -3, 0 },
+        { "sadd", ascii_sadd, -3, HB_ASCII_WRITE },
+        { "srem", ascii_srem, -3, HB_ASCII_WRITE },
+        { "sismember", ascii_sismember, 3, 0 },
+        { "smembers", ascii_smembers, 2, 0 },
+        { "scard", ascii_scard, 2, 0 },
+        { "sinter", ascii_sinter, -2, 0 },
+        { "sunion", ascii_sunion, -2, 0 },
+        { "sdiff", ascii_sdiff, -2, 0 },
+        { "xadd", ascii_xadd, -5, HB_ASCII_WRITE },
+        { "xlen", ascii_xlen, 2, 0 },
+        { "xrange", ascii_xrange, -4, 0 },
+        { "xread", ascii_xread, -4, 0 },
+        { "xgroup", ascii_xgroup, -4, HB_ASCII_WRITE },
+        { "xreadgroup", ascii_xreadgroup, -7, HB_ASCII_BLOCK },
+        { "xack", ascii_xack, -4, HB_ASCII_WRITE },
+        { "xpending", ascii_xpending, 3, 0 },
+        { "xclaim", ascii_xclaim, -6, HB_ASCII_LOGS },
+        { NULL, NULL, 0, 0 },
+    };
+
+    server.commands = commands;
+
     core_init(argc, argv);
+    core_signals();
 
     char *ascii_logo =
         "                                                           \n"
@@ -74,24 +175,66 @@ int main(int argc , char *argv[])
 
     printf(ascii_logo, HB_VERSION, server.port, server.pid);
 
+    server.status = stat_init();
+    if (server.status == HB_ERR) core_close(1);
+
     server.status = net_init();
     if (server.status == HB_ERR) core_close(1);
 
     server.status = map_init();
     if (server.status == HB_ERR) core_close(1);
 
-    fprintf(stdout, "hb: %s waiting for incoming connections...\n", HB_LOG_INF);
+    server.status = server.engine->init();
+    if (server.status == HB_ERR) core_close(1);
 
-    struct ascii_t commands [] = {
-        { "inf", ascii_inf },
-        { "set", ascii_set },
-        { "get", ascii_get },
-        { "del", ascii_del },
-        { "len", ascii_len },
-        { "clr", ascii_clr },
-    };
+    server.status = slow_init();
+    if (server.status == HB_ERR) core_close(1);
 
-    server.commands = commands;
+    server.status = sketch_init();
+    if (server.status == HB_ERR) core_close(1);
+
+    server.status = bitmap_init();
+    if (server.status == HB_ERR) core_close(1);
+
+    /* On-disk engines keep their own files, logs and snapshots are for memory */
+    if (server.engine->durable) {
+        if (server.aof)
+            fprintf(stdout, "hb: %s append only file is ignored by the %s engine\n", HB_LOG_WRN, server.engine->name);
+        server.aof = NULL;
+        server.snapshot = NULL;
+        if (server.tier_after > 0)
+            fprintf(stdout, "hb: %s tiering is ignored by the %s engine\n", HB_LOG_WRN, server.engine->name);
+        server.tier_after = 0;
+        if (server.compress_above > 0)
+            fprintf(stdout, "hb: %s compression is ignored by the %s engine\n", HB_LOG_WRN, server.engine->name);
+        server.compress_above = 0;
+        if (server.replicaof)
+            fprintf(stdout, "hb: %s replication is ignored by the %s engine\n", HB_LOG_WRN, server.engine->name);
+        server.replicaof = NULL;
+    }
+
+    /* The log has every write since it was started, a snapshot may be older */
+    server.status = server.aof ? aof_load() : save_load();
+    if (server.status == HB_ERR) core_close(1);
+
+    server.status = aof_init();
+    if (server.status == HB_ERR) core_close(1);
+
+    if (server.tier_after > 0) {
+        server.status = tier_init();
+        if (server.status == HB_ERR) core_close(1);
+    }
+
+    server.status = repl_init();
+    if (server.status == HB_ERR) core_close(1);
+
+    server.status = block_init();
+    if (server.status == HB_ERR) core_close(1);
+
+    fprintf(stdout, "hb: %s waiting for incoming connections...\n", HB_LOG_INF);
+
+    server.status = metrics_init();
+    if (server.status == HB_ERR) core_close(1);
 
     net_loop();
 
@@ -0,0 +1,732 @@
+/*
+ * AOF                   Append-only log of write commands with group commit.
+ *
+ * Version:                                      @(#)aof.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+extern map_t database;
+
+/* Offsets count bytes since the log was opened: 'fed' is what commands have
+ * appended to 'buf', 'written' what reached the kernel and 'synced' what
+ * fdatasync() made durable. Only one thread does I/O at a time ('flushing'),
+ * everybody else waits on 'done' and is covered by that single write. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static pipe_t buf;
+static uint64_t fed;
+static uint64_t written;
+static uint64_t synced;
+static uint64_t base;
+static int flushing;
+static int failed;
+static int fd = HB_ERR;
+static int loading;
+
+/* While a child rewrites the log everything fed is also kept in 'rewrite'
+ * and appended to the new file before it replaces the old one. */
+static pipe_t rewrite;
+static pid_t child;
+static uint64_t rewrite_start;
+static uint64_t rewrite_nsec;
+static uint64_t rewrite_base;
+static uint64_t rewrites;
+static int rewrite_status = HB_OK;
+
+/* Copies of the counters above for aof_state() and aof_catinfo(), which
+ * read them without the lock every write takes. Stored with the lock
+ * held, loaded relaxed. */
+static int enabled;
+static uint64_t current;                    /* base + written */
+static uint64_t buffered;                   /* fed - written */
+
+#define AOF_PUBLISH(var, value)  __atomic_store_n(&(var), (value), __ATOMIC_RELAXED)
+#define AOF_READ(var)            __atomic_load_n(&(var), __ATOMIC_RELAXED)
+
+static __thread uint64_t mine;
+
+/* Writer state of the rewriting child */
+typedef struct _aof_out {
+    int fd;
+    int failed;
+    pipe_t buf;
+    uint64_t bytes;
+    uint64_t start;
+    const char *command;                    /* Of the collection being written */
+    char *key;
+    object_t *stream;                       /* Whose groups are being written */
+    pipe_t group;
+    int args;
+} aof_out_t;
+
+static int   aof_write(int);
+static void *aof_loop(void *);
+static int   aof_grown(void);
+static void  aof_out_flush(aof_out_t *);
+static int   aof_out_arg(any_t, const char *, size_t);
+static int   aof_out_member(any_t, const char *, size_t, double);
+static void  aof_out_end(aof_out_t *);
+static void  aof_out_line(aof_out_t *, const char **, pipe_t *, int);
+static int   aof_out_stream_entry(any_t, const stream_id_t *, pipe_t *, int);
+static int   aof_out_stream_group(any_t, pipe_t, const stream_id_t *);
+static int   aof_out_stream_pending(any_t, const stream_id_t *, pipe_t);
+static int   aof_out_entry(any_t, char *, any_t);
+static int   aof_rewrite_child(const char *);
+static void *aof_rewrite_wait(void *);
+static int   aof_rewrite_done(const char *);
+
+int aof_policy(const char *name)
+{
+    if (!strcasecmp(name, "always")) return HB_AOF_FSYNC_ALWAYS;
+    if (!strcasecmp(name, "everysec")) return HB_AOF_FSYNC_EVERYSEC;
+    if (!strcasecmp(name, "no")) return HB_AOF_FSYNC_NO;
+    return HB_ERR;
+}
+
+int aof_init(void)
+{
+    pthread_t thread_id;
+    struct stat st;
+
+    if (server.aof == NULL) return HB_OK;
+
+    if ((fd = open(server.aof, O_WRONLY | O_APPEND | O_CREAT, 0644)) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not open append only file [%s]\n", HB_LOG_ERR, server.aof);
+        return HB_ERR;
+    }
+
+    if (fstat(fd, &st) == HB_OK) base = st.st_size;
+    AOF_PUBLISH(rewrite_base, base);
+    AOF_PUBLISH(current, base);
+    AOF_PUBLISH(enabled, 1);
+    buf = pipe_empty();
+
+    if (pthread_create(&thread_id, NULL, aof_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create aof thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    return HB_OK;
+}
+
+/* Every command is one line of tokens quoted the way pipe_splitargs()
+ * reads them back, so the log is also readable by humans. */
+void aof_feed(pipe_t *tokens, int count)
+{
+    size_t len;
+    int i;
+
+    if (fd == HB_ERR || loading) return;
+
+    pthread_mutex_lock(&lock);
+    len = pipe_len(buf);
+    for (i = 0; i < count; i++) {
+        if (i) buf = pipe_catlen(buf, " ", 1);
+        buf = pipe_catrepr(buf, tokens[i], pipe_len(tokens[i]));
+    }
+    buf = pipe_catlen(buf, "\r\n", 2);
+    if (child) rewrite = pipe_catlen(rewrite, buf + len, pipe_len(buf) - len);
+    fed += pipe_len(buf) - len;
+    AOF_PUBLISH(buffered, fed - written);
+    mine = fed;
+    pthread_mutex_unlock(&lock);
+}
+
+/* Take the whole buffer and write it out, optionally followed by
+ * fdatasync(). Called and returns with 'lock' held, but drops it for the
+ * duration of the I/O so commands keep appending to a fresh buffer. On
+ * error the unwritten part goes back in front of the buffer. */
+static int aof_write(int sync)
+{
+    pipe_t data = buf;
+    size_t len = pipe_len(data), off = 0;
+    ssize_t n;
+    int status = HB_OK;
+
+    flushing = 1;
+    buf = pipe_empty();
+    pthread_mutex_unlock(&lock);
+
+    while (off < len) {
+        if ((n = write(fd, data + off, len - off)) < 0) {
+            if (errno == EINTR) continue;
+            status = HB_ERR;
+            break;
+        }
+        off += n;
+    }
+
+    if (status == HB_OK && sync && fdatasync(fd) == HB_ERR) status = HB_ERR;
+    if (status == HB_ERR)
+        fprintf(stdout, "hb: %s could not write append only file: %s\n", HB_LOG_ERR, strerror(errno));
+
+    pthread_mutex_lock(&lock);
+    written += off;
+    AOF_PUBLISH(current, base + written);
+    AOF_PUBLISH(buffered, fed - written);
+    if (status == HB_OK && sync) synced = written;
+    if (off < len) {
+        pipe_range(data, off, -1);
+        data = pipe_catpipe(data, buf);
+        pipe_free(buf);
+        buf = data;
+    } else {
+        pipe_free(data);
+    }
+    AOF_PUBLISH(failed, status == HB_ERR);
+    flushing = 0;
+    pthread_cond_broadcast(&done);
+
+    return status;
+}
+
+int aof_sync(void)
+{
+    int status = HB_OK;
+
+    if (fd == HB_ERR || server.aof_fsync != HB_AOF_FSYNC_ALWAYS) return HB_OK;
+
+    pthread_mutex_lock(&lock);
+    while (synced < mine) {
+        if (flushing) {
+            pthread_cond_wait(&done, &lock);
+        } else if (aof_write(1) == HB_ERR) {
+            status = HB_ERR;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    return status;
+}
+
+void aof_flush(void)
+{
+    if (fd == HB_ERR) return;
+
+    pthread_mutex_lock(&lock);
+    while (flushing) pthread_cond_wait(&done, &lock);
+    if (pipe_len(buf) || synced < written) aof_write(1);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Background writer: every HB_AOF_INTERVAL the buffer is handed to the
+ * kernel, once a second it is also synced unless the policy is "no". With
+ * "always" command threads normally get there first. */
+static void *aof_loop(void *arg)
+{
+    uint64_t last = stat_clock();
+
+    for (;;) {
+        int sync;
+
+        usleep(HB_AOF_INTERVAL * 1000);
+
+        pthread_mutex_lock(&lock);
+        sync = server.aof_fsync != HB_AOF_FSYNC_NO && stat_clock() - last >= 1000000000ULL;
+        if (!flushing && (pipe_len(buf) || (sync && synced < written))) {
+            aof_write(sync);
+            if (sync) last = stat_clock();
+        }
+        pthread_mutex_unlock(&lock);
+
+        /* The database lock comes first, as for commands */
+        if (aof_grown()) {
+            pthread_mutex_lock(&server.mutex);
+            if (aof_rewrite() == HB_OK)
+                fprintf(stdout, "hb: %s append only file doubled, rewriting\n", HB_LOG_INF);
+            pthread_mutex_unlock(&server.mutex);
+        }
+    }
+
+    return NULL;
+}
+
+/* Rewrite on its own once the log is HB_AOF_REWRITE_GROWTH percent bigger
+ * than after the last rewrite, but not for small logs. */
+static int aof_grown(void)
+{
+    uint64_t size;
+    int grown;
+
+    pthread_mutex_lock(&lock);
+    size = base + written;
+    grown = !child && size >= HB_AOF_REWRITE_MIN &&
+            size >= rewrite_base + rewrite_base * HB_AOF_REWRITE_GROWTH / 100;
+    pthread_mutex_unlock(&lock);
+
+    return grown;
+}
+
+/* Write what the child has buffered, sleeping as needed to stay under
+ * server.aof_rewrite_rate megabytes per second. */
+static void aof_out_flush(aof_out_t *out)
+{
+    size_t off = 0, len = pipe_len(out->buf);
+    ssize_t n;
+
+    while (off < len && !out->failed) {
+        if ((n = write(out->fd, out->buf + off, len - off)) < 0) {
+            if (errno != EINTR) out->failed = 1;
+            continue;
+        }
+        off += n;
+    }
+    pipe_clear(out->buf);
+    out->bytes += off;
+
+    if (server.aof_rewrite_rate > 0) {
+        uint64_t due = out->bytes * 1000000 / ((uint64_t) server.aof_rewrite_rate * MB);
+        uint64_t spent = (stat_clock() - out->start) / 1000;
+
+        if (spent < due) usleep(due - spent);
+    }
+}
+
+/* The elements of a collection go out as one command per
+ * HB_AOF_REWRITE_ARGS of them, not as one huge line. */
+static int aof_out_arg(any_t item, const char *p, size_t len)
+{
+    aof_out_t *out = item;
+
+    if (out->args == 0) {
+        out->buf = pipe_catprintf(out->buf, "\"%s\" ", out->command);
+        out->buf = pipe_catrepr(out->buf, out->key, pipe_len(out->key));
+    }
+    out->buf = pipe_catlen(out->buf, " ", 1);
+    out->buf = pipe_catrepr(out->buf, p, len);
+
+    if (++out->args == HB_AOF_REWRITE_ARGS) aof_out_end(out);
+
+    return out->failed ? HB_ERR : HB_OK;
+}
+
+/* zadd takes the score first */
+static int aof_out_member(any_t item, const char *member, size_t len, double score)
+{
+    pipe_t s = zset_catscore(pipe_empty(), score);
+
+    aof_out_arg(item, s, pipe_len(s));
+    pipe_free(s);
+
+    return aof_out_arg(item, member, len);
+}
+
+static void aof_out_end(aof_out_t *out)
+{
+    if (out->args == 0) return;
+
+    out->buf = pipe_catlen(out->buf, "\r\n", 2);
+    out->args = 0;
+
+    if (pipe_len(out->buf) >= HB_AOF_REWRITE_CHUNK) aof_out_flush(out);
+}
+
+/* A whole command: the name, 'head' and 'tail', stream entries are not
+ * split across commands */
+static void aof_out_line(aof_out_t *out, const char **head, pipe_t *tail, int count)
+{
+    int i;
+
+    out->buf = pipe_catprintf(out->buf, "\"%s\"", out->command);
+    for (i = 0; head[i] != NULL; i++) {
+        out->buf = pipe_catlen(out->buf, " ", 1);
+        out->buf = pipe_catrepr(out->buf, head[i], strlen(head[i]));
+    }
+    for (i = 0; i < count; i++) {
+        out->buf = pipe_catlen(out->buf, " ", 1);
+        out->buf = pipe_catrepr(out->buf, tail[i], pipe_len(tail[i]));
+    }
+    out->buf = pipe_catlen(out->buf, "\r\n", 2);
+
+    if (pipe_len(out->buf) >= HB_AOF_REWRITE_CHUNK) aof_out_flush(out);
+}
+
+static int aof_out_stream_entry(any_t item, const stream_id_t *id, pipe_t *fields, int count)
+{
+    aof_out_t *out = item;
+    pipe_t s = stream_catid(pipe_empty(), id);
+    const char *head[] = { out->key, s, NULL };
+
+    out->command = "xadd";
+    aof_out_line(out, head, fields, count);
+    pipe_free(s);
+
+    return out->failed ? HB_ERR : HB_OK;
+}
+
+/* A group is created where it was, its pending entries are claimed back */
+static int aof_out_stream_group(any_t item, pipe_t name, const stream_id_t *last)
+{
+    aof_out_t *out = item;
+    pipe_t s = stream_catid(pipe_empty(), last);
+    const char *head[] = { "create", out->key, name, s, "mkstream", NULL };
+
+    out->command = "xgroup";
+    aof_out_line(out, head, NULL, 0);
+    pipe_free(s);
+
+    out->group = name;
+    stream_iterate_pending(out->stream, name, aof_out_stream_pending, out);
+
+    return out->failed ? HB_ERR : HB_OK;
+}
+
+static int aof_out_stream_pending(any_t item, const stream_id_t *id, pipe_t consumer)
+{
+    aof_out_t *out = item;
+    pipe_t s = stream_catid(pipe_empty(), id);
+    const char *head[] = { out->key, out->group, consumer, "0", s, "force", NULL };
+
+    out->command = "xclaim";
+    aof_out_line(out, head, NULL, 0);
+    pipe_free(s);
+
+    return out->failed ? HB_ERR : HB_OK;
+}
+
+/* One set per key is the shortest log that rebuilds the database */
+static int aof_out_entry(any_t item, char *key, any_t data)
+{
+    aof_out_t *out = item;
+    object_t *o = data;
+    pipe_t value = o->ptr;
+
+    if (o->type == HB_OBJ_LIST || o->type == HB_OBJ_SET) {
+        out->command = o->type == HB_OBJ_LIST ? "rpush" : "sadd";
+        out->key = key;
+        if (o->type == HB_OBJ_LIST) list_iterate(o->ptr, aof_out_arg, out);
+        else set_iterate(o, aof_out_arg, out);
+        aof_out_end(out);
+
+        return out->failed ? HB_ERR : HB_OK;
+    }
+
+    if (o->type == HB_OBJ_STREAM) {
+        out->key = key;
+        out->stream = o;
+        stream_iterate(o, aof_out_stream_entry, out);
+        stream_iterate_groups(o, aof_out_stream_group, out);
+
+        return out->failed ? HB_ERR : HB_OK;
+    }
+
+    /* An even number of arguments a command keeps the pairs whole */
+    if (o->type == HB_OBJ_HASH || o->type == HB_OBJ_ZSET) {
+        out->command = o->type == HB_OBJ_HASH ? "hset" : "zadd";
+        out->key = key;
+        if (o->type == HB_OBJ_HASH) hash_iterate(o, aof_out_arg, out);
+        else zset_iterate(o, aof_out_member, out);
+        aof_out_end(out);
+
+        return out->failed ? HB_ERR : HB_OK;
+    }
+
+    /* The log is plain commands, values are written out whole */
+    if (o->encoding != HB_ENC_RAW && (value = object_value(o)) == NULL) {
+        out->failed = 1;
+        return HB_ERR;
+    }
+
+    out->buf = pipe_catlen(out->buf, "\"set\" ", 6);
+    out->buf = pipe_catrepr(out->buf, key, pipe_len(key));
+    out->buf = pipe_catlen(out->buf, " ", 1);
+    out->buf = pipe_catrepr(out->buf, value, pipe_len(value));
+    out->buf = pipe_catlen(out->buf, "\r\n", 2);
+
+    if (o->encoding != HB_ENC_RAW) pipe_free(value);
+
+    if (pipe_len(out->buf) >= HB_AOF_REWRITE_CHUNK) aof_out_flush(out);
+
+    return out->failed ? HB_ERR : HB_OK;
+}
+
+/* Runs in the forked child, on its copy-on-write view of the database. The
+ * rewrite yields CPU and disk to the server: lowest nice value, idle I/O
+ * scheduling class where the kernel has one, and the rate limit. */
+static int aof_rewrite_child(const char *path)
+{
+    aof_out_t out;
+
+    setpriority(PRIO_PROCESS, 0, 19);
+#if defined(SYS_ioprio_set)
+    /* IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE */
+    syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+
+    memset(&out, 0, sizeof(out));
+    if ((out.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == HB_ERR) return HB_ERR;
+    out.buf = pipe_empty();
+    out.start = stat_clock();
+
+    map_iterate(&database, aof_out_entry, &out);
+    aof_out_flush(&out);
+
+    if (fsync(out.fd) == HB_ERR) out.failed = 1;
+    if (close(out.fd) == HB_ERR) out.failed = 1;
+
+    return out.failed ? HB_ERR : HB_OK;
+}
+
+int aof_rewrite(void)
+{
+    pthread_t thread_id;
+    char path[PATH_MAX];
+    pid_t pid;
+
+    if (fd == HB_ERR) return HB_ERR;
+
+    pthread_mutex_lock(&lock);
+    if (child) {
+        pthread_mutex_unlock(&lock);
+        return HB_ERR;
+    }
+
+    snprintf(path, sizeof(path), "%s.rewrite", server.aof);
+    rewrite_start = stat_clock();
+
+    if ((pid = fork()) == 0) {
+        _exit(aof_rewrite_child(path) == HB_OK ? 0 : 1);
+    } else if (pid == HB_ERR) {
+        fprintf(stdout, "hb: %s could not fork for rewrite: %s\n", HB_LOG_ERR, strerror(errno));
+        AOF_PUBLISH(rewrite_status, HB_ERR);
+        pthread_mutex_unlock(&lock);
+        return HB_ERR;
+    }
+
+    AOF_PUBLISH(child, pid);
+    rewrite = pipe_empty();
+
+    if (pthread_create(&thread_id, NULL, aof_rewrite_wait, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create rewrite thread\n", HB_LOG_ERR);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        unlink(path);
+        pipe_free(rewrite);
+        AOF_PUBLISH(child, 0);
+        pthread_mutex_unlock(&lock);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+    pthread_mutex_unlock(&lock);
+
+    return HB_OK;
+}
+
+static void *aof_rewrite_wait(void *arg)
+{
+    char path[PATH_MAX];
+    int status;
+    pid_t pid;
+
+    pthread_mutex_lock(&lock);
+    pid = child;
+    pthread_mutex_unlock(&lock);
+
+    snprintf(path, sizeof(path), "%s.rewrite", server.aof);
+
+    while (waitpid(pid, &status, 0) == HB_ERR && errno == EINTR);
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        status = aof_rewrite_done(path);
+    } else {
+        status = HB_ERR;
+        pthread_mutex_lock(&lock);
+        pipe_free(rewrite);
+        rewrite = NULL;
+        AOF_PUBLISH(child, 0);
+        pthread_mutex_unlock(&lock);
+    }
+
+    if (status == HB_ERR) unlink(path);
+
+    pthread_mutex_lock(&lock);
+    AOF_PUBLISH(rewrite_status, status);
+    AOF_PUBLISH(rewrite_nsec, stat_clock() - rewrite_start);
+    if (status == HB_OK) AOF_PUBLISH(rewrites, rewrites + 1);
+    pthread_mutex_unlock(&lock);
+
+    fprintf(stdout, "hb: %s append only file rewrite %s\n",
+            status == HB_OK ? HB_LOG_OK : HB_LOG_ERR, status == HB_OK ? "done" : "failed");
+
+    return NULL;
+}
+
+/* Append what was fed during the rewrite, most of it without holding the
+ * lock, then the rest and swap the files while nobody is writing. */
+static int aof_rewrite_done(const char *path)
+{
+    pipe_t pending;
+    struct stat st;
+    size_t off;
+    ssize_t n;
+    int nfd, status = HB_OK;
+
+    if ((nfd = open(path, O_WRONLY | O_APPEND)) == HB_ERR) status = HB_ERR;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        if (status == HB_ERR || pipe_len(rewrite) < HB_AOF_REWRITE_CHUNK) break;
+        pending = rewrite;
+        rewrite = pipe_empty();
+        pthread_mutex_unlock(&lock);
+
+        for (off = 0; off < pipe_len(pending) && status == HB_OK; off += n)
+            if ((n = write(nfd, pending + off, pipe_len(pending) - off)) < 0) status = HB_ERR;
+        pipe_free(pending);
+    }
+
+    /* The lock is held from here on, commands wait for the switch */
+    while (flushing) pthread_cond_wait(&done, &lock);
+
+    for (off = 0; status == HB_OK && off < pipe_len(rewrite); off += n)
+        if ((n = write(nfd, rewrite + off, pipe_len(rewrite) - off)) < 0) status = HB_ERR;
+
+    if (status == HB_OK && (fdatasync(nfd) == HB_ERR || fstat(nfd, &st) == HB_ERR ||
+                            rename(path, server.aof) == HB_ERR))
+        status = HB_ERR;
+
+    if (status == HB_OK) {
+        /* Everything fed so far is in the new file and synced */
+        close(fd);
+        fd = nfd;
+        pipe_clear(buf);
+        written = synced = fed;
+        base = st.st_size - fed;
+        AOF_PUBLISH(current, base + written);
+        AOF_PUBLISH(buffered, 0);
+        AOF_PUBLISH(rewrite_base, st.st_size);
+        AOF_PUBLISH(failed, 0);
+        pthread_cond_broadcast(&done);
+    } else if (nfd != HB_ERR) {
+        close(nfd);
+    }
+
+    pipe_free(rewrite);
+    rewrite = NULL;
+    AOF_PUBLISH(child, 0);
+    pthread_mutex_unlock(&lock);
+
+    return status;
+}
+
+int aof_load(void)
+{
+    struct stat st;
+    struct ascii_t *command;
+    pipe_t line, *tokens;
+    char *data, *p, *end, *nl;
+    uint64_t commands = 0, start = stat_clock();
+    int rfd, count;
+
+    if (server.aof == NULL) return HB_OK;
+
+    if ((rfd = open(server.aof, O_RDONLY)) == HB_ERR) return HB_OK;
+    if (fstat(rfd, &st) == HB_ERR || st.st_size == 0) {
+        close(rfd);
+        return HB_OK;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, rfd, 0);
+    close(rfd);
+    if (data == MAP_FAILED) {
+        fprintf(stdout, "hb: %s could not map append only file\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    loading = 1;
+    line = pipe_empty();
+
+    for (p = data, end = data + st.st_size; p < end; p = nl + 1) {
+        if ((nl = memchr(p, '\n', end - p)) == NULL) break;
+
+        line = pipe_cpylen(line, p, nl - p);
+        tokens = pipe_splitargs(line, &count);
+
+        /* A complete line was written whole, so it is corruption, not a crash */
+        if ((command = ascii_lookup(tokens, count)) == NULL) {
+            fprintf(stdout, "hb: %s bad command in append only file at offset %ld, refusing to start\n",
+                    HB_LOG_ERR, (long) (p - data));
+            pipe_freesplitres(tokens, count);
+            loading = 0;
+            pipe_free(line);
+            munmap(data, st.st_size);
+            return HB_ERR;
+        }
+
+        pipe_free(command->func(tokens, count));
+        pipe_freesplitres(tokens, count);
+        commands++;
+    }
+
+    loading = 0;
+    pipe_free(line);
+
+    /* A crash in the middle of a write leaves a last command without its
+     * newline, only that torn tail is cut off */
+    if (p < end) {
+        fprintf(stdout, "hb: %s truncating append only file from %ld to %ld bytes\n",
+                HB_LOG_WRN, (long) st.st_size, (long) (p - data));
+        if (truncate(server.aof, p - data) == HB_ERR) {
+            munmap(data, st.st_size);
+            return HB_ERR;
+        }
+    }
+
+    munmap(data, st.st_size);
+
+    fprintf(stdout, "hb: %s loaded %" PRIu64 " commands from append only file in %.3fs\n",
+            HB_LOG_OK, commands, (stat_clock() - start) / 1e9);
+
+    return HB_OK;
+}
+
+void aof_state(aof_state_t *state)
+{
+    memset(state, 0, sizeof(*state));
+    if (!AOF_READ(enabled)) return;
+
+    state->enabled = 1;
+    state->size = AOF_READ(current);
+    state->base_size = AOF_READ(rewrite_base);
+    state->rewriting = AOF_READ(child) != 0;
+    state->rewrites = AOF_READ(rewrites);
+    state->rewrite_nsec = AOF_READ(rewrite_nsec);
+}
+
+pipe_t aof_catinfo(pipe_t s)
+{
+    static const char *policies[] = { "no", "always", "everysec" };
+
+    s = pipe_catprintf(s, "aof_enabled:%d\n", AOF_READ(enabled));
+    if (!AOF_READ(enabled)) return s;
+
+    s = pipe_catprintf(s, "aof_fsync:%s\n", policies[server.aof_fsync]);
+    s = pipe_catprintf(s, "aof_current_size:%" PRIu64 "\n", AOF_READ(current));
+    s = pipe_catprintf(s, "aof_buffer_length:%" PRIu64 "\n", AOF_READ(buffered));
+    s = pipe_catprintf(s, "aof_last_write_status:%s\n", AOF_READ(failed) ? "err" : "ok");
+    s = pipe_catprintf(s, "aof_base_size:%" PRIu64 "\n", AOF_READ(rewrite_base));
+    s = pipe_catprintf(s, "aof_rewrite_in_progress:%d\n", AOF_READ(child) != 0);
+    s = pipe_catprintf(s, "aof_rewrites:%" PRIu64 "\n", AOF_READ(rewrites));
+    s = pipe_catprintf(s, "aof_last_rewrite_duration_sec:%.3f\n", AOF_READ(rewrite_nsec) / 1e9);
+    s = pipe_catprintf(s, "aof_last_rewrite_status:%s\n", AOF_READ(rewrite_status) == HB_OK ? "ok" : "err");
+
+    return s;
+}
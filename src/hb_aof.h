@@ -0,0 +1,75 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_AOF_H_
+#define _HB_AOF_H_
+
+#define HB_AOF_FSYNC_NO         0           /* Let the kernel decide */
+#define HB_AOF_FSYNC_ALWAYS     1           /* Durable before the reply */
+#define HB_AOF_FSYNC_EVERYSEC   2           /* At most a second is lost */
+
+typedef struct _aof_state {
+    int enabled;
+    int rewriting;
+    uint64_t size;                          /* Current log size */
+    uint64_t base_size;                     /* Log size after the last rewrite */
+    uint64_t rewrites;
+    uint64_t rewrite_nsec;                  /* Duration of the last rewrite */
+} aof_state_t;
+
+/* Open the log named by server.aof and start the flusher thread. */
+int     aof_init(void);
+
+/* Replay the log into the database. Returns HB_OK or HB_ERR. */
+int     aof_load(void);
+
+/* Append a write command to the log buffer. Must be called with the
+ * database lock held, so the log order is the execution order. */
+void    aof_feed(pipe_t *, int);
+
+/* Block until everything fed by the calling thread is on disk (policy
+ * "always" only). Concurrent callers are served by one write+fdatasync. */
+int     aof_sync(void);
+
+/* Write and sync whatever is buffered, used on shutdown. */
+void    aof_flush(void);
+
+/* Fork a child that writes the shortest log for the current database to
+ * a new file, which replaces the log once the writes made meanwhile are
+ * appended. Must be called with the database lock held. */
+int     aof_rewrite(void);
+
+/* Copy the log counters, for the metrics endpoint. Takes no lock. */
+void    aof_state(aof_state_t *);
+
+/* Parse a fsync policy name. Returns the policy or HB_ERR. */
+int     aof_policy(const char *);
+
+/* Append the persistence section of the inf report. */
+pipe_t  aof_catinfo(pipe_t);
+
+#endif
@@ -6,69 +6,1381 @@
  *
  */
 
+#include <stdlib.h>
+#include <strings.h>
+
 #include <hb_core.h>
 
+extern struct server server;
 extern map_t database;
 
-pipe_t ascii_inf(pipe_t *tokens)
+static int    ascii_typed(pipe_t, int, object_t **);
+static pipe_t ascii_push(pipe_t *, int, int);
+static pipe_t ascii_pop(pipe_t *, int, int);
+static pipe_t ascii_bpop(pipe_t *, int, int);
+static object_t *ascii_writable(pipe_t, object_t *);
+static pipe_t ascii_bytes(object_t *);
+static void   ascii_bytes_free(object_t *, pipe_t);
+static int    ascii_span(pipe_t *, int, int, long long, long long *, long long *);
+static int    ascii_hll_merge(pipe_t, unsigned char *);
+static int    ascii_filter(pipe_t, int (*)(pipe_t), object_t **);
+static pipe_t ascii_filter_new(pipe_t, pipe_t);
+static pipe_t ascii_filter_results(const int *, int);
+static pipe_t ascii_bloom(pipe_t *, int, int);
+static pipe_t ascii_setop(pipe_t *, int, int);
+static void   ascii_log(pipe_t *, int);
+static int    ascii_stream_id(pipe_t, uint64_t, stream_id_t *);
+static pipe_t ascii_stream_read(pipe_t *, int, int, pipe_t, pipe_t);
+
+/* Find the command named by the first token, NULL when there is no such
+ * command or it was called with a wrong number of arguments. */
+struct ascii_t *ascii_lookup(pipe_t *tokens, int count)
+{
+    struct ascii_t *command;
+
+    if (tokens == NULL || count == 0) return NULL;
+
+    for (command = server.commands; command->name != NULL; command++) {
+        if (strcmp(command->name, tokens[0]) || command->func == NULL) continue;
+
+        if ((command->arity > 0 && count != command->arity) ||
+            (command->arity < 0 && count < -command->arity))
+            return NULL;
+
+        return command;
+    }
+
+    return NULL;
+}
+
+/* The object of a key if it is of that type, NULL if the key is missing.
+ * HB_ERR for another type and with the durable engines, which keep
+ * strings only. */
+static int ascii_typed(pipe_t key, int type, object_t **o)
+{
+    if (server.engine->durable) return HB_ERR;
+
+    *o = memory_lookup(key);
+
+    return *o == NULL || (*o)->type == type ? HB_OK : HB_ERR;
+}
+
+pipe_t ascii_inf(pipe_t *tokens, int count)
 {
 	pipe_t buffer = pipe_empty();
 
     buffer = pipe_new("hashbase ");
     buffer = pipe_cat(buffer, HB_VERSION);
-    buffer = pipe_cat(buffer, " (c) 2014 Maciej A. Czyzewski");
-    
+    buffer = pipe_cat(buffer, " (c) 2014 Maciej A. Czyzewski\n");
+    buffer = stat_catinfo(buffer, count > 1 ? tokens[1] : "all");
+    pipe_trim(buffer, "\n");
+
     return buffer;
 }
 
-pipe_t ascii_set(pipe_t *tokens)
+pipe_t ascii_set(pipe_t *tokens, int count)
 {
 	pipe_t buffer = pipe_empty();
 
-    map_put(&database, tokens[1], tokens[2]);
-    buffer = pipe_fromlonglong(HB_OK);
+    buffer = pipe_fromlonglong(server.engine->put(tokens[1], tokens[2]));
 
     return buffer;
 }
 
-pipe_t ascii_get(pipe_t *tokens)
+pipe_t ascii_get(pipe_t *tokens, int count)
 {
 	pipe_t buffer = pipe_empty();
 
-    if ((map_get(&database, tokens[1], (void**)(&buffer))) != HB_ERR) {
-        buffer = pipe_new(buffer);
-    }else{
+    if ((buffer = server.engine->get(tokens[1])) == NULL) {
     	buffer = pipe_fromlonglong(HB_ERR);
     }
 
     return buffer;
 }
 
-pipe_t ascii_del(pipe_t *tokens)
+pipe_t ascii_del(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+
+    buffer = pipe_fromlonglong(server.engine->del(tokens[1]));
+
+    return buffer;
+}
+
+pipe_t ascii_type(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+    object_t *o;
+    pipe_t value;
+
+    /* Only the memory engine keeps typed values, the others hold strings */
+    if (!server.engine->durable) {
+        o = memory_lookup(tokens[1]);
+        buffer = pipe_cat(buffer, o ? object_typename(o) : "none");
+    } else {
+        value = server.engine->get(tokens[1]);
+        buffer = pipe_cat(buffer, value ? "string" : "none");
+        pipe_free(value);
+    }
+
+    return buffer;
+}
+
+pipe_t ascii_object(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+    any_t o;
+
+    /* Looked at without counting as an access */
+    if (server.engine->durable || map_get(&database, tokens[2], &o) == HB_ERR) {
+        pipe_free(buffer);
+        return pipe_fromlonglong(HB_ERR);
+    }
+
+    if (!strcasecmp(tokens[1], "encoding")) {
+        buffer = pipe_cat(buffer, object_encname(o));
+    } else if (!strcasecmp(tokens[1], "refcount")) {
+        pipe_free(buffer);
+        buffer = pipe_fromlonglong(((object_t *) o)->refcount);
+    } else if (!strcasecmp(tokens[1], "idletime")) {
+        pipe_free(buffer);
+        buffer = pipe_fromlonglong(object_idle(o));
+    } else {
+        pipe_free(buffer);
+        buffer = pipe_fromlonglong(HB_ERR);
+    }
+
+    return buffer;
+}
+
+pipe_t ascii_len(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+
+	buffer = pipe_fromlonglong(server.engine->len());
+
+    return buffer;
+}
+
+pipe_t ascii_clr(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+
+    buffer = pipe_fromlonglong(server.engine->clr());
+
+    return buffer;
+}
+
+pipe_t ascii_compact(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+
+    buffer = pipe_fromlonglong(server.engine->compact ? server.engine->compact() : HB_ERR);
+
+    return buffer;
+}
+
+pipe_t ascii_save(pipe_t *tokens, int count)
 {
 	pipe_t buffer = pipe_empty();
 
-    map_remove(&database, tokens[1]);
-    buffer = pipe_fromlonglong(HB_OK);
+    buffer = pipe_fromlonglong(save_now());
 
     return buffer;
 }
 
-pipe_t ascii_len(pipe_t *tokens)
+pipe_t ascii_bgsave(pipe_t *tokens, int count)
 {
 	pipe_t buffer = pipe_empty();
 
-	buffer = pipe_fromlonglong(map_length(&database));
+    buffer = pipe_fromlonglong(save_background());
 
     return buffer;
 }
 
-pipe_t ascii_clr(pipe_t *tokens)
+pipe_t ascii_bgrewriteaof(pipe_t *tokens, int count)
 {
 	pipe_t buffer = pipe_empty();
 
-    map_free(&database);
-    buffer = pipe_fromlonglong(HB_OK);
+    buffer = pipe_fromlonglong(aof_rewrite());
+
+    return buffer;
+}
+
+pipe_t ascii_slowlog(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+
+    if (count > 1 && !strcasecmp(tokens[1], "len")) {
+        pipe_free(buffer);
+        buffer = pipe_fromlonglong(slow_length());
+    } else if (count > 1 && !strcasecmp(tokens[1], "reset")) {
+        slow_reset();
+        pipe_free(buffer);
+        buffer = pipe_fromlonglong(HB_OK);
+    } else if (count == 1 || !strcasecmp(tokens[1], "get")) {
+        buffer = slow_catentries(buffer, count > 2 ? atoi(tokens[2]) : 10);
+    } else {
+        pipe_free(buffer);
+        buffer = pipe_fromlonglong(HB_ERR);
+    }
+
+    return buffer;
+}
+
+pipe_t ascii_hot(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+
+    buffer = sketch_cathot(buffer, count > 1 ? atoi(tokens[1]) : -1);
+
+    return buffer;
+}
+
+pipe_t ascii_big(pipe_t *tokens, int count)
+{
+	pipe_t buffer = pipe_empty();
+
+    buffer = sketch_catbig(buffer, count > 1 ? atoi(tokens[1]) : -1);
+
+    return buffer;
+}
+
+static pipe_t ascii_push(pipe_t *tokens, int count, int where)
+{
+    object_t *o;
+    int i;
+
+    if (ascii_typed(tokens[1], HB_OBJ_LIST, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    if (o == NULL) {
+        o = object_new(HB_OBJ_LIST, HB_ENC_CHUNKS, list_new());
+        if (memory_store(tokens[1], o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    }
+    for (i = 2; i < count; i++)
+        list_push(o->ptr, tokens[i], pipe_len(tokens[i]), where);
+    block_signal(tokens[1]);
+
+    return pipe_fromlonglong(list_length(o->ptr));
+}
+
+/* A list that becomes empty is removed */
+static pipe_t ascii_pop(pipe_t *tokens, int count, int where)
+{
+    object_t *o;
+    pipe_t buffer;
+
+    if (ascii_typed(tokens[1], HB_OBJ_LIST, &o) == HB_ERR || o == NULL) return pipe_fromlonglong(HB_ERR);
+
+    buffer = list_pop(o->ptr, where);
+    if (list_length(o->ptr) == 0) server.engine->del(tokens[1]);
+
+    return buffer;
+}
+
+pipe_t ascii_lpush(pipe_t *tokens, int count)
+{
+    return ascii_push(tokens, count, HB_LIST_HEAD);
+}
+
+pipe_t ascii_rpush(pipe_t *tokens, int count)
+{
+    return ascii_push(tokens, count, HB_LIST_TAIL);
+}
+
+pipe_t ascii_lpop(pipe_t *tokens, int count)
+{
+    return ascii_pop(tokens, count, HB_LIST_HEAD);
+}
+
+pipe_t ascii_rpop(pipe_t *tokens, int count)
+{
+    return ascii_pop(tokens, count, HB_LIST_TAIL);
+}
+
+pipe_t ascii_llen(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_LIST, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(o ? list_length(o->ptr) : 0);
+}
+
+pipe_t ascii_lindex(pipe_t *tokens, int count)
+{
+    object_t *o;
+    pipe_t buffer = NULL;
+
+    if (ascii_typed(tokens[1], HB_OBJ_LIST, &o) == HB_OK && o != NULL)
+        buffer = list_index(o->ptr, strtoll(tokens[2], NULL, 10));
+
+    return buffer ? buffer : pipe_fromlonglong(HB_ERR);
+}
+
+pipe_t ascii_lrange(pipe_t *tokens, int count)
+{
+    object_t *o;
+    pipe_t buffer = pipe_empty();
+
+    if (ascii_typed(tokens[1], HB_OBJ_LIST, &o) == HB_ERR) {
+        pipe_free(buffer);
+        return pipe_fromlonglong(HB_ERR);
+    }
+    if (o != NULL)
+        buffer = list_catrange(buffer, o->ptr, strtoll(tokens[2], NULL, 10), strtoll(tokens[3], NULL, 10));
+
+    return buffer;
+}
+
+/* Pop from the first of the keys that has elements, or park the client
+ * until one gets some. A missing reply tells the connection it is parked. */
+static pipe_t ascii_bpop(pipe_t *tokens, int count, int where)
+{
+    double timeout = strtod(tokens[count - 1], NULL);
+    object_t *o;
+    int i;
+
+    if (timeout < 0) return pipe_fromlonglong(HB_ERR);
+
+    for (i = 1; i < count - 1; i++) {
+        if (ascii_typed(tokens[i], HB_OBJ_LIST, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+        if (o != NULL) return block_pop(tokens[i], where);
+    }
+
+    if (block_park(net_socket(), tokens + 1, count - 2, where, timeout) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return NULL;
+}
+
+pipe_t ascii_blpop(pipe_t *tokens, int count)
+{
+    return ascii_bpop(tokens, count, HB_LIST_HEAD);
+}
+
+pipe_t ascii_brpop(pipe_t *tokens, int count)
+{
+    return ascii_bpop(tokens, count, HB_LIST_TAIL);
+}
+
+/* Fields are checked before anything is set, a map encoded hash keeps
+ * them as C strings */
+pipe_t ascii_hset(pipe_t *tokens, int count)
+{
+    object_t *o;
+    long long added = 0;
+    int i;
+
+    if (count % 2 != 0 || ascii_typed(tokens[1], HB_OBJ_HASH, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    for (i = 2; i < count; i += 2)
+        if (memchr(tokens[i], '\0', pipe_len(tokens[i])) != NULL) return pipe_fromlonglong(HB_ERR);
+
+    if (o == NULL && memory_store(tokens[1], o = hash_new()) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    for (i = 2; i < count; i += 2)
+        added += hash_set(o, tokens[i], pipe_len(tokens[i]), tokens[i + 1], pipe_len(tokens[i + 1]));
+
+    return pipe_fromlonglong(added);
+}
+
+pipe_t ascii_hget(pipe_t *tokens, int count)
+{
+    object_t *o;
+    pipe_t buffer = NULL;
+
+    if (ascii_typed(tokens[1], HB_OBJ_HASH, &o) == HB_OK && o != NULL)
+        buffer = hash_get(o, tokens[2]);
+
+    return buffer ? buffer : pipe_fromlonglong(HB_ERR);
+}
+
+/* A hash that becomes empty is removed */
+pipe_t ascii_hdel(pipe_t *tokens, int count)
+{
+    object_t *o;
+    long long removed = 0;
+    int i;
+
+    if (ascii_typed(tokens[1], HB_OBJ_HASH, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(0);
+
+    for (i = 2; i < count; i++)
+        removed += hash_del(o, tokens[i]);
+    if (hash_length(o) == 0) server.engine->del(tokens[1]);
+
+    return pipe_fromlonglong(removed);
+}
+
+pipe_t ascii_hgetall(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_HASH, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return o ? hash_catall(pipe_empty(), o) : pipe_empty();
+}
+
+pipe_t ascii_hlen(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_HASH, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(o ? hash_length(o) : 0);
+}
+
+pipe_t ascii_hincrby(pipe_t *tokens, int count)
+{
+    object_t *o;
+    long long incr, result;
+
+    if (!util_strtoll(tokens[3], pipe_len(tokens[3]), &incr) || memchr(tokens[2], '\0', pipe_len(tokens[2])) != NULL ||
+        ascii_typed(tokens[1], HB_OBJ_HASH, &o) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+
+    if (o == NULL && memory_store(tokens[1], o = hash_new()) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (hash_incrby(o, tokens[2], incr, &result) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(result);
+}
+
+/* Scores and members are checked before anything is added */
+pipe_t ascii_zadd(pipe_t *tokens, int count)
+{
+    object_t *o;
+    long long added = 0;
+    double score;
+    int i;
+
+    if (count % 2 != 0 || ascii_typed(tokens[1], HB_OBJ_ZSET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    for (i = 2; i < count; i += 2)
+        if (zset_strtod(tokens[i], pipe_len(tokens[i]), &score) == HB_ERR ||
+            memchr(tokens[i + 1], '\0', pipe_len(tokens[i + 1])) != NULL)
+            return pipe_fromlonglong(HB_ERR);
+
+    if (o == NULL && memory_store(tokens[1], o = zset_new()) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    for (i = 2; i < count; i += 2) {
+        zset_strtod(tokens[i], pipe_len(tokens[i]), &score);
+        added += zset_add(o, score, tokens[i + 1], pipe_len(tokens[i + 1]));
+    }
+
+    return pipe_fromlonglong(added);
+}
+
+pipe_t ascii_zscore(pipe_t *tokens, int count)
+{
+    object_t *o;
+    double score;
+
+    if (ascii_typed(tokens[1], HB_OBJ_ZSET, &o) == HB_ERR || o == NULL || zset_score(o, tokens[2], &score) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+
+    return zset_catscore(pipe_empty(), score);
+}
+
+pipe_t ascii_zrank(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_ZSET, &o) == HB_ERR || o == NULL) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(zset_rank(o, tokens[2]));
+}
+
+pipe_t ascii_zrange(pipe_t *tokens, int count)
+{
+    int withscores = count == 5 && !strcasecmp(tokens[4], "withscores");
+    object_t *o;
+
+    if ((count > 4 && !withscores) || ascii_typed(tokens[1], HB_OBJ_ZSET, &o) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_empty();
+
+    return zset_catrange(pipe_empty(), o, strtoll(tokens[2], NULL, 10), strtoll(tokens[3], NULL, 10), withscores);
+}
+
+pipe_t ascii_zrangebyscore(pipe_t *tokens, int count)
+{
+    int withscores = count == 5 && !strcasecmp(tokens[4], "withscores");
+    zset_range_t range;
+    object_t *o;
+
+    if ((count > 4 && !withscores) || zset_strtorange(tokens[2], tokens[3], &range) == HB_ERR ||
+        ascii_typed(tokens[1], HB_OBJ_ZSET, &o) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_empty();
+
+    return zset_catrangebyscore(pipe_empty(), o, &range, withscores);
+}
+
+/* A sorted set that becomes empty is removed */
+pipe_t ascii_zrem(pipe_t *tokens, int count)
+{
+    object_t *o;
+    long long removed = 0;
+    int i;
+
+    if (ascii_typed(tokens[1], HB_OBJ_ZSET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(0);
+
+    for (i = 2; i < count; i++)
+        removed += zset_rem(o, tokens[i]);
+    if (zset_length(o) == 0) server.engine->del(tokens[1]);
+
+    return pipe_fromlonglong(removed);
+}
+
+pipe_t ascii_zcard(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_ZSET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(o ? zset_length(o) : 0);
+}
+
+/* A string object that may be changed in place: raw and referenced by
+ * the database alone, a reply may still be sending it otherwise. Anything
+ * else is replaced by a raw copy. */
+static object_t *ascii_writable(pipe_t key, object_t *o)
+{
+    pipe_t value;
+
+    if (o != NULL && o->encoding == HB_ENC_RAW && o->refcount == 1) return o;
+
+    if (o == NULL) value = pipe_empty();
+    else if ((value = object_value(o)) == NULL) return NULL;
+
+    o = object_new(HB_OBJ_STRING, HB_ENC_RAW, value);
+
+    return memory_store(key, o) == HB_ERR ? NULL : o;
+}
+
+/* The bytes of a string object, a copy unless it is raw */
+static pipe_t ascii_bytes(object_t *o)
+{
+    return o->encoding == HB_ENC_RAW ? o->ptr : object_value(o);
+}
+
+static void ascii_bytes_free(object_t *o, pipe_t value)
+{
+    if (value != o->ptr) pipe_free(value);
+}
+
+/* An optional byte range at tokens[at] and tokens[at + 1], negative ends
+ * count from the end. HB_ERR if a given end is not a number. */
+static int ascii_span(pipe_t *tokens, int count, int at, long long len, long long *start, long long *end)
+{
+    *start = 0;
+    *end = len - 1;
+
+    if ((count > at && !util_strtoll(tokens[at], pipe_len(tokens[at]), start)) ||
+        (count > at + 1 && !util_strtoll(tokens[at + 1], pipe_len(tokens[at + 1]), end)))
+        return HB_ERR;
+
+    if (*start < 0) *start = MAX(*start + len, 0);
+    if (*end < 0) *end += len;
+    if (*end >= len) *end = len - 1;
+
+    return HB_OK;
+}
+
+pipe_t ascii_setbit(pipe_t *tokens, int count)
+{
+    long long offset, bit;
+    unsigned char *p, mask;
+    object_t *o;
+    int old;
+
+    if (!util_strtoll(tokens[2], pipe_len(tokens[2]), &offset) || offset < 0 || offset >= (long long) HB_BITMAP_MAX * 8 ||
+        !util_strtoll(tokens[3], pipe_len(tokens[3]), &bit) || (bit != 0 && bit != 1) ||
+        ascii_typed(tokens[1], HB_OBJ_STRING, &o) == HB_ERR || (o = ascii_writable(tokens[1], o)) == NULL)
+        return pipe_fromlonglong(HB_ERR);
+
+    o->ptr = pipe_growzero(o->ptr, (offset >> 3) + 1);
+    p = (unsigned char *) o->ptr + (offset >> 3);
+    mask = 0x80 >> (offset & 7);
+    old = (*p & mask) != 0;
+    *p = bit ? *p | mask : *p & ~mask;
+
+    return pipe_fromlonglong(old);
+}
+
+pipe_t ascii_getbit(pipe_t *tokens, int count)
+{
+    long long offset;
+    object_t *o;
+    pipe_t value;
+    int bit = 0;
+
+    if (!util_strtoll(tokens[2], pipe_len(tokens[2]), &offset) || offset < 0 ||
+        ascii_typed(tokens[1], HB_OBJ_STRING, &o) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(0);
+
+    if ((value = ascii_bytes(o)) == NULL) return pipe_fromlonglong(HB_ERR);
+    if ((size_t) (offset >> 3) < pipe_len(value))
+        bit = (((unsigned char *) value)[offset >> 3] & (0x80 >> (offset & 7))) != 0;
+    ascii_bytes_free(o, value);
+
+    return pipe_fromlonglong(bit);
+}
+
+pipe_t ascii_bitcount(pipe_t *tokens, int count)
+{
+    long long start, end, bits = 0;
+    object_t *o;
+    pipe_t value;
+
+    if ((count != 2 && count != 4) || ascii_typed(tokens[1], HB_OBJ_STRING, &o) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(0);
+
+    if ((value = ascii_bytes(o)) == NULL) return pipe_fromlonglong(HB_ERR);
+    if (ascii_span(tokens, count, 2, pipe_len(value), &start, &end) == HB_ERR) {
+        ascii_bytes_free(o, value);
+        return pipe_fromlonglong(HB_ERR);
+    }
+    if (start <= end) bits = bitmap_count((unsigned char *) value + start, end - start + 1);
+    ascii_bytes_free(o, value);
+
+    return pipe_fromlonglong(bits);
+}
+
+/* Looking for a clear bit without an end given, the bits past the value
+ * count as clear */
+pipe_t ascii_bitpos(pipe_t *tokens, int count)
+{
+    long long bit, start, end, pos = HB_ERR;
+    object_t *o;
+    pipe_t value;
+
+    if (count > 5 || !util_strtoll(tokens[2], pipe_len(tokens[2]), &bit) || (bit != 0 && bit != 1) ||
+        ascii_typed(tokens[1], HB_OBJ_STRING, &o) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(bit ? HB_ERR : 0);
+
+    if ((value = ascii_bytes(o)) == NULL) return pipe_fromlonglong(HB_ERR);
+    if (ascii_span(tokens, count, 3, pipe_len(value), &start, &end) == HB_ERR) {
+        ascii_bytes_free(o, value);
+        return pipe_fromlonglong(HB_ERR);
+    }
+    if (start <= end) {
+        pos = bitmap_pos((unsigned char *) value + start, end - start + 1, bit);
+        if (pos != HB_ERR) pos += start * 8;
+        else if (!bit && count < 5) pos = (end + 1) * 8;
+    }
+    ascii_bytes_free(o, value);
+
+    return pipe_fromlonglong(pos);
+}
+
+/* Shorter sources count as zero bytes up to the longest one. The sources
+ * are read before the destination is replaced, it may be one of them. */
+pipe_t ascii_bitop(pipe_t *tokens, int count)
+{
+    pipe_t result, value;
+    object_t *o;
+    size_t len;
+    int op, i;
+
+    if (!strcasecmp(tokens[1], "and")) op = HB_BITMAP_AND;
+    else if (!strcasecmp(tokens[1], "or")) op = HB_BITMAP_OR;
+    else if (!strcasecmp(tokens[1], "xor")) op = HB_BITMAP_XOR;
+    else if (!strcasecmp(tokens[1], "not") && count == 4) op = HB_BITMAP_NOT;
+    else return pipe_fromlonglong(HB_ERR);
+
+    for (i = 3; i < count; i++)
+        if (ascii_typed(tokens[i], HB_OBJ_STRING, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    result = pipe_empty();
+    for (i = 3; i < count; i++) {
+        ascii_typed(tokens[i], HB_OBJ_STRING, &o);
+        if (o != NULL && (value = ascii_bytes(o)) == NULL) {
+            pipe_free(result);
+            return pipe_fromlonglong(HB_ERR);
+        }
+        len = o != NULL ? pipe_len(value) : 0;
+
+        result = pipe_growzero(result, len);
+        if (i == 3) {
+            if (len > 0) memcpy(result, value, len);
+        } else {
+            bitmap_op((unsigned char *) result, (unsigned char *) value, len, op);
+            if (op == HB_BITMAP_AND) memset(result + len, 0, pipe_len(result) - len);
+        }
+        if (o != NULL) ascii_bytes_free(o, value);
+    }
+    if (op == HB_BITMAP_NOT) bitmap_op((unsigned char *) result, NULL, pipe_len(result), op);
+
+    if ((len = pipe_len(result)) == 0) {
+        pipe_free(result);
+        server.engine->del(tokens[2]);
+        return pipe_fromlonglong(0);
+    }
+    if (memory_store(tokens[2], object_new(HB_OBJ_STRING, HB_ENC_RAW, result)) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(len);
+}
+
+/* Raise 'max' to the registers of a key, a missing one has none. HB_ERR
+ * for anything but a HyperLogLog. */
+static int ascii_hll_merge(pipe_t key, unsigned char *max)
+{
+    object_t *o;
+    pipe_t value;
+    int status;
+
+    if (ascii_typed(key, HB_OBJ_STRING, &o) == HB_ERR) return HB_ERR;
+    if (o == NULL) return HB_OK;
+
+    if ((value = ascii_bytes(o)) == NULL) return HB_ERR;
+    if ((status = hll_check(value)) == HB_OK) hll_merge(max, value);
+    ascii_bytes_free(o, value);
+
+    return status;
+}
+
+/* 1 if the estimate may have changed */
+pipe_t ascii_pfadd(pipe_t *tokens, int count)
+{
+    int changed = 0, i;
+    object_t *o;
+    pipe_t value;
+
+    if (ascii_typed(tokens[1], HB_OBJ_STRING, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (o != NULL) {
+        if ((value = ascii_bytes(o)) == NULL) return pipe_fromlonglong(HB_ERR);
+        i = hll_check(value);
+        ascii_bytes_free(o, value);
+        if (i == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    } else {
+        changed = 1;
+    }
+    if ((o = ascii_writable(tokens[1], o)) == NULL) return pipe_fromlonglong(HB_ERR);
+
+    value = o->ptr;
+    if (changed) {
+        pipe_free(value);
+        value = hll_new();
+    }
+    for (i = 2; i < count; i++)
+        changed |= hll_add(&value, tokens[i], pipe_len(tokens[i]));
+    o->ptr = value;
+
+    return pipe_fromlonglong(changed);
+}
+
+/* The estimate of one key is kept in it unless a reply is still sending
+ * it, several keys are merged first */
+pipe_t ascii_pfcount(pipe_t *tokens, int count)
+{
+    unsigned char *max;
+    uint64_t card = 0;
+    object_t *o;
+    pipe_t value;
+    int i;
+
+    if (count == 2) {
+        if (ascii_typed(tokens[1], HB_OBJ_STRING, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+        if (o == NULL) return pipe_fromlonglong(0);
+
+        if ((value = ascii_bytes(o)) == NULL) return pipe_fromlonglong(HB_ERR);
+        if ((i = hll_check(value)) == HB_OK) card = hll_count(value, value == o->ptr && o->refcount == 1);
+        ascii_bytes_free(o, value);
+
+        return pipe_fromlonglong(i == HB_OK ? (long long) card : HB_ERR);
+    }
+
+    max = calloc(HB_HLL_REGISTERS, 1);
+    for (i = 1; i < count; i++)
+        if (ascii_hll_merge(tokens[i], max) == HB_ERR) break;
+    if (i == count) card = hll_estimate(max);
+    free(max);
+
+    return pipe_fromlonglong(i == count ? (long long) card : HB_ERR);
+}
+
+/* The destination is one of the sources and always ends up dense */
+pipe_t ascii_pfmerge(pipe_t *tokens, int count)
+{
+    unsigned char *max = calloc(HB_HLL_REGISTERS, 1);
+    pipe_t value;
+    int i;
+
+    for (i = 1; i < count; i++)
+        if (ascii_hll_merge(tokens[i], max) == HB_ERR) break;
+    if (i < count) {
+        free(max);
+        return pipe_fromlonglong(HB_ERR);
+    }
+
+    value = hll_dense(max);
+    free(max);
+    if (memory_store(tokens[1], object_new(HB_OBJ_STRING, HB_ENC_RAW, value)) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(HB_OK);
+}
+
+/* A filter checked by 'check' or no key at all, HB_ERR for anything else */
+static int ascii_filter(pipe_t key, int (*check)(pipe_t), object_t **o)
+{
+    pipe_t value;
+    int status;
+
+    if (ascii_typed(key, HB_OBJ_STRING, o) == HB_ERR) return HB_ERR;
+    if (*o == NULL) return HB_OK;
+
+    if ((value = ascii_bytes(*o)) == NULL) return HB_ERR;
+    status = check(value);
+    ascii_bytes_free(*o, value);
+
+    return status;
+}
+
+/* Store a new filter, an existing key is left alone */
+static pipe_t ascii_filter_new(pipe_t key, pipe_t value)
+{
+    object_t *o;
+
+    if (value == NULL) return pipe_fromlonglong(HB_ERR);
+    if (ascii_typed(key, HB_OBJ_STRING, &o) == HB_ERR || o != NULL ||
+        memory_store(key, object_new(HB_OBJ_STRING, HB_ENC_RAW, value)) == HB_ERR) {
+        pipe_free(value);
+        return pipe_fromlonglong(HB_ERR);
+    }
+
+    return pipe_fromlonglong(HB_OK);
+}
+
+static pipe_t ascii_filter_results(const int *result, int count)
+{
+    pipe_t s = pipe_empty();
+    int i;
+
+    for (i = 0; i < count; i++)
+        s = pipe_catprintf(s, i > 0 ? "\n%d" : "%d", result[i]);
+
+    return s;
+}
+
+/* A missing key gets a filter sized by HB_BLOOM_CAPACITY on the first
+ * add. The blocks are aligned whenever nobody else reads the string. */
+static pipe_t ascii_bloom(pipe_t *tokens, int count, int add)
+{
+    int *result = calloc(count - 2, sizeof(int));
+    object_t *o;
+    pipe_t value, reply;
+
+    if (ascii_filter(tokens[1], bloom_check, &o) == HB_ERR) {
+        free(result);
+        return pipe_fromlonglong(HB_ERR);
+    }
+
+    if (add) {
+        int created = o == NULL;
+
+        if ((o = ascii_writable(tokens[1], o)) == NULL) {
+            free(result);
+            return pipe_fromlonglong(HB_ERR);
+        }
+        if (created) {
+            pipe_free(o->ptr);
+            o->ptr = bloom_new(HB_BLOOM_CAPACITY, HB_BLOOM_ERROR);
+        }
+        bloom_align(o->ptr);
+        bloom_batch(o->ptr, tokens + 2, count - 2, 1, result);
+    } else if (o != NULL) {
+        if ((value = ascii_bytes(o)) == NULL) {
+            free(result);
+            return pipe_fromlonglong(HB_ERR);
+        }
+        if (value == o->ptr && o->refcount == 1) bloom_align(value);
+        bloom_batch(value, tokens + 2, count - 2, 0, result);
+        ascii_bytes_free(o, value);
+    }
+
+    reply = ascii_filter_results(result, count - 2);
+    free(result);
+
+    return reply;
+}
+
+/* 0 if made, HB_ERR if the key exists */
+pipe_t ascii_bfreserve(pipe_t *tokens, int count)
+{
+    long long capacity;
+    double error;
+
+    if (zset_strtod(tokens[2], pipe_len(tokens[2]), &error) == HB_ERR || !(error > 0 && error < 1) ||
+        !util_strtoll(tokens[3], pipe_len(tokens[3]), &capacity) || capacity < 1)
+        return pipe_fromlonglong(HB_ERR);
+
+    return ascii_filter_new(tokens[1], bloom_new(capacity, error));
+}
+
+/* 1 if the item was surely not there yet */
+pipe_t ascii_bfadd(pipe_t *tokens, int count)
+{
+    return ascii_bloom(tokens, count, 1);
+}
+
+pipe_t ascii_bfmadd(pipe_t *tokens, int count)
+{
+    return ascii_bloom(tokens, count, 1);
+}
+
+pipe_t ascii_bfexists(pipe_t *tokens, int count)
+{
+    return ascii_bloom(tokens, count, 0);
+}
+
+pipe_t ascii_bfmexists(pipe_t *tokens, int count)
+{
+    return ascii_bloom(tokens, count, 0);
+}
+
+pipe_t ascii_cfreserve(pipe_t *tokens, int count)
+{
+    long long capacity;
+
+    if (!util_strtoll(tokens[2], pipe_len(tokens[2]), &capacity) || capacity < 1) return pipe_fromlonglong(HB_ERR);
+
+    return ascii_filter_new(tokens[1], cuckoo_new(capacity));
+}
+
+/* HB_ERR once the filter is full */
+pipe_t ascii_cfadd(pipe_t *tokens, int count)
+{
+    int created;
+    object_t *o;
+
+    if (ascii_filter(tokens[1], cuckoo_check, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    created = o == NULL;
+    if ((o = ascii_writable(tokens[1], o)) == NULL) return pipe_fromlonglong(HB_ERR);
+    if (created) {
+        pipe_free(o->ptr);
+        o->ptr = cuckoo_new(HB_BLOOM_CAPACITY);
+    }
+
+    return pipe_fromlonglong(cuckoo_add(o->ptr, tokens[2], pipe_len(tokens[2])));
+}
+
+pipe_t ascii_cfdel(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_filter(tokens[1], cuckoo_check, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(0);
+    if ((o = ascii_writable(tokens[1], o)) == NULL) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(cuckoo_del(o->ptr, tokens[2], pipe_len(tokens[2])));
+}
+
+pipe_t ascii_cfexists(pipe_t *tokens, int count)
+{
+    int *result = calloc(count - 2, sizeof(int));
+    object_t *o;
+    pipe_t value, reply;
+
+    if (ascii_filter(tokens[1], cuckoo_check, &o) == HB_ERR) {
+        free(result);
+        return pipe_fromlonglong(HB_ERR);
+    }
+    if (o != NULL) {
+        if ((value = ascii_bytes(o)) == NULL) {
+            free(result);
+            return pipe_fromlonglong(HB_ERR);
+        }
+        cuckoo_batch(value, tokens + 2, count - 2, result);
+        ascii_bytes_free(o, value);
+    }
+
+    reply = ascii_filter_results(result, count - 2);
+    free(result);
+
+    return reply;
+}
+
+pipe_t ascii_cfmexists(pipe_t *tokens, int count)
+{
+    return ascii_cfexists(tokens, count);
+}
+
+/* Members are checked before anything is added, a map encoded set keeps
+ * them as C strings */
+pipe_t ascii_sadd(pipe_t *tokens, int count)
+{
+    object_t *o;
+    long long added = 0;
+    int i;
+
+    if (ascii_typed(tokens[1], HB_OBJ_SET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    for (i = 2; i < count; i++)
+        if (memchr(tokens[i], '\0', pipe_len(tokens[i])) != NULL) return pipe_fromlonglong(HB_ERR);
+
+    if (o == NULL && memory_store(tokens[1], o = set_new()) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    for (i = 2; i < count; i++)
+        added += set_add(o, tokens[i], pipe_len(tokens[i]));
+
+    return pipe_fromlonglong(added);
+}
+
+/* A set that becomes empty is removed */
+pipe_t ascii_srem(pipe_t *tokens, int count)
+{
+    object_t *o;
+    long long removed = 0;
+    int i;
+
+    if (ascii_typed(tokens[1], HB_OBJ_SET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(0);
+
+    for (i = 2; i < count; i++)
+        removed += set_rem(o, tokens[i], pipe_len(tokens[i]));
+    if (set_length(o) == 0) server.engine->del(tokens[1]);
+
+    return pipe_fromlonglong(removed);
+}
+
+pipe_t ascii_sismember(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_SET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(o ? set_ismember(o, tokens[2], pipe_len(tokens[2])) : 0);
+}
+
+pipe_t ascii_smembers(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_SET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return o ? set_catall(pipe_empty(), o) : pipe_empty();
+}
+
+pipe_t ascii_scard(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_SET, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(o ? set_length(o) : 0);
+}
+
+/* Missing keys are empty sets, any other type fails the whole command */
+static pipe_t ascii_setop(pipe_t *tokens, int count, int op)
+{
+    object_t **sets = malloc((count - 1) * sizeof(object_t *)), *result;
+    pipe_t reply;
+    int i;
+
+    for (i = 1; i < count; i++)
+        if (ascii_typed(tokens[i], HB_OBJ_SET, &sets[i - 1]) == HB_ERR) {
+            free(sets);
+            return pipe_fromlonglong(HB_ERR);
+        }
+
+    result = set_combine(sets, count - 1, op);
+    reply = set_catall(pipe_empty(), result);
+    object_decr(result);
+    free(sets);
+
+    return reply;
+}
+
+pipe_t ascii_sinter(pipe_t *tokens, int count)
+{
+    return ascii_setop(tokens, count, HB_SET_INTER);
+}
+
+pipe_t ascii_sunion(pipe_t *tokens, int count)
+{
+    return ascii_setop(tokens, count, HB_SET_UNION);
+}
+
+pipe_t ascii_sdiff(pipe_t *tokens, int count)
+{
+    return ascii_setop(tokens, count, HB_SET_DIFF);
+}
+
+/* For commands that log what they did rather than what they were asked,
+ * a replica logs the line from its primary instead */
+static void ascii_log(pipe_t *tokens, int count)
+{
+    if (server.replicaof) return;
+
+    aof_feed(tokens, count);
+    repl_feed(tokens, count);
+    server.dirty++;
+}
+
+/* "-" and "+" are the first and last ids there can be, a missing sequence
+ * is 'seq' */
+static int ascii_stream_id(pipe_t token, uint64_t seq, stream_id_t *id)
+{
+    if (!strcmp(token, "-") || !strcmp(token, "+")) {
+        id->ms = id->seq = token[0] == '-' ? 0 : HB_STREAM_MAX_ID;
+        return HB_OK;
+    }
+
+    return stream_strtoid(token, pipe_len(token), seq, id);
+}
+
+/* The id token of an automatic id is replaced by the one taken, so the
+ * log and the replicas get the same entry */
+pipe_t ascii_xadd(pipe_t *tokens, int count)
+{
+    stream_id_t id = { 0, 0 };
+    int automatic = !strcmp(tokens[2], "*");
+    object_t *o;
+
+    if ((count - 3) % 2 != 0 || ascii_typed(tokens[1], HB_OBJ_STREAM, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (!automatic && stream_strtoid(tokens[2], pipe_len(tokens[2]), 0, &id) == HB_ERR)
+        return pipe_fromlonglong(HB_ERR);
+    if (o == NULL && !automatic && id.ms == 0 && id.seq == 0) return pipe_fromlonglong(HB_ERR);
+
+    if (o == NULL && memory_store(tokens[1], o = stream_new()) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (stream_add(o, &id, automatic, tokens + 3, count - 3) == HB_ERR) {
+        if (stream_length(o) == 0 && stream_groups(o) == 0) server.engine->del(tokens[1]);
+        return pipe_fromlonglong(HB_ERR);
+    }
+
+    pipe_free(tokens[2]);
+    tokens[2] = stream_catid(pipe_empty(), &id);
+    block_signal(tokens[1]);
+
+    return pipe_dup(tokens[2]);
+}
+
+pipe_t ascii_xlen(pipe_t *tokens, int count)
+{
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_STREAM, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    return pipe_fromlonglong(o ? stream_length(o) : 0);
+}
+
+pipe_t ascii_xrange(pipe_t *tokens, int count)
+{
+    stream_id_t start, end;
+    long long max = -1;
+    pipe_t buffer = pipe_empty();
+    object_t *o;
+
+    if ((count != 4 && (count != 6 || strcasecmp(tokens[4], "count"))) ||
+        (count == 6 && (util_strtoll(tokens[5], pipe_len(tokens[5]), &max) == 0 || max < 0)) ||
+        ascii_stream_id(tokens[2], 0, &start) == HB_ERR ||
+        ascii_stream_id(tokens[3], HB_STREAM_MAX_ID, &end) == HB_ERR ||
+        ascii_typed(tokens[1], HB_OBJ_STREAM, &o) == HB_ERR) {
+        pipe_free(buffer);
+        return pipe_fromlonglong(HB_ERR);
+    }
+    if (o != NULL) stream_catrange(&buffer, o, &start, &end, max, NULL);
 
     return buffer;
-}
\ No newline at end of file
+}
+
+/* Options from 'at' on, then the keys and an id each. Streams with entries
+ * past the id, or new to the group for ">", answer at once; if none does
+ * and "block" was given the client is parked on all of them. A history
+ * read of a group never blocks. */
+static pipe_t ascii_stream_read(pipe_t *tokens, int count, int at, pipe_t group, pipe_t consumer)
+{
+    stream_id_t *ids, end = { HB_STREAM_MAX_ID, HB_STREAM_MAX_ID };
+    long long max = -1, block = -1, n;
+    pipe_t reply, *keys;
+    object_t *o;
+    int i, nkeys, history = 0;
+
+    for (; at < count && strcasecmp(tokens[at], "streams"); at += 2) {
+        if (at + 1 >= count) return pipe_fromlonglong(HB_ERR);
+        if (!strcasecmp(tokens[at], "count")) {
+            if (util_strtoll(tokens[at + 1], pipe_len(tokens[at + 1]), &max) == 0 || max < 0)
+                return pipe_fromlonglong(HB_ERR);
+        } else if (!strcasecmp(tokens[at], "block")) {
+            if (util_strtoll(tokens[at + 1], pipe_len(tokens[at + 1]), &block) == 0 || block < 0)
+                return pipe_fromlonglong(HB_ERR);
+        } else {
+            return pipe_fromlonglong(HB_ERR);
+        }
+    }
+    if (at >= count || (count - at - 1) == 0 || (count - at - 1) % 2 != 0) return pipe_fromlonglong(HB_ERR);
+    if (max == 0) max = -1;
+
+    /* Nothing wakes a parked client on a replica, its writes come from the primary */
+    if (block >= 0 && server.replicaof) return pipe_fromlonglong(HB_ERR);
+
+    keys = tokens + at + 1;
+    nkeys = (count - at - 1) / 2;
+    ids = calloc(nkeys, sizeof(stream_id_t));
+
+    /* Everything is checked before a group delivers anything */
+    for (i = 0; i < nkeys; i++) {
+        pipe_t id = keys[nkeys + i];
+
+        if (ascii_typed(keys[i], HB_OBJ_STREAM, &o) == HB_ERR || (group != NULL && (o == NULL ||
+            !stream_group_exists(o, group)))) {
+            free(ids);
+            return pipe_fromlonglong(HB_ERR);
+        }
+
+        if (group != NULL && !strcmp(id, ">")) continue;
+        if (group == NULL && !strcmp(id, "$")) {
+            if (o != NULL) stream_last(o, &ids[i]);
+        } else if (stream_strtoid(id, pipe_len(id), 0, &ids[i]) == HB_ERR) {
+            free(ids);
+            return pipe_fromlonglong(HB_ERR);
+        }
+        if (group != NULL) history = 1;
+    }
+
+    reply = pipe_empty();
+    for (i = 0; i < nkeys; i++) {
+        stream_id_t start = ids[i];
+
+        if ((o = memory_lookup(keys[i])) == NULL) continue;
+
+        if (group != NULL && !strcmp(keys[nkeys + i], ">")) {
+            block_readgroup(&reply, keys[i], group, consumer, max);
+        } else if (group != NULL) {
+            stream_readgroup(&reply, o, group, consumer, &ids[i], max, keys[i]);
+        } else if (stream_next(&start) == HB_OK) {
+            stream_catrange(&reply, o, &start, &end, max, keys[i]);
+        }
+    }
+
+    if (pipe_len(reply) > 0 || history) {
+        free(ids);
+        return reply;
+    }
+    pipe_free(reply);
+
+    n = block < 0 ? HB_ERR : block_park_stream(net_socket(), keys, ids, nkeys, max, group, consumer, block / 1000.0);
+    free(ids);
+
+    return n == HB_ERR ? pipe_fromlonglong(HB_ERR) : NULL;
+}
+
+pipe_t ascii_xread(pipe_t *tokens, int count)
+{
+    return ascii_stream_read(tokens, count, 1, NULL, NULL);
+}
+
+pipe_t ascii_xreadgroup(pipe_t *tokens, int count)
+{
+    if (strcasecmp(tokens[1], "group") || memchr(tokens[3], '\0', pipe_len(tokens[3])) != NULL)
+        return pipe_fromlonglong(HB_ERR);
+
+    return ascii_stream_read(tokens, count, 4, tokens[2], tokens[3]);
+}
+
+/* "create" with "mkstream" makes an empty stream, one left empty without
+ * groups is removed */
+pipe_t ascii_xgroup(pipe_t *tokens, int count)
+{
+    stream_id_t id = { 0, 0 };
+    object_t *o;
+    int destroyed;
+
+    if (ascii_typed(tokens[2], HB_OBJ_STREAM, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    if (!strcasecmp(tokens[1], "create") && (count == 5 || (count == 6 && !strcasecmp(tokens[5], "mkstream")))) {
+        if (strcmp(tokens[4], "$") && stream_strtoid(tokens[4], pipe_len(tokens[4]), 0, &id) == HB_ERR)
+            return pipe_fromlonglong(HB_ERR);
+        if (o == NULL && (count == 5 || memory_store(tokens[2], o = stream_new()) == HB_ERR))
+            return pipe_fromlonglong(HB_ERR);
+        if (!strcmp(tokens[4], "$")) stream_last(o, &id);
+        if (stream_group_create(o, tokens[3], &id) == HB_ERR) {
+            if (stream_length(o) == 0 && stream_groups(o) == 0) server.engine->del(tokens[2]);
+            return pipe_fromlonglong(HB_ERR);
+        }
+
+        return pipe_fromlonglong(HB_OK);
+    }
+
+    if (!strcasecmp(tokens[1], "destroy") && count == 4) {
+        if (o == NULL) return pipe_fromlonglong(0);
+        destroyed = stream_group_destroy(o, tokens[3]);
+        if (stream_length(o) == 0 && stream_groups(o) == 0) server.engine->del(tokens[2]);
+
+        return pipe_fromlonglong(destroyed);
+    }
+
+    return pipe_fromlonglong(HB_ERR);
+}
+
+pipe_t ascii_xack(pipe_t *tokens, int count)
+{
+    stream_id_t id;
+    long long acked = 0;
+    object_t *o;
+    int i;
+
+    if (ascii_typed(tokens[1], HB_OBJ_STREAM, &o) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    if (o == NULL) return pipe_fromlonglong(0);
+    if (!stream_group_exists(o, tokens[2])) return pipe_fromlonglong(HB_ERR);
+
+    for (i = 3; i < count; i++)
+        if (stream_strtoid(tokens[i], pipe_len(tokens[i]), 0, &id) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+    for (i = 3; i < count; i++) {
+        stream_strtoid(tokens[i], pipe_len(tokens[i]), 0, &id);
+        acked += stream_ack(o, tokens[2], &id);
+    }
+
+    return pipe_fromlonglong(acked);
+}
+
+pipe_t ascii_xpending(pipe_t *tokens, int count)
+{
+    object_t *o;
+    pipe_t buffer;
+
+    if (ascii_typed(tokens[1], HB_OBJ_STREAM, &o) == HB_ERR || o == NULL) return pipe_fromlonglong(HB_ERR);
+    if ((buffer = stream_catpending(pipe_empty(), o, tokens[2])) == NULL) return pipe_fromlonglong(HB_ERR);
+
+    return buffer;
+}
+
+/* Whether an entry was idle long enough depends on when this runs, each
+ * claim is logged as one that takes it regardless */
+pipe_t ascii_xclaim(pipe_t *tokens, int count)
+{
+    int force = !strcasecmp(tokens[count - 1], "force"), i, last = force ? count - 1 : count;
+    pipe_t buffer, line[7];
+    long long idle;
+    stream_id_t id;
+    object_t *o;
+
+    if (ascii_typed(tokens[1], HB_OBJ_STREAM, &o) == HB_ERR || o == NULL || !stream_group_exists(o, tokens[2]) ||
+        memchr(tokens[3], '\0', pipe_len(tokens[3])) != NULL ||
+        util_strtoll(tokens[4], pipe_len(tokens[4]), &idle) == 0 || idle < 0 || last <= 5)
+        return pipe_fromlonglong(HB_ERR);
+    for (i = 5; i < last; i++)
+        if (stream_strtoid(tokens[i], pipe_len(tokens[i]), 0, &id) == HB_ERR) return pipe_fromlonglong(HB_ERR);
+
+    line[0] = pipe_new("xclaim");
+    line[4] = pipe_new("0");
+    line[6] = pipe_new("force");
+    memcpy(line + 1, tokens + 1, 3 * sizeof(pipe_t));
+
+    buffer = pipe_empty();
+    for (i = 5; i < last; i++) {
+        stream_strtoid(tokens[i], pipe_len(tokens[i]), 0, &id);
+        if (stream_claim(o, tokens[2], tokens[3], idle, &id, force) != 1) continue;
+
+        stream_catrange(&buffer, o, &id, &id, 1, NULL);
+        line[5] = tokens[i];
+        ascii_log(line, 7);
+    }
+    pipe_free(line[0]);
+    pipe_free(line[4]);
+    pipe_free(line[6]);
+
+    return buffer;
+}
@@ -28,16 +28,92 @@
 #ifndef _HB_ASCII_H_
 #define _HB_ASCII_H_
 
+#define HB_ASCII_WRITE      (1<<0)          /* Modifies the database */
+#define HB_ASCII_BLOCK      (1<<1)          /* Writes once woken, logs its own writes */
+#define HB_ASCII_LOGS       (1<<2)          /* Logs its own writes, as what they turned out to be */
+
+/* Arity counts the command name too, negative means "at least". */
 struct ascii_t {
 	const char *name;
-	pipe_t (*func)(pipe_t *);
+	pipe_t (*func)(pipe_t *, int);
+	int arity;
+	int flags;
 };
 
-pipe_t ascii_inf(pipe_t *);
-pipe_t ascii_set(pipe_t *);
-pipe_t ascii_get(pipe_t *);
-pipe_t ascii_del(pipe_t *);
-pipe_t ascii_len(pipe_t *);
-pipe_t ascii_clr(pipe_t *);
+struct ascii_t *ascii_lookup(pipe_t *, int);
+
+
+pipe_t ascii_inf(pipe_t *, int);
+pipe_t ascii_set(pipe_t *, int);
+pipe_t ascii_get(pipe_t *, int);
+pipe_t ascii_del(pipe_t *, int);
+pipe_t ascii_type(pipe_t *, int);
+pipe_t ascii_object(pipe_t *, int);
+pipe_t ascii_len(pipe_t *, int);
+pipe_t ascii_clr(pipe_t *, int);
+pipe_t ascii_compact(pipe_t *, int);
+pipe_t ascii_save(pipe_t *, int);
+pipe_t ascii_bgsave(pipe_t *, int);
+pipe_t ascii_bgrewriteaof(pipe_t *, int);
+pipe_t ascii_slowlog(pipe_t *, int);
+pipe_t ascii_hot(pipe_t *, int);
+pipe_t ascii_big(pipe_t *, int);
+pipe_t ascii_lpush(pipe_t *, int);
+pipe_t ascii_rpush(pipe_t *, int);
+pipe_t ascii_lpop(pipe_t *, int);
+pipe_t ascii_rpop(pipe_t *, int);
+pipe_t ascii_llen(pipe_t *, int);
+pipe_t ascii_lindex(pipe_t *, int);
+pipe_t ascii_lrange(pipe_t *, int);
+pipe_t ascii_blpop(pipe_t *, int);
+pipe_t ascii_brpop(pipe_t *, int);
+pipe_t ascii_hset(pipe_t *, int);
+pipe_t ascii_hget(pipe_t *, int);
+pipe_t ascii_hdel(pipe_t *, int);
+pipe_t ascii_hgetall(pipe_t *, int);
+pipe_t ascii_hlen(pipe_t *, int);
+pipe_t ascii_hincrby(pipe_t *, int);
+pipe_t ascii_zadd(pipe_t *, int);
+pipe_t ascii_zscore(pipe_t *, int);
+pipe_t ascii_zrank(pipe_t *, int);
+pipe_t ascii_zrange(pipe_t *, int);
+pipe_t ascii_zrangebyscore(pipe_t *, int);
+pipe_t ascii_zrem(pipe_t *, int);
+pipe_t ascii_zcard(pipe_t *, int);
+pipe_t ascii_setbit(pipe_t *, int);
+pipe_t ascii_getbit(pipe_t *, int);
+pipe_t ascii_bitcount(pipe_t *, int);
+pipe_t ascii_bitpos(pipe_t *, int);
+pipe_t ascii_bitop(pipe_t *, int);
+pipe_t ascii_pfadd(pipe_t *, int);
+pipe_t ascii_pfcount(pipe_t *, int);
+pipe_t ascii_pfmerge(pipe_t *, int);
+pipe_t ascii_bfreserve(pipe_t *, int);
+pipe_t ascii_bfadd(pipe_t *, int);
+pipe_t ascii_bfmadd(pipe_t *, int);
+pipe_t ascii_bfexists(pipe_t *, int);
+pipe_t ascii_bfmexists(pipe_t *, int);
+pipe_t ascii_cfreserve(pipe_t *, int);
+pipe_t ascii_cfadd(pipe_t *, int);
+pipe_t ascii_cfdel(pipe_t *, int);
+pipe_t ascii_cfexists(pipe_t *, int);
+pipe_t ascii_cfmexists(pipe_t *, int);
+pipe_t ascii_sadd(pipe_t *, int);
+pipe_t ascii_srem(pipe_t *, int);
+pipe_t ascii_sismember(pipe_t *, int);
+pipe_t ascii_smembers(pipe_t *, int);
+pipe_t ascii_scard(pipe_t *, int);
+pipe_t ascii_sinter(pipe_t *, int);
+pipe_t ascii_sunion(pipe_t *, int);
+pipe_t ascii_sdiff(pipe_t *, int);
+pipe_t ascii_xadd(pipe_t *, int);
+pipe_t ascii_xlen(pipe_t *, int);
+pipe_t ascii_xrange(pipe_t *, int);
+pipe_t ascii_xread(pipe_t *, int);
+pipe_t ascii_xgroup(pipe_t *, int);
+pipe_t ascii_xreadgroup(pipe_t *, int);
+pipe_t ascii_xack(pipe_t *, int);
+pipe_t ascii_xpending(pipe_t *, int);
+pipe_t ascii_xclaim(pipe_t *, int);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,203 @@
+/*
+ * BITMAP                          Bit counting and bitwise kernels for bitmaps.
+ *
+ * Version:                                   @(#)bitmap.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <hb_core.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HB_BITMAP_X86
+#include <immintrin.h>
+#endif
+
+extern struct server server;
+
+static uint64_t (*count_kernel)(const unsigned char *, size_t);
+static void     (*op_kernel)(unsigned char *, const unsigned char *, size_t, int);
+static const char *kernel = "scalar";
+
+static uint64_t bitmap_count_scalar(const unsigned char *, size_t);
+static void     bitmap_op_scalar(unsigned char *, const unsigned char *, size_t, int);
+#ifdef HB_BITMAP_X86
+static uint64_t bitmap_count_popcnt(const unsigned char *, size_t);
+static uint64_t bitmap_count_avx2(const unsigned char *, size_t);
+static void     bitmap_op_avx2(unsigned char *, const unsigned char *, size_t, int);
+#endif
+
+/* Eight bytes at a time, the compiler has no popcount instruction here */
+static uint64_t bitmap_count_scalar(const unsigned char *p, size_t len)
+{
+    uint64_t count = 0, w;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, 8);
+        w = w - ((w >> 1) & 0x5555555555555555ULL);
+        w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+        w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        count += (w * 0x0101010101010101ULL) >> 56;
+    }
+    while (len--) count += __builtin_popcount(*p++);
+
+    return count;
+}
+
+static void bitmap_op_scalar(unsigned char *dst, const unsigned char *src, size_t len, int op)
+{
+    uint64_t a, b = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&a, dst + i, 8);
+        if (op != HB_BITMAP_NOT) memcpy(&b, src + i, 8);
+        switch (op) {
+            case HB_BITMAP_AND: a &= b; break;
+            case HB_BITMAP_OR:  a |= b; break;
+            case HB_BITMAP_XOR: a ^= b; break;
+            case HB_BITMAP_NOT: a = ~a; break;
+        }
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; i++) {
+        switch (op) {
+            case HB_BITMAP_AND: dst[i] &= src[i]; break;
+            case HB_BITMAP_OR:  dst[i] |= src[i]; break;
+            case HB_BITMAP_XOR: dst[i] ^= src[i]; break;
+            case HB_BITMAP_NOT: dst[i] = ~dst[i]; break;
+        }
+    }
+}
+
+#ifdef HB_BITMAP_X86
+/* Four independent words a round keep the popcnt units busy */
+__attribute__((target("popcnt")))
+static uint64_t bitmap_count_popcnt(const unsigned char *p, size_t len)
+{
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0, w[4];
+
+    for (; len >= 32; p += 32, len -= 32) {
+        memcpy(w, p, 32);
+        c0 += __builtin_popcountll(w[0]);
+        c1 += __builtin_popcountll(w[1]);
+        c2 += __builtin_popcountll(w[2]);
+        c3 += __builtin_popcountll(w[3]);
+    }
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(w, p, 8);
+        c0 += __builtin_popcountll(w[0]);
+    }
+    while (len--) c0 += __builtin_popcount(*p++);
+
+    return c0 + c1 + c2 + c3;
+}
+
+/* Nibbles are looked up in a register with a shuffle, the byte counts
+ * summed into 64-bit lanes before they can overflow: a byte takes at
+ * most 8 a round, 31 rounds stay under 256. */
+__attribute__((target("avx2,popcnt")))
+static uint64_t bitmap_count_avx2(const unsigned char *p, size_t len)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256(), local, v;
+    uint64_t lanes[4];
+    int i;
+
+    while (len >= 32) {
+        local = _mm256_setzero_si256();
+        for (i = 0; i < 31 && len >= 32; i++, p += 32, len -= 32) {
+            v = _mm256_loadu_si256((const __m256i *) p);
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)));
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+    _mm256_storeu_si256((__m256i *) lanes, total);
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + bitmap_count_popcnt(p, len);
+}
+
+__attribute__((target("avx2")))
+static void bitmap_op_avx2(unsigned char *dst, const unsigned char *src, size_t len, int op)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    __m256i a, b;
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *) (dst + i));
+        b = op == HB_BITMAP_NOT ? ones : _mm256_loadu_si256((const __m256i *) (src + i));
+        switch (op) {
+            case HB_BITMAP_AND: a = _mm256_and_si256(a, b); break;
+            case HB_BITMAP_OR:  a = _mm256_or_si256(a, b); break;
+            case HB_BITMAP_XOR:
+            case HB_BITMAP_NOT: a = _mm256_xor_si256(a, b); break;
+        }
+        _mm256_storeu_si256((__m256i *) (dst + i), a);
+    }
+
+    bitmap_op_scalar(dst + i, op == HB_BITMAP_NOT ? NULL : src + i, len - i, op);
+}
+#endif
+
+int bitmap_init(void)
+{
+    count_kernel = bitmap_count_scalar;
+    op_kernel = bitmap_op_scalar;
+
+#ifdef HB_BITMAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        count_kernel = bitmap_count_avx2;
+        op_kernel = bitmap_op_avx2;
+        kernel = "avx2";
+    } else if (__builtin_cpu_supports("popcnt")) {
+        count_kernel = bitmap_count_popcnt;
+        kernel = "popcnt";
+    }
+#endif
+
+    fprintf(stdout, "hb: %s bitmap kernels: %s\n", HB_LOG_INF, kernel);
+
+    return HB_OK;
+}
+
+uint64_t bitmap_count(const unsigned char *p, size_t len)
+{
+    return count_kernel(p, len);
+}
+
+void bitmap_op(unsigned char *dst, const unsigned char *src, size_t len, int op)
+{
+    op_kernel(dst, src, len, op);
+}
+
+/* Skips a word at a time of bytes that hold no such bit */
+long long bitmap_pos(const unsigned char *p, size_t len, int bit)
+{
+    uint64_t skip = bit ? 0 : ~0ULL, w;
+    unsigned char c;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w, p + i, 8);
+        if (w != skip) break;
+    }
+    for (; i < len; i++) {
+        c = bit ? p[i] : (unsigned char) ~p[i];
+        if (c != 0) return (long long) i * 8 + __builtin_clz(c) - 24;
+    }
+
+    return HB_ERR;
+}
+
+const char *bitmap_kernel(void)
+{
+    return kernel;
+}
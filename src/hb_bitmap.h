@@ -0,0 +1,55 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+
+#ifndef _HB_BITMAP_H_
+#define _HB_BITMAP_H_
+
+/* Bitmaps are raw strings, bit 0 is the highest bit of the first byte.
+ * Counting and the bitwise operations go through kernels picked for the
+ * CPU once at startup: AVX2 on 32-byte lanes, POPCNT on 8-byte words or
+ * plain C. */
+#define HB_BITMAP_AND       0
+#define HB_BITMAP_OR        1
+#define HB_BITMAP_XOR       2
+#define HB_BITMAP_NOT       3
+
+int       bitmap_init(void);
+
+/* Bits set in 'len' bytes. */
+uint64_t  bitmap_count(const unsigned char *, size_t);
+
+/* Position of the first bit that is 'bit', HB_ERR if there is none. */
+long long bitmap_pos(const unsigned char *, size_t, int);
+
+/* dst = dst op src over 'len' bytes, NOT inverts dst and ignores src. */
+void      bitmap_op(unsigned char *, const unsigned char *, size_t, int);
+
+/* Name of the kernels in use. */
+const char *bitmap_kernel(void);
+
+#endif
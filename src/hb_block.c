@@ -0,0 +1,515 @@
+/*
+ * BLOCK                 Clients parked until a list or a stream gets an element.
+ *
+ * Version:                                    @(#)block.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+typedef struct _block_client block_client_t;
+typedef struct _block_queue block_queue_t;
+
+/* One per key a client waits on, linked into the queue of that key */
+typedef struct _block_wait {
+    block_client_t *client;
+    block_queue_t *queue;
+    stream_id_t id;                         /* Of a stream, entries past it are waited for */
+    struct _block_wait *prev;
+    struct _block_wait *next;
+} block_wait_t;
+
+struct _block_queue {
+    pipe_t key;                             /* The key in 'waiting', owned here */
+    block_wait_t *head;
+    block_wait_t *tail;
+};
+
+struct _block_client {
+    int sock;
+    int where;                              /* HB_LIST_HEAD, HB_LIST_TAIL or HB_BLOCK_STREAM */
+    long long count;                        /* Of stream entries, -1 for all */
+    pipe_t group;                           /* Reading for a consumer group, or NULL */
+    pipe_t consumer;
+    int pending;                            /* Sent more while parked, not polled */
+    uint64_t deadline;                      /* stat_clock(), 0 without a timeout */
+    int slot;                               /* Index in 'parked' */
+    int timer;                              /* Index in 'timers', -1 if none */
+    int nkeys;
+    block_wait_t waits[];
+};
+
+/* All of this is protected by the database lock */
+static map_t *waiting;                      /* Key to its queue of waiters */
+static block_client_t **parked;
+static block_client_t **timers;             /* Min-heap on the deadline */
+static int nparked;
+static int ntimers;
+static int size;
+static pipe_t ready;                        /* Signalled keys, copies */
+static uint64_t served;
+static uint64_t timeouts;
+
+static int wake[2] = { HB_ERR, HB_ERR };
+
+static void  block_wake(void);
+static block_client_t *block_new(int, pipe_t *, const stream_id_t *, int, int, double);
+static int   block_ready(block_wait_t *, object_t *);
+static pipe_t block_stream(block_client_t *);
+static void  block_timer_swap(int, int);
+static void  block_timer_up(int);
+static void  block_timer_down(int);
+static void  block_timer_del(block_client_t *);
+static void  block_unpark(block_client_t *);
+static void  block_resume(block_client_t *, pipe_t);
+static void  block_drop(block_client_t *);
+static void  block_free(block_client_t *);
+static void  block_check(int);
+static void  block_expire(void);
+static void *block_loop(void *);
+
+/* Make the thread look at the parked clients again */
+static void block_wake(void)
+{
+    char c = 0;
+
+    server.status = write(wake[1], &c, 1);
+}
+
+static void block_timer_swap(int i, int j)
+{
+    block_client_t *c = timers[i];
+
+    timers[i] = timers[j];
+    timers[j] = c;
+    timers[i]->timer = i;
+    timers[j]->timer = j;
+}
+
+static void block_timer_up(int i)
+{
+    while (i > 0 && timers[(i - 1) / 2]->deadline > timers[i]->deadline) {
+        block_timer_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void block_timer_down(int i)
+{
+    int l, m;
+
+    for (;;) {
+        l = 2 * i + 1;
+        m = i;
+        if (l < ntimers && timers[l]->deadline < timers[m]->deadline) m = l;
+        if (l + 1 < ntimers && timers[l + 1]->deadline < timers[m]->deadline) m = l + 1;
+        if (m == i) return;
+        block_timer_swap(i, m);
+        i = m;
+    }
+}
+
+static void block_timer_del(block_client_t *c)
+{
+    int i = c->timer;
+
+    if (i < 0) return;
+
+    block_timer_swap(i, --ntimers);
+    c->timer = -1;
+    if (i < ntimers) {
+        block_timer_up(i);
+        block_timer_down(i);
+    }
+}
+
+/* Take a client out of its queues, the timers and the parked set */
+static void block_unpark(block_client_t *c)
+{
+    int i;
+
+    for (i = 0; i < c->nkeys; i++) {
+        block_wait_t *w = &c->waits[i];
+        block_queue_t *q = w->queue;
+
+        if (w->prev) w->prev->next = w->next;
+        else q->head = w->next;
+        if (w->next) w->next->prev = w->prev;
+        else q->tail = w->prev;
+
+        if (q->head == NULL) {
+            map_remove(waiting, q->key);
+            pipe_free(q->key);
+            free(q);
+        }
+    }
+
+    block_timer_del(c);
+
+    parked[c->slot] = parked[--nparked];
+    parked[c->slot]->slot = c->slot;
+}
+
+/* Give the socket of a client that was unparked a thread again. That
+ * thread sends the reply, not this one, which holds the database lock. */
+static void block_resume(block_client_t *c, pipe_t reply)
+{
+    reply = pipe_catlen(reply, "\r\n", 2);
+
+    if (net_resume(c->sock, reply) == HB_ERR) {
+        pipe_free(reply);
+        block_drop(c);
+    } else {
+        block_free(c);
+    }
+}
+
+static void block_drop(block_client_t *c)
+{
+    fprintf(stdout, "hb: %s client disconnected [fd: %d]\n", HB_LOG_OK, c->sock);
+    close(c->sock);
+    __sync_fetch_and_sub(&server.clients, 1);
+    block_free(c);
+}
+
+static void block_free(block_client_t *c)
+{
+    pipe_free(c->group);
+    pipe_free(c->consumer);
+    free(c);
+}
+
+/* The socket of a parked client is readable: it went away, or it sent
+ * the next command early, which waits in the socket until it is served. */
+static void block_check(int sock)
+{
+    char c;
+    ssize_t n;
+    int i;
+
+    for (i = 0; i < nparked && parked[i]->sock != sock; i++);
+    if (i == nparked) return;
+
+    n = recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0) {
+        parked[i]->pending = 1;
+    } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        block_client_t *client = parked[i];
+
+        block_unpark(client);
+        block_drop(client);
+    }
+}
+
+static void block_expire(void)
+{
+    uint64_t now = stat_clock();
+
+    while (ntimers > 0 && timers[0]->deadline <= now) {
+        block_client_t *c = timers[0];
+
+        block_unpark(c);
+        block_resume(c, pipe_fromlonglong(HB_ERR));
+        timeouts++;
+    }
+}
+
+/* Polls the wake pipe and the parked sockets until the next deadline */
+static void *block_loop(void *arg)
+{
+    struct pollfd *fds = NULL;
+    int i, n, timeout;
+    uint64_t now;
+    char buf[64];
+
+    for (;;) {
+        pthread_mutex_lock(&server.mutex);
+        fds = realloc(fds, (nparked + 1) * sizeof(struct pollfd));
+        fds[0].fd = wake[0];
+        fds[0].events = POLLIN;
+        for (i = 0, n = 1; i < nparked; i++) {
+            if (parked[i]->pending) continue;
+            fds[n].fd = parked[i]->sock;
+            fds[n++].events = POLLIN;
+        }
+        now = stat_clock();
+        if (ntimers == 0) timeout = -1;
+        else if (timers[0]->deadline <= now) timeout = 0;
+        else timeout = MIN((timers[0]->deadline - now + 999999) / 1000000, INT_MAX);
+        pthread_mutex_unlock(&server.mutex);
+
+        if (poll(fds, n, timeout) < 0 && errno != EINTR) {
+            fprintf(stdout, "hb: %s could not poll blocked clients: %s\n", HB_LOG_ERR, strerror(errno));
+            sleep(1);
+            continue;
+        }
+
+        pthread_mutex_lock(&server.mutex);
+        if (fds[0].revents & POLLIN)
+            while (read(wake[0], buf, sizeof(buf)) == sizeof(buf));
+        for (i = 1; i < n; i++)
+            if (fds[i].revents) block_check(fds[i].fd);
+        block_expire();
+        pthread_mutex_unlock(&server.mutex);
+    }
+
+    return NULL;
+}
+
+int block_init(void)
+{
+    pthread_t thread_id;
+
+    if (pipe(wake) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not create wake pipe: %s\n", HB_LOG_ERR, strerror(errno));
+        return HB_ERR;
+    }
+    fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake[1], F_SETFL, O_NONBLOCK);
+
+    waiting = map_new();
+    ready = pipe_empty();
+
+    if (pthread_create(&thread_id, NULL, block_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create blocking thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    return HB_OK;
+}
+
+pipe_t block_pop(pipe_t key, int where)
+{
+    object_t *o = memory_lookup(key);
+    pipe_t value = list_pop(o->ptr, where), reply = pipe_empty();
+    pipe_t tokens[2];
+
+    if (list_length(o->ptr) == 0) server.engine->del(key);
+
+    /* Logged as the pop it was, a replay must not block */
+    tokens[0] = pipe_new(where == HB_LIST_HEAD ? "lpop" : "rpop");
+    tokens[1] = key;
+    aof_feed(tokens, 2);
+    repl_feed(tokens, 2);
+    server.dirty++;
+    pipe_free(tokens[0]);
+
+    reply = pipe_catrepr(reply, key, pipe_len(key));
+    reply = pipe_catlen(reply, "\n", 1);
+    reply = pipe_catrepr(reply, value, pipe_len(value));
+    pipe_free(value);
+
+    return reply;
+}
+
+/* Queue a client on the given keys, with the ids it waits past on streams */
+static block_client_t *block_new(int sock, pipe_t *keys, const stream_id_t *ids, int count, int where,
+                                 double timeout)
+{
+    block_client_t *c;
+    any_t q;
+    int i;
+
+    if (sock < 0 || wake[1] == HB_ERR) return NULL;
+
+    c = calloc(1, sizeof(block_client_t) + count * sizeof(block_wait_t));
+    c->sock = sock;
+    c->where = where;
+    c->count = -1;
+    c->deadline = timeout > 0 ? stat_clock() + (uint64_t) (timeout * 1e9) : 0;
+    c->timer = -1;
+
+    /* Waiting twice on one key would serve the client twice */
+    for (i = 0; i < count; i++) {
+        block_wait_t *w = &c->waits[c->nkeys];
+        int j;
+
+        for (j = 0; j < i && strcmp(keys[j], keys[i]); j++);
+        if (j < i) continue;
+        c->nkeys++;
+
+        if (map_get(waiting, keys[i], &q) == HB_ERR) {
+            q = calloc(1, sizeof(block_queue_t));
+            ((block_queue_t *) q)->key = pipe_dup(keys[i]);
+            map_put(waiting, ((block_queue_t *) q)->key, q);
+        }
+        w->client = c;
+        w->queue = q;
+        if (ids != NULL) w->id = ids[i];
+        w->prev = w->queue->tail;
+        if (w->prev) w->prev->next = w;
+        else w->queue->head = w;
+        w->queue->tail = w;
+    }
+
+    if (nparked == size) {
+        size = size ? size * 2 : 64;
+        parked = realloc(parked, size * sizeof(block_client_t *));
+        timers = realloc(timers, size * sizeof(block_client_t *));
+    }
+    c->slot = nparked;
+    parked[nparked++] = c;
+
+    if (c->deadline) {
+        c->timer = ntimers;
+        timers[ntimers++] = c;
+        block_timer_up(c->timer);
+    }
+
+    block_wake();
+
+    return c;
+}
+
+int block_park(int sock, pipe_t *keys, int count, int where, double timeout)
+{
+    return block_new(sock, keys, NULL, count, where, timeout) != NULL ? HB_OK : HB_ERR;
+}
+
+int block_park_stream(int sock, pipe_t *keys, const stream_id_t *ids, int count, long long max, pipe_t group,
+                      pipe_t consumer, double timeout)
+{
+    block_client_t *c = block_new(sock, keys, ids, count, HB_BLOCK_STREAM, timeout);
+
+    if (c == NULL) return HB_ERR;
+
+    c->count = max;
+    if (group != NULL) {
+        c->group = pipe_dup(group);
+        c->consumer = pipe_dup(consumer);
+    }
+
+    return HB_OK;
+}
+
+long long block_readgroup(pipe_t *reply, pipe_t key, pipe_t group, pipe_t consumer, long long count)
+{
+    pipe_t tokens[9];
+    long long n = stream_readgroup(reply, memory_lookup(key), group, consumer, NULL, count, key);
+
+    /* Logged as a read of what was delivered, a replay must not block. A
+     * replica logs the line it got from its primary. */
+    if (n <= 0 || server.replicaof) return n;
+
+    tokens[0] = pipe_new("xreadgroup");
+    tokens[1] = pipe_new("group");
+    tokens[2] = group;
+    tokens[3] = consumer;
+    tokens[4] = pipe_new("count");
+    tokens[5] = pipe_fromlonglong(n);
+    tokens[6] = pipe_new("streams");
+    tokens[7] = key;
+    tokens[8] = pipe_new(">");
+    aof_feed(tokens, 9);
+    repl_feed(tokens, 9);
+    server.dirty++;
+    pipe_free(tokens[0]);
+    pipe_free(tokens[1]);
+    pipe_free(tokens[4]);
+    pipe_free(tokens[5]);
+    pipe_free(tokens[6]);
+    pipe_free(tokens[8]);
+
+    return n;
+}
+
+/* A list waiter takes any list, a stream waiter entries past its id or,
+ * in a group, past the last delivered */
+static int block_ready(block_wait_t *w, object_t *o)
+{
+    block_client_t *c = w->client;
+
+    if (c->where != HB_BLOCK_STREAM) return o->type == HB_OBJ_LIST;
+
+    return o->type == HB_OBJ_STREAM && stream_ready(o, &w->id, c->group);
+}
+
+/* The entries of every stream the client waits on that has some for it */
+static pipe_t block_stream(block_client_t *c)
+{
+    stream_id_t start, end = { HB_STREAM_MAX_ID, HB_STREAM_MAX_ID };
+    pipe_t reply = pipe_empty(), key;
+    object_t *o;
+    int i;
+
+    for (i = 0; i < c->nkeys; i++) {
+        key = c->waits[i].queue->key;
+        if ((o = memory_lookup(key)) == NULL || !block_ready(&c->waits[i], o)) continue;
+
+        if (c->group != NULL) {
+            block_readgroup(&reply, key, c->group, c->consumer, c->count);
+        } else {
+            start = c->waits[i].id;
+            stream_next(&start);
+            stream_catrange(&reply, o, &start, &end, c->count, key);
+        }
+    }
+
+    return reply;
+}
+
+void block_signal(pipe_t key)
+{
+    any_t q;
+
+    if (waiting == NULL || map_get(waiting, key, &q) == HB_ERR) return;
+
+    key = pipe_dup(key);
+    ready = pipe_catlen(ready, &key, sizeof(key));
+}
+
+void block_serve(void)
+{
+    pipe_t *keys, key;
+    object_t *o;
+    any_t q;
+    int i, n;
+
+    while ((n = pipe_len(ready) / sizeof(pipe_t)) > 0) {
+        /* Serving may signal again, take the list as it is now */
+        keys = (pipe_t *) ready;
+        ready = pipe_empty();
+
+        for (i = 0; i < n; i++) {
+            key = keys[i];
+
+            /* First come, first served, while there are elements. A stream
+             * waiter may not want the ones there are, the next one might. */
+            while (map_get(waiting, key, &q) == HB_OK && (o = memory_lookup(key)) != NULL) {
+                block_wait_t *w;
+                block_client_t *c;
+                pipe_t reply;
+
+                for (w = ((block_queue_t *) q)->head; w != NULL && !block_ready(w, o); w = w->next);
+                if (w == NULL) break;
+
+                c = w->client;
+                reply = c->where == HB_BLOCK_STREAM ? block_stream(c) : block_pop(key, c->where);
+                block_unpark(c);
+                block_resume(c, reply);
+                served++;
+            }
+            pipe_free(key);
+        }
+        pipe_free((pipe_t) keys);
+    }
+}
+
+pipe_t block_catinfo(pipe_t s)
+{
+    s = pipe_catprintf(s, "blocked_clients:%d\n", nparked);
+    s = pipe_catprintf(s, "blocked_served:%" PRIu64 "\n", served);
+    s = pipe_catprintf(s, "blocked_timeouts:%" PRIu64 "\n", timeouts);
+
+    return s;
+}
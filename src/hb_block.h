@@ -0,0 +1,71 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_BLOCK_H_
+#define _HB_BLOCK_H_
+
+/* A client that waits for an element of an empty list, or for entries of
+ * a stream past an id, is parked: its connection thread ends and the
+ * socket is kept in a FIFO queue per key it waits on, and in a timer heap
+ * if it has a timeout. One thread polls the parked sockets for disconnects
+ * and expires the timers. A push or an append marks its key ready, and
+ * once the command is logged the first waiters that want what is there
+ * get it and their sockets are handed to new connection threads. */
+#define HB_BLOCK_STREAM     2               /* Waits on streams, not at a list end */
+
+/* Start the thread watching parked clients. */
+int     block_init(void);
+
+/* Pop from a list for a client and return the reply, the key and the
+ * element quoted on two lines. The pop is logged and replicated as lpop or
+ * rpop. Must be called with the database lock held. */
+pipe_t  block_pop(pipe_t, int);
+
+/* Park the client on 'sock' on the given keys, with a timeout in seconds
+ * or 0 to wait forever. Return HB_OK or HB_ERR. */
+int     block_park(int, pipe_t *, int, int, double);
+
+/* Park the client on streams, each past its id or, with a group, past
+ * what the group delivered. Up to 'max' entries a stream, -1 for all. */
+int     block_park_stream(int, pipe_t *, const stream_id_t *, int, long long, pipe_t, pipe_t, double);
+
+/* Deliver up to 'count' new entries of a stream to a consumer of a group,
+ * appended to the reply as stream_readgroup() does. The delivery is logged
+ * and replicated as a read of that many. Must be called with the database
+ * lock held. Returns how many, HB_ERR if there is no such group. */
+long long block_readgroup(pipe_t *, pipe_t, pipe_t, pipe_t, long long);
+
+/* A key got elements, its waiters are served by block_serve(). */
+void    block_signal(pipe_t);
+
+/* Serve the waiters of the keys signalled so far. Called after a write
+ * command was logged, with the database lock held. */
+void    block_serve(void);
+
+pipe_t  block_catinfo(pipe_t);
+
+#endif
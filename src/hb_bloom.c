@@ -0,0 +1,343 @@
+/*
+ * BLOOM                       Blocked Bloom and cuckoo filters kept in strings.
+ *
+ * Version:                                    @(#)bloom.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <hb_core.h>
+
+#if defined(__GNUC__)
+#define bloom_prefetch(p, rw)   __builtin_prefetch((p), (rw), 3)
+#else
+#define bloom_prefetch(p, rw)
+#endif
+
+extern struct server server;
+
+static uint64_t  bloom_hash(const char *, size_t);
+static uint64_t  bloom_mix(uint64_t);
+static unsigned char *bloom_block(pipe_t, uint64_t);
+static int       bloom_probe(unsigned char *, uint64_t, int, int);
+static double    bloom_rate(uint64_t, uint64_t, int);
+static uint16_t *cuckoo_bucket(pipe_t, uint64_t);
+static uint64_t  cuckoo_alt(pipe_t, uint64_t, uint16_t);
+static uint16_t  cuckoo_hash(pipe_t, const char *, size_t, uint64_t *, uint64_t *);
+static int       cuckoo_put(uint16_t *, uint16_t);
+static int       cuckoo_take(uint16_t *, uint16_t);
+static int       cuckoo_find(pipe_t, uint16_t, uint64_t, uint64_t);
+
+/* map_hashkey() has 32 bits in it, picking a block and the bits within it
+ * takes more. */
+static uint64_t bloom_hash(const char *p, size_t len)
+{
+    return util_hash64(p, len, 0x8445d61a4e774912ULL);
+}
+
+/* The splitmix64 finalizer */
+static uint64_t bloom_mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+    return x ^ (x >> 31);
+}
+
+/* The high half of the hash picks the block */
+static unsigned char *bloom_block(pipe_t s, uint64_t hash)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+
+    return (unsigned char *) (h + 1) + h->offset + ((hash >> 32) * h->size >> 32) * HB_BLOOM_BLOCK;
+}
+
+/* Seven bit numbers of 9 bits come out of each mix of the hash, the
+ * low half alone repeats too many patterns among the items of a block.
+ * Returns 1 if one of the bits was clear. */
+static int bloom_probe(unsigned char *block, uint64_t hash, int k, int add)
+{
+    unsigned int bit;
+    uint64_t x = 0;
+    int i, clear = 0;
+
+    for (i = 0; i < k; i++, x >>= 9) {
+        if (i % 7 == 0) x = bloom_mix(hash + (i / 7 + 1) * 0x9e3779b97f4a7c15ULL);
+
+        bit = x & (HB_BLOOM_BITS - 1);
+        if (block[bit >> 3] & 1 << (bit & 7)) continue;
+
+        clear = 1;
+        if (!add) break;
+        block[bit >> 3] |= 1 << (bit & 7);
+    }
+
+    return clear;
+}
+
+/* The false positive rate of 'size' blocks holding 'capacity' items: the
+ * items per block are Poisson distributed, a crowded block answers yes
+ * more often than a plain filter of the same bits would. */
+static double bloom_rate(uint64_t size, uint64_t capacity, int k)
+{
+    double lambda = (double) capacity / size, rate = 0, p;
+    int j;
+
+    for (j = 0; j <= lambda + 10 * sqrt(lambda) + 20; j++) {
+        p = exp(j * log(lambda) - lambda - lgamma(j + 1));
+        rate += p * pow(1 - pow(1 - 1.0 / HB_BLOOM_BITS, (double) k * j), k);
+    }
+
+    return rate;
+}
+
+/* Sized as a plain filter first, then grown until the blocks are as good */
+pipe_t bloom_new(uint64_t capacity, double error)
+{
+    int k = MIN(MAX((int) ceil(-log(error) / log(2)), 1), 16);
+    double bits = ceil(-(double) capacity * log(error) / (log(2) * log(2)));
+    uint64_t size;
+    bloom_header_t *h;
+    pipe_t s;
+
+    if (bits / 8 > HB_BITMAP_MAX) return NULL;
+    size = MAX((uint64_t) ceil(bits / HB_BLOOM_BITS), 1);
+    while (bloom_rate(size, capacity, k) > error) {
+        size += size / 32 + 1;
+        if (size * HB_BLOOM_BLOCK > HB_BITMAP_MAX) return NULL;
+    }
+
+    s = pipe_growzero(pipe_empty(), sizeof(bloom_header_t) + HB_BLOOM_BLOCK + size * HB_BLOOM_BLOCK);
+    h = (bloom_header_t *) s;
+    memcpy(h->magic, "BLOM", 4);
+    h->k = k;
+    h->size = size;
+    h->capacity = capacity;
+    bloom_align(s);
+
+    return s;
+}
+
+int bloom_check(pipe_t s)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+    size_t len = pipe_len(s);
+
+    if (len < sizeof(bloom_header_t) + HB_BLOOM_BLOCK || memcmp(h->magic, "BLOM", 4) != 0) return HB_ERR;
+    if (h->k < 1 || h->k > 16 || h->offset >= HB_BLOOM_BLOCK || h->size < 1) return HB_ERR;
+
+    return (len - sizeof(bloom_header_t) - HB_BLOOM_BLOCK) / HB_BLOOM_BLOCK == h->size &&
+           (len - sizeof(bloom_header_t)) % HB_BLOOM_BLOCK == 0 ? HB_OK : HB_ERR;
+}
+
+void bloom_align(pipe_t s)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+    unsigned char *p = (unsigned char *) (h + 1);
+    unsigned int offset = -(uintptr_t) p & (HB_BLOOM_BLOCK - 1);
+
+    if (offset == h->offset) return;
+
+    memmove(p + offset, p + h->offset, h->size * HB_BLOOM_BLOCK);
+    if (offset > h->offset) memset(p + h->offset, 0, offset - h->offset);
+    else memset(p + offset + h->size * HB_BLOOM_BLOCK, 0, h->offset - offset);
+    h->offset = offset;
+}
+
+/* Items are hashed and their blocks prefetched HB_BLOOM_AHEAD ahead of
+ * the one probed, the misses of a batch overlap instead of queueing. */
+void bloom_batch(pipe_t s, pipe_t *items, int count, int add, int *result)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+    unsigned char *block[HB_BLOOM_AHEAD];
+    uint64_t hash[HB_BLOOM_AHEAD];
+    int i, j;
+
+    for (i = 0; i < count + HB_BLOOM_AHEAD; i++) {
+        j = i % HB_BLOOM_AHEAD;
+
+        if (i >= HB_BLOOM_AHEAD) {
+            int clear = bloom_probe(block[j], hash[j], h->k, add);
+
+            result[i - HB_BLOOM_AHEAD] = add ? clear : !clear;
+            if (add && clear) h->items++;
+        }
+        if (i < count) {
+            hash[j] = bloom_hash(items[i], pipe_len(items[i]));
+            block[j] = bloom_block(s, hash[j]);
+            if (add) bloom_prefetch(block[j], 1);
+            else bloom_prefetch(block[j], 0);
+        }
+    }
+}
+
+static uint16_t *cuckoo_bucket(pipe_t s, uint64_t i)
+{
+    return (uint16_t *) ((bloom_header_t *) s + 1) + i * HB_CUCKOO_SLOTS;
+}
+
+/* Either bucket of a fingerprint leads to the other one */
+static uint64_t cuckoo_alt(pipe_t s, uint64_t i, uint16_t fp)
+{
+    return (i ^ (fp * 0x5bd1e995ULL)) & (((bloom_header_t *) s)->size - 1);
+}
+
+/* The fingerprint, never 0, and both buckets of an item */
+static uint16_t cuckoo_hash(pipe_t s, const char *p, size_t len, uint64_t *i1, uint64_t *i2)
+{
+    uint64_t hash = bloom_hash(p, len);
+    uint16_t fp = (hash & 0xffff) ? hash & 0xffff : 1;
+
+    *i1 = (hash >> 32) & (((bloom_header_t *) s)->size - 1);
+    *i2 = cuckoo_alt(s, *i1, fp);
+
+    return fp;
+}
+
+static int cuckoo_put(uint16_t *bucket, uint16_t fp)
+{
+    int i;
+
+    for (i = 0; i < HB_CUCKOO_SLOTS; i++)
+        if (bucket[i] == 0) {
+            bucket[i] = fp;
+            return 1;
+        }
+
+    return 0;
+}
+
+static int cuckoo_take(uint16_t *bucket, uint16_t fp)
+{
+    int i;
+
+    for (i = 0; i < HB_CUCKOO_SLOTS; i++)
+        if (bucket[i] == fp) {
+            bucket[i] = 0;
+            return 1;
+        }
+
+    return 0;
+}
+
+static int cuckoo_find(pipe_t s, uint16_t fp, uint64_t i1, uint64_t i2)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+    uint16_t *a = cuckoo_bucket(s, i1), *b = cuckoo_bucket(s, i2);
+    int i;
+
+    for (i = 0; i < HB_CUCKOO_SLOTS; i++)
+        if (a[i] == fp || b[i] == fp) return 1;
+
+    return h->victim == fp && (h->victim_at == i1 || h->victim_at == i2);
+}
+
+/* Buckets are filled to 95% at capacity */
+pipe_t cuckoo_new(uint64_t capacity)
+{
+    uint64_t size = 1;
+    bloom_header_t *h;
+    pipe_t s;
+
+    while (size * HB_CUCKOO_SLOTS * 95 / 100 < capacity) {
+        if (size * HB_CUCKOO_SLOTS * sizeof(uint16_t) >= HB_BITMAP_MAX) return NULL;
+        size <<= 1;
+    }
+
+    s = pipe_growzero(pipe_empty(), sizeof(bloom_header_t) + size * HB_CUCKOO_SLOTS * sizeof(uint16_t));
+    h = (bloom_header_t *) s;
+    memcpy(h->magic, "CUCK", 4);
+    h->size = size;
+    h->capacity = capacity;
+
+    return s;
+}
+
+int cuckoo_check(pipe_t s)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+    size_t len = pipe_len(s);
+
+    if (len < sizeof(bloom_header_t) || memcmp(h->magic, "CUCK", 4) != 0) return HB_ERR;
+    if (h->size < 1 || (h->size & (h->size - 1)) != 0 || h->victim_at >= h->size) return HB_ERR;
+
+    return (len - sizeof(bloom_header_t)) / (HB_CUCKOO_SLOTS * sizeof(uint16_t)) == h->size &&
+           (len - sizeof(bloom_header_t)) % (HB_CUCKOO_SLOTS * sizeof(uint16_t)) == 0 ? HB_OK : HB_ERR;
+}
+
+/* Both buckets full, fingerprints are kicked to their other bucket. The
+ * slot to kick is taken from the fingerprint rather than rand(), so an
+ * append only file replays into the same table. */
+int cuckoo_add(pipe_t s, const char *p, size_t len)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+    uint64_t i1, i2, i;
+    uint16_t fp, *bucket, kicked;
+    int n;
+
+    if (h->victim != 0) return HB_ERR;
+
+    fp = cuckoo_hash(s, p, len, &i1, &i2);
+    h->items++;
+    if (cuckoo_put(cuckoo_bucket(s, i1), fp) || cuckoo_put(cuckoo_bucket(s, i2), fp)) return 1;
+
+    for (i = fp & 1 ? i1 : i2, n = 0; n < HB_CUCKOO_KICKS; n++) {
+        bucket = cuckoo_bucket(s, i);
+        kicked = bucket[(fp + n) % HB_CUCKOO_SLOTS];
+        bucket[(fp + n) % HB_CUCKOO_SLOTS] = fp;
+        fp = kicked;
+
+        i = cuckoo_alt(s, i, fp);
+        if (cuckoo_put(cuckoo_bucket(s, i), fp)) return 1;
+    }
+
+    h->victim = fp;
+    h->victim_at = i;
+
+    return 1;
+}
+
+/* A slot freed may take the victim back */
+int cuckoo_del(pipe_t s, const char *p, size_t len)
+{
+    bloom_header_t *h = (bloom_header_t *) s;
+    uint64_t i1, i2;
+    uint16_t fp = cuckoo_hash(s, p, len, &i1, &i2);
+
+    if (h->victim == fp && (h->victim_at == i1 || h->victim_at == i2)) {
+        h->victim = 0;
+        h->victim_at = 0;
+    } else if (!cuckoo_take(cuckoo_bucket(s, i1), fp) && !cuckoo_take(cuckoo_bucket(s, i2), fp)) {
+        return 0;
+    } else if (h->victim != 0 && (cuckoo_put(cuckoo_bucket(s, h->victim_at), h->victim) ||
+                                  cuckoo_put(cuckoo_bucket(s, cuckoo_alt(s, h->victim_at, h->victim)), h->victim))) {
+        h->victim = 0;
+        h->victim_at = 0;
+    }
+    h->items--;
+
+    return 1;
+}
+
+/* Both buckets are prefetched, as in bloom_batch() */
+void cuckoo_batch(pipe_t s, pipe_t *items, int count, int *result)
+{
+    uint64_t i1[HB_BLOOM_AHEAD], i2[HB_BLOOM_AHEAD];
+    uint16_t fp[HB_BLOOM_AHEAD];
+    int i, j;
+
+    for (i = 0; i < count + HB_BLOOM_AHEAD; i++) {
+        j = i % HB_BLOOM_AHEAD;
+
+        if (i >= HB_BLOOM_AHEAD) result[i - HB_BLOOM_AHEAD] = cuckoo_find(s, fp[j], i1[j], i2[j]);
+        if (i < count) {
+            fp[j] = cuckoo_hash(s, items[i], pipe_len(items[i]), &i1[j], &i2[j]);
+            bloom_prefetch(cuckoo_bucket(s, i1[j]), 0);
+            bloom_prefetch(cuckoo_bucket(s, i2[j]), 0);
+        }
+    }
+}
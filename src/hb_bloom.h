@@ -0,0 +1,90 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+
+
+#ifndef _HB_BLOOM_H_
+#define _HB_BLOOM_H_
+
+/* Filters are strings: a header and the table. A Bloom filter is blocked,
+ * every item sets its k bits within one 64-byte block, so an add or a
+ * lookup touches a single cache line. Allocations are not aligned that
+ * far, the blocks start 'offset' bytes past the header (64 bytes are kept
+ * for it) and are moved onto a boundary by bloom_align() whenever the
+ * string may be changed. A cuckoo filter keeps a 16-bit fingerprint per
+ * item in buckets of four, an item sits in one of two buckets, so it can
+ * be deleted. The one fingerprint left over when a kick-out chain runs
+ * too long is kept in the header, the filter is full until it fits. */
+#define HB_BLOOM_BLOCK      64
+#define HB_BLOOM_BITS       (HB_BLOOM_BLOCK * 8)
+#define HB_BLOOM_AHEAD      8               /* Items hashed and prefetched before the one looked up */
+#define HB_CUCKOO_SLOTS     4
+#define HB_CUCKOO_KICKS     500
+
+typedef struct _bloom_header {
+    char      magic[4];                     /* "BLOM" or "CUCK" */
+    uint8_t   k;                            /* Bits set per item, Bloom only */
+    uint8_t   offset;                       /* Of the first block past the header */
+    uint16_t  victim;                       /* Fingerprint that did not fit, 0 if none */
+    uint64_t  size;                         /* Blocks, or buckets (a power of two) */
+    uint64_t  items;                        /* Added, less the deleted ones */
+    uint64_t  capacity;
+    uint64_t  victim_at;                    /* A bucket the victim may go to */
+} bloom_header_t;
+
+/* A Bloom filter for 'capacity' items at a false positive rate 'error',
+ * NULL if it would be larger than HB_BITMAP_MAX. */
+pipe_t    bloom_new(uint64_t, double);
+
+/* HB_OK if a string is a Bloom filter. */
+int       bloom_check(pipe_t);
+
+/* Move the blocks onto a cache line boundary, the string must not be
+ * read by anyone else. */
+void      bloom_align(pipe_t);
+
+/* Look up or, if 'add' is set, add items; result[i] is 1 if item i may be
+ * in the filter or, adding, if it surely was not. */
+void      bloom_batch(pipe_t, pipe_t *, int, int, int *);
+
+/* A cuckoo filter for 'capacity' items, NULL if too large. */
+pipe_t    cuckoo_new(uint64_t);
+
+/* HB_OK if a string is a cuckoo filter. */
+int       cuckoo_check(pipe_t);
+
+/* Add an item, again if it is there already. HB_ERR if full. */
+int       cuckoo_add(pipe_t, const char *, size_t);
+
+/* Delete one copy of an item, 1 if there was one. An item never added
+ * may share a fingerprint with another one and delete it. */
+int       cuckoo_del(pipe_t, const char *, size_t);
+
+/* result[i] is 1 if item i may be in the filter. */
+void      cuckoo_batch(pipe_t, pipe_t *, int, int *);
+
+#endif
@@ -0,0 +1,708 @@
+/*
+ * CASK               Bitcask storage engine, log files with an in-memory keydir.
+ *
+ * Version:                                     @(#)cask.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/mman.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+extern map_t database;
+
+/* Key directory entry, the map value of every key. Values stay on disk. */
+typedef struct _cask_entry {
+    pipe_t key;
+    uint64_t seq;
+    uint64_t offset;                        /* Of the record */
+    uint32_t file;
+    uint32_t len;                           /* Of the value */
+} cask_entry_t;
+
+typedef struct _cask_file {
+    int fd;
+    uint64_t size;
+    uint64_t dead;                          /* Bytes of superseded records */
+} cask_file_t;
+
+/* All of this is protected by the database lock: commands already hold it
+ * and the background thread takes it for every key it looks at. */
+static cask_file_t *files;
+static uint32_t nfiles;
+static uint32_t active;
+static uint64_t seq;
+static uint64_t merges;
+static uint64_t merge_nsec;
+static int merging;
+static int merge_wanted;
+
+static void     cask_name(char *, uint32_t, const char *);
+static uint64_t cask_record(uint32_t, uint32_t);
+static int      cask_open(uint32_t, int);
+static int      cask_append(const char *, uint32_t, const char *, uint32_t, uint64_t *);
+static int      cask_check(const unsigned char *, uint64_t);
+static void     cask_index(uint32_t, uint64_t, uint64_t, const char *, uint32_t, uint32_t);
+static int      cask_load_hint(uint32_t);
+static void     cask_load_data(uint32_t);
+static int      cask_collect(any_t, char *, any_t);
+static int      cask_release(any_t, char *, any_t);
+static int      cask_rotate(void);
+static int      cask_worth(void);
+static void     cask_merge(void);
+static int      cask_merge_finish(uint32_t, int, pipe_t);
+static int      cask_merge_commit(uint32_t *, uint32_t);
+static void     cask_merge_resume(void);
+static int      cask_syncdir(void);
+static void    *cask_loop(void *);
+
+static void cask_name(char *path, uint32_t id, const char *ext)
+{
+    snprintf(path, PATH_MAX, "%s/%09u.%s", server.dir, id, ext);
+}
+
+/* New and renamed files only survive a crash once their directory is synced. */
+static int cask_syncdir(void)
+{
+    int fd, status;
+
+    if ((fd = open(server.dir, O_RDONLY)) == HB_ERR) return HB_ERR;
+    status = fsync(fd) == HB_OK ? HB_OK : HB_ERR;
+    close(fd);
+
+    return status;
+}
+
+static uint64_t cask_record(uint32_t klen, uint32_t vlen)
+{
+    return HB_CASK_HEADER + klen + (vlen == HB_CASK_TOMBSTONE ? 0 : vlen);
+}
+
+/* Open data file 'id', growing the file table as needed. New files are
+ * created for writing, existing ones only read. */
+static int cask_open(uint32_t id, int create)
+{
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (id >= nfiles) {
+        cask_file_t *grown = realloc(files, (id + 1) * sizeof(cask_file_t));
+
+        if (grown == NULL) return HB_ERR;
+        files = grown;
+        for (; nfiles <= id; nfiles++) {
+            files[nfiles].fd = HB_ERR;
+            files[nfiles].size = files[nfiles].dead = 0;
+        }
+    }
+
+    cask_name(path, id, "cask");
+    files[id].fd = create ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+    if (files[id].fd == HB_ERR || fstat(files[id].fd, &st) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not open data file [%s]: %s\n", HB_LOG_ERR, path, strerror(errno));
+        return HB_ERR;
+    }
+    files[id].size = st.st_size;
+    files[id].dead = 0;
+
+    return HB_OK;
+}
+
+/* Append one record to the active file, a value of NULL is a tombstone. */
+static int cask_append(const char *key, uint32_t klen, const char *value, uint32_t vlen, uint64_t *offset)
+{
+    uint64_t size = cask_record(klen, vlen);
+    unsigned char *buf;
+    int status;
+
+    if (files[active].size >= HB_CASK_FILE_SIZE && cask_rotate() == HB_ERR) return HB_ERR;
+    if ((buf = malloc(size)) == NULL) return HB_ERR;
+
+    util_put64(buf + 4, ++seq);
+    util_put32(buf + 12, klen);
+    util_put32(buf + 16, vlen);
+    memcpy(buf + HB_CASK_HEADER, key, klen);
+    if (value) memcpy(buf + HB_CASK_HEADER + klen, value, vlen);
+    util_put32(buf, util_crc32(0, buf + 4, size - 4));
+
+    *offset = files[active].size;
+    if ((status = util_pwrite(files[active].fd, buf, size, *offset)) == HB_OK) {
+        files[active].size += size;
+    } else {
+        fprintf(stdout, "hb: %s could not write data file: %s\n", HB_LOG_ERR, strerror(errno));
+    }
+
+    free(buf);
+
+    return status;
+}
+
+/* Verify the record at 'p' with 'left' bytes available. Returns its size
+ * or 0 if it is torn or corrupt. */
+static int cask_check(const unsigned char *p, uint64_t left)
+{
+    uint64_t size;
+
+    if (left < HB_CASK_HEADER) return 0;
+    size = cask_record(util_get32(p + 12), util_get32(p + 16));
+    if (size > left || size > INT_MAX) return 0;
+    if (util_crc32(0, p + 4, size - 4) != util_get32(p)) return 0;
+
+    return (int) size;
+}
+
+/* Startup: the record with the highest sequence number wins, whatever file
+ * it is in. Tombstones stay in the directory until everything is read. */
+static void cask_index(uint32_t id, uint64_t offset, uint64_t s, const char *key, uint32_t klen, uint32_t vlen)
+{
+    cask_entry_t *e;
+    pipe_t k = pipe_newlen(key, klen);
+
+    if (s > seq) seq = s;
+
+    if (map_get(&database, k, (void**)(&e)) == HB_OK) {
+        pipe_free(k);
+        if (e->seq > s) {
+            files[id].dead += cask_record(klen, vlen);
+            return;
+        }
+        files[e->file].dead += cask_record(klen, e->len);
+    } else {
+        e = malloc(sizeof(cask_entry_t));
+        e->key = k;
+        map_put(&database, e->key, e);
+    }
+
+    e->seq = s;
+    e->offset = offset;
+    e->file = id;
+    e->len = vlen;
+}
+
+static int cask_load_hint(uint32_t id)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    unsigned char *data, *p, *end;
+    int fd;
+
+    cask_name(path, id, "hint");
+    if ((fd = open(path, O_RDONLY)) == HB_ERR) return HB_ERR;
+    if (fstat(fd, &st) == HB_ERR || st.st_size < 4) {
+        close(fd);
+        return HB_ERR;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return HB_ERR;
+
+    end = data + st.st_size - 4;
+    if (util_crc32(0, data, end - data) != util_get32(end)) {
+        munmap(data, st.st_size);
+        fprintf(stdout, "hb: %s ignoring corrupt hint file [%s]\n", HB_LOG_WRN, path);
+        return HB_ERR;
+    }
+
+    for (p = data; p + HB_CASK_HINT <= end && p + HB_CASK_HINT + util_get32(p + 16) <= end;
+         p += HB_CASK_HINT + util_get32(p + 16))
+        cask_index(id, util_get64(p + 8), util_get64(p), (char *) p + HB_CASK_HINT, util_get32(p + 16), util_get32(p + 20));
+
+    munmap(data, st.st_size);
+
+    return HB_OK;
+}
+
+static void cask_load_data(uint32_t id)
+{
+    unsigned char *data;
+    uint64_t offset = 0;
+    int size;
+
+    if (files[id].size == 0) return;
+
+    data = mmap(NULL, files[id].size, PROT_READ, MAP_PRIVATE, files[id].fd, 0);
+    if (data == MAP_FAILED) return;
+    madvise(data, files[id].size, MADV_SEQUENTIAL);
+
+    while ((size = cask_check(data + offset, files[id].size - offset)) > 0) {
+        cask_index(id, offset, util_get64(data + offset + 4), (char *) data + offset + HB_CASK_HEADER,
+                   util_get32(data + offset + 12), util_get32(data + offset + 16));
+        offset += size;
+    }
+
+    /* A crash can leave a torn last record, it is never read again */
+    if (offset < files[id].size) {
+        fprintf(stdout, "hb: %s ignoring %" PRIu64 " bytes at the end of data file %u\n",
+                HB_LOG_WRN, files[id].size - offset, id);
+        files[id].dead += files[id].size - offset;
+    }
+
+    munmap(data, files[id].size);
+}
+
+static int cask_collect(any_t item, char *key, any_t data)
+{
+    cask_entry_t *e = data;
+    pipe_t *tombs = item;
+
+    if (e->len == HB_CASK_TOMBSTONE) *tombs = pipe_catlen(*tombs, &e, sizeof(e));
+
+    return HB_OK;
+}
+
+static int cask_release(any_t item, char *key, any_t data)
+{
+    cask_entry_t *e = data;
+
+    pipe_free(e->key);
+    free(e);
+
+    return HB_OK;
+}
+
+int cask_init(void)
+{
+    pthread_t thread_id;
+    DIR *dir;
+    struct dirent *de;
+    pipe_t tombs;
+    cask_entry_t **e;
+    uint64_t start = stat_clock();
+    uint32_t id, loaded = 0;
+    int len;
+
+    if (mkdir(server.dir, 0755) == HB_ERR && errno != EEXIST) {
+        fprintf(stdout, "hb: %s could not create data directory [%s]\n", HB_LOG_ERR, server.dir);
+        return HB_ERR;
+    }
+    if ((dir = opendir(server.dir)) == NULL) {
+        fprintf(stdout, "hb: %s could not open data directory [%s]\n", HB_LOG_ERR, server.dir);
+        return HB_ERR;
+    }
+
+    cask_merge_resume();
+
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "%u.cask%n", &id, &len) != 1 || de->d_name[len] != '\0') continue;
+        if (cask_open(id, 0) == HB_ERR) {
+            closedir(dir);
+            return HB_ERR;
+        }
+        loaded++;
+    }
+    closedir(dir);
+
+    for (id = 0; id < nfiles; id++) {
+        if (files[id].fd == HB_ERR) continue;
+        if (cask_load_hint(id) == HB_ERR) cask_load_data(id);
+    }
+
+    /* Deleted keys leave the directory once every file has been seen */
+    tombs = pipe_empty();
+    map_iterate(&database, cask_collect, &tombs);
+    for (e = (cask_entry_t **) tombs; (char *) e < tombs + pipe_len(tombs); e++) {
+        files[(*e)->file].dead += cask_record(pipe_len((*e)->key), (*e)->len);
+        map_remove(&database, (*e)->key);
+        cask_release(NULL, NULL, *e);
+    }
+    pipe_free(tombs);
+
+    active = nfiles;
+    if (cask_open(active, 1) == HB_ERR) return HB_ERR;
+
+    if (pthread_create(&thread_id, NULL, cask_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create merge thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    fprintf(stdout, "hb: %s loaded %d keys from %u data files in %.3fs\n",
+            HB_LOG_OK, map_length(&database), loaded, (stat_clock() - start) / 1e9);
+
+    return HB_OK;
+}
+
+static int cask_rotate(void)
+{
+    active = nfiles;
+
+    return cask_open(active, 1);
+}
+
+int cask_put(pipe_t key, pipe_t value)
+{
+    cask_entry_t *e;
+    uint64_t offset;
+
+    if (cask_append(key, pipe_len(key), value, pipe_len(value), &offset) == HB_ERR) return HB_ERR;
+
+    if (map_get(&database, key, (void**)(&e)) == HB_OK) {
+        files[e->file].dead += cask_record(pipe_len(e->key), e->len);
+    } else {
+        if ((e = malloc(sizeof(cask_entry_t))) == NULL) return HB_ERR;
+        e->key = pipe_newlen(key, pipe_len(key));
+        map_put(&database, e->key, e);
+    }
+
+    e->seq = seq;
+    e->offset = offset;
+    e->file = active;
+    e->len = pipe_len(value);
+
+    return HB_OK;
+}
+
+/* One pread() of the whole record, so the checksum can be verified. */
+pipe_t cask_get(pipe_t key)
+{
+    cask_entry_t *e;
+    unsigned char *buf;
+    uint64_t size;
+    pipe_t value = NULL;
+
+    if (map_get(&database, key, (void**)(&e)) == HB_ERR) return NULL;
+
+    size = cask_record(pipe_len(e->key), e->len);
+    if ((buf = malloc(size)) == NULL) return NULL;
+
+    if (pread(files[e->file].fd, buf, size, e->offset) == (ssize_t) size && cask_check(buf, size)) {
+        value = pipe_newlen(buf + HB_CASK_HEADER + pipe_len(e->key), e->len);
+    } else {
+        fprintf(stdout, "hb: %s bad record in data file %u at offset %" PRIu64 "\n",
+                HB_LOG_ERR, e->file, e->offset);
+    }
+
+    free(buf);
+
+    return value;
+}
+
+int cask_del(pipe_t key)
+{
+    cask_entry_t *e;
+    uint64_t offset;
+
+    if (map_get(&database, key, (void**)(&e)) == HB_ERR) return HB_OK;
+
+    if (cask_append(key, pipe_len(key), NULL, HB_CASK_TOMBSTONE, &offset) == HB_ERR) return HB_ERR;
+
+    /* The tombstone only shadows older records, it is dead from the start */
+    files[active].dead += cask_record(pipe_len(key), HB_CASK_TOMBSTONE);
+    files[e->file].dead += cask_record(pipe_len(e->key), e->len);
+
+    map_remove(&database, key);
+    cask_release(NULL, NULL, e);
+
+    return HB_OK;
+}
+
+long long cask_len(void)
+{
+    return map_length(&database);
+}
+
+int cask_clr(void)
+{
+    char path[PATH_MAX];
+    uint32_t id;
+
+    if (merging) return HB_ERR;
+
+    map_iterate(&database, cask_release, NULL);
+    map_clear(&database);
+
+    for (id = 0; id < nfiles; id++) {
+        if (files[id].fd == HB_ERR) continue;
+        close(files[id].fd);
+        files[id].fd = HB_ERR;
+        cask_name(path, id, "cask");
+        unlink(path);
+        cask_name(path, id, "hint");
+        unlink(path);
+    }
+
+    return cask_rotate();
+}
+
+int cask_compact(void)
+{
+    merge_wanted = 1;
+
+    return HB_OK;
+}
+
+/* Merge once dead records are HB_CASK_MERGE_RATIO percent of the immutable
+ * files and at least HB_CASK_MERGE_MIN bytes. */
+static int cask_worth(void)
+{
+    uint64_t size = 0, dead = 0;
+    uint32_t id;
+
+    for (id = 0; id < nfiles; id++) {
+        if (id == active || files[id].fd == HB_ERR) continue;
+        size += files[id].size;
+        dead += files[id].dead;
+    }
+
+    return dead >= HB_CASK_MERGE_MIN && dead * 100 >= size * HB_CASK_MERGE_RATIO;
+}
+
+/* Sync the active file once a second and merge when it is worth it. */
+static void *cask_loop(void *arg)
+{
+    int fd, merge;
+
+    for (;;) {
+        sleep(1);
+
+        pthread_mutex_lock(&server.mutex);
+        fd = dup(files[active].fd);
+        merge = merge_wanted || cask_worth();
+        merge_wanted = 0;
+        pthread_mutex_unlock(&server.mutex);
+
+        if (fd != HB_ERR) {
+            fdatasync(fd);
+            close(fd);
+        }
+
+        if (merge) cask_merge();
+    }
+
+    return NULL;
+}
+
+/* Sync a merged data file and write its hint file next to it. */
+static int cask_merge_finish(uint32_t id, int fd, pipe_t hint)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    unsigned char crc[4];
+    int hfd, status;
+
+    util_put32(crc, util_crc32(0, hint, pipe_len(hint)));
+    hint = pipe_catlen(hint, crc, 4);
+
+    cask_name(path, id, "hint");
+    cask_name(tmp, id, "hint.tmp");
+
+    status = fdatasync(fd) == HB_OK ? HB_OK : HB_ERR;
+    if (status == HB_OK && (hfd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != HB_ERR) {
+        status = util_pwrite(hfd, hint, pipe_len(hint), 0);
+        if (status == HB_OK && fsync(hfd) == HB_ERR) status = HB_ERR;
+        close(hfd);
+        if (status == HB_OK && rename(tmp, path) == HB_ERR) status = HB_ERR;
+        if (status == HB_ERR) unlink(tmp);
+    }
+
+    pipe_free(hint);
+
+    return status;
+}
+
+/* The merged files are durable, record which inputs they replace. Once the
+ * marker is in place the inputs are as good as gone: a crash before all of
+ * them are unlinked is finished by cask_merge_resume() on the next start,
+ * so a tombstone can never go while an older value of its key stays. */
+static int cask_merge_commit(uint32_t *ids, uint32_t n)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    pipe_t list = pipe_empty();
+    uint32_t i;
+    int fd, status;
+
+    snprintf(path, PATH_MAX, "%s/%s", server.dir, HB_CASK_MERGE_FILE);
+    snprintf(tmp, PATH_MAX, "%s/%s.tmp", server.dir, HB_CASK_MERGE_FILE);
+
+    for (i = 0; i < n; i++)
+        list = pipe_catprintf(list, "%09u\n", ids[i]);
+
+    status = cask_syncdir();
+    if (status == HB_OK && (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != HB_ERR) {
+        status = util_pwrite(fd, list, pipe_len(list), 0);
+        if (status == HB_OK && fsync(fd) == HB_ERR) status = HB_ERR;
+        close(fd);
+        if (status == HB_OK && rename(tmp, path) == HB_ERR) status = HB_ERR;
+        if (status == HB_OK) status = cask_syncdir();
+        if (status == HB_ERR) unlink(tmp);
+    } else {
+        status = HB_ERR;
+    }
+
+    pipe_free(list);
+
+    return status;
+}
+
+/* Startup: drop the inputs of a merge that committed but did not finish. */
+static void cask_merge_resume(void)
+{
+    char path[PATH_MAX], file[PATH_MAX];
+    uint32_t id, n = 0;
+    FILE *f;
+
+    snprintf(path, PATH_MAX, "%s/%s.tmp", server.dir, HB_CASK_MERGE_FILE);
+    unlink(path);
+
+    snprintf(path, PATH_MAX, "%s/%s", server.dir, HB_CASK_MERGE_FILE);
+    if ((f = fopen(path, "r")) == NULL) return;
+
+    while (fscanf(f, "%u", &id) == 1) {
+        cask_name(file, id, "cask");
+        unlink(file);
+        cask_name(file, id, "hint");
+        unlink(file);
+        n++;
+    }
+    fclose(f);
+
+    cask_syncdir();
+    unlink(path);
+
+    fprintf(stdout, "hb: %s finished an interrupted merge of %u data files\n", HB_LOG_WRN, n);
+}
+
+/* Copy the live records of every immutable file into new files, then drop
+ * the old ones. Records keep their sequence numbers so the startup rebuild
+ * does not depend on file order, which is also why tombstones can go: any
+ * older value of their key is in the files being merged too, and those go
+ * away together with them (see cask_merge_commit()). */
+static void cask_merge(void)
+{
+    uint32_t *ids, n = 0, i, id, out = 0;
+    uint64_t offset, osize = 0, size, start = stat_clock();
+    unsigned char *data;
+    char path[PATH_MAX];
+    pipe_t key = pipe_empty(), hint = NULL;
+    cask_entry_t *e;
+    int fd, ofd = HB_ERR, rsize, live, status = HB_OK;
+
+    /* Start a new active file so everything written so far is merged */
+    pthread_mutex_lock(&server.mutex);
+    merging = 1;
+    if (files[active].size > 0) cask_rotate();
+    ids = malloc(nfiles * sizeof(uint32_t));
+    for (id = 0; ids && id < nfiles; id++)
+        if (id != active && files[id].fd != HB_ERR) ids[n++] = id;
+    pthread_mutex_unlock(&server.mutex);
+
+    for (i = 0; i < n && status == HB_OK; i++) {
+        pthread_mutex_lock(&server.mutex);
+        fd = files[ids[i]].fd;
+        size = files[ids[i]].size;
+        pthread_mutex_unlock(&server.mutex);
+
+        if (size == 0) continue;
+        if ((data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+            status = HB_ERR;
+            break;
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+
+        for (offset = 0; (rsize = cask_check(data + offset, size - offset)) > 0; offset += rsize) {
+            unsigned char *r = data + offset;
+
+            if (util_get32(r + 16) == HB_CASK_TOMBSTONE) continue;
+
+            key = pipe_cpylen(key, (char *) r + HB_CASK_HEADER, util_get32(r + 12));
+
+            pthread_mutex_lock(&server.mutex);
+            live = map_get(&database, key, (void**)(&e)) == HB_OK && e->file == ids[i] && e->offset == offset;
+            if (live && (ofd == HB_ERR || osize >= HB_CASK_FILE_SIZE)) {
+                if (ofd != HB_ERR && cask_merge_finish(out, ofd, hint) == HB_ERR) status = HB_ERR;
+                out = nfiles;
+                if (status == HB_OK && cask_open(out, 1) == HB_ERR) status = HB_ERR;
+                ofd = files[out].fd;
+                osize = 0;
+                hint = pipe_empty();
+            }
+            pthread_mutex_unlock(&server.mutex);
+
+            if (!live) continue;
+            if (status == HB_ERR || util_pwrite(ofd, r, rsize, osize) == HB_ERR) {
+                status = HB_ERR;
+                break;
+            }
+
+            hint = pipe_catlen(hint, r + 4, 8);
+            hint = pipe_catlen(hint, "\0\0\0\0\0\0\0\0", 8);
+            util_put64((unsigned char *) hint + pipe_len(hint) - 8, osize);
+            hint = pipe_catlen(hint, r + 12, 8);
+            hint = pipe_catpipe(hint, key);
+
+            /* A command may have replaced or deleted the key meanwhile */
+            pthread_mutex_lock(&server.mutex);
+            if (map_get(&database, key, (void**)(&e)) == HB_OK && e->file == ids[i] && e->offset == offset) {
+                e->file = out;
+                e->offset = osize;
+            } else {
+                files[out].dead += rsize;
+            }
+            files[out].size = osize + rsize;
+            pthread_mutex_unlock(&server.mutex);
+
+            osize += rsize;
+        }
+
+        munmap(data, size);
+    }
+
+    if (ofd != HB_ERR && status == HB_OK) status = cask_merge_finish(out, ofd, hint);
+    else if (hint) pipe_free(hint);
+    if (status == HB_OK) status = cask_merge_commit(ids, n);
+
+    pthread_mutex_lock(&server.mutex);
+    for (i = 0; i < n && status == HB_OK; i++) {
+        close(files[ids[i]].fd);
+        files[ids[i]].fd = HB_ERR;
+        cask_name(path, ids[i], "cask");
+        unlink(path);
+        cask_name(path, ids[i], "hint");
+        unlink(path);
+    }
+    if (status == HB_OK) {
+        snprintf(path, PATH_MAX, "%s/%s", server.dir, HB_CASK_MERGE_FILE);
+        unlink(path);
+        merges++;
+    }
+    merge_nsec = stat_clock() - start;
+    merging = 0;
+    pthread_mutex_unlock(&server.mutex);
+
+    fprintf(stdout, "hb: %s merge of %u data files %s\n", status == HB_OK ? HB_LOG_OK : HB_LOG_ERR,
+            n, status == HB_OK ? "done" : "failed");
+
+    pipe_free(key);
+    free(ids);
+}
+
+pipe_t cask_catinfo(pipe_t s)
+{
+    uint64_t size = 0, dead = 0;
+    uint32_t id, count = 0;
+
+    for (id = 0; id < nfiles; id++) {
+        if (files[id].fd == HB_ERR) continue;
+        size += files[id].size;
+        dead += files[id].dead;
+        count++;
+    }
+
+    s = pipe_catprintf(s, "cask_dir:%s\n", server.dir);
+    s = pipe_catprintf(s, "cask_files:%u\n", count);
+    s = pipe_catprintf(s, "cask_active_file:%u\n", active);
+    s = pipe_catprintf(s, "cask_disk_bytes:%" PRIu64 "\n", size);
+    s = pipe_catprintf(s, "cask_dead_bytes:%" PRIu64 "\n", dead);
+    s = pipe_catprintf(s, "cask_merging:%d\n", merging);
+    s = pipe_catprintf(s, "cask_merges:%" PRIu64 "\n", merges);
+    s = pipe_catprintf(s, "cask_last_merge_duration_sec:%.3f\n", merge_nsec / 1e9);
+
+    return s;
+}
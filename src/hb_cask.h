@@ -0,0 +1,55 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_CASK_H_
+#define _HB_CASK_H_
+
+/* Data files are sequences of records: crc32 of the rest of the record,
+ * sequence number, key length, value length (HB_CASK_TOMBSTONE for a
+ * delete), key and value, integers little endian. Hint files written by a
+ * merge hold sequence number, record offset, key length, value length and
+ * key for each record of their data file, followed by a crc32 of it all. */
+#define HB_CASK_HEADER      20
+#define HB_CASK_HINT        24
+#define HB_CASK_TOMBSTONE   0xffffffffU
+
+/* Rebuild the key directory from the data and hint files in server.dir
+ * and open a new active file. */
+int       cask_init(void);
+
+int       cask_put(pipe_t, pipe_t);
+pipe_t    cask_get(pipe_t);
+int       cask_del(pipe_t);
+long long cask_len(void);
+int       cask_clr(void);
+
+/* Ask the background thread to merge the immutable files now. */
+int       cask_compact(void);
+
+pipe_t    cask_catinfo(pipe_t);
+
+#endif
@@ -23,6 +23,7 @@ extern struct client client;
 
 static void do_daemonize();
 static void do_stop();
+static void *core_wait(void *);
 
 static void print_help(args_context_t);
 static void print_version(args_context_t);
@@ -99,6 +100,21 @@ static const args_option_t option_list[] = {
     { "daemonize", 'd', ARGS_OPTION_TYPE_NO_ARG,   0x0, 'd', "run hashbase as a daemon",                             0x0 },
     { "stop",      's', ARGS_OPTION_TYPE_NO_ARG,   0x0, 's', "close running daemon",                                 0x0 },
     { "port",      'p', ARGS_OPTION_TYPE_REQUIRED, 0x0, 'p', "set the tcp port to listen on",                   "NUMBER" },
+    { "metrics-port",        0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'm', "serve prometheus metrics over http", "NUMBER" },
+    { "engine",              0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'e', "storage engine: memory, bitcask, mmap or lsm", "NAME" },
+    { "dir",                 0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'D', "data directory of on-disk engines",  "PATH" },
+    { "prefault",            0x0, ARGS_OPTION_TYPE_NO_ARG,   0x0, 'P', "fault in mapped files in background", 0x0 },
+    { "tier-after",          0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'T', "move values idle this long to disk", "SECONDS" },
+    { "compress-above",      0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'z', "compress values at least that long",  "BYTES" },
+    { "replicaof",           0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'R', "replicate the primary at host:port", "HOST:PORT" },
+    { "repl-backlog-size",   0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'B', "keep that much of the stream for resyncs", "BYTES" },
+    { "appendonly",          0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'a', "log writes to an append only file",   "FILE" },
+    { "appendfsync",         0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'f', "fsync policy: always, everysec or no", "POLICY" },
+    { "slowlog-slower-than", 0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'l', "log commands slower than usec (-1 off)", "USEC" },
+    { "slowlog-max-len",     0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'L', "keep that many slow commands",     "NUMBER" },
+    { "aof-rewrite-rate",    0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'r', "limit log rewrites to MB/s (0 off)", "NUMBER" },
+    { "snapshot",            0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'S', "save and load snapshots in file",     "FILE" },
+    { "sketch-sample",       0x0, ARGS_OPTION_TYPE_REQUIRED, 0x0, 'k', "track hot/big keys on 1 of n accesses", "NUMBER" },
     { "help",      'h', ARGS_OPTION_TYPE_NO_ARG,   0x0, 'h', "show hashbase version, usage, options, and exit",      0x0 },
     { "version",   'v', ARGS_OPTION_TYPE_NO_ARG,   0x0, 'v', "show version and exit",                                0x0 },
     ARGS_OPTIONS_END
@@ -133,6 +149,57 @@ void core_init(int argc, char *argv[])
         case 'p':
             server.port = atoi(ctx.current_opt_arg);
             break;
+        case 'm':
+            server.metrics_port = atoi(ctx.current_opt_arg);
+            break;
+        case 'l':
+            server.slow_threshold = atoll(ctx.current_opt_arg);
+            break;
+        case 'L':
+            server.slow_length = atoi(ctx.current_opt_arg);
+            break;
+        case 'k':
+            server.sketch_rate = atoi(ctx.current_opt_arg);
+            break;
+        case 'e':
+            if ((server.engine = engine_find(ctx.current_opt_arg)) == NULL) {
+                fprintf(stdout, "hb: %s unknown engine [%s]\n", HB_LOG_ERR, ctx.current_opt_arg);
+                core_close(1);
+            }
+            break;
+        case 'D':
+            server.dir = (char *) ctx.current_opt_arg;
+            break;
+        case 'P':
+            server.prefault = true;
+            break;
+        case 'T':
+            server.tier_after = atoi(ctx.current_opt_arg);
+            break;
+        case 'z':
+            server.compress_above = atoi(ctx.current_opt_arg);
+            break;
+        case 'R':
+            server.replicaof = (char *) ctx.current_opt_arg;
+            break;
+        case 'B':
+            server.repl_backlog = atoll(ctx.current_opt_arg);
+            break;
+        case 'a':
+            server.aof = (char *) ctx.current_opt_arg;
+            break;
+        case 'r':
+            server.aof_rewrite_rate = atoi(ctx.current_opt_arg);
+            break;
+        case 'S':
+            server.snapshot = (char *) ctx.current_opt_arg;
+            break;
+        case 'f':
+            if ((server.aof_fsync = aof_policy(ctx.current_opt_arg)) == HB_ERR) {
+                fprintf(stdout, "hb: %s unknown fsync policy [%s]\n", HB_LOG_ERR, ctx.current_opt_arg);
+                core_close(1);
+            }
+            break;
         /* Help & Version */
         case 'h':
             print_help(ctx);
@@ -146,10 +213,45 @@ void core_init(int argc, char *argv[])
     }
 }
 
+/* Signals are taken by a thread of their own with sigwait(), so the
+ * shutdown runs as ordinary code instead of inside a handler. Called before
+ * any other thread is started, which then all inherit the blocked mask. */
+void core_signals(void)
+{
+    static sigset_t set;
+    pthread_t thread;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    if (pthread_create(&thread, NULL, core_wait, &set) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create signal thread\n", HB_LOG_ERR);
+        core_close(1);
+    }
+    pthread_detach(thread);
+}
+
+static void *core_wait(void *arg)
+{
+    int sig;
+
+    while (sigwait(arg, &sig) != HB_OK);
+    core_close(2);
+
+    return NULL;
+}
+
+/* The database lock is held from here on, so no command is left halfway
+ * when the log is flushed and the engine closed. */
 void core_close(int code)
 {
+    pthread_mutex_lock(&server.mutex);
     server.keepRunning = false;
 
+    aof_flush();
+    if (server.engine && server.engine->close) server.engine->close();
+
     close(client.socket);
     close(server.socket);
 
@@ -72,22 +72,131 @@
 #define HB_NET_PORT         5555
 #define HB_NET_BUFFER       512
 #define HB_NET_BACKLOG      256
+#define HB_NET_PEER         64
 
 #define HB_CORE_LOCK        "/tmp/hashbase.pid"
 #define HB_CORE_MAX_OPTIONS 32
 #define HB_CORE_MAX_ARGS    32
+#define HB_CORE_MAX_COMMANDS 128
 
 #define HB_PIPE_PREALLOC    (1024*1024)
 
+#define HB_METRICS_PORT     0
+#define HB_METRICS_BACKLOG  16
+#define HB_METRICS_REQUEST  4096
+#define HB_METRICS_TIMEOUT  2
+
+#define HB_SKETCH_RATE      0
+#define HB_SKETCH_DEPTH     4
+#define HB_SKETCH_WIDTH     4096
+#define HB_SKETCH_TOPK      32
+#define HB_SKETCH_CLASSES   40
+#define HB_SKETCH_DECAY     (64*1024)
+
+#define HB_AOF_INTERVAL     10
+#define HB_AOF_REWRITE_RATE 32
+#define HB_AOF_REWRITE_CHUNK (1024*1024)
+#define HB_AOF_REWRITE_ARGS 64
+#define HB_AOF_REWRITE_MIN  (64*1024*1024)
+#define HB_AOF_REWRITE_GROWTH 100
+
+#define HB_ENGINE           "memory"
+#define HB_CORE_DIR         "/tmp/hashbase"
+
+#define HB_CASK_FILE_SIZE   (64*1024*1024)
+#define HB_CASK_MERGE_RATIO 50
+#define HB_CASK_MERGE_MIN   (16*1024*1024)
+#define HB_CASK_MERGE_FILE  "merge"
+
+#define HB_PMAP_SIZE        1024
+#define HB_PMAP_HEAP_SIZE   (1024*1024)
+#define HB_PMAP_CHECKPOINT  1
+#define HB_PMAP_PREFAULT    (4*1024*1024)
+
+#define HB_LSM_MEMTABLE     (4*1024*1024)
+#define HB_LSM_BLOCK        4096
+#define HB_LSM_FILE_SIZE    (2*1024*1024)
+#define HB_LSM_LEVELS       7
+#define HB_LSM_LEVEL_BASE   (10*1024*1024)
+#define HB_LSM_L0_TRIGGER   4
+#define HB_LSM_L0_STOP      12
+#define HB_LSM_BLOOM_BITS   10
+
+#define HB_TIER_MIN         64
+#define HB_TIER_SCAN        65536
+#define HB_TIER_BATCH       (4*1024*1024)
+#define HB_TIER_COMPACT_MIN (64*1024*1024)
+
+#define HB_LZF_HLOG         14
+#define HB_LZF_SAVING       8
+
+#define HB_REPL_BACKLOG     (16*1024*1024)
+#define HB_REPL_CHUNK       (64*1024)
+#define HB_REPL_PING        1
+#define HB_REPL_WAIT        100
+#define HB_REPL_TIMEOUT     10
+#define HB_REPL_RETRY       1
+
+#define HB_LIST_CHUNK       8192
+
+#define HB_HASH_PACKED_FIELDS 128
+#define HB_HASH_PACKED_VALUE  64
+#define HB_ZSET_PACKED_MEMBERS 128
+#define HB_ZSET_PACKED_VALUE  64
+#define HB_SET_INTSET_MAX   8192
+
+#define HB_BITMAP_MAX       (512*1024*1024)
+
+#define HB_HLL_SPARSE_MAX   3000
+
+#define HB_BLOOM_CAPACITY   100000          /* Of a filter made by an add */
+#define HB_BLOOM_ERROR      0.01
+
+#define HB_STREAM_BLOCK     4096            /* Bytes of entries a block takes before the next */
+
+#define HB_SAVE_FILE        "/tmp/hashbase.snap"
+#define HB_SAVE_BUFFER      (1024*1024)
+#define HB_SAVE_CHUNK       (1024*1024)
+#define HB_SAVE_THREADS     16
+
+#define HB_SLOW_THRESHOLD   10000
+#define HB_SLOW_LENGTH      128
+#define HB_SLOW_ARGS        32
+#define HB_SLOW_ARGLEN      128
+
 /*-----------------------------------------------------------------------------
  * HASHBASE modules
  *-------------------------------------------------------------------------- */
 
+#include <hb_probe.h>
 #include <hb_pipe.h>
 #include <hb_args.h>
 #include <hb_ascii.h>
 #include <hb_map.h>
 #include <hb_net.h>
+#include <hb_stat.h>
+#include <hb_slow.h>
+#include <hb_metrics.h>
+#include <hb_aof.h>
+#include <hb_save.h>
+#include <hb_object.h>
+#include <hb_sketch.h>
+#include <hb_list.h>
+#include <hb_hash.h>
+#include <hb_zset.h>
+#include <hb_set.h>
+#include <hb_bitmap.h>
+#include <hb_hll.h>
+#include <hb_bloom.h>
+#include <hb_stream.h>
+#include <hb_block.h>
+#include <hb_engine.h>
+#include <hb_cask.h>
+#include <hb_pmap.h>
+#include <hb_lsm.h>
+#include <hb_tier.h>
+#include <hb_lzf.h>
+#include <hb_repl.h>
 #include <hb_util.h>
 
 /*-----------------------------------------------------------------------------
@@ -98,15 +207,39 @@ struct server {
     /* options with no argument */
 
     int                     status;           /* memory  : last status code */
+    pthread_mutex_t         mutex;            /* memory  : database lock */
 
     struct ascii_t *        commands;         /* ascii   : commands map */
 
+    engine_t *              engine;           /* storage : key/value engine */
+    bool                    prefault;         /* storage : fault in mapped files on start */
+    int                     tier_after;       /* storage : idle seconds before a value goes to disk */
+    int                     compress_above;   /* storage : compress values at least that long */
+    char *                  dir;              /* storage : data directory */
+
     int                     buffer;           /* network : packet lenght */
     int                     backlog;          /* network : tcp backlog */
     int                     port;             /* network : tcp listening port */
     int                     socket;           /* network : tcp socket */
     struct sockaddr_in      addr;             /* network : tcp addr */
+    int                     clients;          /* network : connected clients */
+    int                     metrics_port;     /* network : http metrics port, 0 off */
+
+    long long               slow_threshold;   /* slowlog : usec, negative disables */
+    int                     slow_length;      /* slowlog : ring buffer entries */
+
+    int                     sketch_rate;      /* sketch  : sample 1 of n, 0 off */
+
+    char *                  aof;              /* persist : append only file, NULL off */
+    int                     aof_fsync;        /* persist : fsync policy */
+    int                     aof_rewrite_rate; /* persist : rewrite MB/s, 0 unlimited */
+    char *                  snapshot;         /* persist : snapshot file */
+    uint64_t                dirty;            /* persist : writes since last snapshot */
+
+    char *                  replicaof;        /* replica : primary host:port, NULL on a primary */
+    long long               repl_backlog;     /* replica : bytes of the stream kept for resyncs */
 
+    time_t                  start;            /* process : start time */
     pid_t                   pid;              /* process : pid */
     char *                  lock;             /* process : lock */
     bool                    daemonize:1;      /* process : daemon */
@@ -126,6 +259,7 @@ struct client {
  *-------------------------------------------------------------------------- */
 
 void core_init(int, char * []);
+void core_signals(void);
 void core_close(int);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+/*
+ * ENGINE                      Storage engines behind the key/value commands.
+ *
+ * Version:                                   @(#)engine.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+extern map_t database;
+
+static int       memory_init(void);
+static int       memory_put(pipe_t, pipe_t);
+static pipe_t    memory_get(pipe_t);
+static int       memory_del(pipe_t);
+static long long memory_len(void);
+static int       memory_clr(void);
+static pipe_t    memory_catinfo(pipe_t);
+static int       memory_free(any_t, char *, any_t);
+
+static engine_t engines[] = {
+    { "memory",  0, memory_init, memory_put, memory_get, memory_del, memory_len, memory_clr, NULL, NULL, memory_catinfo },
+    { "bitcask", 1, cask_init, cask_put, cask_get, cask_del, cask_len, cask_clr, cask_compact, NULL, cask_catinfo },
+    { "mmap",    1, pmap_init, pmap_put, pmap_get, pmap_del, pmap_len, pmap_clr, pmap_compact, pmap_close, pmap_catinfo },
+    { "lsm",     1, lsm_init, lsm_put, lsm_get, lsm_del, lsm_len, lsm_clr, lsm_compact, lsm_close, lsm_catinfo },
+    { NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+engine_t *engine_find(const char *name)
+{
+    engine_t *engine;
+
+    for (engine = engines; engine->name != NULL; engine++)
+        if (!strcasecmp(engine->name, name)) return engine;
+
+    return NULL;
+}
+
+pipe_t engine_catinfo(pipe_t s)
+{
+    s = pipe_catprintf(s, "engine:%s\n", server.engine->name);
+    if (server.engine->catinfo) s = server.engine->catinfo(s);
+
+    return s;
+}
+
+/* The memory engine keeps the values themselves in the database map, as
+ * objects. It owns copies of the keys, so a command's own tokens can be
+ * freed once it is done. */
+static int memory_init(void)
+{
+    return HB_OK;
+}
+
+static int memory_put(pipe_t key, pipe_t value)
+{
+    return memory_store(key, object_string(value));
+}
+
+/* A value moved to the value log comes back to memory on its first read,
+ * a raw one is sent without being copied. */
+static pipe_t memory_get(pipe_t key)
+{
+    object_t *o;
+    pipe_t value = NULL;
+
+    if ((o = memory_lookup(key)) == NULL || o->type != HB_OBJ_STRING) return NULL;
+    if (o->encoding != HB_ENC_TIER) return o->encoding == HB_ENC_RAW ? object_reply(o) : object_value(o);
+
+    /* The promotion drops the lock, the reference keeps the object */
+    object_incr(o);
+    if (tier_promote(key, o) == HB_OK)
+        value = o->encoding == HB_ENC_RAW ? object_reply(o) : object_value(o);
+    object_decr(o);
+
+    return value;
+}
+
+static int memory_del(pipe_t key)
+{
+    char *k;
+    any_t o;
+
+    if (map_take(&database, key, &k, &o) == HB_ERR) return HB_OK;
+
+    sketch_forget(key, pipe_len(key));
+    pipe_free(k);
+    object_decr(o);
+
+    return HB_OK;
+}
+
+static long long memory_len(void)
+{
+    return map_length(&database);
+}
+
+static int memory_free(any_t item, char *key, any_t o)
+{
+    sketch_forget(key, pipe_len(key));
+    pipe_free(key);
+    object_decr(o);
+
+    return HB_OK;
+}
+
+static int memory_clr(void)
+{
+    map_iterate(&database, memory_free, NULL);
+    if (server.tier_after > 0) tier_reset();
+
+    return map_clear(&database) == HB_OK ? HB_OK : HB_ERR;
+}
+
+static pipe_t memory_catinfo(pipe_t s)
+{
+    s = object_catinfo(s);
+    if (server.compress_above > 0) s = lzf_catinfo(s);
+
+    return s;
+}
+
+object_t *memory_lookup(pipe_t key)
+{
+    any_t o;
+
+    if (map_get(&database, key, &o) == HB_ERR) return NULL;
+    ((object_t *) o)->lru = object_clock();
+    sketch_access(key, pipe_len(key), o);
+
+    return o;
+}
+
+int memory_store(pipe_t key, object_t *o)
+{
+    any_t old;
+    pipe_t k;
+
+    sketch_write(key, pipe_len(key), o);
+
+    if (map_swap(&database, key, o, &old) == HB_OK) {
+        object_decr(old);
+        return HB_OK;
+    }
+
+    k = pipe_dup(key);
+    if (map_put(&database, k, o) != HB_OK) {
+        pipe_free(k);
+        object_decr(o);
+        return HB_ERR;
+    }
+
+    return HB_OK;
+}
@@ -0,0 +1,61 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_ENGINE_H_
+#define _HB_ENGINE_H_
+
+/* A storage engine keeps the key/value data behind the commands. Keys and
+ * values are pipes, get returns a new pipe or NULL when the key is missing. */
+typedef struct _engine {
+    const char *name;
+    int       durable;                      /* Keeps its own data on disk */
+    int       (*init)(void);
+    int       (*put)(pipe_t, pipe_t);
+    pipe_t    (*get)(pipe_t);
+    int       (*del)(pipe_t);
+    long long (*len)(void);
+    int       (*clr)(void);
+    int       (*compact)(void);             /* NULL if there is nothing to compact */
+    void      (*close)(void);               /* NULL if nothing to do on shutdown, called with the lock */
+    pipe_t    (*catinfo)(pipe_t);
+} engine_t;
+
+/* Find an engine by name. Returns NULL for unknown names. */
+engine_t *engine_find(const char *);
+
+/* Append the engine section of the inf report. */
+pipe_t    engine_catinfo(pipe_t);
+
+/* The object of a key in the memory engine, NULL when it is missing. Must
+ * be called with the database lock held, counts as an access. */
+object_t *memory_lookup(pipe_t);
+
+/* Put an object under a key of the memory engine, taking over its
+ * reference. Return HB_OK or HB_ERR. */
+int       memory_store(pipe_t, object_t *);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * HASH                              Field and value hashes, packed while small.
+ *
+ * Version:                                     @(#)hash.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+/* What map_iterate() walks a map encoded hash with */
+typedef struct _hash_walk {
+    int (*f)(any_t, const char *, size_t);
+    any_t item;
+} hash_walk_t;
+
+static unsigned char *hash_packed_next(unsigned char *, unsigned char *, const char **, uint64_t *,
+                                       const char **, uint64_t *);
+static unsigned char *hash_packed_find(pipe_t, const char *, size_t, const char **, uint64_t *, unsigned char **);
+static pipe_t hash_packed_add(pipe_t, const char *, size_t, const char *, size_t);
+static void   hash_convert(object_t *);
+static int    hash_free_pair(any_t, char *, any_t);
+static int    hash_walk_pair(any_t, char *, any_t);
+static int    hash_catone(any_t, const char *, size_t);
+
+/* The pair at 'p', returns where the next one starts. */
+static unsigned char *hash_packed_next(unsigned char *p, unsigned char *end, const char **field, uint64_t *flen,
+                                       const char **value, uint64_t *vlen)
+{
+    p += util_varint_get(p, end, flen);
+    *field = (const char *) p;
+    p += *flen;
+    p += util_varint_get(p, end, vlen);
+    *value = (const char *) p;
+
+    return p + *vlen;
+}
+
+/* The pair of 'field' in a packed hash and where the one after it starts,
+ * NULL if the field is not there. */
+static unsigned char *hash_packed_find(pipe_t s, const char *field, size_t len, const char **value, uint64_t *vlen,
+                                       unsigned char **next)
+{
+    unsigned char *p = (unsigned char *) s, *end = p + pipe_len(s), *pair;
+    const char *f;
+    uint64_t flen;
+
+    while (p < end) {
+        pair = p;
+        p = hash_packed_next(p, end, &f, &flen, value, vlen);
+        if (flen == len && memcmp(f, field, len) == 0) {
+            *next = p;
+            return pair;
+        }
+    }
+
+    return NULL;
+}
+
+static pipe_t hash_packed_add(pipe_t s, const char *field, size_t flen, const char *value, size_t vlen)
+{
+    unsigned char head[HB_UTIL_VARINT];
+
+    s = pipe_catlen(s, head, util_varint_put(head, flen));
+    s = pipe_catlen(s, field, flen);
+    s = pipe_catlen(s, head, util_varint_put(head, vlen));
+
+    return pipe_catlen(s, value, vlen);
+}
+
+static void hash_convert(object_t *o)
+{
+    unsigned char *p = (unsigned char *) o->ptr, *end = p + pipe_len(o->ptr);
+    map_t *m = map_new();
+    const char *field, *value;
+    uint64_t flen, vlen;
+
+    while (p < end) {
+        p = hash_packed_next(p, end, &field, &flen, &value, &vlen);
+        map_put(m, pipe_newlen(field, flen), pipe_newlen(value, vlen));
+    }
+
+    pipe_free(o->ptr);
+    o->ptr = m;
+    o->encoding = HB_ENC_MAP;
+}
+
+object_t *hash_new(void)
+{
+    return object_new(HB_OBJ_HASH, HB_ENC_PACKED, pipe_empty());
+}
+
+static int hash_free_pair(any_t item, char *key, any_t data)
+{
+    pipe_free(key);
+    pipe_free(data);
+
+    return HB_OK;
+}
+
+void hash_free(map_t *m)
+{
+    map_iterate(m, hash_free_pair, NULL);
+    map_free(m);
+}
+
+int hash_set(object_t *o, const char *field, size_t flen, const char *value, size_t vlen)
+{
+    unsigned char *pair, *next;
+    const char *old;
+    uint64_t olen;
+    pipe_t key, replaced;
+
+    if (o->encoding == HB_ENC_PACKED) {
+        if ((pair = hash_packed_find(o->ptr, field, flen, &old, &olen, &next)) != NULL) {
+            /* Same length, overwritten where it is */
+            if (olen == vlen) {
+                memcpy((char *) old, value, vlen);
+                return 0;
+            }
+            memmove(pair, next, (unsigned char *) o->ptr + pipe_len(o->ptr) - next);
+            pipe_IncrLen(o->ptr, -(int) (next - pair));
+        }
+
+        if (flen <= HB_HASH_PACKED_VALUE && vlen <= HB_HASH_PACKED_VALUE &&
+            (pair != NULL || hash_length(o) < HB_HASH_PACKED_FIELDS)) {
+            o->ptr = hash_packed_add(o->ptr, field, flen, value, vlen);
+            return pair == NULL;
+        }
+        hash_convert(o);
+        if (pair != NULL) {
+            map_put(o->ptr, pipe_newlen(field, flen), pipe_newlen(value, vlen));
+            return 0;
+        }
+    }
+
+    key = pipe_newlen(field, flen);
+    if (map_swap(o->ptr, key, pipe_newlen(value, vlen), (any_t *) &replaced) == HB_OK) {
+        pipe_free(replaced);
+        pipe_free(key);
+        return 0;
+    }
+    map_put(o->ptr, key, pipe_newlen(value, vlen));
+
+    return 1;
+}
+
+pipe_t hash_get(object_t *o, pipe_t field)
+{
+    unsigned char *next;
+    const char *value;
+    uint64_t vlen;
+    any_t data;
+
+    if (o->encoding == HB_ENC_MAP)
+        return map_get(o->ptr, field, &data) == HB_OK ? pipe_dup(data) : NULL;
+
+    if (hash_packed_find(o->ptr, field, pipe_len(field), &value, &vlen, &next) == NULL) return NULL;
+
+    return pipe_newlen(value, vlen);
+}
+
+int hash_del(object_t *o, pipe_t field)
+{
+    unsigned char *pair, *next;
+    const char *value;
+    uint64_t vlen;
+    char *key;
+    any_t data;
+
+    if (o->encoding == HB_ENC_MAP) {
+        if (map_take(o->ptr, field, &key, &data) != HB_OK) return 0;
+        pipe_free(key);
+        pipe_free(data);
+        return 1;
+    }
+
+    if ((pair = hash_packed_find(o->ptr, field, pipe_len(field), &value, &vlen, &next)) == NULL) return 0;
+    memmove(pair, next, (unsigned char *) o->ptr + pipe_len(o->ptr) - next);
+    pipe_IncrLen(o->ptr, -(int) (next - pair));
+
+    return 1;
+}
+
+int hash_incrby(object_t *o, pipe_t field, long long incr, long long *result)
+{
+    pipe_t value = hash_get(o, field);
+    long long number = 0;
+    int ok = value == NULL || util_strtoll(value, pipe_len(value), &number);
+
+    pipe_free(value);
+    if (!ok || (incr > 0 && number > LLONG_MAX - incr) || (incr < 0 && number < LLONG_MIN - incr)) return HB_ERR;
+
+    *result = number + incr;
+    value = pipe_fromlonglong(*result);
+    hash_set(o, field, pipe_len(field), value, pipe_len(value));
+    pipe_free(value);
+
+    return HB_OK;
+}
+
+static int hash_walk_pair(any_t item, char *key, any_t data)
+{
+    hash_walk_t *w = item;
+    int status;
+
+    if ((status = w->f(w->item, key, pipe_len(key))) != HB_OK) return status;
+
+    return w->f(w->item, data, pipe_len(data));
+}
+
+int hash_iterate(object_t *o, int (*f)(any_t, const char *, size_t), any_t item)
+{
+    unsigned char *p, *end;
+    const char *field, *value;
+    uint64_t flen, vlen;
+    hash_walk_t w;
+    int status;
+
+    if (o->encoding == HB_ENC_MAP) {
+        if (map_length(o->ptr) == 0) return HB_OK;
+        w.f = f;
+        w.item = item;
+        return map_iterate(o->ptr, hash_walk_pair, &w);
+    }
+
+    for (p = (unsigned char *) o->ptr, end = p + pipe_len(o->ptr); p < end;) {
+        p = hash_packed_next(p, end, &field, &flen, &value, &vlen);
+        if ((status = f(item, field, flen)) != HB_OK || (status = f(item, value, vlen)) != HB_OK) return status;
+    }
+
+    return HB_OK;
+}
+
+static int hash_catone(any_t item, const char *p, size_t len)
+{
+    pipe_t *s = item;
+
+    if (pipe_len(*s) > 0) *s = pipe_catlen(*s, "\n", 1);
+    *s = pipe_catrepr(*s, p, len);
+
+    return HB_OK;
+}
+
+pipe_t hash_catall(pipe_t s, object_t *o)
+{
+    hash_iterate(o, hash_catone, &s);
+
+    return s;
+}
+
+long long hash_length(object_t *o)
+{
+    unsigned char *p, *end;
+    const char *field, *value;
+    uint64_t flen, vlen;
+    long long n = 0;
+
+    if (o->encoding == HB_ENC_MAP) return map_length(o->ptr);
+
+    for (p = (unsigned char *) o->ptr, end = p + pipe_len(o->ptr); p < end; n++)
+        p = hash_packed_next(p, end, &field, &flen, &value, &vlen);
+
+    return n;
+}
@@ -0,0 +1,67 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+
+#ifndef _HB_HASH_H_
+#define _HB_HASH_H_
+
+/* A small hash is one pipe of field and value pairs, each a varint length
+ * and the bytes, scanned linearly. Once it gets more than
+ * HB_HASH_PACKED_FIELDS fields or a field or value longer than
+ * HB_HASH_PACKED_VALUE bytes it becomes a map of field pipes to value
+ * pipes for good. Fields are map keys then, so they may not hold a NUL. */
+
+/* New empty hash object, in the packed encoding. */
+object_t *hash_new(void);
+
+/* Free a map encoded hash with its fields and values. */
+void      hash_free(map_t *);
+
+/* Set a field to a copy of a value. Returns 1 if the field is new, 0 if
+ * it was replaced. */
+int       hash_set(object_t *, const char *, size_t, const char *, size_t);
+
+/* The value of a field in a new pipe, NULL if there is no such field. */
+pipe_t    hash_get(object_t *, pipe_t);
+
+/* Remove a field, returns 1 if it was there. */
+int       hash_del(object_t *, pipe_t);
+
+/* Add to the number a field holds, a missing one is 0. HB_ERR if the
+ * value is not a number or the result would overflow. */
+int       hash_incrby(object_t *, pipe_t, long long, long long *);
+
+/* Call 'f' with each field and then its value until it does not return
+ * HB_OK. */
+int       hash_iterate(object_t *, int (*)(any_t, const char *, size_t), any_t);
+
+/* Append all fields and values to 's', one quoted per line. */
+pipe_t    hash_catall(pipe_t, object_t *);
+
+long long hash_length(object_t *);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * HLL                        HyperLogLog cardinality estimates kept in strings.
+ *
+ * Version:                                      @(#)hll.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <hb_core.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern struct server server;
+
+static int      hll_hash(const char *, size_t, int *);
+static int      hll_get(const unsigned char *, int);
+static void     hll_set(unsigned char *, int, int);
+static void     hll_unpack(unsigned char *, const unsigned char *);
+static void     hll_pack(unsigned char *, const unsigned char *);
+static void     hll_max(unsigned char *, const unsigned char *, size_t);
+static void     hll_todense(pipe_t *);
+static double   hll_sigma(double);
+static double   hll_tau(double);
+static uint64_t hll_histogram_estimate(const int *);
+
+/* The low bits of the hash pick the register, the rest give the rank:
+ * one more than the trailing zeros. The hash needs all 64 bits for the
+ * ranks to reach HB_HLL_Q. */
+static int hll_hash(const char *p, size_t len, int *rank)
+{
+    uint64_t h = util_hash64(p, len, 0xadc83b19ULL);
+
+    *rank = __builtin_ctzll((h >> HB_HLL_P) | 1ULL << HB_HLL_Q) + 1;
+
+    return h & (HB_HLL_REGISTERS - 1);
+}
+
+/* Registers are 6 bits, lowest first. The pipe is NUL terminated, so the
+ * byte after the last register can always be read. Any string may claim
+ * to be dense, values past the highest rank are cut. */
+static int hll_get(const unsigned char *r, int i)
+{
+    int byte = i * 6 / 8, bit = i * 6 & 7;
+
+    return MIN((r[byte] >> bit | r[byte + 1] << (8 - bit)) & 63, HB_HLL_Q + 1);
+}
+
+static void hll_set(unsigned char *r, int i, int v)
+{
+    int byte = i * 6 / 8, bit = i * 6 & 7;
+
+    r[byte] &= ~(63 << bit);
+    r[byte] |= v << bit;
+    r[byte + 1] &= ~(63 >> (8 - bit));
+    r[byte + 1] |= v >> (8 - bit);
+}
+
+/* Four registers to three bytes and back */
+static void hll_unpack(unsigned char *out, const unsigned char *r)
+{
+    int i;
+
+    for (i = 0; i < HB_HLL_REGISTERS; i += 4, r += 3) {
+        out[i] = r[0] & 63;
+        out[i + 1] = (r[0] >> 6 | r[1] << 2) & 63;
+        out[i + 2] = (r[1] >> 4 | r[2] << 4) & 63;
+        out[i + 3] = r[2] >> 2;
+    }
+}
+
+static void hll_pack(unsigned char *r, const unsigned char *in)
+{
+    int i;
+
+    for (i = 0; i < HB_HLL_REGISTERS; i += 4, r += 3) {
+        r[0] = in[i] | in[i + 1] << 6;
+        r[1] = in[i + 1] >> 2 | in[i + 2] << 4;
+        r[2] = in[i + 2] >> 4 | in[i + 3] << 2;
+    }
+}
+
+/* Sixteen registers at a time with SSE2, which every x86-64 has */
+static void hll_max(unsigned char *max, const unsigned char *r, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i *) (max + i), _mm_max_epu8(_mm_loadu_si128((const __m128i *) (max + i)),
+                                                             _mm_loadu_si128((const __m128i *) (r + i))));
+#endif
+    for (; i < n; i++)
+        if (r[i] > max[i]) max[i] = r[i];
+}
+
+pipe_t hll_new(void)
+{
+    pipe_t s = pipe_growzero(pipe_empty(), sizeof(hll_header_t));
+
+    memcpy(s, "HYLL", 4);
+
+    return s;
+}
+
+/* Sparse entries are indexes into arrays, so they are all checked */
+int hll_check(pipe_t s)
+{
+    hll_header_t *h = (hll_header_t *) s;
+    uint32_t *entries = (uint32_t *) (h + 1);
+    size_t n, i;
+
+    if (pipe_len(s) < sizeof(hll_header_t) || memcmp(h->magic, "HYLL", 4) != 0) return HB_ERR;
+    if (h->encoding == HB_HLL_DENSE) return pipe_len(s) == sizeof(hll_header_t) + HB_HLL_DENSE_SIZE ? HB_OK : HB_ERR;
+    if (h->encoding != HB_HLL_SPARSE || (pipe_len(s) - sizeof(hll_header_t)) % 4 != 0) return HB_ERR;
+
+    n = (pipe_len(s) - sizeof(hll_header_t)) / 4;
+    for (i = 0; i < n; i++)
+        if (entries[i] >> 8 >= HB_HLL_REGISTERS || (entries[i] & 0xff) == 0 || (entries[i] & 0xff) > HB_HLL_Q + 1 ||
+            (i > 0 && entries[i] >> 8 <= entries[i - 1] >> 8))
+            return HB_ERR;
+
+    return HB_OK;
+}
+
+static void hll_todense(pipe_t *s)
+{
+    hll_header_t *h = (hll_header_t *) *s;
+    uint32_t *entries = (uint32_t *) (h + 1);
+    size_t n = (pipe_len(*s) - sizeof(hll_header_t)) / 4, i;
+    pipe_t dense = pipe_growzero(pipe_empty(), sizeof(hll_header_t) + HB_HLL_DENSE_SIZE);
+    hll_header_t *d = (hll_header_t *) dense;
+
+    memcpy(d->magic, "HYLL", 4);
+    d->encoding = HB_HLL_DENSE;
+    d->card = h->card;
+    d->histogram[0] = HB_HLL_REGISTERS - n;
+    for (i = 0; i < n; i++) {
+        hll_set((unsigned char *) (d + 1), entries[i] >> 8, entries[i] & 0xff);
+        d->histogram[entries[i] & 0xff]++;
+    }
+
+    pipe_free(*s);
+    *s = dense;
+}
+
+int hll_add(pipe_t *s, const char *p, size_t len)
+{
+    hll_header_t *h = (hll_header_t *) *s;
+    int rank, index = hll_hash(p, len, &rank), old;
+    size_t n, lo, hi, mid;
+    uint32_t *entries;
+
+    if (h->encoding == HB_HLL_DENSE) {
+        if ((old = hll_get((unsigned char *) (h + 1), index)) >= rank) return 0;
+        hll_set((unsigned char *) (h + 1), index, rank);
+        h->histogram[old]--;
+        h->histogram[rank]++;
+        h->card |= HB_HLL_STALE;
+        return 1;
+    }
+
+    entries = (uint32_t *) (h + 1);
+    n = (pipe_len(*s) - sizeof(hll_header_t)) / 4;
+    for (lo = 0, hi = n; lo < hi;) {
+        mid = (lo + hi) / 2;
+        if ((int) (entries[mid] >> 8) < index) lo = mid + 1;
+        else hi = mid;
+    }
+
+    if (lo < n && (int) (entries[lo] >> 8) == index) {
+        if ((int) (entries[lo] & 0xff) >= rank) return 0;
+        entries[lo] = index << 8 | rank;
+    } else {
+        if ((n + 1) * 4 > HB_HLL_SPARSE_MAX) {
+            hll_todense(s);
+            return hll_add(s, p, len);
+        }
+        *s = pipe_MakeRoomFor(*s, 4);
+        h = (hll_header_t *) *s;
+        entries = (uint32_t *) (h + 1);
+        memmove(entries + lo + 1, entries + lo, (n - lo) * 4);
+        entries[lo] = index << 8 | rank;
+        pipe_IncrLen(*s, 4);
+    }
+    h->card |= HB_HLL_STALE;
+
+    return 1;
+}
+
+static double hll_sigma(double x)
+{
+    double y = 1, z = x, last;
+
+    if (x == 1.) return INFINITY;
+    do {
+        x *= x;
+        last = z;
+        z += x * y;
+        y += y;
+    } while (z != last);
+
+    return z;
+}
+
+static double hll_tau(double x)
+{
+    double y = 1, z = 1 - x, last;
+
+    if (x == 0. || x == 1.) return 0.;
+    do {
+        x = sqrt(x);
+        last = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (z != last);
+
+    return z / 3;
+}
+
+/* Ertl's estimator, from how many registers hold each value: no bias
+ * correction tables and good from the smallest counts on. */
+static uint64_t hll_histogram_estimate(const int *histogram)
+{
+    double m = HB_HLL_REGISTERS, z = m * hll_tau((m - histogram[HB_HLL_Q + 1]) / m);
+    int k;
+
+    for (k = HB_HLL_Q; k >= 1; k--) {
+        z += histogram[k];
+        z *= 0.5;
+    }
+    z += m * hll_sigma(histogram[0] / m);
+
+    return llround(0.5 / log(2) * m * m / z);
+}
+
+uint64_t hll_count(pipe_t s, int cache)
+{
+    hll_header_t *h = (hll_header_t *) s;
+    int histogram[HB_HLL_Q + 2] = { 0 }, i, n;
+    uint32_t *entries = (uint32_t *) (h + 1);
+    uint64_t card;
+
+    if (!(h->card & HB_HLL_STALE)) return h->card;
+
+    if (h->encoding == HB_HLL_DENSE) {
+        for (i = 0; i < HB_HLL_Q + 2; i++) histogram[i] = h->histogram[i];
+    } else {
+        n = (pipe_len(s) - sizeof(hll_header_t)) / 4;
+        histogram[0] = HB_HLL_REGISTERS - n;
+        for (i = 0; i < n; i++) histogram[entries[i] & 0xff]++;
+    }
+
+    card = hll_histogram_estimate(histogram);
+    if (cache) h->card = card;
+
+    return card;
+}
+
+void hll_merge(unsigned char *max, pipe_t s)
+{
+    hll_header_t *h = (hll_header_t *) s;
+    uint32_t *entries = (uint32_t *) (h + 1);
+    unsigned char r[HB_HLL_REGISTERS];
+    size_t n, i;
+
+    if (h->encoding == HB_HLL_DENSE) {
+        hll_unpack(r, (unsigned char *) (h + 1));
+        hll_max(max, r, HB_HLL_REGISTERS);
+        return;
+    }
+
+    n = (pipe_len(s) - sizeof(hll_header_t)) / 4;
+    for (i = 0; i < n; i++)
+        if ((entries[i] & 0xff) > max[entries[i] >> 8]) max[entries[i] >> 8] = entries[i] & 0xff;
+}
+
+uint64_t hll_estimate(const unsigned char *max)
+{
+    int histogram[HB_HLL_Q + 2] = { 0 }, i;
+
+    for (i = 0; i < HB_HLL_REGISTERS; i++) histogram[MIN(max[i], HB_HLL_Q + 1)]++;
+
+    return hll_histogram_estimate(histogram);
+}
+
+pipe_t hll_dense(const unsigned char *max)
+{
+    pipe_t s = pipe_growzero(pipe_empty(), sizeof(hll_header_t) + HB_HLL_DENSE_SIZE);
+    hll_header_t *h = (hll_header_t *) s;
+    int i;
+
+    memcpy(h->magic, "HYLL", 4);
+    h->encoding = HB_HLL_DENSE;
+    h->card = HB_HLL_STALE;
+    for (i = 0; i < HB_HLL_REGISTERS; i++) h->histogram[MIN(max[i], HB_HLL_Q + 1)]++;
+    hll_pack((unsigned char *) (h + 1), max);
+
+    return s;
+}
@@ -0,0 +1,77 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+
+#ifndef _HB_HLL_H_
+#define _HB_HLL_H_
+
+/* A HyperLogLog is a string: a header and either a sparse list of the
+ * registers that are set, 4 bytes each (index << 8 | value, by index),
+ * or all 16384 registers at 6 bits each, 12 KB. The sparse form becomes
+ * dense once it is past HB_HLL_SPARSE_MAX bytes. The header caches the
+ * last estimate and, when dense, how many registers hold each value, so
+ * a count after adds does not walk the registers. Elements are hashed
+ * with MurmurHash64A. */
+#define HB_HLL_P            14
+#define HB_HLL_REGISTERS    (1 << HB_HLL_P)
+#define HB_HLL_Q            (64 - HB_HLL_P)
+#define HB_HLL_DENSE_SIZE   (HB_HLL_REGISTERS * 6 / 8)
+#define HB_HLL_SPARSE       0
+#define HB_HLL_DENSE        1
+#define HB_HLL_STALE        (1ULL << 63)
+
+typedef struct _hll_header {
+    char      magic[4];                     /* "HYLL" */
+    uint8_t   encoding;
+    uint8_t   unused[3];
+    uint64_t  card;                         /* Last estimate or HB_HLL_STALE */
+    uint16_t  histogram[HB_HLL_Q + 2];      /* Dense only, registers per value */
+} hll_header_t;
+
+/* An empty, sparse HyperLogLog. */
+pipe_t    hll_new(void);
+
+/* HB_OK if a string is a HyperLogLog. */
+int       hll_check(pipe_t);
+
+/* Add an element, the string may be converted and move. Returns 1 if a
+ * register changed. */
+int       hll_add(pipe_t *, const char *, size_t);
+
+/* The estimate, kept in the header if 'cache' is set. */
+uint64_t  hll_count(pipe_t, int);
+
+/* Raise 'max', one byte a register, to the registers of a HyperLogLog. */
+void      hll_merge(unsigned char *, pipe_t);
+
+/* The estimate of registers one byte each. */
+uint64_t  hll_estimate(const unsigned char *);
+
+/* A dense HyperLogLog of registers one byte each. */
+pipe_t    hll_dense(const unsigned char *);
+
+#endif
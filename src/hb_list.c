@@ -0,0 +1,293 @@
+/*
+ * LIST                                      Lists of packed chunks of elements.
+ *
+ * Version:                                     @(#)list.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+static int          list_backlen_put(unsigned char *, uint64_t);
+static int          list_backlen_get(const unsigned char *, uint64_t *);
+static int          list_backlen_len(uint64_t);
+static size_t       list_entry_put(unsigned char *, const char *, size_t);
+static unsigned char *list_entry_get(list_node_t *, unsigned char *, const char **, uint64_t *);
+static list_node_t *list_node_add(list_t *, int);
+static list_node_t *list_node_grow(list_t *, list_node_t *, size_t);
+static void         list_node_del(list_t *, list_node_t *);
+static list_node_t *list_seek(list_t *, long long, long long *);
+
+/* The length of an element's header and bytes, written so that it is read
+ * backwards from its last byte: seven bits a byte, the lowest last, the
+ * top bit set while more bytes come before. */
+static int list_backlen_put(unsigned char *p, uint64_t v)
+{
+    int n = list_backlen_len(v), i;
+
+    for (i = n - 1; i >= 0; i--, v >>= 7)
+        p[i] = (v & 0x7f) | (i != 0 ? 0x80 : 0);
+
+    return n;
+}
+
+static int list_backlen_get(const unsigned char *end, uint64_t *v)
+{
+    int n = 0;
+
+    *v = 0;
+    do {
+        end--;
+        *v |= (uint64_t) (*end & 0x7f) << (7 * n++);
+    } while (*end & 0x80);
+
+    return n;
+}
+
+static int list_backlen_len(uint64_t v)
+{
+    int n = 1;
+
+    while (v >>= 7) n++;
+
+    return n;
+}
+
+/* Write an element at 'p' and return its size, only the size if 'p' is
+ * NULL. */
+static size_t list_entry_put(unsigned char *p, const char *value, size_t len)
+{
+    unsigned char head[HB_UTIL_VARINT];
+    int n = util_varint_put(head, len);
+    int b = list_backlen_len(n + len);
+
+    if (p != NULL) {
+        memcpy(p, head, n);
+        memcpy(p + n, value, len);
+        list_backlen_put(p + n + len, n + len);
+    }
+
+    return n + len + b;
+}
+
+/* The element at 'p', returns where the next one starts. */
+static unsigned char *list_entry_get(list_node_t *node, unsigned char *p, const char **value, uint64_t *len)
+{
+    int n = util_varint_get(p, node->data + node->len, len);
+
+    *value = (const char *) p + n;
+
+    return p + n + *len + list_backlen_len(n + *len);
+}
+
+static list_node_t *list_node_add(list_t *l, int where)
+{
+    list_node_t *node = calloc(1, sizeof(list_node_t));
+
+    if (where == HB_LIST_HEAD) {
+        node->next = l->head;
+        if (l->head) l->head->prev = node;
+        else l->tail = node;
+        l->head = node;
+    } else {
+        node->prev = l->tail;
+        if (l->tail) l->tail->next = node;
+        else l->head = node;
+        l->tail = node;
+    }
+    l->nodes++;
+
+    return node;
+}
+
+/* Make room for 'need' more bytes, doubling up to a chunk. The node may
+ * move, its neighbours are pointed at the new place. */
+static list_node_t *list_node_grow(list_t *l, list_node_t *node, size_t need)
+{
+    size_t size;
+
+    if (node->len + need <= node->size) return node;
+
+    size = MAX(node->len + need, MIN(node->size * 2, HB_LIST_CHUNK));
+    node = realloc(node, sizeof(list_node_t) + size);
+    node->size = size;
+
+    if (node->prev) node->prev->next = node;
+    else l->head = node;
+    if (node->next) node->next->prev = node;
+    else l->tail = node;
+
+    return node;
+}
+
+static void list_node_del(list_t *l, list_node_t *node)
+{
+    if (node->prev) node->prev->next = node->next;
+    else l->head = node->next;
+    if (node->next) node->next->prev = node->prev;
+    else l->tail = node->prev;
+
+    l->nodes--;
+    free(node);
+}
+
+/* The node holding the element at 'index', walked to from the nearer
+ * end, and the index of the element within it. */
+static list_node_t *list_seek(list_t *l, long long index, long long *at)
+{
+    list_node_t *node;
+
+    if (index < l->count / 2) {
+        for (node = l->head; index >= node->count; node = node->next)
+            index -= node->count;
+    } else {
+        for (index = l->count - 1 - index, node = l->tail; index >= node->count; node = node->prev)
+            index -= node->count;
+        index = node->count - 1 - index;
+    }
+    *at = index;
+
+    return node;
+}
+
+list_t *list_new(void)
+{
+    return calloc(1, sizeof(list_t));
+}
+
+void list_free(list_t *l)
+{
+    list_node_t *node, *next;
+
+    for (node = l->head; node != NULL; node = next) {
+        next = node->next;
+        free(node);
+    }
+    free(l);
+}
+
+void list_push(list_t *l, const char *value, size_t len, int where)
+{
+    list_node_t *node = where == HB_LIST_HEAD ? l->head : l->tail;
+    size_t size = list_entry_put(NULL, value, len);
+
+    if (node == NULL || node->len + size > HB_LIST_CHUNK) node = list_node_add(l, where);
+    node = list_node_grow(l, node, size);
+
+    if (where == HB_LIST_HEAD) {
+        memmove(node->data + size, node->data, node->len);
+        list_entry_put(node->data, value, len);
+    } else {
+        list_entry_put(node->data + node->len, value, len);
+    }
+
+    node->len += size;
+    node->count++;
+    l->count++;
+}
+
+pipe_t list_pop(list_t *l, int where)
+{
+    list_node_t *node = where == HB_LIST_HEAD ? l->head : l->tail;
+    unsigned char *p, *next;
+    const char *value;
+    uint64_t len;
+    pipe_t s;
+
+    if (node == NULL) return NULL;
+
+    if (where == HB_LIST_HEAD) {
+        p = node->data;
+    } else {
+        int b = list_backlen_get(node->data + node->len, &len);
+        p = node->data + node->len - b - len;
+    }
+    next = list_entry_get(node, p, &value, &len);
+    s = pipe_newlen(value, len);
+
+    memmove(p, next, node->data + node->len - next);
+    node->len -= next - p;
+    node->count--;
+    l->count--;
+
+    if (node->count == 0) list_node_del(l, node);
+
+    return s;
+}
+
+pipe_t list_index(list_t *l, long long index)
+{
+    list_node_t *node;
+    unsigned char *p;
+    const char *value;
+    uint64_t len;
+    long long at;
+
+    if (index < 0) index += l->count;
+    if (index < 0 || index >= l->count) return NULL;
+
+    node = list_seek(l, index, &at);
+    p = node->data;
+    do p = list_entry_get(node, p, &value, &len); while (at-- > 0);
+
+    return pipe_newlen(value, len);
+}
+
+pipe_t list_catrange(pipe_t s, list_t *l, long long start, long long stop)
+{
+    list_node_t *node;
+    unsigned char *p;
+    const char *value;
+    uint64_t len;
+    long long at, n;
+
+    if (start < 0) start += l->count;
+    if (stop < 0) stop += l->count;
+    if (start < 0) start = 0;
+    if (stop >= l->count) stop = l->count - 1;
+    if (start > stop) return s;
+
+    /* Straight through the packed nodes from the first element on */
+    node = list_seek(l, start, &at);
+    for (p = node->data; at-- > 0; p = list_entry_get(node, p, &value, &len));
+
+    for (n = stop - start + 1; n > 0; n--) {
+        if (p == node->data + node->len) {
+            node = node->next;
+            p = node->data;
+        }
+        p = list_entry_get(node, p, &value, &len);
+        s = pipe_catrepr(s, value, len);
+        if (n > 1) s = pipe_catlen(s, "\n", 1);
+    }
+
+    return s;
+}
+
+int list_iterate(list_t *l, int (*f)(any_t, const char *, size_t), any_t item)
+{
+    list_node_t *node;
+    unsigned char *p;
+    const char *value;
+    uint64_t len;
+    int status;
+
+    for (node = l->head; node != NULL; node = node->next) {
+        for (p = node->data; p < node->data + node->len; ) {
+            p = list_entry_get(node, p, &value, &len);
+            if ((status = f(item, value, len)) != HB_OK) return status;
+        }
+    }
+
+    return HB_OK;
+}
+
+long long list_length(list_t *l)
+{
+    return l->count;
+}
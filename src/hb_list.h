@@ -0,0 +1,78 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_LIST_H_
+#define _HB_LIST_H_
+
+/* A list is a doubly linked list of nodes that each pack many elements
+ * into one block of at most HB_LIST_CHUNK bytes (one element may exceed
+ * it and gets a node of its own). An element is its varint length, the
+ * bytes and the length of both once more, stored backwards, so a node is
+ * walked from either end without pointers of its own. */
+#define HB_LIST_HEAD        0
+#define HB_LIST_TAIL        1
+
+typedef struct _list_node {
+    struct _list_node *prev;
+    struct _list_node *next;
+    uint32_t  count;                        /* Elements in the node */
+    uint32_t  len;                          /* Bytes used */
+    uint32_t  size;                         /* Bytes allocated */
+    unsigned char data[];
+} list_node_t;
+
+typedef struct _list {
+    list_node_t *head;
+    list_node_t *tail;
+    long long count;
+    long long nodes;
+} list_t;
+
+list_t   *list_new(void);
+void      list_free(list_t *);
+
+/* Add a copy of an element at one end. */
+void      list_push(list_t *, const char *, size_t, int);
+
+/* Remove the element at one end and return it in a new pipe, NULL if
+ * the list is empty. */
+pipe_t    list_pop(list_t *, int);
+
+/* The element at an index, negative ones count from the tail. */
+pipe_t    list_index(list_t *, long long);
+
+/* Append the elements from 'start' to 'stop' (both included, negative
+ * ones count from the tail) to 's', one quoted element per line. */
+pipe_t    list_catrange(pipe_t, list_t *, long long, long long);
+
+/* Call 'f' with each element from head to tail until it does not return
+ * HB_OK. */
+int       list_iterate(list_t *, int (*)(any_t, const char *, size_t), any_t);
+
+long long list_length(list_t *);
+
+#endif
@@ -0,0 +1,1352 @@
+/*
+ * LSM                  Log-structured merge tree engine with leveled compaction.
+ *
+ * Version:                                      @(#)lsm.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+#define LSM_MISSING 0
+#define LSM_FOUND   1
+#define LSM_DELETED 2
+
+/* Memtable entry, the map value of every key. A NULL value is a delete. */
+typedef struct _lsm_entry {
+    pipe_t key;
+    pipe_t value;
+} lsm_entry_t;
+
+typedef struct _lsm_block {
+    pipe_t last;
+    uint64_t offset;
+    uint32_t len;                           /* Without the crc */
+} lsm_block_t;
+
+typedef struct _lsm_table {
+    uint32_t id;
+    int fd;
+    uint64_t size;
+    uint64_t entries;
+    uint64_t tombstones;
+    pipe_t first;
+    lsm_block_t *blocks;
+    uint32_t nblocks;
+    pipe_t bloom;
+    uint32_t probes;
+} lsm_table_t;
+
+typedef struct _lsm_level {
+    lsm_table_t **tables;                   /* Level 0 by age, others by key */
+    int count;
+    uint64_t size;
+} lsm_level_t;
+
+typedef struct _lsm_writer {
+    uint32_t id;
+    int fd;
+    uint64_t offset;
+    pipe_t block;
+    pipe_t index;
+    pipe_t hashes;                          /* One uint32_t per key, for the bloom */
+    pipe_t last;
+    uint64_t entries;
+    uint64_t tombstones;
+    int failed;
+} lsm_writer_t;
+
+/* Reads a table block by block during a merge. */
+typedef struct _lsm_iter {
+    lsm_table_t *table;
+    uint32_t block;
+    unsigned char *buf;
+    size_t len;
+    size_t pos;
+    const unsigned char *key;
+    uint64_t klen;
+    const unsigned char *value;
+    uint64_t vlen;
+    int deleted;
+    int valid;
+    int failed;
+} lsm_iter_t;
+
+/* Live keys seen by lsm_count. */
+typedef struct _lsm_count {
+    map_t *newer;
+    long long keys;
+} lsm_count_t;
+
+/* A flush when there are no inputs, a merge into 'level' otherwise. */
+typedef struct _lsm_job {
+    int level;
+    int drop;                               /* Nothing older below, deletes can go */
+    lsm_table_t **inputs;                   /* Newest first */
+    int ninputs;
+    lsm_table_t **outputs;
+    int noutputs;
+} lsm_job_t;
+
+/* All of this is protected by the database lock. The background thread
+ * reads the immutable memtable and its input tables without it, 'busy'
+ * keeps clr from freeing them under its feet. */
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static lsm_level_t levels[HB_LSM_LEVELS];
+static pipe_t cursor[HB_LSM_LEVELS];        /* Where the next merge of a level starts */
+static map_t *mem;
+static map_t *imm;
+static uint64_t mem_bytes;
+static uint32_t imm_log;
+static uint32_t next_id;
+static uint32_t log_id;
+static int log_fd = HB_ERR;
+static uint64_t log_size;
+static pipe_t record;
+static int busy;
+static int compact_wanted;
+static uint64_t flushes;
+static uint64_t merges;
+static uint64_t merge_read;
+static uint64_t written;
+static uint64_t stalls;
+static uint64_t gets;
+static uint64_t block_reads;
+static uint64_t bloom_skips;
+
+static void     lsm_name(char *, uint32_t, const char *);
+static int      lsm_cmp(const void *, size_t, const void *, size_t);
+static int      lsm_order(const void *, const void *);
+static uint32_t lsm_id(void);
+static int      lsm_log_open(void);
+static int      lsm_log_replay(uint32_t);
+static void     lsm_apply(map_t *, const char *, size_t, const char *, size_t);
+static int      lsm_collect(any_t, char *, any_t);
+static int      lsm_release(any_t, char *, any_t);
+static int      lsm_count(any_t, char *, any_t);
+static void     lsm_mem_free(map_t *);
+static void     lsm_rotate(void);
+static int      lsm_manifest(void);
+static int      lsm_manifest_load(void);
+static void     lsm_table_free(lsm_table_t *, int);
+static lsm_table_t *lsm_table_open(uint32_t);
+static int      lsm_table_get(lsm_table_t *, const char *, size_t, uint32_t, pipe_t *);
+static int      lsm_tables_get(pipe_t, pipe_t *);
+static unsigned char *lsm_block_read(lsm_table_t *, uint32_t);
+static void     lsm_level_add(int, lsm_table_t *);
+static void     lsm_level_remove(int, lsm_table_t *);
+static int      lsm_writer_open(lsm_writer_t *);
+static void     lsm_writer_add(lsm_writer_t *, const void *, size_t, const void *, size_t, int);
+static void     lsm_writer_block(lsm_writer_t *);
+static lsm_table_t *lsm_writer_finish(lsm_writer_t *);
+static void     lsm_iter_next(lsm_iter_t *);
+static int      lsm_flush(map_t *, lsm_job_t *);
+static int      lsm_merge(lsm_job_t *);
+static int      lsm_pick(lsm_job_t *);
+static void     lsm_install(lsm_job_t *);
+static void    *lsm_loop(void *);
+
+static void lsm_name(char *path, uint32_t id, const char *ext)
+{
+    snprintf(path, PATH_MAX, "%s/%09u.%s", server.dir, id, ext);
+}
+
+static int lsm_cmp(const void *a, size_t alen, const void *b, size_t blen)
+{
+    int c = memcmp(a, b, MIN(alen, blen));
+
+    return c ? c : (alen > blen) - (alen < blen);
+}
+
+static int lsm_order(const void *a, const void *b)
+{
+    const lsm_entry_t *x = *(lsm_entry_t **) a, *y = *(lsm_entry_t **) b;
+
+    return lsm_cmp(x->key, pipe_len(x->key), y->key, pipe_len(y->key));
+}
+
+/* Ids of logs and tables come from one sequence, the thread takes them
+ * without the lock. */
+static uint32_t lsm_id(void)
+{
+    return __sync_fetch_and_add(&next_id, 1);
+}
+
+static int lsm_log_open(void)
+{
+    char path[PATH_MAX];
+
+    log_id = lsm_id();
+    lsm_name(path, log_id, "log");
+    if ((log_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not open log [%s]: %s\n", HB_LOG_ERR, path, strerror(errno));
+        return HB_ERR;
+    }
+    log_size = 0;
+
+    return HB_OK;
+}
+
+/* Replay a log into the memtable up to the first torn record. */
+static int lsm_log_replay(uint32_t id)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    unsigned char *data, *p;
+    uint64_t left;
+    uint32_t klen, vlen;
+    int fd;
+
+    lsm_name(path, id, "log");
+    if ((fd = open(path, O_RDONLY)) == HB_ERR || fstat(fd, &st) == HB_ERR) return HB_ERR;
+    if ((data = malloc(st.st_size + 1)) == NULL ||
+        pread(fd, data, st.st_size, 0) != st.st_size) {
+        free(data);
+        close(fd);
+        return HB_ERR;
+    }
+    close(fd);
+
+    for (p = data, left = st.st_size; left >= HB_LSM_LOG_HEADER; ) {
+        uint64_t size;
+
+        klen = util_get32(p + 4);
+        vlen = util_get32(p + 8);
+        size = HB_LSM_LOG_HEADER + (uint64_t) klen + (vlen == HB_LSM_TOMBSTONE ? 0 : vlen);
+        if (size > left || util_crc32(0, p + 4, size - 4) != util_get32(p)) break;
+
+        lsm_apply(mem, (char *) p + HB_LSM_LOG_HEADER, klen,
+                  vlen == HB_LSM_TOMBSTONE ? NULL : (char *) p + HB_LSM_LOG_HEADER + klen, vlen);
+        p += size;
+        left -= size;
+    }
+
+    if (left)
+        fprintf(stdout, "hb: %s ignoring %" PRIu64 " torn bytes at the end of [%s]\n", HB_LOG_WRN, left, path);
+
+    free(data);
+
+    return HB_OK;
+}
+
+/* Set or delete a key in a memtable. */
+static void lsm_apply(map_t *m, const char *key, size_t klen, const char *value, size_t vlen)
+{
+    lsm_entry_t *e;
+    pipe_t k = pipe_newlen(key, klen);
+
+    if (map_get(m, k, (void **) &e) == HB_OK) {
+        pipe_free(k);
+        if (e->value) {
+            mem_bytes -= pipe_len(e->value);
+            pipe_free(e->value);
+        }
+    } else {
+        e = malloc(sizeof(lsm_entry_t));
+        e->key = k;
+        map_put(m, e->key, e);
+        mem_bytes += sizeof(lsm_entry_t) + klen;
+    }
+
+    if (value) {
+        e->value = pipe_newlen(value, vlen);
+        mem_bytes += vlen;
+    } else {
+        e->value = NULL;
+    }
+}
+
+static int lsm_collect(any_t item, char *key, any_t data)
+{
+    pipe_t *entries = item;
+
+    *entries = pipe_catlen(*entries, &data, sizeof(data));
+
+    return HB_OK;
+}
+
+static int lsm_release(any_t item, char *key, any_t data)
+{
+    lsm_entry_t *e = data;
+
+    pipe_free(e->key);
+    if (e->value) pipe_free(e->value);
+    free(e);
+
+    return HB_OK;
+}
+
+static void lsm_mem_free(map_t *m)
+{
+    map_iterate(m, lsm_release, NULL);
+    map_free(m);
+}
+
+/* The memtable becomes immutable and is handed to the background thread
+ * together with its log. */
+static void lsm_rotate(void)
+{
+    imm = mem;
+    imm_log = log_id;
+    close(log_fd);
+
+    mem = map_new();
+    mem_bytes = 0;
+    if (lsm_log_open() == HB_ERR) log_fd = HB_ERR;
+
+    pthread_cond_signal(&work);
+}
+
+/* Rewrite the manifest, tables that are not listed are not part of the
+ * tree even if their file exists. */
+static int lsm_manifest(void)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    FILE *f;
+    int level, i, status;
+
+    snprintf(path, PATH_MAX, "%s/MANIFEST", server.dir);
+    snprintf(tmp, PATH_MAX, "%s/MANIFEST.tmp", server.dir);
+    if ((f = fopen(tmp, "w")) == NULL) return HB_ERR;
+
+    fprintf(f, "hashbase-lsm 1\nnext %u\n", next_id);
+    for (level = 0; level < HB_LSM_LEVELS; level++)
+        for (i = 0; i < levels[level].count; i++)
+            fprintf(f, "%d %u\n", level, levels[level].tables[i]->id);
+
+    status = fflush(f) == 0 && fsync(fileno(f)) == 0 ? HB_OK : HB_ERR;
+    if (fclose(f) != 0) status = HB_ERR;
+    if (status == HB_OK && rename(tmp, path) == HB_ERR) status = HB_ERR;
+    if (status == HB_ERR)
+        fprintf(stdout, "hb: %s could not write manifest [%s]: %s\n", HB_LOG_ERR, path, strerror(errno));
+
+    return status;
+}
+
+static int lsm_manifest_load(void)
+{
+    char path[PATH_MAX];
+    lsm_table_t *t;
+    FILE *f;
+    uint32_t id;
+    int level, version;
+
+    snprintf(path, PATH_MAX, "%s/MANIFEST", server.dir);
+    if ((f = fopen(path, "r")) == NULL) return errno == ENOENT ? HB_OK : HB_ERR;
+
+    if (fscanf(f, "hashbase-lsm %d next %u", &version, &next_id) != 2 || version != 1) {
+        fprintf(stdout, "hb: %s manifest is corrupt [%s]\n", HB_LOG_ERR, path);
+        fclose(f);
+        return HB_ERR;
+    }
+
+    while (fscanf(f, "%d %u", &level, &id) == 2) {
+        if (level < 0 || level >= HB_LSM_LEVELS || (t = lsm_table_open(id)) == NULL) {
+            fclose(f);
+            return HB_ERR;
+        }
+        lsm_level_add(level, t);
+    }
+    fclose(f);
+
+    return HB_OK;
+}
+
+static void lsm_table_free(lsm_table_t *t, int unlink_file)
+{
+    char path[PATH_MAX];
+    uint32_t i;
+
+    if (unlink_file) {
+        lsm_name(path, t->id, "sst");
+        unlink(path);
+    }
+    close(t->fd);
+    for (i = 0; i < t->nblocks; i++) pipe_free(t->blocks[i].last);
+    free(t->blocks);
+    pipe_free(t->first);
+    pipe_free(t->bloom);
+    free(t);
+}
+
+/* Read the footer, index and bloom filter of a table into memory. */
+static lsm_table_t *lsm_table_open(uint32_t id)
+{
+    char path[PATH_MAX];
+    unsigned char footer[HB_LSM_FOOTER], *meta = NULL, *p, *end;
+    uint64_t index_off, index_len, bloom_off, bloom_len, klen, offset, len;
+    lsm_table_t *t;
+    struct stat st;
+    unsigned long crc;
+    int n;
+
+    if ((t = calloc(1, sizeof(lsm_table_t))) == NULL) return NULL;
+    t->id = id;
+
+    lsm_name(path, id, "sst");
+    if ((t->fd = open(path, O_RDONLY)) == HB_ERR || fstat(t->fd, &st) == HB_ERR) goto err;
+    t->size = st.st_size;
+
+    if (t->size < HB_LSM_FOOTER ||
+        pread(t->fd, footer, HB_LSM_FOOTER, t->size - HB_LSM_FOOTER) != HB_LSM_FOOTER ||
+        memcmp(footer + HB_LSM_FOOTER - 8, HB_LSM_MAGIC, 8))
+        goto corrupt;
+
+    index_off = util_get64(footer);
+    index_len = util_get64(footer + 8);
+    bloom_off = util_get64(footer + 16);
+    bloom_len = util_get64(footer + 24);
+    t->entries = util_get64(footer + 32);
+    t->tombstones = util_get64(footer + 40);
+    t->probes = util_get32(footer + 48);
+
+    if (index_off + index_len != bloom_off || bloom_off + bloom_len != t->size - HB_LSM_FOOTER ||
+        (meta = malloc(index_len + bloom_len + 1)) == NULL ||
+        pread(t->fd, meta, index_len + bloom_len, index_off) != (ssize_t) (index_len + bloom_len))
+        goto corrupt;
+
+    crc = util_crc32(0, meta, index_len + bloom_len);
+    if (util_crc32(crc, footer, 52) != util_get32(footer + 52)) goto corrupt;
+
+    p = meta;
+    end = meta + index_len;
+    if ((n = util_varint_get(p, end, &klen)) == 0 || klen > (uint64_t) (end - p - n)) goto corrupt;
+    t->first = pipe_newlen(p + n, klen);
+    p += n + klen;
+
+    while (p < end) {
+        lsm_block_t *b;
+
+        if ((n = util_varint_get(p, end, &klen)) == 0 || klen > (uint64_t) (end - p - n)) goto corrupt;
+        p += n;
+        if ((t->nblocks & (t->nblocks - 1)) == 0) {
+            lsm_block_t *grown = realloc(t->blocks, (t->nblocks ? t->nblocks * 2 : 1) * sizeof(lsm_block_t));
+
+            if (grown == NULL) goto corrupt;
+            t->blocks = grown;
+        }
+        b = &t->blocks[t->nblocks++];
+        b->last = pipe_newlen(p, klen);
+        p += klen;
+        if ((n = util_varint_get(p, end, &offset)) == 0) goto corrupt;
+        p += n;
+        if ((n = util_varint_get(p, end, &len)) == 0) goto corrupt;
+        p += n;
+        b->offset = offset;
+        b->len = len;
+    }
+    if (t->nblocks == 0) goto corrupt;
+
+    t->bloom = pipe_newlen(meta + index_len, bloom_len);
+    free(meta);
+
+    return t;
+
+corrupt:
+    fprintf(stdout, "hb: %s table is corrupt [%s]\n", HB_LOG_ERR, path);
+    free(meta);
+    lsm_table_free(t, 0);
+    return NULL;
+
+err:
+    fprintf(stdout, "hb: %s could not open table [%s]: %s\n", HB_LOG_ERR, path, strerror(errno));
+    free(t);
+    return NULL;
+}
+
+/* Read and verify data block 'i'. The caller frees it. */
+static unsigned char *lsm_block_read(lsm_table_t *t, uint32_t i)
+{
+    lsm_block_t *b = &t->blocks[i];
+    unsigned char *buf;
+
+    if ((buf = malloc(b->len + 4)) == NULL) return NULL;
+    if (pread(t->fd, buf, b->len + 4, b->offset) != (ssize_t) b->len + 4 ||
+        util_crc32(0, buf, b->len) != util_get32(buf + b->len)) {
+        fprintf(stdout, "hb: %s corrupt block %u in table %09u\n", HB_LOG_ERR, i, t->id);
+        free(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+/* Bloom filter probes use double hashing of one 32-bit hash. */
+static int lsm_bloom(const pipe_t bloom, uint32_t probes, uint32_t h)
+{
+    uint64_t bits = pipe_len(bloom) * 8;
+    uint32_t delta = (h >> 17) | (h << 15), i;
+
+    for (i = 0; i < probes; i++, h += delta)
+        if ((((unsigned char *) bloom)[(h % bits) / 8] & (1 << ((h % bits) % 8))) == 0) return 0;
+
+    return 1;
+}
+
+/* Look a key up in one table, at most one block is read. */
+static int lsm_table_get(lsm_table_t *t, const char *key, size_t klen, uint32_t hash, pipe_t *value)
+{
+    unsigned char *buf, *p, *end;
+    uint64_t rklen, rvlen;
+    uint32_t lo = 0, hi = t->nblocks, mid;
+    int n, status = LSM_MISSING;
+
+    if (lsm_cmp(key, klen, t->first, pipe_len(t->first)) < 0) return LSM_MISSING;
+    if (!lsm_bloom(t->bloom, t->probes, hash)) {
+        bloom_skips++;
+        return LSM_MISSING;
+    }
+
+    /* First block whose last key is not below the key */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (lsm_cmp(t->blocks[mid].last, pipe_len(t->blocks[mid].last), key, klen) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == t->nblocks || (buf = lsm_block_read(t, lo)) == NULL) return LSM_MISSING;
+    block_reads++;
+
+    for (p = buf, end = buf + t->blocks[lo].len; p < end; p += rklen + (rvlen ? rvlen - 1 : 0)) {
+        if ((n = util_varint_get(p, end, &rklen)) == 0) break;
+        p += n;
+        if ((n = util_varint_get(p, end, &rvlen)) == 0) break;
+        p += n;
+        if (rklen + (rvlen ? rvlen - 1 : 0) > (uint64_t) (end - p)) break;
+
+        if ((n = lsm_cmp(p, rklen, key, klen)) < 0) continue;
+        if (n == 0) {
+            if (rvlen == 0) {
+                status = LSM_DELETED;
+            } else {
+                *value = pipe_newlen(p + rklen, rvlen - 1);
+                status = LSM_FOUND;
+            }
+        }
+        break;
+    }
+    free(buf);
+
+    return status;
+}
+
+/* Level 0 keeps tables in the order they were flushed, deeper levels in
+ * key order. */
+static void lsm_level_add(int level, lsm_table_t *t)
+{
+    lsm_level_t *l = &levels[level];
+    int i;
+
+    l->tables = realloc(l->tables, (l->count + 1) * sizeof(lsm_table_t *));
+    for (i = l->count; i > 0; i--) {
+        lsm_table_t *prev = l->tables[i - 1];
+
+        if (level == 0 ? prev->id < t->id : lsm_cmp(prev->first, pipe_len(prev->first), t->first, pipe_len(t->first)) < 0)
+            break;
+        l->tables[i] = prev;
+    }
+    l->tables[i] = t;
+    l->count++;
+    l->size += t->size;
+}
+
+static void lsm_level_remove(int level, lsm_table_t *t)
+{
+    lsm_level_t *l = &levels[level];
+    int i;
+
+    for (i = 0; i < l->count; i++) {
+        if (l->tables[i] != t) continue;
+        memmove(l->tables + i, l->tables + i + 1, (l->count - i - 1) * sizeof(lsm_table_t *));
+        l->count--;
+        l->size -= t->size;
+        return;
+    }
+}
+
+static int lsm_writer_open(lsm_writer_t *w)
+{
+    char path[PATH_MAX];
+
+    memset(w, 0, sizeof(*w));
+    w->id = lsm_id();
+    lsm_name(path, w->id, "sst");
+    if ((w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not create table [%s]: %s\n", HB_LOG_ERR, path, strerror(errno));
+        return HB_ERR;
+    }
+    w->block = pipe_empty();
+    w->index = pipe_empty();
+    w->hashes = pipe_empty();
+    w->last = pipe_empty();
+
+    return HB_OK;
+}
+
+static void lsm_writer_add(lsm_writer_t *w, const void *key, size_t klen, const void *value, size_t vlen, int deleted)
+{
+    unsigned char buf[2 * HB_UTIL_VARINT];
+    uint32_t hash = map_hashkey(key, klen);
+    int n;
+
+    if (w->entries == 0) {
+        n = util_varint_put(buf, klen);
+        w->index = pipe_catlen(w->index, buf, n);
+        w->index = pipe_catlen(w->index, key, klen);
+    }
+
+    n = util_varint_put(buf, klen);
+    n += util_varint_put(buf + n, deleted ? 0 : vlen + 1);
+    w->block = pipe_catlen(w->block, buf, n);
+    w->block = pipe_catlen(w->block, key, klen);
+    if (!deleted) w->block = pipe_catlen(w->block, value, vlen);
+
+    w->hashes = pipe_catlen(w->hashes, &hash, sizeof(hash));
+    w->last = pipe_cpylen(w->last, key, klen);
+    w->entries++;
+    if (deleted) w->tombstones++;
+
+    if (pipe_len(w->block) >= HB_LSM_BLOCK) lsm_writer_block(w);
+}
+
+static void lsm_writer_block(lsm_writer_t *w)
+{
+    unsigned char buf[HB_UTIL_VARINT];
+    size_t len = pipe_len(w->block);
+    int n;
+
+    if (len == 0) return;
+
+    util_put32(buf, util_crc32(0, w->block, len));
+    w->block = pipe_catlen(w->block, buf, 4);
+    if (util_pwrite(w->fd, w->block, len + 4, w->offset) == HB_ERR) w->failed = 1;
+
+    n = util_varint_put(buf, pipe_len(w->last));
+    w->index = pipe_catlen(w->index, buf, n);
+    w->index = pipe_catpipe(w->index, w->last);
+    n = util_varint_put(buf, w->offset);
+    w->index = pipe_catlen(w->index, buf, n);
+    n = util_varint_put(buf, len);
+    w->index = pipe_catlen(w->index, buf, n);
+
+    w->offset += len + 4;
+    pipe_clear(w->block);
+}
+
+/* Write index, bloom filter and footer, sync and open the result. An
+ * empty or failed table is removed and NULL returned. */
+static lsm_table_t *lsm_writer_finish(lsm_writer_t *w)
+{
+    char path[PATH_MAX];
+    unsigned char footer[HB_LSM_FOOTER];
+    uint64_t bits, i, keys = w->entries;
+    uint32_t probes;
+    unsigned long crc;
+    pipe_t bloom;
+    int status;
+
+    lsm_writer_block(w);
+
+    /* About 1% false positives at HB_LSM_BLOOM_BITS of 10 */
+    bits = MAX(keys * HB_LSM_BLOOM_BITS, 64);
+    bloom = pipe_growzero(pipe_empty(), (bits + 7) / 8);
+    bits = pipe_len(bloom) * 8;
+    probes = MAX(1, MIN(30, HB_LSM_BLOOM_BITS * 69 / 100));
+    for (i = 0; i < keys; i++) {
+        uint32_t h, delta, j;
+
+        memcpy(&h, w->hashes + i * sizeof(h), sizeof(h));
+        delta = (h >> 17) | (h << 15);
+
+        for (j = 0; j < probes; j++, h += delta)
+            ((unsigned char *) bloom)[(h % bits) / 8] |= 1 << ((h % bits) % 8);
+    }
+
+    util_put64(footer, w->offset);
+    util_put64(footer + 8, pipe_len(w->index));
+    util_put64(footer + 16, w->offset + pipe_len(w->index));
+    util_put64(footer + 24, pipe_len(bloom));
+    util_put64(footer + 32, w->entries);
+    util_put64(footer + 40, w->tombstones);
+    util_put32(footer + 48, probes);
+    crc = util_crc32(0, w->index, pipe_len(w->index));
+    crc = util_crc32(crc, bloom, pipe_len(bloom));
+    util_put32(footer + 52, util_crc32(crc, footer, 52));
+    memcpy(footer + HB_LSM_FOOTER - 8, HB_LSM_MAGIC, 8);
+
+    w->index = pipe_catpipe(w->index, bloom);
+    w->index = pipe_catlen(w->index, footer, HB_LSM_FOOTER);
+    if (keys == 0 || w->failed || util_pwrite(w->fd, w->index, pipe_len(w->index), w->offset) == HB_ERR)
+        status = HB_ERR;
+    else
+        status = fdatasync(w->fd) == HB_ERR ? HB_ERR : HB_OK;
+    close(w->fd);
+
+    pipe_free(bloom);
+    pipe_free(w->block);
+    pipe_free(w->index);
+    pipe_free(w->hashes);
+    pipe_free(w->last);
+
+    if (status == HB_OK) return lsm_table_open(w->id);
+
+    if (keys) fprintf(stdout, "hb: %s could not write table %09u: %s\n", HB_LOG_ERR, w->id, strerror(errno));
+    lsm_name(path, w->id, "sst");
+    unlink(path);
+
+    return NULL;
+}
+
+static void lsm_iter_next(lsm_iter_t *it)
+{
+    const unsigned char *p, *end;
+    int n;
+
+    while (it->pos >= it->len) {
+        free(it->buf);
+        it->buf = NULL;
+        it->pos = it->len = 0;
+        if (it->block == it->table->nblocks) {
+            it->valid = 0;
+            return;
+        }
+        if ((it->buf = lsm_block_read(it->table, it->block)) == NULL) {
+            it->valid = 0;
+            it->failed = 1;
+            return;
+        }
+        it->len = it->table->blocks[it->block++].len;
+    }
+
+    p = it->buf + it->pos;
+    end = it->buf + it->len;
+    if ((n = util_varint_get(p, end, &it->klen)) == 0) goto corrupt;
+    p += n;
+    if ((n = util_varint_get(p, end, &it->vlen)) == 0) goto corrupt;
+    p += n;
+    it->deleted = it->vlen == 0;
+    if (!it->deleted) it->vlen--;
+    if (it->klen + it->vlen > (uint64_t) (end - p)) goto corrupt;
+
+    it->key = p;
+    it->value = p + it->klen;
+    it->pos = p + it->klen + it->vlen - it->buf;
+    it->valid = 1;
+    return;
+
+corrupt:
+    it->valid = 0;
+    it->failed = 1;
+}
+
+/* Write a memtable out as one level 0 table. */
+static int lsm_flush(map_t *m, lsm_job_t *job)
+{
+    lsm_writer_t w;
+    lsm_entry_t **e;
+    pipe_t entries = pipe_empty();
+    size_t i, n;
+
+    map_iterate(m, lsm_collect, &entries);
+    e = (lsm_entry_t **) entries;
+    n = pipe_len(entries) / sizeof(*e);
+    qsort(e, n, sizeof(*e), lsm_order);
+
+    if (lsm_writer_open(&w) == HB_ERR) {
+        pipe_free(entries);
+        return HB_ERR;
+    }
+    for (i = 0; i < n; i++)
+        lsm_writer_add(&w, e[i]->key, pipe_len(e[i]->key), e[i]->value,
+                       e[i]->value ? pipe_len(e[i]->value) : 0, e[i]->value == NULL);
+    pipe_free(entries);
+
+    job->level = 0;
+    job->noutputs = 0;
+    job->outputs = malloc(sizeof(lsm_table_t *));
+    if ((job->outputs[0] = lsm_writer_finish(&w)) == NULL) return n ? HB_ERR : HB_OK;
+    job->noutputs = 1;
+
+    return HB_OK;
+}
+
+/* Merge the input tables into new tables of about HB_LSM_FILE_SIZE for
+ * the output level. Of equal keys the newest input wins. */
+static int lsm_merge(lsm_job_t *job)
+{
+    lsm_iter_t *it;
+    lsm_writer_t w;
+    lsm_table_t *t;
+    int i, best, status = HB_OK, open = 0;
+
+    it = calloc(job->ninputs, sizeof(lsm_iter_t));
+    for (i = 0; i < job->ninputs; i++) {
+        it[i].table = job->inputs[i];
+        lsm_iter_next(&it[i]);
+    }
+
+    for (;;) {
+        for (best = -1, i = 0; i < job->ninputs; i++) {
+            if (it[i].failed) status = HB_ERR;
+            if (!it[i].valid) continue;
+            if (best == -1 || lsm_cmp(it[i].key, it[i].klen, it[best].key, it[best].klen) < 0) best = i;
+        }
+        if (best == -1 || status == HB_ERR) break;
+
+        if (!(it[best].deleted && job->drop)) {
+            if (open && w.offset + pipe_len(w.block) >= HB_LSM_FILE_SIZE) {
+                open = 0;
+                if ((t = lsm_writer_finish(&w)) == NULL) {
+                    status = HB_ERR;
+                    break;
+                }
+                job->outputs = realloc(job->outputs, (job->noutputs + 1) * sizeof(lsm_table_t *));
+                job->outputs[job->noutputs++] = t;
+            }
+            if (!open) {
+                if (lsm_writer_open(&w) == HB_ERR) {
+                    status = HB_ERR;
+                    break;
+                }
+                open = 1;
+            }
+            lsm_writer_add(&w, it[best].key, it[best].klen, it[best].value, it[best].vlen, it[best].deleted);
+        }
+
+        /* Older versions of the key are dropped */
+        for (i = job->ninputs - 1; i >= 0; i--)
+            if (i != best && it[i].valid && !lsm_cmp(it[i].key, it[i].klen, it[best].key, it[best].klen))
+                lsm_iter_next(&it[i]);
+        lsm_iter_next(&it[best]);
+    }
+
+    if (open) {
+        if ((t = lsm_writer_finish(&w)) != NULL) {
+            job->outputs = realloc(job->outputs, (job->noutputs + 1) * sizeof(lsm_table_t *));
+            job->outputs[job->noutputs++] = t;
+        } else if (w.entries) {
+            status = HB_ERR;
+        }
+    }
+
+    for (i = 0; i < job->ninputs; i++) free(it[i].buf);
+    free(it);
+
+    return status;
+}
+
+static uint64_t lsm_level_limit(int level)
+{
+    uint64_t limit = HB_LSM_LEVEL_BASE;
+
+    while (--level > 0) limit *= 10;
+
+    return limit;
+}
+
+static void lsm_job_input(lsm_job_t *job, lsm_table_t *t)
+{
+    job->inputs = realloc(job->inputs, (job->ninputs + 1) * sizeof(lsm_table_t *));
+    job->inputs[job->ninputs++] = t;
+}
+
+/* Add the tables of 'level' overlapping [lo, hi] to the job. */
+static void lsm_job_overlap(lsm_job_t *job, int level, pipe_t lo, pipe_t hi)
+{
+    lsm_level_t *l = &levels[level];
+    int i;
+
+    for (i = 0; i < l->count; i++) {
+        lsm_table_t *t = l->tables[i];
+        pipe_t last = t->blocks[t->nblocks - 1].last;
+
+        if (lsm_cmp(last, pipe_len(last), lo, pipe_len(lo)) < 0 ||
+            lsm_cmp(t->first, pipe_len(t->first), hi, pipe_len(hi)) > 0)
+            continue;
+        lsm_job_input(job, t);
+    }
+}
+
+/* Choose the next piece of work: a pending flush, a requested full
+ * compaction, level 0 past its trigger, or the level most over its size.
+ * Returns 0 if there is nothing to do. */
+static int lsm_pick(lsm_job_t *job)
+{
+    lsm_table_t *t;
+    pipe_t lo, hi, last;
+    double score, best = 1.0;
+    int level, pick = -1, i;
+
+    memset(job, 0, sizeof(*job));
+    if (busy) return 0;
+    if (imm) return 1;
+
+    if (compact_wanted) {
+        compact_wanted = 0;
+        for (level = 0; level < HB_LSM_LEVELS; level++) {
+            if (levels[level].count) job->level = level;
+            /* Level 0 newest first, then level by level */
+            for (i = levels[level].count - 1; level == 0 && i >= 0; i--) lsm_job_input(job, levels[0].tables[i]);
+            for (i = 0; level > 0 && i < levels[level].count; i++) lsm_job_input(job, levels[level].tables[i]);
+        }
+        if (job->ninputs == 0) return 0;
+        job->level = MAX(job->level, 1);
+        job->drop = 1;
+        return 1;
+    }
+
+    if (levels[0].count >= HB_LSM_L0_TRIGGER) {
+        pick = 0;
+    } else {
+        for (level = 1; level < HB_LSM_LEVELS - 1; level++) {
+            score = (double) levels[level].size / lsm_level_limit(level);
+            if (score > best) {
+                best = score;
+                pick = level;
+            }
+        }
+    }
+    if (pick == -1) return 0;
+
+    if (pick == 0) {
+        /* All of level 0, its tables overlap each other */
+        lo = hi = NULL;
+        for (i = levels[0].count - 1; i >= 0; i--) {
+            t = levels[0].tables[i];
+            last = t->blocks[t->nblocks - 1].last;
+            lsm_job_input(job, t);
+            if (lo == NULL || lsm_cmp(t->first, pipe_len(t->first), lo, pipe_len(lo)) < 0) lo = t->first;
+            if (hi == NULL || lsm_cmp(last, pipe_len(last), hi, pipe_len(hi)) > 0) hi = last;
+        }
+    } else {
+        /* One table, round robin through the key space */
+        t = levels[pick].tables[0];
+        for (i = 0; cursor[pick] && i < levels[pick].count; i++) {
+            if (lsm_cmp(levels[pick].tables[i]->first, pipe_len(levels[pick].tables[i]->first),
+                        cursor[pick], pipe_len(cursor[pick])) > 0) {
+                t = levels[pick].tables[i];
+                break;
+            }
+        }
+        lo = t->first;
+        hi = t->blocks[t->nblocks - 1].last;
+        lsm_job_input(job, t);
+        if (cursor[pick]) pipe_free(cursor[pick]);
+        cursor[pick] = pipe_dup(hi);
+    }
+
+    job->level = pick + 1;
+    lsm_job_overlap(job, job->level, lo, hi);
+
+    /* Deletes only have to be kept while an older version may be below */
+    job->drop = 1;
+    for (level = job->level + 1; level < HB_LSM_LEVELS; level++)
+        if (levels[level].count) job->drop = 0;
+
+    return 1;
+}
+
+/* Swap the outputs of a finished job in for its inputs. */
+static void lsm_install(lsm_job_t *job)
+{
+    char path[PATH_MAX];
+    int i, level;
+
+    for (i = 0; i < job->ninputs; i++)
+        for (level = 0; level < HB_LSM_LEVELS; level++)
+            lsm_level_remove(level, job->inputs[i]);
+    for (i = 0; i < job->noutputs; i++) {
+        lsm_level_add(job->level, job->outputs[i]);
+        written += job->outputs[i]->size;
+    }
+
+    if (lsm_manifest() == HB_ERR) fprintf(stdout, "hb: %s tables may be lost on restart\n", HB_LOG_WRN);
+
+    for (i = 0; i < job->ninputs; i++) {
+        merge_read += job->inputs[i]->size;
+        lsm_table_free(job->inputs[i], 1);
+    }
+
+    if (job->ninputs == 0) {
+        lsm_mem_free(imm);
+        imm = NULL;
+        lsm_name(path, imm_log, "log");
+        unlink(path);
+        flushes++;
+    } else {
+        merges++;
+    }
+}
+
+int lsm_init(void)
+{
+    pthread_t thread_id;
+    DIR *dir;
+    struct dirent *de;
+    pipe_t logs = pipe_empty();
+    uint32_t id, *ids;
+    size_t i, n;
+    uint64_t start = stat_clock();
+    char ext[8];
+    int level, known;
+    lsm_job_t job;
+
+    if (mkdir(server.dir, 0755) == HB_ERR && errno != EEXIST) {
+        fprintf(stdout, "hb: %s could not create data directory [%s]\n", HB_LOG_ERR, server.dir);
+        return HB_ERR;
+    }
+    if (lsm_manifest_load() == HB_ERR) return HB_ERR;
+
+    if ((dir = opendir(server.dir)) == NULL) {
+        fprintf(stdout, "hb: %s could not open data directory [%s]\n", HB_LOG_ERR, server.dir);
+        return HB_ERR;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "%u.%7s", &id, ext) != 2) continue;
+
+        if (!strcmp(ext, "log")) {
+            logs = pipe_catlen(logs, &id, sizeof(id));
+        } else if (!strcmp(ext, "sst")) {
+            /* Left behind by a flush or merge that did not finish */
+            for (known = 0, level = 0; level < HB_LSM_LEVELS; level++)
+                for (i = 0; i < (size_t) levels[level].count; i++)
+                    if (levels[level].tables[i]->id == id) known = 1;
+            if (!known) {
+                char path[PATH_MAX];
+
+                lsm_name(path, id, "sst");
+                unlink(path);
+            }
+        } else {
+            continue;
+        }
+        if (id >= next_id) next_id = id + 1;
+    }
+    closedir(dir);
+
+    /* Logs that were not flushed are replayed oldest first */
+    mem = map_new();
+    ids = (uint32_t *) logs;
+    n = pipe_len(logs) / sizeof(*ids);
+    for (i = 0; i < n; i++) {
+        size_t j, min = i;
+
+        for (j = i + 1; j < n; j++) if (ids[j] < ids[min]) min = j;
+        id = ids[min];
+        ids[min] = ids[i];
+        ids[i] = id;
+        if (lsm_log_replay(id) == HB_ERR) {
+            fprintf(stdout, "hb: %s could not read log %09u\n", HB_LOG_ERR, id);
+            pipe_free(logs);
+            return HB_ERR;
+        }
+    }
+
+    if (map_length(mem)) {
+        if (lsm_flush(mem, &job) == HB_ERR) return HB_ERR;
+        if (job.noutputs) lsm_level_add(0, job.outputs[0]);
+        free(job.outputs);
+        if (lsm_manifest() == HB_ERR) return HB_ERR;
+        lsm_mem_free(mem);
+        mem = map_new();
+        mem_bytes = 0;
+    }
+    for (i = 0; i < n; i++) {
+        char path[PATH_MAX];
+
+        lsm_name(path, ids[i], "log");
+        unlink(path);
+    }
+    pipe_free(logs);
+
+    if (lsm_log_open() == HB_ERR) return HB_ERR;
+    record = pipe_empty();
+
+    if (pthread_create(&thread_id, NULL, lsm_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create compaction thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    for (n = 0, level = 0; level < HB_LSM_LEVELS; level++) n += levels[level].count;
+    fprintf(stdout, "hb: %s opened %zu tables, about %lld keys in %.3fs\n",
+            HB_LOG_OK, n, lsm_len(), (stat_clock() - start) / 1e9);
+
+    return HB_OK;
+}
+
+/* Writers wait while the background thread is behind: a full memtable
+ * with the previous one not flushed yet, or too many level 0 tables. */
+static int lsm_write(pipe_t key, pipe_t value)
+{
+    unsigned char header[HB_LSM_LOG_HEADER];
+    uint32_t klen = pipe_len(key), vlen = value ? pipe_len(value) : HB_LSM_TOMBSTONE;
+    unsigned long crc;
+    int status;
+
+    while ((mem_bytes >= HB_LSM_MEMTABLE && imm) || levels[0].count >= HB_LSM_L0_STOP) {
+        stalls++;
+        pthread_cond_signal(&work);
+        pthread_cond_wait(&done, &server.mutex);
+    }
+    if (mem_bytes >= HB_LSM_MEMTABLE) lsm_rotate();
+    if (log_fd == HB_ERR) return HB_ERR;
+
+    util_put32(header + 4, klen);
+    util_put32(header + 8, vlen);
+    crc = util_crc32(0, header + 4, 8);
+    crc = util_crc32(crc, key, klen);
+    if (value) crc = util_crc32(crc, value, vlen);
+    util_put32(header, crc);
+
+    /* One write() per record */
+    pipe_clear(record);
+    record = pipe_catlen(record, header, HB_LSM_LOG_HEADER);
+    record = pipe_catpipe(record, key);
+    if (value) record = pipe_catpipe(record, value);
+    if ((status = util_pwrite(log_fd, record, pipe_len(record), log_size)) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not write log: %s\n", HB_LOG_ERR, strerror(errno));
+        return HB_ERR;
+    }
+    log_size += pipe_len(record);
+
+    lsm_apply(mem, key, klen, value, value ? vlen : 0);
+
+    return HB_OK;
+}
+
+int lsm_put(pipe_t key, pipe_t value)
+{
+    return lsm_write(key, value);
+}
+
+/* Look a key up in the tables, newest first. */
+static int lsm_tables_get(pipe_t key, pipe_t *value)
+{
+    lsm_level_t *l;
+    uint32_t hash = map_hashkey(key, pipe_len(key));
+    int level, i, lo, hi, found;
+
+    /* Level 0 newest first */
+    l = &levels[0];
+    for (i = l->count - 1; i >= 0; i--) {
+        if ((found = lsm_table_get(l->tables[i], key, pipe_len(key), hash, value)) != LSM_MISSING)
+            return found;
+    }
+
+    /* At most one table per deeper level */
+    for (level = 1; level < HB_LSM_LEVELS; level++) {
+        l = &levels[level];
+        lo = 0;
+        hi = l->count;
+        while (lo < hi) {
+            lsm_table_t *t = l->tables[lo + (hi - lo) / 2];
+            pipe_t last = t->blocks[t->nblocks - 1].last;
+
+            if (lsm_cmp(last, pipe_len(last), key, pipe_len(key)) < 0) lo = lo + (hi - lo) / 2 + 1;
+            else hi = lo + (hi - lo) / 2;
+        }
+        if (lo == l->count) continue;
+
+        if ((found = lsm_table_get(l->tables[lo], key, pipe_len(key), hash, value)) != LSM_MISSING)
+            return found;
+    }
+
+    return LSM_MISSING;
+}
+
+pipe_t lsm_get(pipe_t key)
+{
+    lsm_entry_t *e;
+    pipe_t value = NULL;
+
+    gets++;
+    if (map_get(mem, key, (void **) &e) == HB_OK || (imm && map_get(imm, key, (void **) &e) == HB_OK))
+        return e->value ? pipe_newlen(e->value, pipe_len(e->value)) : NULL;
+
+    return lsm_tables_get(key, &value) == LSM_FOUND ? value : NULL;
+}
+
+int lsm_del(pipe_t key)
+{
+    return lsm_write(key, NULL);
+}
+
+/* Count the live keys of a memtable, less the table records they shadow.
+ * Keys the newer memtable also holds are counted there. */
+static int lsm_count(any_t item, char *key, any_t data)
+{
+    lsm_count_t *c = item;
+    lsm_entry_t *e = data, *newer;
+    pipe_t value = NULL;
+
+    if (c->newer && map_get(c->newer, e->key, (void **) &newer) == HB_OK) return HB_OK;
+
+    if (e->value) c->keys++;
+    if (lsm_tables_get(e->key, &value) == LSM_FOUND) {
+        c->keys--;
+        pipe_free(value);
+    }
+
+    return HB_OK;
+}
+
+long long lsm_len(void)
+{
+    lsm_count_t count = { NULL, 0 };
+    long long keys = 0, dead = 0;
+    int level, i;
+
+    /* Exact for the memtables */
+    map_iterate(mem, lsm_count, &count);
+    if (imm) {
+        count.newer = mem;
+        map_iterate(imm, lsm_count, &count);
+    }
+
+    for (level = 0; level < HB_LSM_LEVELS; level++) {
+        for (i = 0; i < levels[level].count; i++) {
+            keys += levels[level].tables[i]->entries;
+            dead += levels[level].tables[i]->tombstones;
+        }
+    }
+
+    /* In the tables a delete usually hides one older record */
+    return MAX(count.keys + MAX(keys - 2 * dead, 0), 0);
+}
+
+int lsm_clr(void)
+{
+    lsm_level_t tables[HB_LSM_LEVELS];
+    int level, i;
+
+    while (busy) pthread_cond_wait(&done, &server.mutex);
+
+    if (imm) {
+        char path[PATH_MAX];
+
+        lsm_mem_free(imm);
+        imm = NULL;
+        lsm_name(path, imm_log, "log");
+        unlink(path);
+    }
+    lsm_mem_free(mem);
+    mem = map_new();
+    mem_bytes = 0;
+
+    /* The files go once the manifest no longer lists them */
+    for (level = 0; level < HB_LSM_LEVELS; level++) {
+        tables[level] = levels[level];
+        memset(&levels[level], 0, sizeof(lsm_level_t));
+    }
+    if (lsm_manifest() == HB_ERR) return HB_ERR;
+    for (level = 0; level < HB_LSM_LEVELS; level++) {
+        for (i = 0; i < tables[level].count; i++) lsm_table_free(tables[level].tables[i], 1);
+        free(tables[level].tables);
+    }
+
+    if (ftruncate(log_fd, 0) == HB_ERR) return HB_ERR;
+    log_size = 0;
+
+    return HB_OK;
+}
+
+int lsm_compact(void)
+{
+    compact_wanted = 1;
+    if (map_length(mem) && imm == NULL) lsm_rotate();
+    pthread_cond_signal(&work);
+
+    return HB_OK;
+}
+
+void lsm_close(void)
+{
+    if (log_fd != HB_ERR) fdatasync(log_fd);
+}
+
+/* Flush and compact whenever there is work, sync the log once a second. */
+static void *lsm_loop(void *arg)
+{
+    struct timespec ts;
+    uint64_t synced = stat_clock();
+    lsm_job_t job;
+    int fd, status;
+
+    pthread_mutex_lock(&server.mutex);
+    for (;;) {
+        if (stat_clock() - synced >= 1000000000ULL) {
+            fd = dup(log_fd);
+            pthread_mutex_unlock(&server.mutex);
+            if (fd != HB_ERR) {
+                fdatasync(fd);
+                close(fd);
+            }
+            synced = stat_clock();
+            pthread_mutex_lock(&server.mutex);
+        }
+
+        if (!lsm_pick(&job)) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            pthread_cond_timedwait(&work, &server.mutex, &ts);
+            continue;
+        }
+
+        busy = 1;
+        pthread_mutex_unlock(&server.mutex);
+        status = job.ninputs ? lsm_merge(&job) : lsm_flush(imm, &job);
+        pthread_mutex_lock(&server.mutex);
+
+        if (status == HB_OK) {
+            lsm_install(&job);
+        } else {
+            int i;
+
+            fprintf(stdout, "hb: %s %s failed, retrying\n", HB_LOG_ERR, job.ninputs ? "compaction" : "flush");
+            for (i = 0; i < job.noutputs; i++) lsm_table_free(job.outputs[i], 1);
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            pthread_cond_timedwait(&work, &server.mutex, &ts);
+        }
+        free(job.inputs);
+        free(job.outputs);
+
+        busy = 0;
+        pthread_cond_broadcast(&done);
+    }
+
+    return NULL;
+}
+
+pipe_t lsm_catinfo(pipe_t s)
+{
+    int level;
+
+    s = pipe_catprintf(s, "lsm_dir:%s\n", server.dir);
+    s = pipe_catprintf(s, "lsm_memtable_bytes:%" PRIu64 "\n", mem_bytes);
+    s = pipe_catprintf(s, "lsm_flush_pending:%d\n", imm != NULL);
+    s = pipe_catprintf(s, "lsm_compaction_in_progress:%d\n", busy);
+    for (level = 0; level < HB_LSM_LEVELS; level++) {
+        if (levels[level].count == 0) continue;
+        s = pipe_catprintf(s, "lsm_level_%d:files=%d,bytes=%" PRIu64 "\n",
+                           level, levels[level].count, levels[level].size);
+    }
+    s = pipe_catprintf(s, "lsm_flushes:%" PRIu64 "\n", flushes);
+    s = pipe_catprintf(s, "lsm_compactions:%" PRIu64 "\n", merges);
+    s = pipe_catprintf(s, "lsm_compaction_read_bytes:%" PRIu64 "\n", merge_read);
+    s = pipe_catprintf(s, "lsm_table_written_bytes:%" PRIu64 "\n", written);
+    s = pipe_catprintf(s, "lsm_write_stalls:%" PRIu64 "\n", stalls);
+    s = pipe_catprintf(s, "lsm_blocks_per_get:%.3f\n", gets ? (double) block_reads / gets : 0.0);
+    s = pipe_catprintf(s, "lsm_bloom_skips:%" PRIu64 "\n", bloom_skips);
+
+    return s;
+}
@@ -0,0 +1,72 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_LSM_H_
+#define _HB_LSM_H_
+
+/* Writes go to a log and a memtable, a full memtable is written out as a
+ * sorted table file (%09u.sst) in level 0 and compacted down the levels
+ * in the background. Level 0 files may overlap, every other level is a
+ * sorted run of disjoint files about ten times bigger than the one above.
+ *
+ * A table file is a sequence of data blocks, each a run of records (varint
+ * key length, varint value length plus one or 0 for a delete, key, value)
+ * followed by a crc32 of the block. Then the index block: the first key of
+ * the file and for every data block its last key, offset and length, all
+ * with varint lengths. Then the bloom filter and the footer: index offset
+ * and length, bloom offset and length, records, deletes, number of bloom
+ * probes, crc32 of index, bloom and footer, and HB_LSM_MAGIC. Log records
+ * are crc32, key length, value length (HB_LSM_TOMBSTONE for a delete), key
+ * and value, integers little endian. MANIFEST lists the tables per level. */
+#define HB_LSM_MAGIC        "HBLSMSST"
+#define HB_LSM_FOOTER       64
+#define HB_LSM_LOG_HEADER   12
+#define HB_LSM_TOMBSTONE    0xffffffffU
+
+/* Open the tables listed in the manifest of server.dir and replay what
+ * the logs hold that did not make it into a table. */
+int       lsm_init(void);
+
+int       lsm_put(pipe_t, pipe_t);
+pipe_t    lsm_get(pipe_t);
+int       lsm_del(pipe_t);
+
+/* Live keys are not tracked, this is an estimate from the table stats
+ * that counts overwritten keys more than once until they are compacted. */
+long long lsm_len(void);
+int       lsm_clr(void);
+
+/* Flush the memtable and ask the background thread to merge everything
+ * into the last level. */
+int       lsm_compact(void);
+
+/* Sync the log. */
+void      lsm_close(void);
+
+pipe_t    lsm_catinfo(pipe_t);
+
+#endif
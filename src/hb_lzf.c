@@ -0,0 +1,188 @@
+/*
+ * LZF                         Compression of large values, in the LZF format.
+ *
+ * Version:                                      @(#)lzf.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+/* Totals since start, under the database lock like every write */
+static uint64_t packed;
+static uint64_t packed_in;
+static uint64_t packed_out;
+
+static unsigned int lzf_hash(const unsigned char *);
+
+/* The three bytes at 'p' mapped to a slot of the match table */
+static unsigned int lzf_hash(const unsigned char *p)
+{
+    uint32_t v = (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+
+    return (v * 2654435761U) >> (32 - HB_LZF_HLOG);
+}
+
+/* Greedy: each position looks up the last one with the same three bytes
+ * and takes the match if it is near enough, otherwise the byte goes to
+ * the current literal run, whose control byte is written once it ends. */
+size_t lzf_compress(const void *in_data, size_t in_len, void *out_data, size_t out_len)
+{
+    const unsigned char *in = in_data, *ip = in, *end = in + in_len;
+    unsigned char *out = out_data;
+    uint32_t htab[1 << HB_LZF_HLOG];
+    size_t op = 1, lit = 0;                 /* Control byte of the first run */
+
+    if (in_len == 0 || out_len == 0) return 0;
+    memset(htab, 0, sizeof(htab));
+
+    while (ip < end) {
+        if (ip + 2 < end) {
+            unsigned int h = lzf_hash(ip);
+            const unsigned char *ref = in + htab[h];
+            size_t off = ip - ref;
+
+            htab[h] = ip - in;
+
+            if (off >= 1 && off <= HB_LZF_MAX_OFF &&
+                ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+                size_t len = 3, max = MIN((size_t) (end - ip), HB_LZF_MAX_REF);
+
+                while (len < max && ref[len] == ip[len]) len++;
+
+                /* Close the literal run, or take back its unused control byte */
+                if (lit) out[op - lit - 1] = lit - 1; else op--;
+                if (op + 3 > out_len) return 0;
+
+                off--;
+                if (len - 2 < 7) {
+                    out[op++] = (off >> 8) | ((len - 2) << 5);
+                } else {
+                    out[op++] = (off >> 8) | (7 << 5);
+                    out[op++] = len - 2 - 7;
+                }
+                out[op++] = off;
+
+                lit = 0;
+                op++;
+
+                /* The end of the match is where the next one most likely starts */
+                ip += len;
+                if (ip + 2 < end) {
+                    htab[lzf_hash(ip - 1)] = ip - 1 - in;
+                    htab[lzf_hash(ip - 2)] = ip - 2 - in;
+                }
+                continue;
+            }
+        }
+
+        if (op >= out_len) return 0;
+        out[op++] = *ip++;
+
+        if (++lit == HB_LZF_MAX_LIT) {
+            out[op - lit - 1] = lit - 1;
+            lit = 0;
+            op++;
+        }
+    }
+
+    if (lit) out[op - lit - 1] = lit - 1; else op--;
+
+    return op;
+}
+
+size_t lzf_decompress(const void *in_data, size_t in_len, void *out_data, size_t out_len)
+{
+    const unsigned char *ip = in_data, *end = ip + in_len;
+    unsigned char *out = out_data;
+    size_t op = 0;
+
+    while (ip < end) {
+        unsigned int ctrl = *ip++;
+        size_t len, off;
+
+        if (ctrl < HB_LZF_MAX_LIT) {
+            len = ctrl + 1;
+            if (len > (size_t) (end - ip) || op + len > out_len) return 0;
+
+            memcpy(out + op, ip, len);
+            ip += len;
+            op += len;
+            continue;
+        }
+
+        len = ctrl >> 5;
+        if (len == 7) {
+            if (ip >= end) return 0;
+            len += *ip++;
+        }
+        if (ip >= end) return 0;
+        off = ((ctrl & 0x1f) << 8 | *ip++) + 1;
+        len += 2;
+
+        if (off > op || op + len > out_len) return 0;
+
+        /* Byte by byte, a match may overlap what it produces */
+        for (; len; len--, op++) out[op] = out[op - off];
+    }
+
+    return op;
+}
+
+pipe_t lzf_pack(const pipe_t value)
+{
+    size_t len = pipe_len(value), room = len - len / HB_LZF_SAVING, n;
+    unsigned char head[10];
+    int hlen = util_varint_put(head, len);
+    pipe_t s;
+
+    s = pipe_MakeRoomFor(pipe_empty(), hlen + room);
+    memcpy(s, head, hlen);
+
+    if ((n = lzf_compress(value, len, s + hlen, room)) == 0) {
+        pipe_free(s);
+        return NULL;
+    }
+    pipe_IncrLen(s, hlen + n);
+    s = pipe_RemoveFreeSpace(s);
+
+    packed++;
+    packed_in += len;
+    packed_out += pipe_len(s);
+
+    return s;
+}
+
+pipe_t lzf_unpack(const pipe_t s)
+{
+    pipe_t value;
+    const unsigned char *p = (unsigned char *) s, *end = p + pipe_len(s);
+    uint64_t len;
+    int n;
+
+    if ((n = util_varint_get(p, end, &len)) == 0) return NULL;
+    p += n;
+
+    value = pipe_newlen(NULL, len);
+    if (lzf_decompress(p, end - p, value, len) != len) {
+        pipe_free(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+pipe_t lzf_catinfo(pipe_t s)
+{
+    s = pipe_catprintf(s, "compress_above:%d\n", server.compress_above);
+    s = pipe_catprintf(s, "compressed_writes:%" PRIu64 "\n", packed);
+    s = pipe_catprintf(s, "compressed_in_bytes:%" PRIu64 "\n", packed_in);
+    s = pipe_catprintf(s, "compressed_out_bytes:%" PRIu64 "\n", packed_out);
+
+    return s;
+}
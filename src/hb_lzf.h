@@ -0,0 +1,58 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_LZF_H_
+#define _HB_LZF_H_
+
+/* Values of the memory engine at least --compress-above bytes long are kept
+ * compressed in the LZF format: a control byte below 32 starts a run of
+ * that many plus one literal bytes, otherwise its top three bits are the
+ * match length minus two (7 means one more length byte follows) and the
+ * low five bits with the next byte the distance minus one. A compressed
+ * value is a pipe holding the varint length of the original followed by
+ * the LZF stream, kept in an object of the lzf encoding. */
+#define HB_LZF_MAX_LIT      (1 << 5)
+#define HB_LZF_MAX_OFF      (1 << 13)
+#define HB_LZF_MAX_REF      ((1 << 8) + (1 << 3))
+
+/* Compress 'in' into at most 'out_len' bytes of 'out'. Returns the
+ * compressed length, or 0 if it does not fit. */
+size_t  lzf_compress(const void *, size_t, void *, size_t);
+
+/* Decompress into at most 'out_len' bytes. Returns the length of the
+ * original, or 0 on a malformed stream or a too small buffer. */
+size_t  lzf_decompress(const void *, size_t, void *, size_t);
+
+/* Compressed copy of a value, NULL if that saves too little. */
+pipe_t  lzf_pack(const pipe_t);
+
+/* The original value of a compressed one in a new pipe, NULL on error. */
+pipe_t  lzf_unpack(const pipe_t);
+
+pipe_t  lzf_catinfo(pipe_t);
+
+#endif
@@ -14,10 +14,10 @@
 
 extern map_t database;
 
-static unsigned long crc32(const unsigned char *, unsigned int);
-static unsigned int map_hash_int(map_t *, char *);
-static int map_hash(map_t *, char *);
+static unsigned int map_hash_int(map_t *, char *, size_t);
+static int map_hash(map_t *, char *, size_t, int *);
 static int map_rehash(map_t *);
+static void map_shift(map_t *, int);
 
 int map_init(void)
 {
@@ -44,124 +44,12 @@ err:
     return NULL;
 }
 
-/* The implementation here was originally done by Gary S. Brown.  I have
- * borrowed the tables directly, and made some minor changes to the
- * crc32-function (including changing the interface). //ylo */
-
-/* ============================================================= */
-/*  COPYRIGHT (C) 1986 Gary S. Brown.  You may use this program, or       */
-/*  code or tables extracted from it, as desired without restriction.     */
-/*                                                                        */
-/*  First, the polynomial itself and its table of feedback terms.  The    */
-/*  polynomial is                                                         */
-/*  X^32+X^26+X^23+X^22+X^16+X^12+X^11+X^10+X^8+X^7+X^5+X^4+X^2+X^1+X^0   */
-/*                                                                        */
-/*  Note that we take it "backwards" and put the highest-order term in    */
-/*  the lowest-order bit.  The X^32 term is "implied"; the LSB is the     */
-/*  X^31 term, etc.  The X^0 term (usually shown as "+1") results in      */
-/*  the MSB being 1.                                                      */
-/*                                                                        */
-/*  Note that the usual hardware shift register implementation, which     */
-/*  is what we're using (we're merely optimizing it by doing eight-bit    */
-/*  chunks at a time) shifts bits into the lowest-order term.  In our     */
-/*  implementation, that means shifting towards the right.  Why do we     */
-/*  do it this way?  Because the calculated CRC must be transmitted in    */
-/*  order from highest-order term to lowest-order term.  UARTs transmit   */
-/*  characters in order from LSB to MSB.  By storing the CRC this way,    */
-/*  we hand it to the UART in the order low-byte to high-byte; the UART   */
-/*  sends each low-bit to hight-bit; and the result is transmission bit   */
-/*  by bit from highest- to lowest-order term without requiring any bit   */
-/*  shuffling on our part.  Reception works similarly.                    */
-/*                                                                        */
-/*  The feedback terms table consists of 256, 32-bit entries.  Notes:     */
-/*                                                                        */
-/*      The table can be generated at runtime if desired; code to do so   */
-/*      is shown later.  It might not be obvious, but the feedback        */
-/*      terms simply represent the results of eight shift/xor opera-      */
-/*      tions for all combinations of data and CRC register values.       */
-/*                                                                        */
-/*      The values must be right-shifted by eight bits by the "updcrc"    */
-/*      logic; the shift must be unsigned (bring in zeroes).  On some     */
-/*      hardware you could probably optimize the shift in assembler by    */
-/*      using byte-swap instructions.                                     */
-/*      polynomial $edb88320                                              */
-/*                                                                        */
-/*  --------------------------------------------------------------------  */
-
-static unsigned long crc32_tab[] = {
-    0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
-    0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
-    0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L,
-    0x90bf1d91L, 0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
-    0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L, 0x136c9856L,
-    0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL, 0x14015c4fL, 0x63066cd9L,
-    0xfa0f3d63L, 0x8d080df5L, 0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L,
-    0xa2677172L, 0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
-    0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L, 0x32d86ce3L,
-    0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L, 0x26d930acL, 0x51de003aL,
-    0xc8d75180L, 0xbfd06116L, 0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L,
-    0xb8bda50fL, 0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
-    0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL, 0x76dc4190L,
-    0x01db7106L, 0x98d220bcL, 0xefd5102aL, 0x71b18589L, 0x06b6b51fL,
-    0x9fbfe4a5L, 0xe8b8d433L, 0x7807c9a2L, 0x0f00f934L, 0x9609a88eL,
-    0xe10e9818L, 0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
-    0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL, 0x6c0695edL,
-    0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L, 0x65b0d9c6L, 0x12b7e950L,
-    0x8bbeb8eaL, 0xfcb9887cL, 0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L,
-    0xfbd44c65L, 0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
-    0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL, 0x4369e96aL,
-    0x346ed9fcL, 0xad678846L, 0xda60b8d0L, 0x44042d73L, 0x33031de5L,
-    0xaa0a4c5fL, 0xdd0d7cc9L, 0x5005713cL, 0x270241aaL, 0xbe0b1010L,
-    0xc90c2086L, 0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
-    0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L, 0x59b33d17L,
-    0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL, 0xedb88320L, 0x9abfb3b6L,
-    0x03b6e20cL, 0x74b1d29aL, 0xead54739L, 0x9dd277afL, 0x04db2615L,
-    0x73dc1683L, 0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
-    0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L, 0xf00f9344L,
-    0x8708a3d2L, 0x1e01f268L, 0x6906c2feL, 0xf762575dL, 0x806567cbL,
-    0x196c3671L, 0x6e6b06e7L, 0xfed41b76L, 0x89d32be0L, 0x10da7a5aL,
-    0x67dd4accL, 0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
-    0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L, 0xd1bb67f1L,
-    0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL, 0xd80d2bdaL, 0xaf0a1b4cL,
-    0x36034af6L, 0x41047a60L, 0xdf60efc3L, 0xa867df55L, 0x316e8eefL,
-    0x4669be79L, 0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
-    0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL, 0xc5ba3bbeL,
-    0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L, 0xc2d7ffa7L, 0xb5d0cf31L,
-    0x2cd99e8bL, 0x5bdeae1dL, 0x9b64c2b0L, 0xec63f226L, 0x756aa39cL,
-    0x026d930aL, 0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
-    0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L, 0x92d28e9bL,
-    0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L, 0x86d3d2d4L, 0xf1d4e242L,
-    0x68ddb3f8L, 0x1fda836eL, 0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L,
-    0x18b74777L, 0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
-    0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L, 0xa00ae278L,
-    0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L, 0xa7672661L, 0xd06016f7L,
-    0x4969474dL, 0x3e6e77dbL, 0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L,
-    0x37d83bf0L, 0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
-    0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L, 0xbad03605L,
-    0xcdd70693L, 0x54de5729L, 0x23d967bfL, 0xb3667a2eL, 0xc4614ab8L,
-    0x5d681b02L, 0x2a6f2b94L, 0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL,
-    0x2d02ef8dL
-};
-
-/* Return a 32-bit CRC of the contents of the buffer. */
-static unsigned long crc32(const unsigned char *s, unsigned int len)
-{
-    unsigned int i;
-    unsigned long crc32val;
-
-    crc32val = 0;
-    for (i = 0;  i < len;  i ++) {
-        crc32val =
-            crc32_tab[(crc32val ^ s[i]) & 0xff] ^
-            (crc32val >> 8);
-    }
-    return crc32val;
-}
-
-static unsigned int map_hash_int(map_t * m, char* keystring)
+/* Hash a key of the given length, the same function places keys in the
+ * table so other modules (sketches, filters) can reuse it. */
+unsigned long map_hashkey(const char* keystring, size_t len)
 {
     /* CRC32 initial key */
-    unsigned long key = crc32((unsigned char*)(keystring), strlen(keystring));
+    unsigned long key = util_crc32(0, keystring, len);
 
     /* Robert Jenkins' 32 bit Mix Function */
     key += (key << 12);
@@ -176,24 +64,34 @@ static unsigned int map_hash_int(map_t * m, char* keystring)
     /* Knuth's Multiplicative Method */
     key = (key >> 3) * 2654435761;
 
-    return key % m->table_size;
+    return key;
+}
+
+static unsigned int map_hash_int(map_t * m, char* keystring, size_t len)
+{
+    return map_hashkey(keystring, len) % m->table_size;
 }
 
 /* Return the integer of the location in data
- * to store the point to the item, or HB_MAP_FULL. */
-static int map_hash(map_t * m, char* key)
+ * to store the point to the item, or HB_MAP_FULL.
+ * The number of visited buckets is stored in probes. */
+static int map_hash(map_t * m, char* key, size_t len, int *probes)
 {
     int curr;
     int i;
 
+    *probes = 0;
+
     /* If full, return immediately */
     if(m->size >= (m->table_size/2)) return HB_MAP_FULL;
 
     /* Find the best index */
-    curr = map_hash_int(m, key);
+    curr = map_hash_int(m, key, len);
 
     /* Linear probing */
     for(i = 0; i<HB_MAP_LENGTH; i++) {
+        *probes = i + 1;
+
         if(m->data[curr].in_use == 0)
             return curr;
 
@@ -213,6 +111,8 @@ static int map_rehash(map_t * m)
     int old_size;
     map_bucket_t* curr;
 
+    HB_PROBE2(map__rehash__start, m->table_size, m->size);
+
     /* Setup the new elements */
     map_bucket_t* temp = (map_bucket_t *)
                          calloc(2 * m->table_size, sizeof(map_bucket_t));
@@ -227,42 +127,103 @@ static int map_rehash(map_t * m)
     m->table_size = 2 * m->table_size;
     m->size = 0;
 
-    /* Rehash the elements */
+    /* Rehash the elements, they keep their access time */
     for(i = 0; i < old_size; i++) {
-        int status;
+        int index, probes;
 
         if (curr[i].in_use == 0)
             continue;
 
-        status = map_put(m, curr[i].key, curr[i].data);
-        if (status != HB_OK)
-            return status;
+        index = map_hash(m, curr[i].key, strlen(curr[i].key), &probes);
+        if (index == HB_MAP_FULL) {
+            int status = map_put(m, curr[i].key, curr[i].data);
+            if (status != HB_OK)
+                return status;
+            continue;
+        }
+
+        m->data[index] = curr[i];
+        m->size++;
     }
 
     free(curr);
 
+    HB_PROBE2(map__rehash__done, m->table_size, m->size);
+
     return HB_OK;
 }
 
 /* Add a pointer to the map with some key */
 int map_put(map_t * m, char* key, any_t value)
 {
-    int index;
+    size_t len = strlen(key);
+    int index, probes;
 
     /* Find a place to put our value */
-    index = map_hash(m, key);
+    index = map_hash(m, key, len, &probes);
     while(index == HB_MAP_FULL) {
         if (map_rehash(m) == HB_MAP_OMEM) {
             return HB_MAP_OMEM;
         }
-        index = map_hash(m, key);
+        index = map_hash(m, key, len, &probes);
     }
 
-    /* Set the data */
+    HB_PROBE3(map__put, key, len, probes);
+
+    /* Set the data, overwriting a key does not change the size */
+    if (m->data[index].in_use == 0) m->size++;
     m->data[index].data = value;
     m->data[index].key = key;
     m->data[index].in_use = 1;
-    m->size++;
+
+    return HB_OK;
+}
+
+int map_reserve(map_t * m, int n)
+{
+    int size = m->table_size;
+
+    while (n >= size / 2) size *= 2;
+
+    /* Nothing to move, skip the intermediate sizes */
+    if (m->size == 0 && size > m->table_size) {
+        map_bucket_t *data = (map_bucket_t*) calloc(size, sizeof(map_bucket_t));
+        if (!data) return HB_MAP_OMEM;
+
+        free(m->data);
+        m->data = data;
+        m->table_size = size;
+    }
+
+    while (m->table_size < size) {
+        if (map_rehash(m) == HB_MAP_OMEM) return HB_MAP_OMEM;
+    }
+
+    return HB_OK;
+}
+
+int map_home(map_t * m, const char *key, size_t len)
+{
+    return map_hashkey(key, len) % m->table_size;
+}
+
+int map_put_range(map_t * m, char* key, any_t value, int from, int to)
+{
+    int curr = map_home(m, key, strlen(key));
+    int i;
+
+    for (i = 0; i < HB_MAP_LENGTH && curr >= from && curr < to; i++, curr++) {
+        if (m->data[curr].in_use == 0) {
+            __sync_fetch_and_add(&m->size, 1);
+            break;
+        }
+        if (strcmp(m->data[curr].key, key) == 0) break;
+    }
+    if (i == HB_MAP_LENGTH || curr < from || curr >= to) return HB_MAP_FULL;
+
+    m->data[curr].data = value;
+    m->data[curr].key = key;
+    m->data[curr].in_use = 1;
 
     return HB_OK;
 }
@@ -270,11 +231,12 @@ int map_put(map_t * m, char* key, any_t value)
 /* Get your pointer out of the map with a key */
 int map_get(map_t * m, char* key, any_t *arg)
 {
+    size_t len = strlen(key);
     int curr;
     int i;
 
     /* Find data location */
-    curr = map_hash_int(m, key);
+    curr = map_hash_int(m, key, len);
 
     /* Linear probing, if necessary */
     for(i = 0; i<HB_MAP_LENGTH; i++) {
@@ -283,6 +245,7 @@ int map_get(map_t * m, char* key, any_t *arg)
         if (in_use == 1) {
             if (strcmp(m->data[curr].key,key)==0) {
                 *arg = (m->data[curr].data);
+                HB_PROBE4(map__get, key, len, i + 1, 1);
                 return HB_OK;
             }
         }
@@ -292,13 +255,15 @@ int map_get(map_t * m, char* key, any_t *arg)
 
     *arg = NULL;
 
+    HB_PROBE4(map__get, key, len, i, 0);
+
     /* Not found */
     return HB_ERR;
 }
 
 /* Iterate the function parameter over each element in the map.  The
  * additional any_t argument is passed to the function as its first
- * argument and the map element is the second. */
+ * argument, the key is the second and the map element is the third. */
 int map_iterate(map_t * m, PFany f, any_t item)
 {
     int i;
@@ -311,7 +276,7 @@ int map_iterate(map_t * m, PFany f, any_t item)
     for(i = 0; i< m->table_size; i++)
         if(m->data[i].in_use != 0) {
             any_t data = (any_t) (m->data[i].data);
-            int status = f(item, data);
+            int status = f(item, m->data[i].key, data);
             if (status != HB_OK) {
                 return status;
             }
@@ -320,14 +285,45 @@ int map_iterate(map_t * m, PFany f, any_t item)
     return HB_OK;
 }
 
+/* Replace the element of a key already in the map, the key it holds stays */
+int map_swap(map_t * m, char* key, any_t value, any_t *old)
+{
+    int i;
+    int curr;
+
+    curr = map_hash_int(m, key, strlen(key));
+
+    for(i = 0; i<HB_MAP_LENGTH; i++) {
+        if (m->data[curr].in_use == 1 && strcmp(m->data[curr].key,key)==0) {
+            *old = m->data[curr].data;
+            m->data[curr].data = value;
+            return HB_OK;
+        }
+        curr = (curr + 1) % m->table_size;
+    }
+
+    *old = NULL;
+
+    return HB_ERR;
+}
+
 /* Remove an element with that key from the map */
 int map_remove(map_t * m, char* key)
+{
+    char *stored;
+    any_t data;
+
+    return map_take(m, key, &stored, &data);
+}
+
+/* Remove an element, handing back the key the map held and the element */
+int map_take(map_t * m, char* key, char **stored, any_t *data)
 {
     int i;
     int curr;
 
     /* Find key */
-    curr = map_hash_int(m, key);
+    curr = map_hash_int(m, key, strlen(key));
 
     /* Linear probing, if necessary */
     for(i = 0; i<HB_MAP_LENGTH; i++) {
@@ -335,6 +331,9 @@ int map_remove(map_t * m, char* key)
         int in_use = m->data[curr].in_use;
         if (in_use == 1) {
             if (strcmp(m->data[curr].key,key)==0) {
+                *stored = m->data[curr].key;
+                *data = m->data[curr].data;
+
                 /* Blank out the fields */
                 m->data[curr].in_use = 0;
                 m->data[curr].data = NULL;
@@ -342,6 +341,9 @@ int map_remove(map_t * m, char* key)
 
                 /* Reduce the size */
                 m->size--;
+
+                /* Close the gap so later keys of the probe run stay reachable */
+                map_shift(m, curr);
                 return HB_OK;
             }
         }
@@ -349,9 +351,50 @@ int map_remove(map_t * m, char* key)
     }
 
     /* Data not found */
+    *stored = NULL;
+    *data = NULL;
+
     return HB_ERR;
 }
 
+/* Backward shift deletion: move every following element of the run whose
+ * home bucket is at or before the hole into it, until an empty bucket. */
+static void map_shift(map_t * m, int hole)
+{
+    int curr = (hole + 1) % m->table_size;
+
+    while (m->data[curr].in_use) {
+        char *key = m->data[curr].key;
+        int home = map_hash_int(m, key, strlen(key));
+
+        if ((curr - home + m->table_size) % m->table_size >=
+            (curr - hole + m->table_size) % m->table_size) {
+            m->data[hole] = m->data[curr];
+            m->data[curr].in_use = 0;
+            m->data[curr].data = NULL;
+            m->data[curr].key = NULL;
+            hole = curr;
+        }
+
+        curr = (curr + 1) % m->table_size;
+    }
+}
+
+/* Drop every element and go back to the initial table size. Keys and
+ * values are not freed. */
+int map_clear(map_t * m)
+{
+    map_bucket_t *data = (map_bucket_t*) calloc(HB_MAP_SIZE, sizeof(map_bucket_t));
+    if (!data) return HB_MAP_OMEM;
+
+    free(m->data);
+    m->data = data;
+    m->table_size = HB_MAP_SIZE;
+    m->size = 0;
+
+    return HB_OK;
+}
+
 /* Deallocate the map */
 void map_free(map_t * m)
 {
@@ -35,9 +35,9 @@
  * the map. */
 typedef void *any_t;
 
-/* PFany is a pointer to a function that can take two any_t arguments
- * and return an integer. Returns status code.. */
-typedef int (*PFany)(any_t, any_t);
+/* PFany is a pointer to a function that takes the any_t passed to
+ * map_iterate, a key and its any_t value and returns a status code. */
+typedef int (*PFany)(any_t, char *, any_t);
 
 /* We need to keep keys and values. */
 typedef struct _map_bucket {
@@ -60,7 +60,7 @@ int    map_init(void);
 /* Return an empty map. Returns NULL if empty. */
 map_t *map_new(void);
 
-/* Iteratively call f with argument (item, data) for
+/* Iteratively call f with argument (item, key, data) for
  * each element data in the map. The function must
  * return a map status code. If it returns anything other
  * than HB_OK the traversal is terminated. f must
@@ -73,17 +73,44 @@ int    map_put(map_t *, char *, any_t);
 /* Get an element from the map. Return HB_OK or HB_ERR. */
 int    map_get(map_t *, char *, any_t *);
 
+/* Replace the element of a key already in the map and store the old one,
+ * keeping the key pointer the map holds. Return HB_OK or HB_ERR. */
+int    map_swap(map_t *, char *, any_t, any_t *);
+
 /* Remove an element from the map. Return HB_OK or HB_ERR. */
 int    map_remove(map_t *, char *);
 
+/* Remove an element and hand back the key pointer the map held and the
+ * element, so the caller can free them. Return HB_OK or HB_ERR. */
+int    map_take(map_t *, char *, char **, any_t *);
+
 /* Get any element. Return HB_OK or HB_ERR.
  * remove - should the element be removed from the map */
 int    map_get_one(map_t *, any_t *, int);
 
+/* Grow the table so that 'n' elements fit without a rehash. Return HB_OK
+ * or MAP_OMEM. */
+int    map_reserve(map_t *, int);
+
+/* Home bucket of a key, where its probe run starts. */
+int    map_home(map_t *, const char *, size_t);
+
+/* Add an element whose home bucket is in [from, to) touching no bucket
+ * outside of that range, so threads can fill disjoint ranges of a
+ * reserved map at the same time. Return HB_OK, or HB_MAP_FULL if the
+ * probe run leaves the range; the element is then left for map_put(). */
+int    map_put_range(map_t *, char *, any_t, int, int);
+
+/* Remove all elements, keeping the map itself. Return HB_OK or MAP_OMEM. */
+int    map_clear(map_t *);
+
 /* Free the map. */
 void   map_free(map_t *);
 
 /* Get the current size of a map. */
 int    map_length(map_t *);
 
+/* Hash a key of the given length with the function used by the map. */
+unsigned long map_hashkey(const char *, size_t);
+
 #endif
\ No newline at end of file
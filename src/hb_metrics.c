@@ -0,0 +1,221 @@
+/*
+ * METRICS                 Prometheus/OpenMetrics exposition over HTTP/1.1.
+ *
+ * Version:                                  @(#)metrics.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+extern map_t database;
+
+static int metrics_socket = HB_ERR;
+
+static void *metrics_loop(void *);
+static void  metrics_serve(int);
+static pipe_t metrics_cathistogram(pipe_t, const char *, stat_cmd_t *);
+
+int metrics_init(void)
+{
+    struct sockaddr_in addr;
+    pthread_t thread_id;
+    int yes = 1;
+
+    if (server.metrics_port <= 0) return HB_OK;
+
+    if ((metrics_socket = socket(AF_INET, SOCK_STREAM, 0)) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not create metrics socket\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+
+    setsockopt(metrics_socket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(server.metrics_port);
+
+    if (bind(metrics_socket, (struct sockaddr *)&addr, sizeof(addr)) < HB_OK) {
+        fprintf(stdout, "hb: %s metrics port is already in use\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+
+    listen(metrics_socket, HB_METRICS_BACKLOG);
+
+    if (pthread_create(&thread_id, NULL, metrics_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create metrics thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    fprintf(stdout, "hb: %s metrics on port %d\n", HB_LOG_INF, server.metrics_port);
+
+    return HB_OK;
+}
+
+static void *metrics_loop(void *arg)
+{
+    int sock;
+
+#if defined(SCHED_IDLE)
+    struct sched_param param = { 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+#if defined(SYS_gettid)
+    /* On Linux the nice value is per thread */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+
+    while ((sock = accept(metrics_socket, NULL, NULL)) >= 0 || errno == EINTR) {
+        if (sock < 0) continue;
+        metrics_serve(sock);
+        close(sock);
+    }
+
+    fprintf(stdout, "hb: %s metrics listener stopped\n", HB_LOG_WRN);
+
+    return NULL;
+}
+
+/* A deliberately minimal HTTP/1.1 server: one request per connection, only
+ * GET is understood and the connection is closed after the reply. */
+static void metrics_serve(int sock)
+{
+    char request[HB_METRICS_REQUEST];
+    struct timeval tv = { HB_METRICS_TIMEOUT, 0 };
+    const char *status = "200 OK";
+    pipe_t body, reply;
+    int len = 0, n;
+
+    /* A scraper that stops reading or writing must not hold the listener */
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    while (len < (int) sizeof(request) - 1) {
+        if ((n = recv(sock, request + len, sizeof(request) - 1 - len, 0)) <= 0) return;
+        len += n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+
+    if (strncmp(request, "GET ", 4) != 0) {
+        status = "405 Method Not Allowed";
+        body = pipe_new("method not allowed\n");
+    } else if (strncmp(request + 4, "/metrics ", 9) == 0 || strncmp(request + 4, "/ ", 2) == 0) {
+        body = metrics_render(pipe_empty());
+    } else {
+        status = "404 Not Found";
+        body = pipe_new("not found, try /metrics\n");
+    }
+
+    reply = pipe_catprintf(pipe_empty(),
+                           "HTTP/1.1 %s\r\n"
+                           "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: %zu\r\n"
+                           "Connection: close\r\n\r\n", status, pipe_len(body));
+    reply = pipe_catpipe(reply, body);
+
+    for (len = 0; len < (int) pipe_len(reply); len += n)
+        if ((n = write(sock, reply + len, pipe_len(reply) - len)) <= 0) break;
+
+    pipe_free(body);
+    pipe_free(reply);
+}
+
+/* Buckets are reported at every power of two nanoseconds, where the
+ * log-linear histogram is exact, from 256ns up to the top of its range. */
+static pipe_t metrics_cathistogram(pipe_t s, const char *name, stat_cmd_t *c)
+{
+    int e;
+
+    for (e = 8; e <= HB_STAT_BITS; e++)
+        s = pipe_catprintf(s, "hashbase_command_duration_seconds_bucket{cmd=\"%s\",le=\"%.9g\"} %" PRIu64 "\n",
+                           name, (double) (1ULL << e) / 1e9, stat_below(c, 1ULL << e));
+
+    s = pipe_catprintf(s, "hashbase_command_duration_seconds_bucket{cmd=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+                       name, c->calls);
+    s = pipe_catprintf(s, "hashbase_command_duration_seconds_sum{cmd=\"%s\"} %.9f\n",
+                       name, (double) c->nsec / 1e9);
+    s = pipe_catprintf(s, "hashbase_command_duration_seconds_count{cmd=\"%s\"} %" PRIu64 "\n",
+                       name, c->calls);
+
+    return s;
+}
+
+pipe_t metrics_render(pipe_t s)
+{
+    stat_t st;
+    aof_state_t aof;
+    uint64_t calls = 0;
+    int keys, buckets, i;
+
+    memset(&st, 0, sizeof(st));
+    stat_merge(&st);
+
+    for (i = 0; i < HB_CORE_MAX_COMMANDS; i++)
+        if (st.cmds[i]) calls += st.cmds[i]->calls;
+
+    s = pipe_catprintf(s, "# TYPE hashbase_uptime_seconds gauge\n");
+    s = pipe_catprintf(s, "hashbase_uptime_seconds %ld\n", (long) (time(NULL) - server.start));
+    s = pipe_catprintf(s, "# TYPE hashbase_connected_clients gauge\n");
+    s = pipe_catprintf(s, "hashbase_connected_clients %d\n", server.clients);
+    s = pipe_catprintf(s, "# TYPE hashbase_connections_received_total counter\n");
+    s = pipe_catprintf(s, "hashbase_connections_received_total %" PRIu64 "\n", st.connections);
+    s = pipe_catprintf(s, "# TYPE hashbase_commands_processed_total counter\n");
+    s = pipe_catprintf(s, "hashbase_commands_processed_total %" PRIu64 "\n", calls);
+    s = pipe_catprintf(s, "# TYPE hashbase_instantaneous_ops_per_sec gauge\n");
+    s = pipe_catprintf(s, "hashbase_instantaneous_ops_per_sec %" PRIu64 "\n", stat_rate());
+    s = pipe_catprintf(s, "# TYPE hashbase_net_input_bytes_total counter\n");
+    s = pipe_catprintf(s, "hashbase_net_input_bytes_total %" PRIu64 "\n", st.bytes_in);
+    s = pipe_catprintf(s, "# TYPE hashbase_net_output_bytes_total counter\n");
+    s = pipe_catprintf(s, "hashbase_net_output_bytes_total %" PRIu64 "\n", st.bytes_out);
+    s = pipe_catprintf(s, "# TYPE hashbase_slowlog_length gauge\n");
+    s = pipe_catprintf(s, "hashbase_slowlog_length %d\n", slow_length());
+
+    /* Relaxed loads of the map header, a scrape may see a value one command old */
+    keys = __atomic_load_n(&database.size, __ATOMIC_RELAXED);
+    buckets = __atomic_load_n(&database.table_size, __ATOMIC_RELAXED);
+    s = pipe_catprintf(s, "# TYPE hashbase_keys gauge\n");
+    s = pipe_catprintf(s, "hashbase_keys %d\n", keys);
+    s = pipe_catprintf(s, "# TYPE hashbase_map_buckets gauge\n");
+    s = pipe_catprintf(s, "hashbase_map_buckets %d\n", buckets);
+    s = pipe_catprintf(s, "# TYPE hashbase_map_load_factor gauge\n");
+    s = pipe_catprintf(s, "hashbase_map_load_factor %.4f\n", buckets ? (double) keys / buckets : 0.0);
+
+    aof_state(&aof);
+    if (aof.enabled) {
+        s = pipe_catprintf(s, "# TYPE hashbase_aof_size_bytes gauge\n");
+        s = pipe_catprintf(s, "hashbase_aof_size_bytes %" PRIu64 "\n", aof.size);
+        s = pipe_catprintf(s, "# TYPE hashbase_aof_base_size_bytes gauge\n");
+        s = pipe_catprintf(s, "hashbase_aof_base_size_bytes %" PRIu64 "\n", aof.base_size);
+        s = pipe_catprintf(s, "# TYPE hashbase_aof_rewrite_in_progress gauge\n");
+        s = pipe_catprintf(s, "hashbase_aof_rewrite_in_progress %d\n", aof.rewriting);
+        s = pipe_catprintf(s, "# TYPE hashbase_aof_rewrites_total counter\n");
+        s = pipe_catprintf(s, "hashbase_aof_rewrites_total %" PRIu64 "\n", aof.rewrites);
+        s = pipe_catprintf(s, "# TYPE hashbase_aof_last_rewrite_duration_seconds gauge\n");
+        s = pipe_catprintf(s, "hashbase_aof_last_rewrite_duration_seconds %.6f\n", aof.rewrite_nsec / 1e9);
+    }
+
+    s = pipe_catprintf(s, "# TYPE hashbase_memory_rss_bytes gauge\n");
+    s = pipe_catprintf(s, "hashbase_memory_rss_bytes %zu\n", stat_rss());
+
+    s = pipe_catprintf(s, "# TYPE hashbase_command_duration_seconds histogram\n");
+    for (i = 0; server.commands[i].name != NULL && i < HB_CORE_MAX_COMMANDS; i++) {
+        if (st.cmds[i] == NULL || st.cmds[i]->calls == 0) continue;
+        s = metrics_cathistogram(s, server.commands[i].name, st.cmds[i]);
+    }
+
+    stat_free(&st);
+
+    return s;
+}
@@ -9,12 +9,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sys/uio.h>
 
 #include <hb_core.h>
 
 extern struct server server;
 extern struct client client;
 
+static __thread char peer[HB_NET_PEER];
+static __thread int current = HB_ERR;
+
+/* A parked connection and the reply it was woken with */
+typedef struct _net_resumed {
+    int sock;
+    pipe_t reply;
+} net_resumed_t;
+
+static void *net_resumed(void *);
+
 int net_init(void)
 {
     if ((server.socket = socket(AF_INET, SOCK_STREAM, 0)) == HB_ERR) {
@@ -48,7 +60,10 @@ int net_loop(void)
 
         fprintf(stdout, "hb: %s connection accepted [fd: %d]\n", HB_LOG_OK, client.socket);
 
-        if (pthread_create(&thread_id, NULL, net_handler, (void*) &client.socket) < HB_OK) {
+        __sync_fetch_and_add(&server.clients, 1);
+        stat_local()->connections++;
+
+        if (pthread_create(&thread_id, NULL, net_handler, (void*) (intptr_t) client.socket) < HB_OK) {
             fprintf(stdout, "hb: %s could not create thread\n", HB_LOG_ERR);
             return HB_ERR;
         }
@@ -57,26 +72,97 @@ int net_loop(void)
     return HB_OK;
 }
 
+int net_socket(void)
+{
+    return current;
+}
+
+/* The reply is sent by the new thread, a slow client must not hold up
+ * the one waking it, which has the database lock */
+int net_resume(int sock, pipe_t reply)
+{
+    net_resumed_t *r = malloc(sizeof(net_resumed_t));
+    pthread_t thread_id;
+
+    r->sock = sock;
+    r->reply = reply;
+    if (pthread_create(&thread_id, NULL, net_resumed, r) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create thread\n", HB_LOG_ERR);
+        free(r);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    return HB_OK;
+}
+
+static void *net_resumed(void *arg)
+{
+    net_resumed_t *r = arg;
+    int sock = r->sock;
+
+    util_send(sock, r->reply, pipe_len(r->reply));
+    stat_bytes(0, pipe_len(r->reply));
+    pipe_free(r->reply);
+    free(r);
+
+    return net_handler((void *) (intptr_t) sock);
+}
+
 void *net_handler(void *socket_desc)
 {
-    int sock = *(int*)socket_desc;
+    int sock = (int) (intptr_t) socket_desc;
     int read_size = 0;
 
     char assocc[HB_NET_BUFFER];
     pipe_t buffer = pipe_empty();
 
+    struct sockaddr_in addr;
+    socklen_t size = sizeof(addr);
+    struct iovec reply[2];
+
+    if (getpeername(sock, (struct sockaddr *)&addr, &size) == HB_OK)
+        snprintf(peer, sizeof(peer), "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    current = sock;
+
     while ((read_size = recv(sock, assocc, HB_NET_BUFFER, 0)) > 0) {
         pipe_t packet = pipe_newlen(assocc, read_size);
 
+        stat_bytes(read_size, 0);
+        HB_PROBE2(net__recv, sock, read_size);
+
         buffer = pipe_catpipe(buffer, packet);
         packet = pipe_empty();
 
         if (pipe_len(buffer) > 1) {
             if (buffer[(pipe_len(buffer)-1)] == '\n' && buffer[(pipe_len(buffer)-2)] == '\r') {
                 pipe_trim(buffer, "\r\n");
+
+                /* From here on the connection belongs to a replica */
+                if (!strncmp(buffer, "psync ", 6)) {
+                    repl_serve(sock, buffer);
+                    pipe_free(packet);
+                    read_size = HB_OK;
+                    break;
+                }
+
+                /* The reply may be a stored value, it is sent as it is */
                 packet = net_command(buffer);
-                packet = pipe_cat(packet, "\r\n");
-                server.status = write(sock, packet, (int) pipe_len(packet));
+
+                /* Parked, the socket gets a new thread once it is served */
+                if (packet == NULL) {
+                    stat_release();
+                    return HB_OK;
+                }
+
+                reply[0].iov_base = packet;
+                reply[0].iov_len = pipe_len(packet);
+                reply[1].iov_base = "\r\n";
+                reply[1].iov_len = 2;
+                server.status = writev(sock, reply, 2);
+                stat_bytes(0, pipe_len(packet) + 2);
+                HB_PROBE3(net__reply, sock, pipe_len(packet) + 2, server.status);
+                object_reply_free(packet);
 
                 buffer = pipe_empty();
                 packet = pipe_empty();
@@ -96,23 +182,61 @@ void *net_handler(void *socket_desc)
             break;
     }
 
+    close(sock);
+    __sync_fetch_and_sub(&server.clients, 1);
+    stat_release();
+
     return HB_OK;
 }
 
 void *net_command(void *buffer)
 {
+    struct ascii_t *command;
     pipe_t *tokens;
-    int count, i;
+    uint64_t start, elapsed;
+    int count;
 
     tokens = pipe_splitargs(buffer, &count);
 
-    for (i = 0 ;; i++) {
-        if ( server.commands[i].name == NULL ) {
-            break;
-        } else if (!strcmp(server.commands[i].name, tokens[0]) && server.commands[i].func) {
-            return buffer = server.commands[i].func(tokens);
-        }
+    if ((command = ascii_lookup(tokens, count)) == NULL) {
+        pipe_freesplitres(tokens, count);
+        return buffer = pipe_fromlonglong(HB_ERR);
+    }
+
+    /* A replica only takes writes from its primary */
+    if (server.replicaof && (command->flags & (HB_ASCII_WRITE | HB_ASCII_BLOCK | HB_ASCII_LOGS))) {
+        pipe_freesplitres(tokens, count);
+        return buffer = pipe_fromlonglong(HB_ERR);
+    }
+
+    HB_PROBE2(command__start, tokens[0], count);
+
+    /* Commands run one at a time, writes are logged in execution order */
+    pthread_mutex_lock(&server.mutex);
+
+    start = stat_clock();
+    buffer = command->func(tokens, count);
+    elapsed = stat_clock() - start;
+
+    if (command->flags & HB_ASCII_WRITE) {
+        aof_feed(tokens, count);
+        repl_feed(tokens, count);
+        server.dirty++;
+        block_serve();
     }
 
-    return buffer = pipe_fromlonglong(HB_ERR);
+    pthread_mutex_unlock(&server.mutex);
+
+    /* Group commit happens outside of the database lock */
+    if (buffer && (command->flags & (HB_ASCII_WRITE | HB_ASCII_BLOCK | HB_ASCII_LOGS)) && aof_sync() == HB_ERR) {
+        object_reply_free(buffer);
+        buffer = pipe_fromlonglong(HB_ERR);
+    }
+
+    HB_PROBE3(command__done, tokens[0], buffer ? pipe_len(buffer) : 0, elapsed);
+    stat_command(command - server.commands, elapsed);
+    slow_log(tokens, count, elapsed, peer);
+    pipe_freesplitres(tokens, count);
+
+    return buffer;
 }
@@ -31,6 +31,14 @@
 int   net_init(void);
 int   net_loop(void);
 void *net_handler(void *);
+
+/* The client socket of the calling thread, HB_ERR if it serves none. */
+int   net_socket(void);
+
+/* Start a new thread serving a connection that first sends 'reply' and
+ * frees it. Return HB_OK or HB_ERR, the reply is left to the caller then. */
+int   net_resume(int, pipe_t);
+
 void *net_command(void *);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,219 @@
+/*
+ * OBJECT                 Typed values of the memory engine and their encodings.
+ *
+ * Version:                                   @(#)object.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+/* The object whose pipe this thread's last reply is */
+static __thread object_t *shared;
+
+/* Under the database lock */
+static uint64_t replies;
+
+static void object_free(object_t *);
+
+object_t *object_new(int type, int encoding, any_t ptr)
+{
+    object_t *o = malloc(sizeof(object_t));
+
+    o->type = type;
+    o->encoding = encoding;
+    o->lru = object_clock();
+    o->refcount = 1;
+    o->ptr = ptr;
+
+    return o;
+}
+
+object_t *object_fromlonglong(long long value)
+{
+    if (sizeof(long long) > sizeof(any_t) && (value < INTPTR_MIN || value > INTPTR_MAX))
+        return object_new(HB_OBJ_STRING, HB_ENC_RAW, pipe_fromlonglong(value));
+
+    return object_new(HB_OBJ_STRING, HB_ENC_INT, (any_t) (intptr_t) value);
+}
+
+/* Numbers need no pipe at all, large values are compressed if that pays */
+object_t *object_string(const pipe_t value)
+{
+    long long number;
+    pipe_t packed;
+
+    if (util_strtoll(value, pipe_len(value), &number)) return object_fromlonglong(number);
+
+    if (server.compress_above > 0 && pipe_len(value) >= (size_t) server.compress_above &&
+        (packed = lzf_pack(value)) != NULL)
+        return object_new(HB_OBJ_STRING, HB_ENC_LZF, packed);
+
+    return object_new(HB_OBJ_STRING, HB_ENC_RAW, pipe_dup(value));
+}
+
+/* Only raw strings may still be referenced by a reply once they are out
+ * of the map, so this is the only part that runs without the lock. */
+static void object_free(object_t *o)
+{
+    switch (o->encoding) {
+        case HB_ENC_CHUNKS:
+            list_free(o->ptr);
+            break;
+        case HB_ENC_MAP:
+            if (o->type == HB_OBJ_SET) set_free(o->ptr);
+            else hash_free(o->ptr);
+            break;
+        case HB_ENC_SKIPLIST:
+            zset_free(o->ptr);
+            break;
+        case HB_ENC_STREAM:
+            stream_free(o->ptr);
+            break;
+        case HB_ENC_PACKED:
+        case HB_ENC_INTSET:
+        case HB_ENC_RAW:
+        case HB_ENC_LZF:
+            pipe_free(o->ptr);
+            break;
+        case HB_ENC_TIER:
+            tier_drop(o->ptr);
+            break;
+    }
+
+    free(o);
+}
+
+void object_incr(object_t *o)
+{
+    __sync_fetch_and_add(&o->refcount, 1);
+}
+
+void object_decr(object_t *o)
+{
+    if (__sync_sub_and_fetch(&o->refcount, 1) == 0) object_free(o);
+}
+
+unsigned object_clock(void)
+{
+    return (time(NULL) - server.start + 1) & HB_OBJ_LRU_MAX;
+}
+
+unsigned object_idle(object_t *o)
+{
+    return (object_clock() - o->lru) & HB_OBJ_LRU_MAX;
+}
+
+pipe_t object_value(object_t *o)
+{
+    pipe_t stored, value;
+
+    switch (o->encoding) {
+        case HB_ENC_INT:
+            return pipe_fromlonglong((intptr_t) o->ptr);
+        case HB_ENC_RAW:
+            return pipe_dup(o->ptr);
+        case HB_ENC_LZF:
+            return lzf_unpack(o->ptr);
+        case HB_ENC_TIER:
+            if ((stored = tier_read(o->ptr)) == NULL || !HB_TIER_ISPACKED(o->ptr)) return stored;
+            value = lzf_unpack(stored);
+            pipe_free(stored);
+            return value;
+    }
+
+    return NULL;
+}
+
+pipe_t object_reply(object_t *o)
+{
+    if (shared) object_decr(shared);
+
+    object_incr(o);
+    shared = o;
+    replies++;
+
+    return o->ptr;
+}
+
+void object_reply_free(pipe_t reply)
+{
+    if (shared && shared->ptr == reply) {
+        object_decr(shared);
+        shared = NULL;
+        return;
+    }
+
+    pipe_free(reply);
+}
+
+size_t object_size(object_t *o)
+{
+    intptr_t n;
+    size_t digits = 1;
+
+    switch (o->encoding) {
+        case HB_ENC_INT:
+            for (n = (intptr_t) o->ptr; n >= 10 || n <= -10; n /= 10) digits++;
+            return digits + ((intptr_t) o->ptr < 0);
+        case HB_ENC_RAW:
+        case HB_ENC_LZF:
+            return pipe_len(o->ptr);
+        case HB_ENC_TIER:
+            return HB_TIER_LEN(o->ptr);
+    }
+
+    switch (o->type) {
+        case HB_OBJ_LIST:   return list_length(o->ptr);
+        case HB_OBJ_HASH:   return hash_length(o);
+        case HB_OBJ_ZSET:   return zset_length(o);
+        case HB_OBJ_SET:    return set_length(o);
+        case HB_OBJ_STREAM: return stream_length(o);
+    }
+
+    return 0;
+}
+
+const char *object_typename(object_t *o)
+{
+    switch (o->type) {
+        case HB_OBJ_STRING: return "string";
+        case HB_OBJ_LIST:   return "list";
+        case HB_OBJ_HASH:   return "hash";
+        case HB_OBJ_ZSET:   return "zset";
+        case HB_OBJ_SET:    return "set";
+        case HB_OBJ_STREAM: return "stream";
+    }
+
+    return "unknown";
+}
+
+const char *object_encname(object_t *o)
+{
+    switch (o->encoding) {
+        case HB_ENC_RAW:    return "raw";
+        case HB_ENC_INT:    return "int";
+        case HB_ENC_LZF:    return "lzf";
+        case HB_ENC_TIER:   return "tier";
+        case HB_ENC_CHUNKS: return "chunks";
+        case HB_ENC_PACKED: return "packed";
+        case HB_ENC_MAP:    return "map";
+        case HB_ENC_SKIPLIST: return "skiplist";
+        case HB_ENC_INTSET: return "intset";
+        case HB_ENC_STREAM: return "stream";
+    }
+
+    return "unknown";
+}
+
+pipe_t object_catinfo(pipe_t s)
+{
+    s = pipe_catprintf(s, "shared_replies:%" PRIu64 "\n", replies);
+
+    return s;
+}
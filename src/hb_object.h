@@ -0,0 +1,103 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_OBJECT_H_
+#define _HB_OBJECT_H_
+
+/* Every value of the memory engine is an object: a type, the encoding
+ * its data is kept in, a reference count and the clock of its last
+ * access. A type may have a compact encoding for small values and a full
+ * one it is converted to once a size threshold is crossed. */
+#define HB_OBJ_STRING       0
+#define HB_OBJ_LIST         1
+#define HB_OBJ_HASH         2
+#define HB_OBJ_ZSET         3
+#define HB_OBJ_SET          4
+#define HB_OBJ_STREAM       5
+
+#define HB_ENC_RAW          0               /* ptr is a pipe */
+#define HB_ENC_INT          1               /* ptr is the number itself */
+#define HB_ENC_LZF          2               /* ptr is a compressed pipe */
+#define HB_ENC_TIER         3               /* ptr is a reference into the value log */
+#define HB_ENC_CHUNKS       4               /* ptr is a list_t of packed nodes */
+#define HB_ENC_PACKED       5               /* ptr is a pipe of packed entries */
+#define HB_ENC_MAP          6               /* ptr is a map_t of pipes */
+#define HB_ENC_SKIPLIST     7               /* ptr is a zset_t */
+#define HB_ENC_INTSET       8               /* ptr is a pipe of sorted integers */
+#define HB_ENC_STREAM       9               /* ptr is a stream_t */
+
+#define HB_OBJ_LRU_BITS     24
+#define HB_OBJ_LRU_MAX      ((1U << HB_OBJ_LRU_BITS) - 1)
+
+typedef struct _object {
+    unsigned  type:4;
+    unsigned  encoding:4;
+    unsigned  lru:HB_OBJ_LRU_BITS;          /* Object clock at the last access */
+    int       refcount;
+    any_t     ptr;
+} object_t;
+
+/* New object holding 'ptr', with one reference. */
+object_t   *object_new(int, int, any_t);
+
+/* String object with a copy of a value, in the smallest encoding. */
+object_t   *object_string(const pipe_t);
+
+/* String object of a number. */
+object_t   *object_fromlonglong(long long);
+
+/* References are taken with the database lock held and may be dropped
+ * without it, the last one frees the object. */
+void        object_incr(object_t *);
+void        object_decr(object_t *);
+
+/* Seconds since start, in HB_OBJ_LRU_BITS bits. */
+unsigned    object_clock(void);
+
+/* Seconds since the object was last accessed. */
+unsigned    object_idle(object_t *);
+
+/* The value of a string object in a new pipe, NULL on error. The object
+ * itself is left as it is, so this is safe in a forked child. */
+pipe_t      object_value(object_t *);
+
+/* The pipe of a raw string object as a command reply, shared by taking a
+ * reference instead of copying. Must be called with the database lock. */
+pipe_t      object_reply(object_t *);
+
+/* Release a reply once it was written, shared or not. */
+void        object_reply_free(pipe_t);
+
+/* Bytes of a string as stored, elements of a collection. */
+size_t      object_size(object_t *);
+
+const char *object_typename(object_t *);
+const char *object_encname(object_t *);
+
+pipe_t      object_catinfo(pipe_t);
+
+#endif
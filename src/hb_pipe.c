@@ -142,6 +142,8 @@ pipe_t pipe_MakeRoomFor(pipe_t s, size_t addlen)
     newsh = realloc(sh, sizeof *newsh+newlen+1);
     if (newsh == NULL) return NULL;
 
+    HB_PROBE3(pipe__grow, len, addlen, newlen);
+
     newsh->free = newlen - len;
     return newsh->buf;
 }
@@ -0,0 +1,579 @@
+/*
+ * PMAP              Persistent hash table in memory mapped index and heap files.
+ *
+ * Version:                                     @(#)pmap.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+/* Everything here is protected by the database lock, the checkpoint and
+ * prefault thread takes it too. Only offsets are stored in the files, so
+ * either mapping may move when it grows. */
+static int ifd = HB_ERR;
+static int hfd = HB_ERR;
+static char *index_base;
+static size_t index_len;
+static pmap_bucket_t *table;
+static uint64_t table_size;
+static char *heap;
+static uint64_t heap_cap;
+static uint64_t heap_used;
+static uint64_t count;
+static uint64_t generation;
+static int clean;
+static int rebuilt;
+
+static void     pmap_name(char *, const char *);
+static int      pmap_map_index(uint64_t);
+static int      pmap_map_heap(uint64_t);
+static int      pmap_header_read(pmap_header_t *);
+static int      pmap_header_write(int);
+static int      pmap_dirty(void);
+static void     pmap_checkpoint(void);
+static uint64_t pmap_find(const char *, uint32_t, uint64_t, int *);
+static void     pmap_insert(pmap_bucket_t *, uint64_t, uint64_t, uint64_t);
+static void     pmap_shift(uint64_t);
+static int      pmap_grow(void);
+static int      pmap_check(uint64_t);
+static uint64_t pmap_append(const char *, uint32_t, const char *, uint32_t);
+static int      pmap_rebuild(void);
+static void     pmap_prefault(char **, uint64_t);
+static void    *pmap_loop(void *);
+
+static void pmap_name(char *path, const char *name)
+{
+    snprintf(path, PATH_MAX, "%s/hashbase.%s", server.dir, name);
+}
+
+/* Record fields, the heap gives no alignment guarantees */
+static uint32_t rec32(uint64_t offset, int field)
+{
+    uint32_t v;
+
+    memcpy(&v, heap + offset + 4 * field, 4);
+    return v;
+}
+
+static uint64_t pmap_record(uint32_t klen, uint32_t vlen)
+{
+    return HB_PMAP_RECORD + klen + (vlen == HB_PMAP_TOMBSTONE ? 0 : vlen);
+}
+
+/* (Re)map the index file for 'buckets' buckets. */
+static int pmap_map_index(uint64_t buckets)
+{
+    size_t len = HB_PMAP_TABLE + buckets * sizeof(pmap_bucket_t);
+
+    if (index_base) munmap(index_base, index_len);
+    index_base = NULL;
+
+    if (ftruncate(ifd, len) == HB_ERR) return HB_ERR;
+    index_base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, ifd, 0);
+    if (index_base == MAP_FAILED) {
+        index_base = NULL;
+        return HB_ERR;
+    }
+
+    /* Lookups jump around the table, readahead would only waste I/O */
+    madvise(index_base, len, MADV_RANDOM);
+
+    index_len = len;
+    table = (pmap_bucket_t *) (index_base + HB_PMAP_TABLE);
+    table_size = buckets;
+
+    return HB_OK;
+}
+
+/* (Re)map the heap file with room for 'cap' bytes. */
+static int pmap_map_heap(uint64_t cap)
+{
+    if (heap) munmap(heap, heap_cap);
+    heap = NULL;
+
+    if (ftruncate(hfd, cap) == HB_ERR) return HB_ERR;
+    heap = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, hfd, 0);
+    if (heap == MAP_FAILED) {
+        heap = NULL;
+        return HB_ERR;
+    }
+    madvise(heap, cap, MADV_RANDOM);
+
+    heap_cap = cap;
+
+    return HB_OK;
+}
+
+/* Pick the valid header slot with the highest generation. */
+static int pmap_header_read(pmap_header_t *h)
+{
+    pmap_header_t slot;
+    int i, found = HB_ERR;
+
+    for (i = 0; i < 2; i++) {
+        if (pread(ifd, &slot, sizeof(slot), i * HB_PMAP_SLOT) != sizeof(slot)) continue;
+        if (memcmp(slot.magic, HB_PMAP_MAGIC, sizeof(slot.magic)) ||
+            util_crc32(0, &slot, offsetof(pmap_header_t, crc)) != slot.crc)
+            continue;
+        if (found == HB_ERR || slot.generation > h->generation) {
+            *h = slot;
+            found = HB_OK;
+        }
+    }
+
+    return found;
+}
+
+/* Write the next generation into the slot not holding the current one, so
+ * a torn write leaves the previous header intact. */
+static int pmap_header_write(int is_clean)
+{
+    pmap_header_t h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, HB_PMAP_MAGIC, sizeof(h.magic));
+    h.generation = ++generation;
+    h.table_size = table_size;
+    h.count = count;
+    h.heap_used = heap_used;
+    h.clean = is_clean;
+    h.crc = util_crc32(0, &h, offsetof(pmap_header_t, crc));
+
+    memcpy(index_base + (generation & 1) * HB_PMAP_SLOT, &h, sizeof(h));
+    if (msync(index_base, HB_PMAP_TABLE, MS_SYNC) == HB_ERR) return HB_ERR;
+
+    clean = is_clean;
+
+    return HB_OK;
+}
+
+/* Before the first change after a checkpoint the header must say that
+ * the table can no longer be trusted on its own. */
+static int pmap_dirty(void)
+{
+    if (!clean) return HB_OK;
+
+    return pmap_header_write(0);
+}
+
+static void pmap_checkpoint(void)
+{
+    if (clean || heap == NULL) return;
+
+    if (msync(heap, heap_used, MS_SYNC) == HB_ERR ||
+        msync(index_base, index_len, MS_SYNC) == HB_ERR ||
+        pmap_header_write(1) == HB_ERR)
+        fprintf(stdout, "hb: %s could not checkpoint mapped table: %s\n", HB_LOG_ERR, strerror(errno));
+}
+
+/* Return the bucket of the key, or the empty one where it would go. */
+static uint64_t pmap_find(const char *key, uint32_t klen, uint64_t hash, int *found)
+{
+    uint64_t mask = table_size - 1, i = hash & mask;
+
+    for (;; i = (i + 1) & mask) {
+        uint64_t offset = table[i].offset;
+
+        if (offset == 0) {
+            *found = 0;
+            return i;
+        }
+        if (table[i].hash == hash && rec32(offset, 1) == klen &&
+            !memcmp(heap + offset + HB_PMAP_RECORD, key, klen)) {
+            *found = 1;
+            return i;
+        }
+    }
+}
+
+static void pmap_insert(pmap_bucket_t *t, uint64_t size, uint64_t hash, uint64_t offset)
+{
+    uint64_t i = hash & (size - 1);
+
+    while (t[i].offset) i = (i + 1) & (size - 1);
+    t[i].hash = hash;
+    t[i].offset = offset;
+}
+
+/* Backward shift deletion, as in hb_map. */
+static void pmap_shift(uint64_t hole)
+{
+    uint64_t mask = table_size - 1, i = (hole + 1) & mask;
+
+    for (; table[i].offset; i = (i + 1) & mask) {
+        uint64_t home = table[i].hash & mask;
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table[hole] = table[i];
+            table[i].hash = table[i].offset = 0;
+            hole = i;
+        }
+    }
+}
+
+static int pmap_grow(void)
+{
+    pmap_bucket_t *t;
+    uint64_t i, size = table_size * 2;
+
+    if ((t = calloc(size, sizeof(pmap_bucket_t))) == NULL) return HB_ERR;
+
+    for (i = 0; i < table_size; i++)
+        if (table[i].offset) pmap_insert(t, size, table[i].hash, table[i].offset);
+
+    if (pmap_map_index(size) == HB_ERR) {
+        free(t);
+        return HB_ERR;
+    }
+    memcpy(table, t, size * sizeof(pmap_bucket_t));
+    free(t);
+
+    return HB_OK;
+}
+
+/* Size of the valid record at 'offset', 0 if it is torn or corrupt. */
+static int pmap_check(uint64_t offset)
+{
+    uint64_t size;
+
+    /* Zeroed space past the end would pass the crc, keys are never empty */
+    if (offset + HB_PMAP_RECORD > heap_used || rec32(offset, 1) == 0) return 0;
+    size = pmap_record(rec32(offset, 1), rec32(offset, 2));
+    if (offset + size > heap_used || size > INT_MAX) return 0;
+    if (util_crc32(0, heap + offset + 4, size - 4) != rec32(offset, 0)) return 0;
+
+    return (int) size;
+}
+
+/* Append a record to the heap, doubling the file when it is full. */
+static uint64_t pmap_append(const char *key, uint32_t klen, const char *value, uint32_t vlen)
+{
+    uint64_t size = pmap_record(klen, vlen), offset = heap_used;
+    unsigned long crc;
+    char *p;
+
+    if (heap_used + size > heap_cap) {
+        uint64_t cap = heap_cap;
+
+        while (heap_used + size > cap) cap *= 2;
+        if (pmap_map_heap(cap) == HB_ERR) {
+            fprintf(stdout, "hb: %s could not grow mapped heap: %s\n", HB_LOG_ERR, strerror(errno));
+            return 0;
+        }
+    }
+
+    p = heap + offset;
+    memcpy(p + 4, &klen, 4);
+    memcpy(p + 8, &vlen, 4);
+    memcpy(p + HB_PMAP_RECORD, key, klen);
+    if (value) memcpy(p + HB_PMAP_RECORD + klen, value, vlen);
+    crc = util_crc32(0, p + 4, size - 4);
+    memcpy(p, &(uint32_t) { crc }, 4);
+
+    heap_used += size;
+
+    return offset;
+}
+
+/* Replay the heap journal into an empty table, up to the first record
+ * that does not check out. */
+static int pmap_rebuild(void)
+{
+    uint64_t offset = HB_PMAP_HEAP, i;
+    int size, found;
+
+    memset(table, 0, table_size * sizeof(pmap_bucket_t));
+    count = 0;
+    heap_used = heap_cap;
+
+    for (; (size = pmap_check(offset)) > 0; offset += size) {
+        uint32_t klen = rec32(offset, 1);
+        const char *key = heap + offset + HB_PMAP_RECORD;
+        uint64_t hash = map_hashkey(key, klen);
+
+        i = pmap_find(key, klen, hash, &found);
+        if (rec32(offset, 2) == HB_PMAP_TOMBSTONE) {
+            if (found) {
+                table[i].offset = 0;
+                pmap_shift(i);
+                count--;
+            }
+            continue;
+        }
+
+        if (found) {
+            table[i].offset = offset;
+            continue;
+        }
+        if ((count + 1) * 2 > table_size) {
+            if (pmap_grow() == HB_ERR) return HB_ERR;
+            i = pmap_find(key, klen, hash, &found);
+        }
+        table[i].hash = hash;
+        table[i].offset = offset;
+        count++;
+    }
+
+    heap_used = offset;
+    memset(heap + heap_used, 0, heap_cap - heap_used);
+    rebuilt = 1;
+
+    return HB_OK;
+}
+
+int pmap_init(void)
+{
+    pthread_t thread_id;
+    pmap_header_t h;
+    char path[PATH_MAX];
+    struct stat st;
+    uint64_t start = stat_clock();
+
+    if (mkdir(server.dir, 0755) == HB_ERR && errno != EEXIST) {
+        fprintf(stdout, "hb: %s could not create data directory [%s]\n", HB_LOG_ERR, server.dir);
+        return HB_ERR;
+    }
+
+    memset(&h, 0, sizeof(h));
+
+    pmap_name(path, "idx");
+    if ((ifd = open(path, O_RDWR | O_CREAT, 0644)) == HB_ERR) goto err;
+    pmap_name(path, "heap");
+    if ((hfd = open(path, O_RDWR | O_CREAT, 0644)) == HB_ERR) goto err;
+    if (fstat(hfd, &st) == HB_ERR) goto err;
+
+    if (pmap_header_read(&h) == HB_OK && (uint64_t) st.st_size >= h.heap_used &&
+        h.heap_used >= HB_PMAP_HEAP && h.table_size >= HB_PMAP_SIZE) {
+        generation = h.generation;
+        if (pmap_map_index(h.table_size) == HB_ERR ||
+            pmap_map_heap(MAX((uint64_t) st.st_size, HB_PMAP_HEAP_SIZE)) == HB_ERR)
+            goto err;
+
+        if (h.clean) {
+            /* Nothing to read, pages fault in when they are first used */
+            heap_used = h.heap_used;
+            count = h.count;
+            clean = 1;
+        } else if (pmap_rebuild() == HB_ERR) {
+            goto err;
+        }
+    } else {
+        if (st.st_size > HB_PMAP_HEAP)
+            fprintf(stdout, "hb: %s no valid header in [%s/hashbase.idx], replaying heap\n", HB_LOG_WRN, server.dir);
+        if (pmap_map_index(HB_PMAP_SIZE) == HB_ERR ||
+            pmap_map_heap(MAX((uint64_t) st.st_size, HB_PMAP_HEAP_SIZE)) == HB_ERR)
+            goto err;
+        memcpy(heap, "HBHEAP1", 8);
+        if (pmap_rebuild() == HB_ERR) goto err;
+    }
+
+    pmap_checkpoint();
+
+    if (pthread_create(&thread_id, NULL, pmap_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create checkpoint thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    fprintf(stdout, "hb: %s %s %" PRIu64 " keys in %.3fs\n", HB_LOG_OK, rebuilt ? "rebuilt" : "mapped",
+            count, (stat_clock() - start) / 1e9);
+
+    return HB_OK;
+
+err:
+    fprintf(stdout, "hb: %s could not map table in [%s]: %s\n", HB_LOG_ERR, server.dir, strerror(errno));
+    return HB_ERR;
+}
+
+int pmap_put(pipe_t key, pipe_t value)
+{
+    uint64_t hash = map_hashkey(key, pipe_len(key)), offset, i;
+    int found;
+
+    if (pipe_len(key) == 0 || pmap_dirty() == HB_ERR) return HB_ERR;
+    if ((count + 1) * 2 > table_size && pmap_grow() == HB_ERR) return HB_ERR;
+    if ((offset = pmap_append(key, pipe_len(key), value, pipe_len(value))) == 0) return HB_ERR;
+
+    i = pmap_find(key, pipe_len(key), hash, &found);
+    table[i].hash = hash;
+    table[i].offset = offset;
+    if (!found) count++;
+
+    return HB_OK;
+}
+
+pipe_t pmap_get(pipe_t key)
+{
+    uint64_t i = pmap_find(key, pipe_len(key), map_hashkey(key, pipe_len(key)), &(int) { 0 });
+
+    if (table[i].offset == 0) return NULL;
+
+    return pipe_newlen(heap + table[i].offset + HB_PMAP_RECORD + pipe_len(key),
+                       rec32(table[i].offset, 2));
+}
+
+int pmap_del(pipe_t key)
+{
+    uint64_t i;
+    int found;
+
+    i = pmap_find(key, pipe_len(key), map_hashkey(key, pipe_len(key)), &found);
+    if (!found) return HB_OK;
+
+    /* The tombstone is only there for the journal replay */
+    if (pmap_dirty() == HB_ERR || pmap_append(key, pipe_len(key), NULL, HB_PMAP_TOMBSTONE) == 0)
+        return HB_ERR;
+
+    table[i].offset = 0;
+    pmap_shift(i);
+    count--;
+
+    return HB_OK;
+}
+
+long long pmap_len(void)
+{
+    return count;
+}
+
+int pmap_clr(void)
+{
+    if (pmap_dirty() == HB_ERR) return HB_ERR;
+
+    if (pmap_map_index(HB_PMAP_SIZE) == HB_ERR || pmap_map_heap(HB_PMAP_HEAP_SIZE) == HB_ERR) return HB_ERR;
+    memset(table, 0, table_size * sizeof(pmap_bucket_t));
+    memset(heap + HB_PMAP_HEAP, 0, heap_cap - HB_PMAP_HEAP);
+    heap_used = HB_PMAP_HEAP;
+    count = 0;
+
+    pmap_checkpoint();
+
+    return HB_OK;
+}
+
+/* Copy the live records into a new heap file, then point the buckets at
+ * the copies. Until the checkpoint at the end the header is dirty, so a
+ * crash in between replays whichever heap file is in place. */
+int pmap_compact(void)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    uint64_t *moved, i, used = HB_PMAP_HEAP;
+    int fd, status = HB_OK;
+
+    if ((moved = malloc(table_size * sizeof(uint64_t))) == NULL) return HB_ERR;
+
+    pmap_name(path, "heap");
+    pmap_name(tmp, "heap.tmp");
+    if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) == HB_ERR) {
+        free(moved);
+        return HB_ERR;
+    }
+
+    if (pwrite(fd, heap, HB_PMAP_HEAP, 0) != HB_PMAP_HEAP) status = HB_ERR;
+    for (i = 0; i < table_size && status == HB_OK; i++) {
+        uint64_t offset = table[i].offset, size;
+
+        if (offset == 0) continue;
+        size = pmap_record(rec32(offset, 1), rec32(offset, 2));
+        if (pwrite(fd, heap + offset, size, used) != (ssize_t) size) status = HB_ERR;
+        moved[i] = used;
+        used += size;
+    }
+
+    if (status == HB_OK && (fdatasync(fd) == HB_ERR || pmap_dirty() == HB_ERR || rename(tmp, path) == HB_ERR))
+        status = HB_ERR;
+
+    if (status == HB_OK) {
+        close(hfd);
+        hfd = fd;
+        munmap(heap, heap_cap);
+        heap = NULL;
+        if (pmap_map_heap(MAX(used, HB_PMAP_HEAP_SIZE)) == HB_ERR) {
+            fprintf(stdout, "hb: %s could not map compacted heap\n", HB_LOG_ERR);
+            free(moved);
+            return HB_ERR;
+        }
+        for (i = 0; i < table_size; i++)
+            if (table[i].offset) table[i].offset = moved[i];
+        heap_used = used;
+        pmap_checkpoint();
+    } else {
+        close(fd);
+        unlink(tmp);
+    }
+
+    free(moved);
+
+    return status;
+}
+
+void pmap_close(void)
+{
+    pmap_checkpoint();
+}
+
+/* Touch every page of a mapping in chunks, dropping the lock in between so
+ * commands are served while the data is brought in. */
+static void pmap_prefault(char **base, uint64_t len)
+{
+    volatile char sink;
+    uint64_t off, end, page = sysconf(_SC_PAGESIZE);
+
+    for (off = 0; off < len; off = end) {
+        pthread_mutex_lock(&server.mutex);
+        end = MIN(off + HB_PMAP_PREFAULT, len);
+        if (*base && end <= (base == &heap ? heap_used : index_len)) {
+            madvise(*base + off, end - off, MADV_WILLNEED);
+            for (; off < end; off += page) sink = (*base)[off];
+        } else {
+            end = len;
+        }
+        pthread_mutex_unlock(&server.mutex);
+    }
+    (void) sink;
+}
+
+/* Checkpoint once a second, so after a crash only what happened since
+ * needs to be replayed and a clean restart maps the files as they are. */
+static void *pmap_loop(void *arg)
+{
+    if (server.prefault) {
+        uint64_t start = stat_clock();
+
+        pmap_prefault(&index_base, index_len);
+        pmap_prefault(&heap, heap_used);
+        fprintf(stdout, "hb: %s prefaulted mapped table in %.3fs\n", HB_LOG_INF, (stat_clock() - start) / 1e9);
+    }
+
+    for (;;) {
+        sleep(HB_PMAP_CHECKPOINT);
+
+        pthread_mutex_lock(&server.mutex);
+        pmap_checkpoint();
+        pthread_mutex_unlock(&server.mutex);
+    }
+
+    return NULL;
+}
+
+pipe_t pmap_catinfo(pipe_t s)
+{
+    s = pipe_catprintf(s, "pmap_dir:%s\n", server.dir);
+    s = pipe_catprintf(s, "pmap_table_size:%" PRIu64 "\n", table_size);
+    s = pipe_catprintf(s, "pmap_heap_used:%" PRIu64 "\n", heap_used);
+    s = pipe_catprintf(s, "pmap_heap_capacity:%" PRIu64 "\n", heap_cap);
+    s = pipe_catprintf(s, "pmap_generation:%" PRIu64 "\n", generation);
+    s = pipe_catprintf(s, "pmap_clean:%d\n", clean);
+    s = pipe_catprintf(s, "pmap_rebuilt_on_start:%d\n", rebuilt);
+
+    return s;
+}
@@ -0,0 +1,79 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_PMAP_H_
+#define _HB_PMAP_H_
+
+/* The index file starts with two header slots written alternately, the
+ * valid one with the higher generation is current, then the bucket array
+ * from HB_PMAP_TABLE on. A bucket holds the key hash and the heap offset
+ * of its record, 0 when empty. The heap file is a journal of records: crc32
+ * of the rest, key length, value length (HB_PMAP_TOMBSTONE for a delete),
+ * key and value. Numbers are in host byte order, the files are mapped
+ * as they are. */
+#define HB_PMAP_MAGIC       "HBPMAP1"
+#define HB_PMAP_SLOT        512
+#define HB_PMAP_TABLE       4096
+#define HB_PMAP_HEAP        16              /* Heap magic, no record at 0 */
+#define HB_PMAP_RECORD      12
+#define HB_PMAP_TOMBSTONE   0xffffffffU
+
+typedef struct _pmap_header {
+    char magic[8];
+    uint64_t generation;
+    uint64_t table_size;
+    uint64_t count;
+    uint64_t heap_used;
+    uint64_t clean;                         /* Buckets match the heap */
+    uint32_t crc;
+    uint32_t pad;
+} pmap_header_t;
+
+typedef struct _pmap_bucket {
+    uint64_t hash;
+    uint64_t offset;
+} pmap_bucket_t;
+
+/* Map the files in server.dir. After a clean shutdown or checkpoint this
+ * is all, otherwise the table is rebuilt from the heap. */
+int       pmap_init(void);
+
+int       pmap_put(pipe_t, pipe_t);
+pipe_t    pmap_get(pipe_t);
+int       pmap_del(pipe_t);
+long long pmap_len(void);
+int       pmap_clr(void);
+
+/* Rewrite the heap with the live records only. */
+int       pmap_compact(void);
+
+/* Checkpoint so the next start maps the files without a rebuild. */
+void      pmap_close(void);
+
+pipe_t    pmap_catinfo(pipe_t);
+
+#endif
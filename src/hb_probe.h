@@ -0,0 +1,60 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_PROBE_H_
+#define _HB_PROBE_H_
+
+/* Static tracepoints for perf, bpftrace and systemtap:
+ *
+ *   bpftrace -e 'usdt:./hashbase:hashbase:map__get { @[arg1] = count(); }'
+ *
+ * With <sys/sdt.h> every probe is a single nop plus a note in the ELF file,
+ * the arguments are only materialized in registers. Configure with
+ * --disable-probes to compile them out entirely. Keep the arguments cheap,
+ * they are evaluated even when no tracer is attached. */
+
+#if defined(HB_PROBES)
+
+#include <sys/sdt.h>
+
+#define HB_PROBE(name)                      DTRACE_PROBE(hashbase, name)
+#define HB_PROBE1(name, a)                  DTRACE_PROBE1(hashbase, name, a)
+#define HB_PROBE2(name, a, b)               DTRACE_PROBE2(hashbase, name, a, b)
+#define HB_PROBE3(name, a, b, c)            DTRACE_PROBE3(hashbase, name, a, b, c)
+#define HB_PROBE4(name, a, b, c, d)         DTRACE_PROBE4(hashbase, name, a, b, c, d)
+
+#else
+
+#define HB_PROBE(name)                      do { } while (0)
+#define HB_PROBE1(name, a)                  do { } while (0)
+#define HB_PROBE2(name, a, b)               do { } while (0)
+#define HB_PROBE3(name, a, b, c)            do { } while (0)
+#define HB_PROBE4(name, a, b, c, d)         do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,519 @@
+/*
+ * REPL                  Asynchronous replication from a primary to replicas.
+ *
+ * Version:                                     @(#)repl.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+/* Buffered reading of what the primary sends */
+typedef struct _repl_reader {
+    int sock;
+    pipe_t buf;
+    size_t pos;
+} repl_reader_t;
+
+/* The stream. 'offset' counts its bytes under 'replid', the backlog keeps
+ * the last server.repl_backlog of them from 'first' on; it is allocated
+ * when the first replica connects. 'epoch' changes with the id, so the
+ * senders of a replica drop their own replicas after a full resync. All
+ * of it is protected by 'lock', which is taken inside the database lock
+ * and only ever held for a copy, senders write to their sockets without. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fed = PTHREAD_COND_INITIALIZER;
+static char replid[HB_REPL_ID + 1];
+static uint64_t offset;
+static char *backlog;
+static uint64_t first;
+static uint64_t epoch;
+static int replicas;
+static uint64_t full_syncs;
+static uint64_t partial_syncs;
+static pipe_t line;                         /* Formatting, under the database lock */
+
+/* Replica side */
+static int link_up;
+static time_t link_io;
+
+static void  repl_append(const char *, size_t);
+static int   repl_full(int, uint64_t *);
+static void  repl_stream(int, uint64_t, uint64_t);
+static void *repl_loop(void *);
+static int   repl_connect(void);
+static int   repl_fill(repl_reader_t *);
+static pipe_t repl_line(repl_reader_t *);
+static int   repl_handshake(repl_reader_t *);
+static int   repl_load(repl_reader_t *, const char *, uint64_t, uint64_t);
+static int   repl_apply(const char *, size_t);
+static void  repl_follow(repl_reader_t *);
+
+int repl_init(void)
+{
+    unsigned char seed[HB_REPL_ID / 2];
+    pthread_t thread_id;
+    int fd, i;
+
+    /* Different on every start, a restarted primary's offsets mean nothing */
+    if ((fd = open("/dev/urandom", O_RDONLY)) == HB_ERR || read(fd, seed, sizeof(seed)) != sizeof(seed)) {
+        srand(time(NULL) ^ getpid());
+        for (i = 0; i < (int) sizeof(seed); i++) seed[i] = rand();
+    }
+    if (fd != HB_ERR) close(fd);
+    for (i = 0; i < (int) sizeof(seed); i++) sprintf(replid + 2 * i, "%02x", seed[i]);
+
+    line = pipe_empty();
+
+    if (server.replicaof == NULL) return HB_OK;
+
+    if (strchr(server.replicaof, ':') == NULL) {
+        fprintf(stdout, "hb: %s primary must be given as host:port [%s]\n", HB_LOG_ERR, server.replicaof);
+        return HB_ERR;
+    }
+    if (pthread_create(&thread_id, NULL, repl_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create replication thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    fprintf(stdout, "hb: %s replica of [%s], writes from clients are refused\n", HB_LOG_INF, server.replicaof);
+
+    return HB_OK;
+}
+
+/* Called with 'lock' held. A command longer than the backlog only leaves
+ * its tail, the offset still counts all of it. */
+static void repl_append(const char *p, size_t len)
+{
+    size_t size = server.repl_backlog, pos, n;
+
+    if (backlog) {
+        if (len > size) {
+            offset += len - size;
+            p += len - size;
+            len = size;
+        }
+        pos = offset % size;
+        n = MIN(len, size - pos);
+        memcpy(backlog + pos, p, n);
+        memcpy(backlog, p + n, len - n);
+    }
+    offset += len;
+    if (backlog && offset - first > size) first = offset - size;
+
+    pthread_cond_broadcast(&fed);
+}
+
+void repl_feed(pipe_t *tokens, int count)
+{
+    int i;
+
+    pthread_mutex_lock(&lock);
+
+    /* Nobody asked for the stream yet */
+    if (backlog == NULL) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    pipe_clear(line);
+    for (i = 0; i < count; i++) {
+        if (i) line = pipe_catlen(line, " ", 1);
+        line = pipe_catrepr(line, tokens[i], pipe_len(tokens[i]));
+    }
+    line = pipe_catlen(line, "\r\n", 2);
+    repl_append(line, pipe_len(line));
+
+    pthread_mutex_unlock(&lock);
+}
+
+void repl_serve(int sock, pipe_t request)
+{
+    pipe_t *tokens;
+    uint64_t from = 0, current;
+    int count, partial, status;
+
+    tokens = pipe_splitargs(request, &count);
+
+    /* Only the memory engine can be copied with a snapshot */
+    if (count != 3 || server.engine->durable || server.repl_backlog <= 0) {
+        util_send(sock, "-1\r\n", 4);
+        pipe_freesplitres(tokens, count);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (backlog == NULL && (backlog = malloc(server.repl_backlog)) != NULL) first = offset;
+
+    from = strtoull(tokens[2], NULL, 10);
+    partial = backlog && !strcmp(tokens[1], replid) && from >= first && from <= offset;
+    current = epoch;
+    replicas++;
+    if (partial) partial_syncs++; else full_syncs++;
+    pthread_mutex_unlock(&lock);
+
+    pipe_freesplitres(tokens, count);
+
+    fprintf(stdout, "hb: %s replica [fd: %d] %s\n", HB_LOG_INF, sock, partial ? "continues" : "needs a full resync");
+
+    status = partial ? util_send(sock, "continue\r\n", 10) : repl_full(sock, &from);
+    if (status == HB_OK) repl_stream(sock, from, current);
+
+    pthread_mutex_lock(&lock);
+    replicas--;
+    pthread_mutex_unlock(&lock);
+
+    fprintf(stdout, "hb: %s replica [fd: %d] is gone\n", HB_LOG_INF, sock);
+}
+
+/* A snapshot of exactly the writes before 'from', written by a forked
+ * child like bgsave and sent as it is, compressed values included. The
+ * replica gets keepalives while the child works, so a big dataset does not
+ * run into its read timeout. */
+static int repl_full(int sock, uint64_t *from)
+{
+    char path[PATH_MAX], buf[HB_REPL_CHUNK];
+    struct stat st;
+    pipe_t head;
+    ssize_t n;
+    uint64_t ping = stat_clock();
+    int fd, status;
+    pid_t pid, done;
+
+    if (mkdir(server.dir, 0755) == HB_ERR && errno != EEXIST) return HB_ERR;
+    snprintf(path, sizeof(path), "%s/replica-%d.snap", server.dir, sock);
+
+    pthread_mutex_lock(&server.mutex);
+    pthread_mutex_lock(&lock);
+    *from = offset;
+    pthread_mutex_unlock(&lock);
+    if ((pid = fork()) == 0) _exit(save_write(path) == HB_OK ? 0 : 1);
+    pthread_mutex_unlock(&server.mutex);
+
+    if (pid == HB_ERR) {
+        fprintf(stdout, "hb: %s could not fork for replica snapshot: %s\n", HB_LOG_ERR, strerror(errno));
+        return HB_ERR;
+    }
+    while ((done = waitpid(pid, &status, WNOHANG)) != pid) {
+        if (done == HB_ERR && errno != EINTR) break;
+        if (stat_clock() - ping >= HB_REPL_PING * 1000000000ULL) {
+            if (util_send(sock, "\r\n", 2) == HB_ERR) {
+                kill(pid, SIGKILL);
+                while (waitpid(pid, &status, 0) == HB_ERR && errno == EINTR);
+                unlink(path);
+                return HB_ERR;
+            }
+            ping = stat_clock();
+        }
+        usleep(HB_REPL_WAIT * 1000);
+    }
+
+    if (done != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || (fd = open(path, O_RDONLY)) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not write replica snapshot [%s]\n", HB_LOG_ERR, path);
+        unlink(path);
+        return HB_ERR;
+    }
+    unlink(path);
+    fstat(fd, &st);
+
+    head = pipe_catprintf(pipe_empty(), "fullresync %s %" PRIu64 " %lld\r\n", replid, *from, (long long) st.st_size);
+    status = util_send(sock, head, pipe_len(head));
+    pipe_free(head);
+
+    while (status == HB_OK && (n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno != EINTR) status = HB_ERR;
+            continue;
+        }
+        status = util_send(sock, buf, n);
+    }
+    close(fd);
+
+    return status;
+}
+
+/* Send the stream from 'from' on as it is fed, a keepalive when idle. A
+ * replica that falls out of the backlog is dropped, it comes back and
+ * asks for a full resync. */
+static void repl_stream(int sock, uint64_t from, uint64_t current)
+{
+    char *buf = malloc(HB_REPL_CHUNK);
+    struct timespec ts;
+    size_t n;
+
+    while (buf) {
+        pthread_mutex_lock(&lock);
+        if (from == offset) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += HB_REPL_PING;
+            pthread_cond_timedwait(&fed, &lock, &ts);
+        }
+        if (epoch != current || from < first || from > offset) {
+            pthread_mutex_unlock(&lock);
+            fprintf(stdout, "hb: %s replica [fd: %d] fell out of the backlog\n", HB_LOG_WRN, sock);
+            break;
+        }
+        n = MIN(offset - from, HB_REPL_CHUNK);
+        n = MIN(n, server.repl_backlog - from % server.repl_backlog);
+        memcpy(buf, backlog + from % server.repl_backlog, n);
+        pthread_mutex_unlock(&lock);
+
+        if (util_send(sock, n ? buf : "\r\n", n ? n : 2) == HB_ERR) break;
+        from += n;
+    }
+
+    free(buf);
+}
+
+static void *repl_loop(void *arg)
+{
+    repl_reader_t r;
+
+    r.buf = pipe_empty();
+
+    for (;; sleep(HB_REPL_RETRY)) {
+        if ((r.sock = repl_connect()) == HB_ERR) continue;
+
+        pipe_clear(r.buf);
+        r.pos = 0;
+
+        if (repl_handshake(&r) == HB_OK) {
+            link_up = 1;
+            fprintf(stdout, "hb: %s following primary [%s]\n", HB_LOG_OK, server.replicaof);
+            repl_follow(&r);
+            link_up = 0;
+            fprintf(stdout, "hb: %s lost primary [%s]\n", HB_LOG_WRN, server.replicaof);
+        }
+        close(r.sock);
+    }
+
+    return NULL;
+}
+
+static int repl_connect(void)
+{
+    struct addrinfo hints, *res, *ai;
+    struct timeval tv = { HB_REPL_TIMEOUT, 0 };
+    char host[256], *port;
+    int sock = HB_ERR;
+
+    snprintf(host, sizeof(host), "%s", server.replicaof);
+    port = strrchr(host, ':');
+    *port++ = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return HB_ERR;
+
+    for (ai = res; ai && sock == HB_ERR; ai = ai->ai_next) {
+        if ((sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == HB_ERR) continue;
+        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == HB_ERR) {
+            close(sock);
+            sock = HB_ERR;
+        }
+    }
+    freeaddrinfo(res);
+
+    /* The primary sends at least a keepalive every HB_REPL_PING seconds */
+    if (sock != HB_ERR) setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    return sock;
+}
+
+static int repl_fill(repl_reader_t *r)
+{
+    char buf[HB_REPL_CHUNK];
+    ssize_t n;
+
+    /* Drop what was consumed before reading more */
+    if (r->pos) {
+        pipe_range(r->buf, r->pos, -1);
+        r->pos = 0;
+    }
+
+    while ((n = recv(r->sock, buf, sizeof(buf), 0)) < 0 && errno == EINTR);
+    if (n <= 0) return HB_ERR;
+
+    r->buf = pipe_catlen(r->buf, buf, n);
+    link_io = time(NULL);
+
+    return HB_OK;
+}
+
+/* The next line without its CRLF, NULL once the connection is gone */
+static pipe_t repl_line(repl_reader_t *r)
+{
+    char *nl;
+
+    while ((nl = memmem(r->buf + r->pos, pipe_len(r->buf) - r->pos, "\r\n", 2)) == NULL)
+        if (repl_fill(r) == HB_ERR) return NULL;
+
+    return pipe_newlen(r->buf + r->pos, nl - (r->buf + r->pos));
+}
+
+static int repl_handshake(repl_reader_t *r)
+{
+    pipe_t request, reply, *tokens;
+    int count, status = HB_ERR;
+
+    pthread_mutex_lock(&lock);
+    request = pipe_catprintf(pipe_empty(), "psync %s %" PRIu64 "\r\n", replid, offset);
+    pthread_mutex_unlock(&lock);
+
+    if (util_send(r->sock, request, pipe_len(request)) == HB_ERR) {
+        pipe_free(request);
+        return HB_ERR;
+    }
+    pipe_free(request);
+
+    /* Keepalives come while the primary is still writing the snapshot */
+    while ((reply = repl_line(r)) != NULL && pipe_len(reply) == 0) {
+        r->pos += 2;
+        pipe_free(reply);
+    }
+    if (reply == NULL) return HB_ERR;
+    r->pos += pipe_len(reply) + 2;
+
+    tokens = pipe_splitargs(reply, &count);
+    if (count == 1 && !strcmp(tokens[0], "continue")) {
+        status = HB_OK;
+    } else if (count == 4 && !strcmp(tokens[0], "fullresync") && pipe_len(tokens[1]) == HB_REPL_ID) {
+        status = repl_load(r, tokens[1], strtoull(tokens[2], NULL, 10), strtoull(tokens[3], NULL, 10));
+    } else {
+        fprintf(stdout, "hb: %s primary refused to replicate [%s]\n", HB_LOG_ERR, server.replicaof);
+    }
+    pipe_freesplitres(tokens, count);
+    pipe_free(reply);
+
+    return status;
+}
+
+/* Take the snapshot into a file and replace the database with it. */
+static int repl_load(repl_reader_t *r, const char *id, uint64_t from, uint64_t len)
+{
+    char path[PATH_MAX];
+    uint64_t n, at = 0;
+    int fd, status = HB_OK;
+
+    if (mkdir(server.dir, 0755) == HB_ERR && errno != EEXIST) return HB_ERR;
+    snprintf(path, sizeof(path), "%s/replica.snap", server.dir);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not create [%s]: %s\n", HB_LOG_ERR, path, strerror(errno));
+        return HB_ERR;
+    }
+
+    while (len > 0 && status == HB_OK) {
+        if (r->pos == pipe_len(r->buf) && (status = repl_fill(r)) == HB_ERR) break;
+        n = MIN(len, pipe_len(r->buf) - r->pos);
+        status = util_pwrite(fd, r->buf + r->pos, n, at);
+        at += n;
+        r->pos += n;
+        len -= n;
+    }
+    close(fd);
+
+    if (status == HB_OK) {
+        pthread_mutex_lock(&server.mutex);
+        server.engine->clr();
+        if ((status = save_read(path)) == HB_OK) {
+            pthread_mutex_lock(&lock);
+            memcpy(replid, id, HB_REPL_ID);
+            offset = first = from;
+            epoch++;
+            pthread_mutex_unlock(&lock);
+
+            /* The log has to start over from what was loaded */
+            server.dirty++;
+            if (server.aof) aof_rewrite();
+        }
+        pthread_mutex_unlock(&server.mutex);
+    }
+    unlink(path);
+
+    if (status == HB_OK)
+        fprintf(stdout, "hb: %s full resync from [%s] at offset %" PRIu64 "\n", HB_LOG_OK, server.replicaof, from);
+
+    return status;
+}
+
+/* Run one command of the stream, 'len' includes its CRLF. */
+static int repl_apply(const char *p, size_t len)
+{
+    struct ascii_t *command;
+    pipe_t cmd, *tokens;
+    int count;
+
+    cmd = pipe_newlen(p, len - 2);
+    tokens = pipe_splitargs(cmd, &count);
+    pipe_free(cmd);
+
+    if ((command = ascii_lookup(tokens, count)) == NULL) {
+        fprintf(stdout, "hb: %s bad command in replication stream\n", HB_LOG_ERR);
+        pipe_freesplitres(tokens, count);
+        return HB_ERR;
+    }
+
+    pthread_mutex_lock(&server.mutex);
+    pipe_free(command->func(tokens, count));
+    aof_feed(tokens, count);
+    server.dirty++;
+
+    /* Kept as received, so this replica's offsets are the primary's */
+    pthread_mutex_lock(&lock);
+    repl_append(p, len);
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&server.mutex);
+
+    aof_sync();
+    pipe_freesplitres(tokens, count);
+
+    return HB_OK;
+}
+
+static void repl_follow(repl_reader_t *r)
+{
+    char *nl;
+
+    for (;;) {
+        while ((nl = memmem(r->buf + r->pos, pipe_len(r->buf) - r->pos, "\r\n", 2)) != NULL) {
+            size_t len = nl + 2 - (r->buf + r->pos);
+
+            /* Keepalive */
+            if (len > 2 && repl_apply(r->buf + r->pos, len) == HB_ERR) return;
+            r->pos += len;
+        }
+        if (repl_fill(r) == HB_ERR) return;
+    }
+}
+
+pipe_t repl_catinfo(pipe_t s)
+{
+    pthread_mutex_lock(&lock);
+    s = pipe_catprintf(s, "role:%s\n", server.replicaof ? "replica" : "primary");
+    if (server.replicaof) {
+        s = pipe_catprintf(s, "primary:%s\n", server.replicaof);
+        s = pipe_catprintf(s, "primary_link_status:%s\n", link_up ? "up" : "down");
+        s = pipe_catprintf(s, "primary_last_io_seconds_ago:%ld\n", link_io ? (long) (time(NULL) - link_io) : -1L);
+    }
+    s = pipe_catprintf(s, "connected_replicas:%d\n", replicas);
+    s = pipe_catprintf(s, "repl_id:%s\n", replid);
+    s = pipe_catprintf(s, "repl_offset:%" PRIu64 "\n", offset);
+    s = pipe_catprintf(s, "repl_backlog_size:%lld\n", backlog ? server.repl_backlog : 0LL);
+    s = pipe_catprintf(s, "repl_backlog_first_offset:%" PRIu64 "\n", first);
+    s = pipe_catprintf(s, "repl_full_syncs:%" PRIu64 "\n", full_syncs);
+    s = pipe_catprintf(s, "repl_partial_syncs:%" PRIu64 "\n", partial_syncs);
+    pthread_mutex_unlock(&lock);
+
+    return s;
+}
@@ -0,0 +1,56 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_REPL_H_
+#define _HB_REPL_H_
+
+/* Replication is asynchronous. The stream is the write commands in the
+ * format of the append only file, its position is a byte offset that goes
+ * with a replication id. A replica connects and sends
+ *
+ *     psync <id> <offset>
+ *
+ * with the id and offset it has. If the primary still has the stream from
+ * there in its backlog it answers "continue" and sends the rest, otherwise
+ * "fullresync <id> <offset> <bytes>" and a snapshot taken at that offset,
+ * then the stream. An empty line is a keepalive and is not counted. */
+#define HB_REPL_ID          40
+
+/* Choose a replication id and, on a replica, start following the primary. */
+int     repl_init(void);
+
+/* Append a write command to the stream. Must be called with the database
+ * lock held, so the stream order is the execution order. */
+void    repl_feed(pipe_t *, int);
+
+/* Serve a replica on a connection that sent psync, until it goes away. */
+void    repl_serve(int, pipe_t);
+
+/* Append the replication section of the inf report. */
+pipe_t  repl_catinfo(pipe_t);
+
+#endif
@@ -0,0 +1,778 @@
+/*
+ * SAVE                Point-in-time snapshots of the database, forked or not.
+ *
+ * Version:                                     @(#)save.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+extern map_t database;
+
+/* Output goes through one large buffer so the file is written with few big
+ * sequential write() calls. Records are gathered in a chunk first. */
+typedef struct _save_file {
+    int fd;
+    int failed;
+    unsigned char *buf;
+    size_t len;
+    pipe_t chunk;
+    uint32_t records;
+    unsigned long crc;                      /* Of the header and chunk crcs */
+} save_file_t;
+
+typedef struct _save_chunk {
+    const unsigned char *p;
+    uint32_t len;
+    uint32_t records;
+} save_chunk_t;
+
+/* A decoded key and value, waiting to be put into its shard. */
+typedef struct _save_item {
+    pipe_t key;
+    object_t *value;
+    int home;
+} save_item_t;
+
+/* A hash being decoded and the field still waiting for its value */
+typedef struct _save_pair {
+    object_t *object;
+    const char *field;
+    size_t len;
+} save_pair_t;
+
+/* Loading runs in two parallel passes: every thread decodes chunks and
+ * sorts the records by the shard of their home bucket, then every thread
+ * inserts one shard, a disjoint range of the presized table. */
+typedef struct _save_loader {
+    save_chunk_t *chunks;
+    int nchunks;
+    int next;
+    int threads;
+    int verify;                             /* Chunks carry a crc */
+    int failed;
+    pipe_t *lists;                          /* threads x shards item arrays */
+    pipe_t *left;                           /* Per shard, for map_put() */
+} save_loader_t;
+
+typedef struct _save_worker {
+    save_loader_t *loader;
+    int id;
+} save_worker_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pid_t child;
+static uint64_t child_start;
+static uint64_t child_dirty;
+static time_t last_save;
+static uint64_t last_nsec;
+static int last_status = HB_OK;
+
+static void  save_append(save_file_t *, const void *, size_t);
+static void  save_varint(save_file_t *, uint64_t);
+static void  save_flush(save_file_t *);
+static void  save_chunk(save_file_t *);
+static int   save_element(any_t, const char *, size_t);
+static int   save_member(any_t, const char *, size_t, double);
+static int   save_entry(any_t, char *, any_t);
+static void *save_wait(void *);
+static const unsigned char *save_decode_elements(const unsigned char *, const unsigned char *, uint64_t,
+                                                 int (*)(any_t, const char *, size_t), any_t);
+static int   save_list_push(any_t, const char *, size_t);
+static int   save_hash_set(any_t, const char *, size_t);
+static int   save_zset_add(any_t, const char *, size_t);
+static int   save_set_add(any_t, const char *, size_t);
+static int   save_decode_chunk(save_loader_t *, int, save_chunk_t *);
+static void *save_decode(void *);
+static void *save_insert(void *);
+static void  save_run(save_loader_t *, void *(*)(void *));
+static void  save_discard(save_loader_t *);
+
+static void save_flush(save_file_t *f)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < f->len && !f->failed) {
+        if ((n = write(f->fd, f->buf + off, f->len - off)) < 0) {
+            if (errno != EINTR) f->failed = 1;
+            continue;
+        }
+        off += n;
+    }
+    f->len = 0;
+}
+
+static void save_append(save_file_t *f, const void *data, size_t len)
+{
+    if (f->len + len > HB_SAVE_BUFFER) save_flush(f);
+
+    /* Values bigger than the buffer skip it */
+    if (len > HB_SAVE_BUFFER) {
+        unsigned char *buf = f->buf;
+
+        f->buf = (unsigned char *) data;
+        f->len = len;
+        save_flush(f);
+        f->buf = buf;
+        return;
+    }
+
+    memcpy(f->buf + f->len, data, len);
+    f->len += len;
+}
+
+static void save_varint(save_file_t *f, uint64_t value)
+{
+    unsigned char buf[HB_UTIL_VARINT];
+    int n = util_varint_put(buf, value);
+
+    f->chunk = pipe_catlen(f->chunk, buf, n);
+}
+
+/* Frame the gathered records and pass them on to the file buffer. */
+static void save_chunk(save_file_t *f)
+{
+    unsigned char frame[HB_SAVE_FRAME], crc[4];
+
+    if (f->records == 0) return;
+
+    util_put32(frame, pipe_len(f->chunk));
+    util_put32(frame + 4, f->records);
+    util_put32(crc, util_crc32(0, f->chunk, pipe_len(f->chunk)));
+    f->crc = util_crc32(f->crc, crc, 4);
+
+    save_append(f, frame, HB_SAVE_FRAME);
+    save_append(f, f->chunk, pipe_len(f->chunk));
+    save_append(f, crc, 4);
+
+    pipe_clear(f->chunk);
+    f->records = 0;
+}
+
+static int save_element(any_t item, const char *value, size_t len)
+{
+    save_file_t *f = item;
+
+    save_varint(f, len);
+    f->chunk = pipe_catlen(f->chunk, value, len);
+
+    return HB_OK;
+}
+
+static int save_member(any_t item, const char *member, size_t len, double score)
+{
+    unsigned char bits[8];
+    uint64_t u;
+
+    memcpy(&u, &score, sizeof(u));
+    util_put64(bits, u);
+    save_element(item, member, len);
+
+    return save_element(item, (const char *) bits, sizeof(bits));
+}
+
+static int save_entry(any_t item, char *key, any_t data)
+{
+    save_file_t *f = item;
+    object_t *o = data;
+    pipe_t value = o->ptr;
+    unsigned char type;
+    long long number = (intptr_t) o->ptr;
+
+    /* A stream goes as its blocks are */
+    if (o->type == HB_OBJ_STREAM) {
+        type = HB_SAVE_STREAM;
+        value = stream_dump(o);
+        f->chunk = pipe_catlen(f->chunk, &type, 1);
+        save_varint(f, pipe_len(key));
+        f->chunk = pipe_catlen(f->chunk, key, pipe_len(key));
+        save_varint(f, pipe_len(value));
+        f->chunk = pipe_catlen(f->chunk, value, pipe_len(value));
+        pipe_free(value);
+
+        if (++f->records && pipe_len(f->chunk) >= HB_SAVE_CHUNK) save_chunk(f);
+
+        return f->failed ? HB_ERR : HB_OK;
+    }
+
+    /* Collections are their element count and the elements */
+    if (o->type != HB_OBJ_STRING) {
+        type = o->type == HB_OBJ_LIST ? HB_SAVE_LIST : o->type == HB_OBJ_HASH ? HB_SAVE_HASH :
+               o->type == HB_OBJ_ZSET ? HB_SAVE_ZSET : HB_SAVE_SET;
+        f->chunk = pipe_catlen(f->chunk, &type, 1);
+        save_varint(f, pipe_len(key));
+        f->chunk = pipe_catlen(f->chunk, key, pipe_len(key));
+        switch (o->type) {
+            case HB_OBJ_LIST:
+                save_varint(f, list_length(o->ptr));
+                list_iterate(o->ptr, save_element, f);
+                break;
+            case HB_OBJ_HASH:
+                save_varint(f, hash_length(o));
+                hash_iterate(o, save_element, f);
+                break;
+            case HB_OBJ_ZSET:
+                save_varint(f, zset_length(o));
+                zset_iterate(o, save_member, f);
+                break;
+            case HB_OBJ_SET:
+                save_varint(f, set_length(o));
+                set_iterate(o, save_element, f);
+                break;
+        }
+
+        if (++f->records && pipe_len(f->chunk) >= HB_SAVE_CHUNK) save_chunk(f);
+
+        return f->failed ? HB_ERR : HB_OK;
+    }
+
+    if (o->encoding == HB_ENC_TIER && (value = tier_read(o->ptr)) == NULL) {
+        f->failed = 1;
+        return HB_ERR;
+    }
+
+    /* Compressed values are written the way they are kept */
+    if (o->encoding == HB_ENC_INT)
+        type = HB_SAVE_INT;
+    else if (o->encoding == HB_ENC_LZF || (o->encoding == HB_ENC_TIER && HB_TIER_ISPACKED(o->ptr)))
+        type = HB_SAVE_LZF;
+    else
+        type = util_strtoll(value, pipe_len(value), &number) ? HB_SAVE_INT : HB_SAVE_STRING;
+
+    f->chunk = pipe_catlen(f->chunk, &type, 1);
+    save_varint(f, pipe_len(key));
+    f->chunk = pipe_catlen(f->chunk, key, pipe_len(key));
+
+    if (type == HB_SAVE_INT) {
+        save_varint(f, util_zigzag(number));
+    } else {
+        save_varint(f, pipe_len(value));
+        f->chunk = pipe_catlen(f->chunk, value, pipe_len(value));
+    }
+
+    if (o->encoding == HB_ENC_TIER) pipe_free(value);
+
+    if (++f->records && pipe_len(f->chunk) >= HB_SAVE_CHUNK) save_chunk(f);
+
+    return f->failed ? HB_ERR : HB_OK;
+}
+
+/* Write the whole database to a temporary file and rename it over 'path'
+ * once it is synced, so a crash never leaves a half written snapshot. */
+int save_write(const char *path)
+{
+    save_file_t f;
+    unsigned char header[16 + HB_UTIL_VARINT], trailer[5];
+    char tmp[PATH_MAX];
+    int len, status;
+
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int) getpid());
+
+    memset(&f, 0, sizeof(f));
+    if ((f.buf = malloc(HB_SAVE_BUFFER)) == NULL) return HB_ERR;
+    if ((f.fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == HB_ERR) {
+        free(f.buf);
+        return HB_ERR;
+    }
+
+    len = strlen(HB_SAVE_MAGIC);
+    memcpy(header, HB_SAVE_MAGIC, len);
+    header[len++] = HB_SAVE_VERSION;
+    len += util_varint_put(header + len, map_length(&database));
+    f.crc = util_crc32(0, header, len);
+    save_append(&f, header, len);
+
+    f.chunk = pipe_empty();
+    map_iterate(&database, save_entry, &f);
+    save_chunk(&f);
+    pipe_free(f.chunk);
+
+    trailer[0] = HB_SAVE_EOF;
+    util_put32(trailer + 1, f.crc);
+    save_append(&f, trailer, 5);
+    save_flush(&f);
+
+    free(f.buf);
+
+    status = f.failed || fsync(f.fd) == HB_ERR ? HB_ERR : HB_OK;
+    if (close(f.fd) == HB_ERR) status = HB_ERR;
+    if (status == HB_OK && rename(tmp, path) == HB_ERR) status = HB_ERR;
+    if (status == HB_ERR) unlink(tmp);
+
+    return status;
+}
+
+int save_now(void)
+{
+    uint64_t start = stat_clock();
+    int status;
+
+    if (server.snapshot == NULL) return HB_ERR;
+
+    pthread_mutex_lock(&lock);
+    if (child) {
+        pthread_mutex_unlock(&lock);
+        return HB_ERR;
+    }
+
+    if ((status = save_write(server.snapshot)) == HB_OK) {
+        server.dirty = 0;
+        last_save = time(NULL);
+    } else {
+        fprintf(stdout, "hb: %s could not write snapshot [%s]: %s\n", HB_LOG_ERR, server.snapshot, strerror(errno));
+    }
+    last_status = status;
+    last_nsec = stat_clock() - start;
+    pthread_mutex_unlock(&lock);
+
+    return status;
+}
+
+/* The child only reads memory it shares copy-on-write with the parent and
+ * never touches a lock another thread might have held at fork() time. */
+int save_background(void)
+{
+    pthread_t thread_id;
+    pid_t pid;
+
+    if (server.snapshot == NULL) return HB_ERR;
+
+    pthread_mutex_lock(&lock);
+    if (child) {
+        pthread_mutex_unlock(&lock);
+        return HB_ERR;
+    }
+
+    child_start = stat_clock();
+
+    if ((pid = fork()) == 0) {
+        _exit(save_write(server.snapshot) == HB_OK ? 0 : 1);
+    } else if (pid == HB_ERR) {
+        fprintf(stdout, "hb: %s could not fork for snapshot: %s\n", HB_LOG_ERR, strerror(errno));
+        last_status = HB_ERR;
+        pthread_mutex_unlock(&lock);
+        return HB_ERR;
+    }
+
+    child = pid;
+    child_dirty = server.dirty;
+
+    if (pthread_create(&thread_id, NULL, save_wait, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create snapshot thread\n", HB_LOG_ERR);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        child = 0;
+        pthread_mutex_unlock(&lock);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+    pthread_mutex_unlock(&lock);
+
+    fprintf(stdout, "hb: %s background snapshot started [pid: %d]\n", HB_LOG_INF, (int) pid);
+
+    return HB_OK;
+}
+
+/* Reap the child and account for the writes it covered. */
+static void *save_wait(void *arg)
+{
+    int status;
+    pid_t pid;
+
+    pthread_mutex_lock(&lock);
+    pid = child;
+    pthread_mutex_unlock(&lock);
+
+    while (waitpid(pid, &status, 0) == HB_ERR && errno == EINTR);
+
+    pthread_mutex_lock(&server.mutex);
+    pthread_mutex_lock(&lock);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        server.dirty -= MIN(child_dirty, server.dirty);
+        last_save = time(NULL);
+        last_status = HB_OK;
+        fprintf(stdout, "hb: %s background snapshot saved\n", HB_LOG_OK);
+    } else {
+        last_status = HB_ERR;
+        fprintf(stdout, "hb: %s background snapshot failed\n", HB_LOG_ERR);
+    }
+    last_nsec = stat_clock() - child_start;
+    child = 0;
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&server.mutex);
+
+    return NULL;
+}
+
+/* Hand 'count' length prefixed elements to 'f'. Returns the position after
+ * them, NULL if they do not fit the chunk. */
+static const unsigned char *save_decode_elements(const unsigned char *p, const unsigned char *end, uint64_t count,
+                                                 int (*f)(any_t, const char *, size_t), any_t item)
+{
+    uint64_t len;
+    int n;
+
+    while (count-- > 0) {
+        if ((n = util_varint_get(p, end, &len)) == 0 || len > (uint64_t) (end - p - n)) return NULL;
+        f(item, (const char *) p + n, len);
+        p += n + len;
+    }
+
+    return p;
+}
+
+static int save_list_push(any_t l, const char *value, size_t len)
+{
+    list_push(l, value, len, HB_LIST_TAIL);
+
+    return HB_OK;
+}
+
+/* Fields come first, the pair is set once its value comes */
+static int save_hash_set(any_t item, const char *p, size_t len)
+{
+    save_pair_t *pair = item;
+
+    if (pair->field == NULL) {
+        pair->field = p;
+        pair->len = len;
+        return HB_OK;
+    }
+    hash_set(pair->object, pair->field, pair->len, p, len);
+    pair->field = NULL;
+
+    return HB_OK;
+}
+
+/* A member waits for its score the same way */
+static int save_zset_add(any_t item, const char *p, size_t len)
+{
+    save_pair_t *pair = item;
+    uint64_t u;
+    double score;
+
+    if (pair->field == NULL) {
+        pair->field = p;
+        pair->len = len;
+        return HB_OK;
+    }
+    if (len == sizeof(u)) {
+        u = util_get64((const unsigned char *) p);
+        memcpy(&score, &u, sizeof(score));
+        zset_add(pair->object, score, pair->field, pair->len);
+    }
+    pair->field = NULL;
+
+    return HB_OK;
+}
+
+static int save_set_add(any_t o, const char *member, size_t len)
+{
+    set_add(o, member, len);
+
+    return HB_OK;
+}
+
+/* Decode the records of one chunk into the lists of thread 'id'. */
+static int save_decode_chunk(save_loader_t *l, int id, save_chunk_t *c)
+{
+    const unsigned char *p = c->p, *end = c->p + c->len;
+    uint64_t klen, vlen, n;
+    save_item_t item;
+    int len, shard, size = database.table_size;
+
+    if (l->verify && util_crc32(0, c->p, c->len) != util_get32(end)) return HB_ERR;
+
+    for (n = 0; p < end; n++) {
+        unsigned char type = *p++;
+
+        if ((len = util_varint_get(p, end, &klen)) == 0 || klen > (uint64_t) (end - p - len)) return HB_ERR;
+        item.key = pipe_newlen(p + len, klen);
+        p += len + klen;
+
+        if ((len = util_varint_get(p, end, &vlen)) == 0) {
+            pipe_free(item.key);
+            return HB_ERR;
+        }
+        p += len;
+
+        if (type == HB_SAVE_INT) {
+            item.value = object_fromlonglong(util_unzigzag(vlen));
+        } else if (type == HB_SAVE_STRING && vlen <= (uint64_t) (end - p)) {
+            item.value = object_new(HB_OBJ_STRING, HB_ENC_RAW, pipe_newlen(p, vlen));
+            p += vlen;
+        } else if (type == HB_SAVE_LZF && vlen <= (uint64_t) (end - p)) {
+            /* Stays compressed unless compression was turned off since */
+            pipe_t value = pipe_newlen(p, vlen);
+
+            p += vlen;
+            if (server.compress_above > 0) {
+                item.value = object_new(HB_OBJ_STRING, HB_ENC_LZF, value);
+            } else {
+                pipe_t raw = lzf_unpack(value);
+
+                pipe_free(value);
+                if (raw == NULL) {
+                    pipe_free(item.key);
+                    return HB_ERR;
+                }
+                item.value = object_new(HB_OBJ_STRING, HB_ENC_RAW, raw);
+            }
+        } else if (type == HB_SAVE_LIST) {
+            item.value = object_new(HB_OBJ_LIST, HB_ENC_CHUNKS, list_new());
+            if ((p = save_decode_elements(p, end, vlen, save_list_push, item.value->ptr)) == NULL) {
+                object_decr(item.value);
+                pipe_free(item.key);
+                return HB_ERR;
+            }
+        } else if (type == HB_SAVE_STREAM && vlen <= (uint64_t) (end - p)) {
+            item.value = stream_load((const char *) p, vlen);
+            p += vlen;
+            if (item.value == NULL) {
+                pipe_free(item.key);
+                return HB_ERR;
+            }
+        } else if (type == HB_SAVE_SET && vlen <= (uint64_t) (end - p)) {
+            item.value = set_new();
+            if ((p = save_decode_elements(p, end, vlen, save_set_add, item.value)) == NULL) {
+                object_decr(item.value);
+                pipe_free(item.key);
+                return HB_ERR;
+            }
+        } else if ((type == HB_SAVE_HASH || type == HB_SAVE_ZSET) && vlen <= (uint64_t) (end - p)) {
+            save_pair_t pair = { type == HB_SAVE_HASH ? hash_new() : zset_new(), NULL, 0 };
+
+            item.value = pair.object;
+            if ((p = save_decode_elements(p, end, vlen * 2, type == HB_SAVE_HASH ? save_hash_set : save_zset_add,
+                                          &pair)) == NULL) {
+                object_decr(item.value);
+                pipe_free(item.key);
+                return HB_ERR;
+            }
+        } else {
+            pipe_free(item.key);
+            return HB_ERR;
+        }
+
+        item.home = map_home(&database, item.key, klen);
+        shard = (int) ((long long) item.home * l->threads / size);
+        l->lists[id * l->threads + shard] = pipe_catlen(l->lists[id * l->threads + shard], &item, sizeof(item));
+    }
+
+    return c->records == 0 || n == c->records ? HB_OK : HB_ERR;
+}
+
+static void *save_decode(void *arg)
+{
+    save_worker_t *w = arg;
+    save_loader_t *l = w->loader;
+    int i;
+
+    while ((i = __sync_fetch_and_add(&l->next, 1)) < l->nchunks) {
+        if (l->failed) break;
+        if (save_decode_chunk(l, w->id, &l->chunks[i]) == HB_ERR) l->failed = 1;
+    }
+
+    return NULL;
+}
+
+/* Fill the buckets of one shard, records whose probe run would leave it
+ * are put afterwards by the main thread. */
+static void *save_insert(void *arg)
+{
+    save_worker_t *w = arg;
+    save_loader_t *l = w->loader;
+    long long size = database.table_size;
+    int from = w->id * size / l->threads, to = (w->id + 1) * size / l->threads, t;
+
+    for (t = 0; t < l->threads; t++) {
+        pipe_t list = l->lists[t * l->threads + w->id];
+        save_item_t *item;
+
+        for (item = (save_item_t *) list; (char *) item < list + pipe_len(list); item++)
+            if (map_put_range(&database, item->key, item->value, from, to) != HB_OK)
+                l->left[w->id] = pipe_catlen(l->left[w->id], item, sizeof(*item));
+    }
+
+    return NULL;
+}
+
+static void save_run(save_loader_t *l, void *(*f)(void *))
+{
+    pthread_t threads[HB_SAVE_THREADS];
+    save_worker_t workers[HB_SAVE_THREADS];
+    int i, started;
+
+    for (i = 0; i < l->threads; i++) {
+        workers[i].loader = l;
+        workers[i].id = i;
+    }
+    for (started = 1; started < l->threads; started++)
+        if (pthread_create(&threads[started], NULL, f, &workers[started]) != HB_OK) break;
+
+    /* Whatever could not be started runs here */
+    for (i = started; i < l->threads; i++) f(&workers[i]);
+    f(&workers[0]);
+    for (i = 1; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+static void save_discard(save_loader_t *l)
+{
+    int i;
+
+    for (i = 0; i < l->threads * l->threads; i++) {
+        save_item_t *item;
+
+        for (item = (save_item_t *) l->lists[i]; (char *) item < l->lists[i] + pipe_len(l->lists[i]); item++) {
+            pipe_free(item->key);
+            object_decr(item->value);
+        }
+    }
+}
+
+int save_load(void)
+{
+    return server.snapshot ? save_read(server.snapshot) : HB_OK;
+}
+
+int save_read(const char *path)
+{
+    struct stat st;
+    unsigned char *data, *p, *end;
+    unsigned long crc;
+    uint64_t keys, n = 0, start = stat_clock();
+    save_loader_t l;
+    save_chunk_t *c;
+    int fd, i, len, version, status = HB_ERR;
+
+    if ((fd = open(path, O_RDONLY)) == HB_ERR) return HB_OK;
+    if (fstat(fd, &st) == HB_ERR || st.st_size == 0) {
+        close(fd);
+        return HB_OK;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stdout, "hb: %s could not map snapshot [%s]\n", HB_LOG_ERR, path);
+        return HB_ERR;
+    }
+    madvise(data, st.st_size, MADV_WILLNEED);
+
+    memset(&l, 0, sizeof(l));
+    p = data;
+    end = data + st.st_size;
+
+    /* Nothing is loaded unless the whole file checks out */
+    if (st.st_size < (off_t) strlen(HB_SAVE_MAGIC) + 1 + 1 + 1 + 4 ||
+        memcmp(p, HB_SAVE_MAGIC, strlen(HB_SAVE_MAGIC)))
+        goto done;
+    version = p[strlen(HB_SAVE_MAGIC)];
+    if (version != 1 && version != HB_SAVE_VERSION) goto done;
+
+    p += strlen(HB_SAVE_MAGIC) + 1;
+    end -= 5;
+    if (*end != HB_SAVE_EOF || (len = util_varint_get(p, end, &keys)) == 0 || keys > (uint64_t) st.st_size)
+        goto done;
+    p += len;
+
+    if (version == 1) {
+        /* The records are one chunk, checked as a whole up front */
+        if (util_crc32(0, data, end + 1 - data) != util_get32(end + 1)) goto done;
+        l.chunks = malloc(sizeof(save_chunk_t));
+        l.chunks[0].p = p;
+        l.chunks[0].len = end - p;
+        l.chunks[0].records = 0;
+        l.nchunks = 1;
+    } else {
+        /* Walk the frames, the chunk crcs are checked by the threads */
+        crc = util_crc32(0, data, p - data);
+        while (p < end) {
+            if (end - p < HB_SAVE_FRAME + 4 || util_get32(p) > (uint64_t) (end - p - HB_SAVE_FRAME - 4)) goto done;
+            if ((l.nchunks & (l.nchunks - 1)) == 0) {
+                c = realloc(l.chunks, (l.nchunks ? l.nchunks * 2 : 1) * sizeof(save_chunk_t));
+                if (c == NULL) goto done;
+                l.chunks = c;
+            }
+            c = &l.chunks[l.nchunks++];
+            c->len = util_get32(p);
+            c->records = util_get32(p + 4);
+            c->p = p + HB_SAVE_FRAME;
+            p = (unsigned char *) c->p + c->len;
+            crc = util_crc32(crc, p, 4);
+            p += 4;
+        }
+        if (crc != util_get32(end + 1)) goto done;
+        l.verify = 1;
+    }
+
+    /* One table size for everything, no rehash while loading */
+    if (map_reserve(&database, map_length(&database) + keys) != HB_OK) goto done;
+
+    l.threads = MAX(1, MIN(sysconf(_SC_NPROCESSORS_ONLN), HB_SAVE_THREADS));
+    l.threads = MIN(l.threads, MAX(l.nchunks, 1));
+    l.lists = malloc(l.threads * l.threads * sizeof(pipe_t));
+    l.left = malloc(l.threads * sizeof(pipe_t));
+    for (i = 0; i < l.threads * l.threads; i++) l.lists[i] = pipe_empty();
+    for (i = 0; i < l.threads; i++) l.left[i] = pipe_empty();
+
+    save_run(&l, save_decode);
+    if (l.failed) {
+        save_discard(&l);
+        goto done;
+    }
+
+    n = map_length(&database);
+    save_run(&l, save_insert);
+    for (i = 0; i < l.threads; i++) {
+        save_item_t *item;
+
+        for (item = (save_item_t *) l.left[i]; (char *) item < l.left[i] + pipe_len(l.left[i]); item++)
+            map_put(&database, item->key, item->value);
+    }
+    n = map_length(&database) - n;
+    status = HB_OK;
+
+    if (n != keys)
+        fprintf(stdout, "hb: %s snapshot announced %" PRIu64 " keys, found %" PRIu64 "\n", HB_LOG_WRN, keys, n);
+
+    last_save = st.st_mtime;
+    fprintf(stdout, "hb: %s loaded %" PRIu64 " keys from snapshot in %.3fs [%d chunks, %d threads]\n",
+            HB_LOG_OK, n, (stat_clock() - start) / 1e9, l.nchunks, l.threads);
+
+done:
+    munmap(data, st.st_size);
+    for (i = 0; l.lists && i < l.threads * l.threads; i++) pipe_free(l.lists[i]);
+    for (i = 0; l.left && i < l.threads; i++) pipe_free(l.left[i]);
+    free(l.lists);
+    free(l.left);
+    free(l.chunks);
+
+    if (status == HB_ERR) fprintf(stdout, "hb: %s snapshot is corrupt [%s]\n", HB_LOG_ERR, path);
+
+    return status;
+}
+
+pipe_t save_catinfo(pipe_t s)
+{
+    pthread_mutex_lock(&lock);
+    s = pipe_catprintf(s, "snapshot_changes_since_last_save:%" PRIu64 "\n", server.dirty);
+    s = pipe_catprintf(s, "snapshot_bgsave_in_progress:%d\n", child != 0);
+    s = pipe_catprintf(s, "snapshot_last_save_time:%ld\n", (long) last_save);
+    s = pipe_catprintf(s, "snapshot_last_status:%s\n", last_status == HB_OK ? "ok" : "err");
+    s = pipe_catprintf(s, "snapshot_last_duration_sec:%.3f\n", last_nsec / 1e9);
+    pthread_mutex_unlock(&lock);
+
+    return s;
+}
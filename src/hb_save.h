@@ -0,0 +1,77 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_SAVE_H_
+#define _HB_SAVE_H_
+
+/* A snapshot is the magic and version, the varint key count, a sequence of
+ * chunks and HB_SAVE_EOF followed by the little endian crc32 of the header
+ * and of the chunk checksums. A chunk is the byte length and the number of
+ * its records, 4 bytes little endian each, the records and their crc32, so
+ * chunks can be checked and decoded on their own. A record is its type,
+ * the varint key length and key, then the value: varint length and bytes,
+ * or a zigzag varint for integers; a compressed value is stored as the
+ * bytes it is kept in. A list is the varint element count and each
+ * element as its varint length and bytes. Version 1 files have the
+ * records right after the header and a crc32 of everything before it at
+ * the end. */
+#define HB_SAVE_MAGIC           "HBSNAP"
+#define HB_SAVE_VERSION         2
+#define HB_SAVE_FRAME           8
+
+#define HB_SAVE_STRING          0           /* Raw bytes */
+#define HB_SAVE_INT             1           /* Decimal string kept as a number */
+#define HB_SAVE_LZF             2           /* Value compressed as in memory */
+#define HB_SAVE_LIST            3           /* Elements from head to tail */
+#define HB_SAVE_HASH            4           /* Each field followed by its value */
+#define HB_SAVE_ZSET            5           /* Each member followed by its score, 8 bytes */
+#define HB_SAVE_SET             6           /* Members */
+#define HB_SAVE_STREAM          7           /* Length and the bytes of stream_dump() */
+#define HB_SAVE_EOF             0xff        /* End of records, checksum follows */
+
+/* Read server.snapshot into the database if it exists. */
+int     save_load(void);
+
+/* Read the snapshot at 'path' into the database, HB_OK if there is none. */
+int     save_read(const char *);
+
+/* Write the database to 'path' from the calling process, through a
+ * temporary file renamed over it once synced. */
+int     save_write(const char *);
+
+/* Write the snapshot from the calling thread, the server waits. */
+int     save_now(void);
+
+/* Fork a child that writes the snapshot from its copy-on-write view of
+ * the database while the parent keeps serving. Must be called with the
+ * database lock held. Returns HB_ERR if a save is already running. */
+int     save_background(void);
+
+/* Append the snapshot part of the persistence section of the inf report. */
+pipe_t  save_catinfo(pipe_t);
+
+#endif
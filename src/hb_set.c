@@ -0,0 +1,550 @@
+/*
+ * SET                            Sets, sorted integer arrays while they can be.
+ *
+ * Version:                                      @(#)set.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hb_core.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern struct server server;
+
+/* What map_iterate() walks a map encoded set with */
+typedef struct _set_walk {
+    int (*f)(any_t, const char *, size_t);
+    any_t item;
+} set_walk_t;
+
+/* The members of one set go through this to the result of set_combine() */
+typedef struct _set_filter {
+    object_t **sets;
+    int count;
+    int walked;                             /* Index of the set walked */
+    int op;
+    object_t *result;
+} set_filter_t;
+
+/* The entries left after the last whole vectors, or all of them */
+#define SET_MERGE(a, na, b, nb, out, i, j, n)   \
+    while ((i) < (na) && (j) < (nb)) {          \
+        if ((a)[i] < (b)[j]) (i)++;             \
+        else if ((a)[i] > (b)[j]) (j)++;        \
+        else (out)[(n)++] = (a)[(i)++], (j)++;  \
+    }
+
+#ifdef __SSE2__
+/* Rotate the lanes of a vector by 'n' bytes */
+#define set_rotate(v, n)    _mm_or_si128(_mm_srli_si128((v), (n)), _mm_slli_si128((v), 16 - (n)))
+#endif
+
+static int       set_fits(long long);
+static int       set_int_width(pipe_t);
+static unsigned char *set_int_data(pipe_t);
+static size_t    set_int_count(pipe_t);
+static long long set_int_get(pipe_t, size_t);
+static void      set_int_put(pipe_t, size_t, long long);
+static int       set_int_find(pipe_t, long long, size_t *);
+static pipe_t    set_int_new(int, size_t);
+static pipe_t    set_int_widen(pipe_t, int);
+static size_t    set_inter16(const int16_t *, size_t, const int16_t *, size_t, int16_t *);
+static size_t    set_inter32(const int32_t *, size_t, const int32_t *, size_t, int32_t *);
+static size_t    set_inter64(const int64_t *, size_t, const int64_t *, size_t, int64_t *);
+static pipe_t    set_int_inter(pipe_t, pipe_t);
+static pipe_t    set_int_union(pipe_t, pipe_t);
+static void      set_convert(object_t *);
+static int       set_free_member(any_t, char *, any_t);
+static int       set_walk(any_t, char *, any_t);
+static int       set_catone(any_t, const char *, size_t);
+static int       set_filter(any_t, const char *, size_t);
+static int       set_cmp(const void *, const void *);
+
+/* The narrowest width an entry takes */
+static int set_fits(long long v)
+{
+    if (v >= INT16_MIN && v <= INT16_MAX) return 2;
+    if (v >= INT32_MIN && v <= INT32_MAX) return 4;
+
+    return 8;
+}
+
+static int set_int_width(pipe_t s)
+{
+    return s[0];
+}
+
+static unsigned char *set_int_data(pipe_t s)
+{
+    return (unsigned char *) s + HB_SET_HEADER;
+}
+
+static size_t set_int_count(pipe_t s)
+{
+    return (pipe_len(s) - HB_SET_HEADER) / set_int_width(s);
+}
+
+static long long set_int_get(pipe_t s, size_t i)
+{
+    switch (set_int_width(s)) {
+        case 2:
+            return ((int16_t *) set_int_data(s))[i];
+        case 4:
+            return ((int32_t *) set_int_data(s))[i];
+    }
+
+    return ((int64_t *) set_int_data(s))[i];
+}
+
+static void set_int_put(pipe_t s, size_t i, long long v)
+{
+    switch (set_int_width(s)) {
+        case 2:
+            ((int16_t *) set_int_data(s))[i] = v;
+            break;
+        case 4:
+            ((int32_t *) set_int_data(s))[i] = v;
+            break;
+        default:
+            ((int64_t *) set_int_data(s))[i] = v;
+            break;
+    }
+}
+
+/* 1 if 'v' is there, 'pos' is where it is or would go */
+static int set_int_find(pipe_t s, long long v, size_t *pos)
+{
+    size_t lo = 0, hi = set_int_count(s), mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (set_int_get(s, mid) < v) lo = mid + 1;
+        else hi = mid;
+    }
+    *pos = lo;
+
+    return lo < set_int_count(s) && set_int_get(s, lo) == v;
+}
+
+/* An intset of 'count' zero entries */
+static pipe_t set_int_new(int width, size_t count)
+{
+    pipe_t s = pipe_growzero(pipe_empty(), HB_SET_HEADER + count * width);
+
+    s[0] = width;
+
+    return s;
+}
+
+static pipe_t set_int_widen(pipe_t s, int width)
+{
+    size_t i, n = set_int_count(s);
+    pipe_t wide = set_int_new(width, n);
+
+    for (i = 0; i < n; i++)
+        set_int_put(wide, i, set_int_get(s, i));
+
+    return wide;
+}
+
+/* Merge kernels of sorted entries. A vector of each side is compared all
+ * against all, rotated a lane at a time, and the side with the smaller
+ * last entry moves on; no entry repeats within a side, so every match is
+ * seen once. */
+static size_t set_inter16(const int16_t *a, size_t na, const int16_t *b, size_t nb, int16_t *out)
+{
+    size_t i = 0, j = 0, n = 0;
+
+#ifdef __SSE2__
+    while (i + 8 <= na && j + 8 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i)), vb = _mm_loadu_si128((const __m128i *) (b + j));
+        __m128i eq = _mm_cmpeq_epi16(va, vb);
+        int16_t amax = a[i + 7], bmax = b[j + 7];
+        unsigned int mask;
+
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, set_rotate(vb, 2)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, set_rotate(vb, 4)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, set_rotate(vb, 6)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, set_rotate(vb, 8)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, set_rotate(vb, 10)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, set_rotate(vb, 12)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, set_rotate(vb, 14)));
+
+        for (mask = _mm_movemask_epi8(eq) & 0x5555; mask != 0; mask &= mask - 1)
+            out[n++] = a[i + __builtin_ctz(mask) / 2];
+
+        if (amax <= bmax) i += 8;
+        if (bmax <= amax) j += 8;
+    }
+#endif
+    SET_MERGE(a, na, b, nb, out, i, j, n);
+
+    return n;
+}
+
+static size_t set_inter32(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out)
+{
+    size_t i = 0, j = 0, n = 0;
+
+#ifdef __SSE2__
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i)), vb = _mm_loadu_si128((const __m128i *) (b + j));
+        __m128i eq = _mm_cmpeq_epi32(va, vb);
+        int32_t amax = a[i + 3], bmax = b[j + 3];
+        unsigned int mask;
+
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, set_rotate(vb, 4)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, set_rotate(vb, 8)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, set_rotate(vb, 12)));
+
+        for (mask = _mm_movemask_ps(_mm_castsi128_ps(eq)); mask != 0; mask &= mask - 1)
+            out[n++] = a[i + __builtin_ctz(mask)];
+
+        if (amax <= bmax) i += 4;
+        if (bmax <= amax) j += 4;
+    }
+#endif
+    SET_MERGE(a, na, b, nb, out, i, j, n);
+
+    return n;
+}
+
+/* Two lanes a vector do not pay, these are merged as they are */
+static size_t set_inter64(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out)
+{
+    size_t i = 0, j = 0, n = 0;
+
+    SET_MERGE(a, na, b, nb, out, i, j, n);
+
+    return n;
+}
+
+/* Intersect intset 'a' with a larger one, 'a' is reused or freed. Much
+ * larger, 'b' is searched for each entry of 'a' instead of merged. */
+static pipe_t set_int_inter(pipe_t a, pipe_t b)
+{
+    size_t na = set_int_count(a), nb = set_int_count(b), n = 0, i, pos;
+    int width = MAX(set_int_width(a), set_int_width(b));
+    pipe_t wide = NULL, out;
+    long long v;
+
+    if (nb / HB_SET_GALLOP > na) {
+        for (i = 0; i < na; i++)
+            if (set_int_find(b, v = set_int_get(a, i), &pos)) set_int_put(a, n++, v);
+        pipe_IncrLen(a, -(int) ((na - n) * set_int_width(a)));
+        return a;
+    }
+
+    if (set_int_width(a) < width) {
+        wide = set_int_widen(a, width);
+        pipe_free(a);
+        a = wide;
+        wide = NULL;
+    }
+    if (set_int_width(b) < width) b = wide = set_int_widen(b, width);
+
+    out = set_int_new(width, MIN(na, nb));
+    switch (width) {
+        case 2:
+            n = set_inter16((int16_t *) set_int_data(a), na, (int16_t *) set_int_data(b), nb,
+                            (int16_t *) set_int_data(out));
+            break;
+        case 4:
+            n = set_inter32((int32_t *) set_int_data(a), na, (int32_t *) set_int_data(b), nb,
+                            (int32_t *) set_int_data(out));
+            break;
+        default:
+            n = set_inter64((int64_t *) set_int_data(a), na, (int64_t *) set_int_data(b), nb,
+                            (int64_t *) set_int_data(out));
+            break;
+    }
+    pipe_IncrLen(out, -(int) ((MIN(na, nb) - n) * width));
+
+    pipe_free(a);
+    pipe_free(wide);
+
+    return out;
+}
+
+static pipe_t set_int_union(pipe_t a, pipe_t b)
+{
+    size_t na = set_int_count(a), nb = set_int_count(b), i = 0, j = 0, n = 0;
+    pipe_t out = set_int_new(MAX(set_int_width(a), set_int_width(b)), na + nb);
+    long long x, y;
+
+    while (i < na && j < nb) {
+        x = set_int_get(a, i);
+        y = set_int_get(b, j);
+        set_int_put(out, n++, MIN(x, y));
+        if (x <= y) i++;
+        if (y <= x) j++;
+    }
+    for (; i < na; i++)
+        set_int_put(out, n++, set_int_get(a, i));
+    for (; j < nb; j++)
+        set_int_put(out, n++, set_int_get(b, j));
+    pipe_IncrLen(out, -(int) ((na + nb - n) * set_int_width(out)));
+
+    return out;
+}
+
+static void set_convert(object_t *o)
+{
+    size_t i, n = set_int_count(o->ptr);
+    map_t *m = map_new();
+
+    for (i = 0; i < n; i++)
+        map_put(m, pipe_fromlonglong(set_int_get(o->ptr, i)), NULL);
+
+    pipe_free(o->ptr);
+    o->ptr = m;
+    o->encoding = HB_ENC_MAP;
+}
+
+object_t *set_new(void)
+{
+    return object_new(HB_OBJ_SET, HB_ENC_INTSET, set_int_new(2, 0));
+}
+
+static int set_free_member(any_t item, char *key, any_t data)
+{
+    pipe_free(key);
+
+    return HB_OK;
+}
+
+void set_free(map_t *m)
+{
+    map_iterate(m, set_free_member, NULL);
+    map_free(m);
+}
+
+int set_add(object_t *o, const char *member, size_t len)
+{
+    long long v;
+    size_t pos, n;
+    pipe_t key, wide;
+    any_t data;
+    int width;
+
+    if (o->encoding == HB_ENC_INTSET) {
+        if (util_strtoll(member, len, &v)) {
+            if (set_int_find(o->ptr, v, &pos)) return 0;
+
+            if ((n = set_int_count(o->ptr)) < HB_SET_INTSET_MAX) {
+                if (set_fits(v) > set_int_width(o->ptr)) {
+                    wide = set_int_widen(o->ptr, set_fits(v));
+                    pipe_free(o->ptr);
+                    o->ptr = wide;
+                }
+                width = set_int_width(o->ptr);
+                o->ptr = pipe_growzero(o->ptr, pipe_len(o->ptr) + width);
+                memmove(set_int_data(o->ptr) + (pos + 1) * width, set_int_data(o->ptr) + pos * width, (n - pos) * width);
+                set_int_put(o->ptr, pos, v);
+                return 1;
+            }
+        }
+        set_convert(o);
+    }
+
+    key = pipe_newlen(member, len);
+    if (map_get(o->ptr, key, &data) == HB_OK) {
+        pipe_free(key);
+        return 0;
+    }
+    map_put(o->ptr, key, NULL);
+
+    return 1;
+}
+
+/* Map encoded, a member with a NUL could only match a shorter one */
+int set_rem(object_t *o, const char *member, size_t len)
+{
+    long long v;
+    size_t pos;
+    char *key;
+    any_t data;
+    pipe_t s;
+
+    if (o->encoding == HB_ENC_MAP) {
+        if (memchr(member, '\0', len) != NULL) return 0;
+
+        s = pipe_newlen(member, len);
+        if (map_take(o->ptr, s, &key, &data) != HB_OK) {
+            pipe_free(s);
+            return 0;
+        }
+        pipe_free(s);
+        pipe_free(key);
+        return 1;
+    }
+
+    if (!util_strtoll(member, len, &v) || !set_int_find(o->ptr, v, &pos)) return 0;
+    memmove(set_int_data(o->ptr) + pos * set_int_width(o->ptr), set_int_data(o->ptr) + (pos + 1) * set_int_width(o->ptr),
+            (set_int_count(o->ptr) - pos - 1) * set_int_width(o->ptr));
+    pipe_IncrLen(o->ptr, -(int) set_int_width(o->ptr));
+
+    return 1;
+}
+
+int set_ismember(object_t *o, const char *member, size_t len)
+{
+    long long v;
+    size_t pos;
+    any_t data;
+    pipe_t s;
+    int found;
+
+    if (o->encoding == HB_ENC_MAP) {
+        if (memchr(member, '\0', len) != NULL) return 0;
+
+        s = pipe_newlen(member, len);
+        found = map_get(o->ptr, s, &data) == HB_OK;
+        pipe_free(s);
+        return found;
+    }
+
+    return util_strtoll(member, len, &v) && set_int_find(o->ptr, v, &pos);
+}
+
+static int set_walk(any_t item, char *key, any_t data)
+{
+    set_walk_t *w = item;
+
+    return w->f(w->item, key, pipe_len(key));
+}
+
+int set_iterate(object_t *o, int (*f)(any_t, const char *, size_t), any_t item)
+{
+    char buf[32];
+    size_t i, n;
+    set_walk_t w;
+    int status, len;
+
+    if (o->encoding == HB_ENC_MAP) {
+        if (map_length(o->ptr) == 0) return HB_OK;
+        w.f = f;
+        w.item = item;
+        return map_iterate(o->ptr, set_walk, &w);
+    }
+
+    for (i = 0, n = set_int_count(o->ptr); i < n; i++) {
+        len = snprintf(buf, sizeof(buf), "%lld", set_int_get(o->ptr, i));
+        if ((status = f(item, buf, len)) != HB_OK) return status;
+    }
+
+    return HB_OK;
+}
+
+static int set_catone(any_t item, const char *p, size_t len)
+{
+    pipe_t *s = item;
+
+    if (pipe_len(*s) > 0) *s = pipe_catlen(*s, "\n", 1);
+    *s = pipe_catrepr(*s, p, len);
+
+    return HB_OK;
+}
+
+pipe_t set_catall(pipe_t s, object_t *o)
+{
+    set_iterate(o, set_catone, &s);
+
+    return s;
+}
+
+long long set_length(object_t *o)
+{
+    if (o->encoding == HB_ENC_MAP) return map_length(o->ptr);
+
+    return set_int_count(o->ptr);
+}
+
+/* Kept if every other set has it (HB_SET_INTER) or none does */
+static int set_filter(any_t item, const char *member, size_t len)
+{
+    set_filter_t *f = item;
+    int i;
+
+    for (i = 0; i < f->count && f->op != HB_SET_UNION; i++) {
+        if (i == f->walked || f->sets[i] == NULL) continue;
+        if (set_ismember(f->sets[i], member, len) != (f->op == HB_SET_INTER)) return HB_OK;
+    }
+    set_add(f->result, member, len);
+
+    return HB_OK;
+}
+
+static int set_cmp(const void *a, const void *b)
+{
+    long long x = set_length(*(object_t * const *) a), y = set_length(*(object_t * const *) b);
+
+    return x < y ? -1 : x > y;
+}
+
+/* Intsets are intersected smallest first and merged for a union, other
+ * sets walk the smallest set, or the first one for a difference, and
+ * look its members up in the rest. */
+object_t *set_combine(object_t **sets, int count, int op)
+{
+    object_t *result = set_new(), **order;
+    set_filter_t filter;
+    int i, intsets = 1;
+    pipe_t s, merged;
+
+    for (i = 0; i < count; i++) {
+        if (sets[i] == NULL && (op == HB_SET_INTER || (op == HB_SET_DIFF && i == 0))) return result;
+        if (sets[i] != NULL && sets[i]->encoding != HB_ENC_INTSET) intsets = 0;
+    }
+
+    if (intsets && op == HB_SET_INTER) {
+        order = malloc(count * sizeof(object_t *));
+        memcpy(order, sets, count * sizeof(object_t *));
+        qsort(order, count, sizeof(object_t *), set_cmp);
+
+        s = pipe_dup(order[0]->ptr);
+        for (i = 1; i < count && set_int_count(s) > 0; i++)
+            s = set_int_inter(s, order[i]->ptr);
+        free(order);
+
+        pipe_free(result->ptr);
+        result->ptr = s;
+        return result;
+    }
+    if (intsets && op == HB_SET_UNION) {
+        for (i = 0; i < count; i++) {
+            if (sets[i] == NULL) continue;
+            merged = set_int_union(result->ptr, sets[i]->ptr);
+            pipe_free(result->ptr);
+            result->ptr = merged;
+        }
+        if (set_int_count(result->ptr) > HB_SET_INTSET_MAX) set_convert(result);
+        return result;
+    }
+
+    filter.sets = sets;
+    filter.count = count;
+    filter.walked = 0;
+    filter.op = op;
+    filter.result = result;
+
+    if (op == HB_SET_UNION) {
+        for (i = 0; i < count; i++)
+            if (sets[i] != NULL) set_iterate(sets[i], set_filter, &filter);
+        return result;
+    }
+
+    if (op == HB_SET_INTER)
+        for (i = 1; i < count; i++)
+            if (set_length(sets[i]) < set_length(sets[filter.walked])) filter.walked = i;
+    set_iterate(sets[filter.walked], set_filter, &filter);
+
+    return result;
+}
@@ -0,0 +1,76 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+
+
+#ifndef _HB_SET_H_
+#define _HB_SET_H_
+
+/* A set of integers only is an intset: one pipe, a header byte with the
+ * width of the entries, 2, 4 or 8 bytes, and the entries sorted, looked
+ * up by binary search. A wider number widens all of them. A member that
+ * is not a number, or more than HB_SET_INTSET_MAX members, make it a map
+ * of member pipes to NULL for good, members may not hold a NUL then.
+ * Numbers are members in their canonical decimal form only, "07" is a
+ * string. Intersections of intsets merge the entries a vector at a time
+ * and search the larger set instead when one is much smaller. */
+#define HB_SET_HEADER       8
+#define HB_SET_GALLOP       32              /* Size ratio past which the larger set is searched */
+
+#define HB_SET_INTER        0
+#define HB_SET_UNION        1
+#define HB_SET_DIFF         2
+
+/* New empty set object, an intset. */
+object_t *set_new(void);
+
+/* Free a map encoded set with its members. */
+void      set_free(map_t *);
+
+/* Add a member, returns 1 if it is new. */
+int       set_add(object_t *, const char *, size_t);
+
+/* Remove a member, returns 1 if it was there. */
+int       set_rem(object_t *, const char *, size_t);
+
+int       set_ismember(object_t *, const char *, size_t);
+
+/* Call 'f' with each member until it does not return HB_OK. Intsets go
+ * in ascending order. */
+int       set_iterate(object_t *, int (*)(any_t, const char *, size_t), any_t);
+
+/* Append all members to 's', one quoted per line. */
+pipe_t    set_catall(pipe_t, object_t *);
+
+long long set_length(object_t *);
+
+/* A new set of the members of all sets (HB_SET_INTER), of any of them
+ * (HB_SET_UNION) or of the first and none of the others (HB_SET_DIFF).
+ * A NULL set is empty. */
+object_t *set_combine(object_t **, int, int);
+
+#endif
@@ -0,0 +1,277 @@
+/*
+ * SKETCH          Sampled hot-key and big-key detection (count-min + top-K).
+ *
+ * Version:                                   @(#)sketch.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+/* Min-heap of the K largest entries, the root is the one to evict. */
+typedef struct _sketch_heap {
+    sketch_entry_t e[HB_SKETCH_TOPK];
+    int n;
+} sketch_heap_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t *counters;
+static uint64_t samples;
+static uint64_t sizes[HB_SKETCH_CLASSES];
+static sketch_heap_t hot;
+static sketch_heap_t big;
+
+static __thread unsigned int tick;
+
+static int      sketch_sample(void);
+static uint64_t sketch_count(const char *, size_t);
+static void     sketch_decay(void);
+static void     heap_swap(sketch_heap_t *, int, int);
+static void     heap_fix(sketch_heap_t *, int);
+static void     heap_offer(sketch_heap_t *, const char *, size_t, uint64_t);
+static void     heap_remove(sketch_heap_t *, const char *, size_t);
+static int      heap_sorted(sketch_heap_t *, sketch_entry_t *);
+static int      entry_cmp(const void *, const void *);
+
+int sketch_init(void)
+{
+    if (server.sketch_rate <= 0) return HB_OK;
+
+    counters = calloc(HB_SKETCH_DEPTH * HB_SKETCH_WIDTH, sizeof(uint32_t));
+    if (counters == NULL) {
+        fprintf(stdout, "hb: %s could not allocate key sketch\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+
+    return HB_OK;
+}
+
+/* Keep one call in server.sketch_rate. A per-thread countdown costs one
+ * increment and one compare on the unsampled path. */
+static int sketch_sample(void)
+{
+    if (counters == NULL) return 0;
+    if (++tick < (unsigned int) server.sketch_rate) return 0;
+    tick = 0;
+    return 1;
+}
+
+/* Conservative update: only the rows holding the current minimum are
+ * incremented, which keeps the overestimate of cold keys low. Each row
+ * uses h1 + i * h2 over the map hash (Kirsch-Mitzenmacher). */
+static uint64_t sketch_count(const char *key, size_t len)
+{
+    unsigned long h1 = map_hashkey(key, len);
+    unsigned long h2 = (h1 >> 17) | (h1 << 15) | 1;
+    uint32_t *cell[HB_SKETCH_DEPTH];
+    uint32_t min = UINT32_MAX;
+    int i;
+
+    for (i = 0; i < HB_SKETCH_DEPTH; i++) {
+        cell[i] = &counters[i * HB_SKETCH_WIDTH + (h1 + i * h2) % HB_SKETCH_WIDTH];
+        if (*cell[i] < min) min = *cell[i];
+    }
+
+    for (i = 0; i < HB_SKETCH_DEPTH; i++)
+        if (*cell[i] == min && min < UINT32_MAX) (*cell[i])++;
+
+    return (uint64_t) min + 1;
+}
+
+/* Halve everything periodically so the ranking follows the recent traffic
+ * instead of the whole uptime. Halving keeps the heap order intact. */
+static void sketch_decay(void)
+{
+    int i;
+
+    for (i = 0; i < HB_SKETCH_DEPTH * HB_SKETCH_WIDTH; i++)
+        counters[i] >>= 1;
+    for (i = 0; i < hot.n; i++)
+        hot.e[i].count >>= 1;
+}
+
+static void heap_swap(sketch_heap_t *h, int a, int b)
+{
+    sketch_entry_t t = h->e[a];
+
+    h->e[a] = h->e[b];
+    h->e[b] = t;
+}
+
+/* Restore the heap property around 'i' after its count changed. */
+static void heap_fix(sketch_heap_t *h, int i)
+{
+    while (i > 0 && h->e[(i - 1) / 2].count > h->e[i].count) {
+        heap_swap(h, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+
+        if (l < h->n && h->e[l].count < h->e[m].count) m = l;
+        if (r < h->n && h->e[r].count < h->e[m].count) m = r;
+        if (m == i) break;
+        heap_swap(h, i, m);
+        i = m;
+    }
+}
+
+static void heap_offer(sketch_heap_t *h, const char *key, size_t len, uint64_t count)
+{
+    int i;
+
+    for (i = 0; i < h->n; i++) {
+        if (pipe_len(h->e[i].key) == len && !memcmp(h->e[i].key, key, len)) {
+            h->e[i].count = count;
+            heap_fix(h, i);
+            return;
+        }
+    }
+
+    if (h->n < HB_SKETCH_TOPK) {
+        h->e[h->n].key = pipe_newlen(key, len);
+        h->e[h->n].count = count;
+        h->n++;
+        heap_fix(h, h->n - 1);
+    } else if (count > h->e[0].count) {
+        h->e[0].key = pipe_cpylen(h->e[0].key, key, len);
+        h->e[0].count = count;
+        heap_fix(h, 0);
+    }
+}
+
+static void heap_remove(sketch_heap_t *h, const char *key, size_t len)
+{
+    int i;
+
+    for (i = 0; i < h->n; i++) {
+        if (pipe_len(h->e[i].key) != len || memcmp(h->e[i].key, key, len)) continue;
+
+        pipe_free(h->e[i].key);
+        h->e[i] = h->e[--h->n];
+        if (i < h->n) heap_fix(h, i);
+        return;
+    }
+}
+
+/* Collections grow in place, so every sampled lookup refreshes the size. */
+void sketch_access(const char *key, size_t len, object_t *o)
+{
+    uint64_t count;
+    size_t size;
+
+    if (!sketch_sample()) return;
+
+    size = object_size(o);
+
+    pthread_mutex_lock(&lock);
+    count = sketch_count(key, len);
+    heap_offer(&hot, key, len, count);
+    heap_offer(&big, key, len, size);
+    if (++samples % HB_SKETCH_DECAY == 0) sketch_decay();
+    pthread_mutex_unlock(&lock);
+}
+
+void sketch_write(const char *key, size_t len, object_t *o)
+{
+    uint64_t count;
+    size_t size;
+    int class;
+
+    if (!sketch_sample()) return;
+
+    size = object_size(o);
+    class = size ? 64 - __builtin_clzll(size) : 0;
+
+    pthread_mutex_lock(&lock);
+    count = sketch_count(key, len);
+    heap_offer(&hot, key, len, count);
+    heap_offer(&big, key, len, size);
+    sizes[MIN(class, HB_SKETCH_CLASSES - 1)]++;
+    if (++samples % HB_SKETCH_DECAY == 0) sketch_decay();
+    pthread_mutex_unlock(&lock);
+}
+
+void sketch_forget(const char *key, size_t len)
+{
+    if (counters == NULL) return;
+
+    pthread_mutex_lock(&lock);
+    heap_remove(&hot, key, len);
+    heap_remove(&big, key, len);
+    pthread_mutex_unlock(&lock);
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const sketch_entry_t *x = a, *y = b;
+
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/* Copy the heap sorted by descending count, keys are shared not copied. */
+static int heap_sorted(sketch_heap_t *h, sketch_entry_t *out)
+{
+    memcpy(out, h->e, h->n * sizeof(sketch_entry_t));
+    qsort(out, h->n, sizeof(sketch_entry_t), entry_cmp);
+    return h->n;
+}
+
+/* One "<key> <estimated accesses>" line per key, counts are scaled back by
+ * the sample rate. */
+pipe_t sketch_cathot(pipe_t s, int count)
+{
+    sketch_entry_t top[HB_SKETCH_TOPK];
+    int i, n;
+
+    if (counters == NULL) return s;
+
+    pthread_mutex_lock(&lock);
+    n = heap_sorted(&hot, top);
+    if (count < 0 || count > n) count = n;
+    for (i = 0; i < count; i++) {
+        s = pipe_catrepr(s, top[i].key, pipe_len(top[i].key));
+        s = pipe_catprintf(s, " %" PRIu64 "%s", top[i].count * server.sketch_rate,
+                           i != count - 1 ? "\n" : "");
+    }
+    pthread_mutex_unlock(&lock);
+
+    return s;
+}
+
+/* The sampled size histogram as "<=<bytes> <writes>" lines, then one
+ * "<key> <bytes>" line per big key. */
+pipe_t sketch_catbig(pipe_t s, int count)
+{
+    sketch_entry_t top[HB_SKETCH_TOPK];
+    int i, n;
+
+    if (counters == NULL) return s;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < HB_SKETCH_CLASSES; i++) {
+        if (sizes[i] == 0) continue;
+        s = pipe_catprintf(s, "<=%llu %" PRIu64 "\n", i ? (1ULL << i) - 1 : 0ULL,
+                           sizes[i] * server.sketch_rate);
+    }
+
+    n = heap_sorted(&big, top);
+    if (count < 0 || count > n) count = n;
+    for (i = 0; i < count; i++) {
+        s = pipe_catrepr(s, top[i].key, pipe_len(top[i].key));
+        s = pipe_catprintf(s, " %" PRIu64 "%s", top[i].count, i != count - 1 ? "\n" : "");
+    }
+    pthread_mutex_unlock(&lock);
+
+    pipe_trim(s, "\n");
+
+    return s;
+}
@@ -0,0 +1,56 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_SKETCH_H_
+#define _HB_SKETCH_H_
+
+/* A tracked key with its estimated access count or value size. */
+typedef struct _sketch_entry {
+    pipe_t   key;
+    uint64_t count;
+} sketch_entry_t;
+
+/* Allocate the count-min sketch, disabled when server.sketch_rate is 0. */
+int     sketch_init(void);
+
+/* Sample a lookup of a key (every server.sketch_rate-th call is kept), the
+ * object is measured for the big keys only when the call is kept. */
+void    sketch_access(const char *, size_t, object_t *);
+
+/* Sample a store of an object, which also counts in the size histogram. */
+void    sketch_write(const char *, size_t, object_t *);
+
+/* Forget a deleted key. */
+void    sketch_forget(const char *, size_t);
+
+/* Append the hottest keys, most accessed first. */
+pipe_t  sketch_cathot(pipe_t, int);
+
+/* Append the value size histogram followed by the biggest keys. */
+pipe_t  sketch_catbig(pipe_t, int);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * SLOW                      Ring buffer of commands exceeding a time limit.
+ *
+ * Version:                                     @(#)slow.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static slow_entry_t *ring;
+static int head;
+static int length;
+static uint64_t next_id;
+
+static void slow_clear(slow_entry_t *);
+
+int slow_init(void)
+{
+    if (server.slow_length <= 0) return HB_OK;
+
+    ring = calloc(server.slow_length, sizeof(slow_entry_t));
+    if (ring == NULL) {
+        fprintf(stdout, "hb: %s could not allocate slowlog\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+
+    return HB_OK;
+}
+
+static void slow_clear(slow_entry_t *e)
+{
+    int i;
+
+    for (i = 0; i < e->argc; i++)
+        pipe_free(e->argv[i]);
+    e->argc = 0;
+}
+
+void slow_log(pipe_t *tokens, int count, uint64_t nsec, const char *client)
+{
+    slow_entry_t *e;
+    int i;
+
+    if (ring == NULL || server.slow_threshold < 0) return;
+    if (nsec / 1000 < (uint64_t) server.slow_threshold) return;
+
+    pthread_mutex_lock(&lock);
+
+    e = &ring[head];
+    slow_clear(e);
+
+    e->id = next_id++;
+    e->time = time(NULL);
+    e->usec = nsec / 1000;
+    e->argc = MIN(count, HB_SLOW_ARGS);
+
+    for (i = 0; i < e->argc; i++) {
+        size_t len = pipe_len(tokens[i]);
+
+        /* The last slot tells how much was left out */
+        if (i == HB_SLOW_ARGS - 1 && count > HB_SLOW_ARGS) {
+            e->argv[i] = pipe_catprintf(pipe_empty(), "... (%d more arguments)", count - i);
+        } else if (len > HB_SLOW_ARGLEN) {
+            e->argv[i] = pipe_newlen(tokens[i], HB_SLOW_ARGLEN);
+            e->argv[i] = pipe_catprintf(e->argv[i], "... (%zu more bytes)", len - HB_SLOW_ARGLEN);
+        } else {
+            e->argv[i] = pipe_newlen(tokens[i], len);
+        }
+    }
+
+    snprintf(e->client, sizeof(e->client), "%s", client ? client : "");
+
+    head = (head + 1) % server.slow_length;
+    if (length < server.slow_length) length++;
+
+    pthread_mutex_unlock(&lock);
+}
+
+int slow_length(void)
+{
+    return length;
+}
+
+void slow_reset(void)
+{
+    int i;
+
+    if (ring == NULL) return;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < server.slow_length; i++)
+        slow_clear(&ring[i]);
+    head = 0;
+    length = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+/* Entries are listed newest first, one per line:
+ * <id> <unix time> <usec> <client> <argv...> */
+pipe_t slow_catentries(pipe_t s, int count)
+{
+    int i, j;
+
+    if (ring == NULL) return s;
+
+    pthread_mutex_lock(&lock);
+
+    if (count < 0 || count > length) count = length;
+
+    for (i = 0; i < count; i++) {
+        slow_entry_t *e = &ring[(head - 1 - i + server.slow_length) % server.slow_length];
+
+        s = pipe_catprintf(s, "%" PRIu64 " %ld %" PRIu64 " %s", e->id, (long) e->time,
+                           e->usec, e->client[0] ? e->client : "-");
+
+        for (j = 0; j < e->argc; j++) {
+            s = pipe_cat(s, " ");
+            s = pipe_catrepr(s, e->argv[j], pipe_len(e->argv[j]));
+        }
+
+        if (i != count - 1) s = pipe_cat(s, "\n");
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return s;
+}
@@ -0,0 +1,57 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_SLOW_H_
+#define _HB_SLOW_H_
+
+/* One slow command, arguments are truncated copies. */
+typedef struct _slow_entry {
+    uint64_t id;
+    time_t   time;
+    uint64_t usec;
+    int      argc;
+    pipe_t   argv[HB_SLOW_ARGS];
+    char     client[HB_NET_PEER];
+} slow_entry_t;
+
+/* Allocate the ring buffer. */
+int     slow_init(void);
+
+/* Record the command if it took longer than the configured threshold.
+ * Returns immediately otherwise, so it is cheap to call for every command. */
+void    slow_log(pipe_t *, int, uint64_t, const char *);
+
+/* Number of entries currently kept. */
+int     slow_length(void);
+
+/* Drop all the entries. */
+void    slow_reset(void);
+
+/* Append the newest 'count' entries (all when negative). */
+pipe_t  slow_catentries(pipe_t, int);
+
+#endif
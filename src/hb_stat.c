@@ -0,0 +1,360 @@
+/*
+ * STAT                   Per-thread counters and command latency histograms.
+ *
+ * Version:                                     @(#)stat.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+extern map_t database;
+
+static __thread stat_t *local;
+
+static stat_t *threads;
+
+static uint64_t sample_time;
+static uint64_t sample_ops;
+static uint64_t sample_rate;
+
+static int  stat_bucket(uint64_t);
+static void stat_add(stat_t *, stat_t *);
+static uint64_t stat_calls(stat_t *);
+static void *stat_loop(void *);
+
+int stat_init(void)
+{
+    pthread_t thread;
+
+    server.start = time(NULL);
+    sample_time = stat_clock();
+
+    if (pthread_create(&thread, NULL, stat_loop, NULL) != 0) {
+        fprintf(stdout, "hb: %s can't start the stat sampler\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread);
+
+    return HB_OK;
+}
+
+/* Sample the command counters once a second, so the instantaneous rate is
+ * fresh no matter how rarely anybody asks for it. */
+static void *stat_loop(void *arg)
+{
+    stat_t *s;
+    uint64_t now, ops;
+
+    (void) arg;
+
+    for (;;) {
+        sleep(1);
+
+        ops = 0;
+        for (s = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); s != NULL; s = s->next)
+            ops += stat_calls(s);
+
+        now = stat_clock();
+        sample_rate = (ops - sample_ops) * 1000000000ULL / (now - sample_time);
+        sample_time = now;
+        sample_ops = ops;
+    }
+
+    return NULL;
+}
+
+uint64_t stat_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Blocks are never freed: a thread that exits marks its block idle and the
+ * next new thread adopts it, counters and all. The list only ever grows at
+ * the head, so readers walk it without taking any lock. */
+stat_t *stat_local(void)
+{
+    stat_t *s;
+    int idle = 1;
+
+    if (local != NULL) return local;
+
+    for (s = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); s != NULL; s = s->next, idle = 1)
+        if (__atomic_compare_exchange_n(&s->idle, &idle, 0, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return local = s;
+
+    s = calloc(1, sizeof(stat_t));
+    if (s == NULL) return NULL;
+
+    s->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &s->next, s, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return local = s;
+}
+
+void stat_release(void)
+{
+    if (local == NULL) return;
+
+    __atomic_store_n(&local->idle, 1, __ATOMIC_RELEASE);
+    local = NULL;
+}
+
+/* Map a duration to its histogram bucket. Values below 2*HB_STAT_SUB are
+ * exact, above that the exponent selects the row and the next HB_STAT_SUB_BITS
+ * bits select the linear sub-bucket. */
+static int stat_bucket(uint64_t v)
+{
+    int e;
+
+    if (v < 2 * HB_STAT_SUB) return (int) v;
+    if (v >> HB_STAT_BITS) return HB_STAT_BUCKETS - 1;
+
+    e = 63 - __builtin_clzll(v);
+
+    return (e - HB_STAT_SUB_BITS + 1) * HB_STAT_SUB +
+           (int) (v >> (e - HB_STAT_SUB_BITS)) - HB_STAT_SUB;
+}
+
+void stat_command(int index, uint64_t nsec)
+{
+    stat_t *s = stat_local();
+    stat_cmd_t *c;
+
+    if (s == NULL || index < 0 || index >= HB_CORE_MAX_COMMANDS) return;
+
+    c = s->cmds[index];
+    if (c == NULL) {
+        if ((c = calloc(1, sizeof(stat_cmd_t))) == NULL) return;
+        __atomic_store_n(&s->cmds[index], c, __ATOMIC_RELEASE);
+    }
+
+    c->calls++;
+    c->nsec += nsec;
+    c->hist[stat_bucket(nsec)]++;
+}
+
+void stat_bytes(size_t in, size_t out)
+{
+    stat_t *s = stat_local();
+
+    if (s == NULL) return;
+
+    s->bytes_in += in;
+    s->bytes_out += out;
+}
+
+/* Add every counter of 'src' to 'dst', allocating command blocks of 'dst'
+ * as needed. The owner thread may be updating 'src' concurrently, a torn
+ * read costs at most one sample. */
+static void stat_add(stat_t *dst, stat_t *src)
+{
+    int i, j;
+
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+    dst->connections += src->connections;
+
+    for (i = 0; i < HB_CORE_MAX_COMMANDS; i++) {
+        stat_cmd_t *c = __atomic_load_n(&src->cmds[i], __ATOMIC_ACQUIRE);
+
+        if (c == NULL) continue;
+        if (dst->cmds[i] == NULL) {
+            dst->cmds[i] = calloc(1, sizeof(stat_cmd_t));
+            if (dst->cmds[i] == NULL) continue;
+        }
+
+        dst->cmds[i]->calls += c->calls;
+        dst->cmds[i]->nsec += c->nsec;
+        for (j = 0; j < HB_STAT_BUCKETS; j++)
+            dst->cmds[i]->hist[j] += c->hist[j];
+    }
+}
+
+static uint64_t stat_calls(stat_t *s)
+{
+    stat_cmd_t *c;
+    uint64_t calls = 0;
+    int i;
+
+    for (i = 0; i < HB_CORE_MAX_COMMANDS; i++)
+        if ((c = __atomic_load_n(&s->cmds[i], __ATOMIC_ACQUIRE)) != NULL) calls += c->calls;
+
+    return calls;
+}
+
+void stat_merge(stat_t *dst)
+{
+    stat_t *s;
+
+    for (s = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); s != NULL; s = s->next)
+        stat_add(dst, s);
+}
+
+void stat_free(stat_t *s)
+{
+    int i;
+
+    for (i = 0; i < HB_CORE_MAX_COMMANDS; i++) {
+        free(s->cmds[i]);
+        s->cmds[i] = NULL;
+    }
+}
+
+uint64_t stat_quantile(stat_cmd_t *c, double q)
+{
+    uint64_t rank, seen = 0;
+    int i, e;
+
+    if (c == NULL || c->calls == 0) return 0;
+
+    rank = (uint64_t) (q * c->calls);
+    if (rank >= c->calls) rank = c->calls - 1;
+
+    for (i = 0; i < HB_STAT_BUCKETS; i++) {
+        seen += c->hist[i];
+        if (seen > rank) break;
+    }
+
+    if (i < 2 * HB_STAT_SUB) return i;
+
+    e = i / HB_STAT_SUB + HB_STAT_SUB_BITS - 1;
+
+    return (((uint64_t) (HB_STAT_SUB + i % HB_STAT_SUB) + 1) << (e - HB_STAT_SUB_BITS)) - 1;
+}
+
+uint64_t stat_below(stat_cmd_t *c, uint64_t nsec)
+{
+    uint64_t seen = 0;
+    int i, last;
+
+    if (c == NULL) return 0;
+
+    last = stat_bucket(nsec);
+    for (i = 0; i < last; i++)
+        seen += c->hist[i];
+
+    return seen;
+}
+
+uint64_t stat_rate(void)
+{
+    return sample_rate;
+}
+
+size_t stat_rss(void)
+{
+    struct rusage ru;
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+        if (resident > 0) return (size_t) resident * sysconf(_SC_PAGESIZE);
+    }
+
+    /* Fall back to the peak, the best a portable process can tell */
+    getrusage(RUSAGE_SELF, &ru);
+    return (size_t) ru.ru_maxrss * 1024;
+}
+
+pipe_t stat_catinfo(pipe_t s, const char *section)
+{
+    stat_t st;
+    struct rusage ru;
+    uint64_t calls;
+    int all = !strcmp(section, "all");
+    int i;
+
+    memset(&st, 0, sizeof(st));
+    stat_merge(&st);
+    calls = stat_calls(&st);
+
+    if (all || !strcmp(section, "server")) {
+        s = pipe_catprintf(s, "# server\n");
+        s = pipe_catprintf(s, "version:%s\n", HB_VERSION);
+        s = pipe_catprintf(s, "pid:%ld\n", (long) getpid());
+        s = pipe_catprintf(s, "port:%d\n", server.port);
+        s = pipe_catprintf(s, "uptime_in_seconds:%ld\n", (long) (time(NULL) - server.start));
+        s = pipe_catprintf(s, "bitmap_kernel:%s\n", bitmap_kernel());
+    }
+
+    if (all || !strcmp(section, "clients")) {
+        s = pipe_catprintf(s, "# clients\n");
+        s = pipe_catprintf(s, "connected_clients:%d\n", server.clients);
+        s = block_catinfo(s);
+        s = pipe_catprintf(s, "total_connections_received:%" PRIu64 "\n", st.connections);
+    }
+
+    if (all || !strcmp(section, "stats")) {
+        s = pipe_catprintf(s, "# stats\n");
+        s = pipe_catprintf(s, "total_commands_processed:%" PRIu64 "\n", calls);
+        s = pipe_catprintf(s, "instantaneous_ops_per_sec:%" PRIu64 "\n", sample_rate);
+        s = pipe_catprintf(s, "total_net_input_bytes:%" PRIu64 "\n", st.bytes_in);
+        s = pipe_catprintf(s, "total_net_output_bytes:%" PRIu64 "\n", st.bytes_out);
+    }
+
+    if (all || !strcmp(section, "engine")) {
+        s = pipe_catprintf(s, "# engine\n");
+        s = engine_catinfo(s);
+        s = tier_catinfo(s);
+    }
+
+    if (all || !strcmp(section, "keyspace")) {
+        s = pipe_catprintf(s, "# keyspace\n");
+        s = pipe_catprintf(s, "keys:%lld\n", server.engine->len());
+        s = pipe_catprintf(s, "table_size:%d\n", database.table_size);
+        s = pipe_catprintf(s, "load_factor:%.4f\n", database.table_size ?
+                           (double) database.size / database.table_size : 0.0);
+    }
+
+    if (all || !strcmp(section, "memory")) {
+        getrusage(RUSAGE_SELF, &ru);
+        s = pipe_catprintf(s, "# memory\n");
+        s = pipe_catprintf(s, "used_memory_rss:%zu\n", stat_rss());
+        s = pipe_catprintf(s, "used_memory_peak:%zu\n", (size_t) ru.ru_maxrss * 1024);
+        s = pipe_catprintf(s, "table_memory:%zu\n", (size_t) database.table_size * sizeof(map_bucket_t));
+    }
+
+    if (all || !strcmp(section, "replication")) {
+        s = pipe_catprintf(s, "# replication\n");
+        s = repl_catinfo(s);
+    }
+
+    if (all || !strcmp(section, "persistence")) {
+        s = pipe_catprintf(s, "# persistence\n");
+        s = save_catinfo(s);
+        s = aof_catinfo(s);
+    }
+
+    if (all || !strcmp(section, "commands")) {
+        s = pipe_catprintf(s, "# commands\n");
+        for (i = 0; server.commands[i].name != NULL && i < HB_CORE_MAX_COMMANDS; i++) {
+            stat_cmd_t *c = st.cmds[i];
+
+            if (c == NULL || c->calls == 0) continue;
+
+            s = pipe_catprintf(s, "cmd_%s:calls=%" PRIu64 ",usec=%" PRIu64
+                               ",usec_per_call=%.2f,p50=%.2f,p99=%.2f,p999=%.2f,max=%.2f\n",
+                               server.commands[i].name, c->calls, c->nsec / 1000,
+                               (double) c->nsec / 1000 / c->calls,
+                               stat_quantile(c, 0.50) / 1000.0, stat_quantile(c, 0.99) / 1000.0,
+                               stat_quantile(c, 0.999) / 1000.0, stat_quantile(c, 1.0) / 1000.0);
+        }
+    }
+
+    stat_free(&st);
+
+    return s;
+}
@@ -0,0 +1,95 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_STAT_H_
+#define _HB_STAT_H_
+
+/* Latency is kept in HDR-style log-linear histograms: every power of two
+ * (in nanoseconds) is split into HB_STAT_SUB linear sub-buckets, which gives
+ * a constant ~12% relative error from 16ns up to 2^HB_STAT_BITS ns (~68s). */
+#define HB_STAT_SUB_BITS    3
+#define HB_STAT_SUB         (1 << HB_STAT_SUB_BITS)
+#define HB_STAT_BITS        36
+#define HB_STAT_BUCKETS     ((HB_STAT_BITS - HB_STAT_SUB_BITS + 1) * HB_STAT_SUB)
+
+/* Counters and histogram of one command. */
+typedef struct _stat_cmd {
+    uint64_t calls;
+    uint64_t nsec;
+    uint64_t hist[HB_STAT_BUCKETS];
+} stat_cmd_t;
+
+/* Every thread owns one block and updates it without any locking, readers
+ * merge all the blocks on demand. Command blocks are allocated lazily so an
+ * idle thread costs only the pointer array. */
+typedef struct _stat {
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t connections;
+    stat_cmd_t *cmds[HB_CORE_MAX_COMMANDS];
+    int idle;
+    struct _stat *next;
+} stat_t;
+
+/* Start the uptime clock and the once-a-second rate sampler. */
+int      stat_init(void);
+
+/* Monotonic clock in nanoseconds. */
+uint64_t stat_clock(void);
+
+/* Return the block of the calling thread, registering it on first use. */
+stat_t  *stat_local(void);
+
+/* Hand the block of the calling thread over to the next one (on thread exit). */
+void     stat_release(void);
+
+/* Record one call of the command at 'index' that took 'nsec'. */
+void     stat_command(int, uint64_t);
+
+/* Record network traffic of the calling thread. */
+void     stat_bytes(size_t, size_t);
+
+/* Sum all the blocks into the zeroed 'stat_t', free it with stat_free(). */
+void     stat_merge(stat_t *);
+void     stat_free(stat_t *);
+
+/* Return the upper bound of the bucket holding the given quantile. */
+uint64_t stat_quantile(stat_cmd_t *, double);
+
+/* Number of samples below 'nsec', exact when 'nsec' is a power of two. */
+uint64_t stat_below(stat_cmd_t *, uint64_t);
+
+/* Instantaneous commands per second, as of the last one-second sample. */
+uint64_t stat_rate(void);
+
+/* Process memory as seen by the kernel, in bytes. */
+size_t   stat_rss(void);
+
+/* Append the report of the given section ("all" for everything). */
+pipe_t   stat_catinfo(pipe_t, const char *);
+
+#endif
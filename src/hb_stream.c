@@ -0,0 +1,760 @@
+/*
+ * STREAM                   Append only streams of entries with consumer groups.
+ *
+ * Version:                                   @(#)stream.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+/* What map_iterate() walks the groups or the pending entries with */
+typedef struct _stream_walk {
+    any_t item;
+    int (*groups)(any_t, pipe_t, const stream_id_t *);
+    int (*pending)(any_t, const stream_id_t *, pipe_t);
+    pipe_t out;                             /* Or the pending entries are collected here */
+    pipe_t consumer;                        /* Only those of this consumer */
+    const stream_id_t *after;               /* And past this id */
+} stream_walk_t;
+
+/* A pending entry taken out of the map to be sorted */
+typedef struct _stream_ref {
+    stream_id_t id;
+    stream_pending_t *pending;
+} stream_ref_t;
+
+static uint64_t  stream_now(void);
+static int       stream_cmp(const stream_id_t *, const stream_id_t *);
+static int       stream_ref_cmp(const void *, const void *);
+static int       stream_strtou64(const char *, size_t, uint64_t *);
+static pipe_t    stream_encode(pipe_t, const stream_id_t *, const stream_id_t *, pipe_t *, int);
+static const unsigned char *stream_decode(const unsigned char *, const unsigned char *, stream_id_t *, uint64_t *);
+static const unsigned char *stream_skip(const unsigned char *, const unsigned char *, uint64_t);
+static const unsigned char *stream_catentry(pipe_t *, const stream_id_t *, const unsigned char *,
+                                            const unsigned char *, uint64_t, pipe_t);
+static long long stream_scan(pipe_t *, stream_t *, const stream_id_t *, const stream_id_t *, long long, pipe_t,
+                             stream_group_t *, pipe_t);
+static stream_group_t *stream_group(stream_t *, pipe_t);
+static void      stream_pending_put(stream_group_t *, const stream_id_t *, pipe_t, uint64_t);
+static pipe_t    stream_pending_sorted(stream_group_t *, pipe_t, const stream_id_t *);
+static int       stream_collect(any_t, char *, any_t);
+static int       stream_free_pending(any_t, char *, any_t);
+static int       stream_free_group(any_t, char *, any_t);
+static void      stream_group_free(stream_group_t *);
+static int       stream_walk_group(any_t, char *, any_t);
+static int       stream_dump_group(any_t, char *, any_t);
+static pipe_t    stream_put(pipe_t, uint64_t);
+static const unsigned char *stream_get(const unsigned char *, const unsigned char *, uint64_t *);
+
+static uint64_t stream_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static int stream_cmp(const stream_id_t *a, const stream_id_t *b)
+{
+    if (a->ms != b->ms) return a->ms < b->ms ? -1 : 1;
+
+    return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static int stream_ref_cmp(const void *a, const void *b)
+{
+    return stream_cmp(&((const stream_ref_t *) a)->id, &((const stream_ref_t *) b)->id);
+}
+
+/* Digits only, no sign, no overflow */
+static int stream_strtou64(const char *p, size_t len, uint64_t *value)
+{
+    uint64_t n = 0;
+    size_t i;
+
+    if (len == 0 || len > 20) return HB_ERR;
+    for (i = 0; i < len; i++) {
+        if (p[i] < '0' || p[i] > '9' || n > (UINT64_MAX - (p[i] - '0')) / 10) return HB_ERR;
+        n = n * 10 + (p[i] - '0');
+    }
+    *value = n;
+
+    return HB_OK;
+}
+
+int stream_strtoid(const char *p, size_t len, uint64_t seq, stream_id_t *id)
+{
+    const char *dash = memchr(p, '-', len);
+
+    if (dash == NULL) {
+        id->seq = seq;
+        return stream_strtou64(p, len, &id->ms);
+    }
+    if (stream_strtou64(p, dash - p, &id->ms) == HB_ERR) return HB_ERR;
+
+    return stream_strtou64(dash + 1, len - (dash - p) - 1, &id->seq);
+}
+
+pipe_t stream_catid(pipe_t s, const stream_id_t *id)
+{
+    return pipe_catprintf(s, "%" PRIu64 "-%" PRIu64, id->ms, id->seq);
+}
+
+int stream_next(stream_id_t *id)
+{
+    if (id->seq < HB_STREAM_MAX_ID) {
+        id->seq++;
+    } else if (id->ms < HB_STREAM_MAX_ID) {
+        id->ms++;
+        id->seq = 0;
+    } else {
+        return HB_ERR;
+    }
+
+    return HB_OK;
+}
+
+static pipe_t stream_put(pipe_t s, uint64_t v)
+{
+    unsigned char buf[HB_UTIL_VARINT];
+
+    return pipe_catlen(s, buf, util_varint_put(buf, v));
+}
+
+/* NULL past the end or on a broken varint */
+static const unsigned char *stream_get(const unsigned char *p, const unsigned char *end, uint64_t *v)
+{
+    int n;
+
+    if (p == NULL || (n = util_varint_get(p, end, v)) == 0) return NULL;
+
+    return p + n;
+}
+
+static pipe_t stream_encode(pipe_t s, const stream_id_t *prev, const stream_id_t *id, pipe_t *fields, int count)
+{
+    int i;
+
+    s = stream_put(s, id->ms - prev->ms);
+    s = stream_put(s, id->ms == prev->ms ? id->seq - prev->seq : id->seq);
+    s = stream_put(s, count);
+    for (i = 0; i < count; i++) {
+        s = stream_put(s, pipe_len(fields[i]));
+        s = pipe_catlen(s, fields[i], pipe_len(fields[i]));
+    }
+
+    return s;
+}
+
+/* The id after 'id' and the number of fields and values, NULL if the
+ * entry is broken */
+static const unsigned char *stream_decode(const unsigned char *p, const unsigned char *end, stream_id_t *id,
+                                          uint64_t *count)
+{
+    uint64_t ms, seq;
+
+    if ((p = stream_get(stream_get(p, end, &ms), end, &seq)) == NULL) return NULL;
+    if (ms > HB_STREAM_MAX_ID - id->ms || (ms == 0 && seq > HB_STREAM_MAX_ID - id->seq)) return NULL;
+
+    id->seq = ms == 0 ? id->seq + seq : seq;
+    id->ms += ms;
+
+    return stream_get(p, end, count);
+}
+
+static const unsigned char *stream_skip(const unsigned char *p, const unsigned char *end, uint64_t count)
+{
+    uint64_t len;
+
+    while (p != NULL && count-- > 0)
+        p = (p = stream_get(p, end, &len)) == NULL || len > (uint64_t) (end - p) ? NULL : p + len;
+
+    return p;
+}
+
+static const unsigned char *stream_catentry(pipe_t *s, const stream_id_t *id, const unsigned char *p,
+                                            const unsigned char *end, uint64_t count, pipe_t prefix)
+{
+    pipe_t buf = stream_catid(pipe_empty(), id);
+    uint64_t len;
+
+    if (pipe_len(*s) > 0) *s = pipe_catlen(*s, "\n", 1);
+    if (prefix != NULL) {
+        *s = pipe_catrepr(*s, prefix, pipe_len(prefix));
+        *s = pipe_catlen(*s, " ", 1);
+    }
+    *s = pipe_catrepr(*s, buf, pipe_len(buf));
+    pipe_free(buf);
+
+    while (count-- > 0) {
+        p = stream_get(p, end, &len);
+        *s = pipe_catlen(*s, " ", 1);
+        *s = pipe_catrepr(*s, (const char *) p, len);
+        p += len;
+    }
+
+    return p;
+}
+
+/* Entries from 'start' to 'end': the block is bisected, then read on. With
+ * 's' NULL they are only counted. Delivered to a group they become
+ * pending for 'consumer'. */
+static long long stream_scan(pipe_t *s, stream_t *st, const stream_id_t *start, const stream_id_t *end,
+                             long long count, pipe_t prefix, stream_group_t *g, pipe_t consumer)
+{
+    size_t lo = 0, hi = st->nblocks, mid;
+    uint64_t now = g != NULL ? stream_now() : 0, fields;
+    long long n = 0;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (stream_cmp(&st->blocks[mid].last, start) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (; lo < st->nblocks && n != count && stream_cmp(&st->blocks[lo].first, end) <= 0; lo++) {
+        stream_block_t *b = &st->blocks[lo];
+        const unsigned char *p = (const unsigned char *) b->data, *e = p + pipe_len(b->data);
+        stream_id_t id = b->first;
+
+        while (p < e && n != count) {
+            p = stream_decode(p, e, &id, &fields);
+            if (stream_cmp(&id, end) > 0) return n;
+            if (stream_cmp(&id, start) < 0 || s == NULL) {
+                if (s == NULL && stream_cmp(&id, start) >= 0) n++;
+                p = stream_skip(p, e, fields);
+                continue;
+            }
+
+            p = stream_catentry(s, &id, p, e, fields, prefix);
+            n++;
+            if (g != NULL) {
+                stream_pending_put(g, &id, consumer, now);
+                g->last = id;
+            }
+        }
+    }
+
+    return n;
+}
+
+object_t *stream_new(void)
+{
+    return object_new(HB_OBJ_STREAM, HB_ENC_STREAM, calloc(1, sizeof(stream_t)));
+}
+
+static int stream_free_pending(any_t item, char *key, any_t data)
+{
+    stream_pending_t *p = data;
+
+    pipe_free(key);
+    pipe_free(p->consumer);
+    free(p);
+
+    return HB_OK;
+}
+
+static void stream_group_free(stream_group_t *g)
+{
+    map_iterate(g->pending, stream_free_pending, NULL);
+    map_free(g->pending);
+    free(g);
+}
+
+static int stream_free_group(any_t item, char *key, any_t data)
+{
+    pipe_free(key);
+    stream_group_free(data);
+
+    return HB_OK;
+}
+
+void stream_free(stream_t *st)
+{
+    size_t i;
+
+    for (i = 0; i < st->nblocks; i++)
+        pipe_free(st->blocks[i].data);
+    free(st->blocks);
+
+    if (st->groups != NULL) {
+        map_iterate(st->groups, stream_free_group, NULL);
+        map_free(st->groups);
+    }
+    free(st);
+}
+
+/* A new block once the last one is full, the array doubles */
+int stream_add(object_t *o, stream_id_t *id, int automatic, pipe_t *fields, int count)
+{
+    stream_t *st = o->ptr;
+    stream_block_t *b;
+    uint64_t now;
+
+    if (automatic) {
+        *id = st->last;
+        if ((now = stream_now()) > id->ms) {
+            id->ms = now;
+            id->seq = 0;
+        } else if (stream_next(id) == HB_ERR) {
+            return HB_ERR;
+        }
+    } else if (stream_cmp(id, &st->last) <= 0) {
+        return HB_ERR;
+    }
+
+    if (st->nblocks == 0 || pipe_len(st->blocks[st->nblocks - 1].data) >= HB_STREAM_BLOCK) {
+        if (st->nblocks == st->size) {
+            st->size = st->size ? st->size * 2 : 4;
+            st->blocks = realloc(st->blocks, st->size * sizeof(stream_block_t));
+        }
+        b = &st->blocks[st->nblocks++];
+        b->first = b->last = *id;
+        b->count = 0;
+        b->data = pipe_empty();
+    }
+
+    b = &st->blocks[st->nblocks - 1];
+    b->data = stream_encode(b->data, &b->last, id, fields, count);
+    b->last = *id;
+    b->count++;
+    st->last = *id;
+    st->length++;
+
+    return HB_OK;
+}
+
+long long stream_length(object_t *o)
+{
+    return ((stream_t *) o->ptr)->length;
+}
+
+void stream_last(object_t *o, stream_id_t *id)
+{
+    *id = ((stream_t *) o->ptr)->last;
+}
+
+long long stream_catrange(pipe_t *s, object_t *o, const stream_id_t *start, const stream_id_t *end, long long count,
+                          pipe_t prefix)
+{
+    return stream_scan(s, o->ptr, start, end, count, prefix, NULL, NULL);
+}
+
+/* Group names are map keys, one with a NUL could only match a shorter one */
+static stream_group_t *stream_group(stream_t *st, pipe_t name)
+{
+    any_t g;
+
+    if (st->groups == NULL || memchr(name, '\0', pipe_len(name)) != NULL || map_get(st->groups, name, &g) != HB_OK)
+        return NULL;
+
+    return g;
+}
+
+int stream_group_create(object_t *o, pipe_t name, const stream_id_t *id)
+{
+    stream_t *st = o->ptr;
+    stream_group_t *g;
+
+    if (memchr(name, '\0', pipe_len(name)) != NULL || stream_group(st, name) != NULL) return HB_ERR;
+    if (st->groups == NULL) st->groups = map_new();
+
+    g = calloc(1, sizeof(stream_group_t));
+    g->last = *id;
+    g->pending = map_new();
+    map_put(st->groups, pipe_dup(name), g);
+
+    return HB_OK;
+}
+
+int stream_group_destroy(object_t *o, pipe_t name)
+{
+    stream_t *st = o->ptr;
+    char *key;
+    any_t g;
+
+    if (stream_group(st, name) == NULL || map_take(st->groups, name, &key, &g) != HB_OK) return 0;
+    pipe_free(key);
+    stream_group_free(g);
+
+    return 1;
+}
+
+long long stream_groups(object_t *o)
+{
+    stream_t *st = o->ptr;
+
+    return st->groups != NULL ? map_length(st->groups) : 0;
+}
+
+int stream_group_exists(object_t *o, pipe_t name)
+{
+    return stream_group(o->ptr, name) != NULL;
+}
+
+static void stream_pending_put(stream_group_t *g, const stream_id_t *id, pipe_t consumer, uint64_t now)
+{
+    pipe_t key = stream_catid(pipe_empty(), id);
+    stream_pending_t *p;
+    any_t data;
+
+    if (map_get(g->pending, key, &data) == HB_OK) {
+        pipe_free(key);
+        p = data;
+        pipe_free(p->consumer);
+        p->deliveries++;
+    } else {
+        p = calloc(1, sizeof(stream_pending_t));
+        p->deliveries = 1;
+        map_put(g->pending, key, p);
+    }
+    p->consumer = pipe_dup(consumer);
+    p->time = now;
+}
+
+static int stream_collect(any_t item, char *key, any_t data)
+{
+    stream_walk_t *w = item;
+    stream_ref_t ref;
+
+    stream_strtoid(key, pipe_len(key), 0, &ref.id);
+    ref.pending = data;
+    if (w->consumer != NULL && strcmp(ref.pending->consumer, w->consumer) != 0) return HB_OK;
+    if (w->after != NULL && stream_cmp(&ref.id, w->after) <= 0) return HB_OK;
+
+    w->out = pipe_catlen(w->out, &ref, sizeof(ref));
+
+    return HB_OK;
+}
+
+/* The pending entries of a group, of one consumer past an id if given,
+ * as stream_ref_t by id */
+static pipe_t stream_pending_sorted(stream_group_t *g, pipe_t consumer, const stream_id_t *after)
+{
+    stream_walk_t w;
+
+    memset(&w, 0, sizeof(w));
+    w.out = pipe_empty();
+    w.consumer = consumer;
+    w.after = after;
+    if (map_length(g->pending) > 0) map_iterate(g->pending, stream_collect, &w);
+    qsort(w.out, pipe_len(w.out) / sizeof(stream_ref_t), sizeof(stream_ref_t), stream_ref_cmp);
+
+    return w.out;
+}
+
+long long stream_readgroup(pipe_t *s, object_t *o, pipe_t name, pipe_t consumer, const stream_id_t *after,
+                           long long count, pipe_t prefix)
+{
+    stream_t *st = o->ptr;
+    stream_group_t *g = stream_group(st, name);
+    stream_id_t start, end = { HB_STREAM_MAX_ID, HB_STREAM_MAX_ID };
+    stream_ref_t *ref;
+    pipe_t refs;
+    long long n = 0;
+    size_t i;
+
+    if (g == NULL) return HB_ERR;
+
+    if (after == NULL) {
+        start = g->last;
+        if (stream_next(&start) == HB_ERR) return 0;
+        return stream_scan(s, st, &start, &end, count, prefix, g, consumer);
+    }
+
+    refs = stream_pending_sorted(g, consumer, after);
+    for (i = 0, ref = (stream_ref_t *) refs; i < pipe_len(refs) / sizeof(stream_ref_t) && n != count; i++)
+        n += stream_scan(s, st, &ref[i].id, &ref[i].id, 1, prefix, NULL, NULL);
+    pipe_free(refs);
+
+    return n;
+}
+
+int stream_ready(object_t *o, const stream_id_t *after, pipe_t name)
+{
+    stream_t *st = o->ptr;
+    stream_group_t *g;
+
+    if (name != NULL) {
+        if ((g = stream_group(st, name)) == NULL) return 0;
+        after = &g->last;
+    }
+
+    return st->length > 0 && stream_cmp(&st->last, after) > 0;
+}
+
+int stream_ack(object_t *o, pipe_t name, const stream_id_t *id)
+{
+    stream_group_t *g = stream_group(o->ptr, name);
+    pipe_t key;
+    char *stored;
+    any_t data;
+    int status;
+
+    if (g == NULL) return HB_ERR;
+
+    key = stream_catid(pipe_empty(), id);
+    if ((status = map_take(g->pending, key, &stored, &data) == HB_OK) != 0) stream_free_pending(NULL, stored, data);
+    pipe_free(key);
+
+    return status;
+}
+
+pipe_t stream_catpending(pipe_t s, object_t *o, pipe_t name)
+{
+    stream_group_t *g = stream_group(o->ptr, name);
+    uint64_t now = stream_now();
+    stream_ref_t *ref;
+    pipe_t refs;
+    size_t i;
+
+    if (g == NULL) return NULL;
+
+    refs = stream_pending_sorted(g, NULL, NULL);
+    for (i = 0, ref = (stream_ref_t *) refs; i < pipe_len(refs) / sizeof(stream_ref_t); i++) {
+        pipe_t id = stream_catid(pipe_empty(), &ref[i].id);
+
+        if (pipe_len(s) > 0) s = pipe_catlen(s, "\n", 1);
+        s = pipe_catrepr(s, id, pipe_len(id));
+        s = pipe_catlen(s, " ", 1);
+        s = pipe_catrepr(s, ref[i].pending->consumer, pipe_len(ref[i].pending->consumer));
+        s = pipe_catprintf(s, " %" PRIu64 " %" PRIu64, now > ref[i].pending->time ? now - ref[i].pending->time : 0,
+                           ref[i].pending->deliveries);
+        pipe_free(id);
+    }
+    pipe_free(refs);
+
+    return s;
+}
+
+int stream_claim(object_t *o, pipe_t name, pipe_t consumer, uint64_t idle, const stream_id_t *id, int force)
+{
+    stream_group_t *g = stream_group(o->ptr, name);
+    uint64_t now = stream_now();
+    pipe_t key;
+    any_t data;
+    int found;
+
+    if (g == NULL) return HB_ERR;
+
+    key = stream_catid(pipe_empty(), id);
+    found = map_get(g->pending, key, &data) == HB_OK;
+    pipe_free(key);
+
+    if (found && now - MIN(now, ((stream_pending_t *) data)->time) < idle) return 0;
+    if (!found && (!force || stream_cmp(id, &g->last) > 0 ||
+                   stream_scan(NULL, o->ptr, id, id, 1, NULL, NULL, NULL) == 0))
+        return 0;
+    stream_pending_put(g, id, consumer, now);
+
+    return 1;
+}
+
+int stream_iterate(object_t *o, int (*f)(any_t, const stream_id_t *, pipe_t *, int), any_t item)
+{
+    stream_t *st = o->ptr;
+    pipe_t *fields = NULL;
+    uint64_t count, len, i;
+    int status = HB_OK;
+    size_t b;
+
+    for (b = 0; b < st->nblocks && status == HB_OK; b++) {
+        const unsigned char *p = (const unsigned char *) st->blocks[b].data, *e = p + pipe_len(st->blocks[b].data);
+        stream_id_t id = st->blocks[b].first;
+
+        while (p < e && status == HB_OK) {
+            p = stream_decode(p, e, &id, &count);
+            fields = realloc(fields, (count + 1) * sizeof(pipe_t));
+            for (i = 0; i < count; i++) {
+                p = stream_get(p, e, &len);
+                fields[i] = pipe_newlen(p, len);
+                p += len;
+            }
+            status = f(item, &id, fields, count);
+            for (i = 0; i < count; i++)
+                pipe_free(fields[i]);
+        }
+    }
+    free(fields);
+
+    return status;
+}
+
+static int stream_walk_group(any_t item, char *key, any_t data)
+{
+    stream_walk_t *w = item;
+
+    return w->groups(w->item, key, &((stream_group_t *) data)->last);
+}
+
+int stream_iterate_groups(object_t *o, int (*f)(any_t, pipe_t, const stream_id_t *), any_t item)
+{
+    stream_t *st = o->ptr;
+    stream_walk_t w;
+
+    if (st->groups == NULL || map_length(st->groups) == 0) return HB_OK;
+
+    memset(&w, 0, sizeof(w));
+    w.item = item;
+    w.groups = f;
+
+    return map_iterate(st->groups, stream_walk_group, &w);
+}
+
+int stream_iterate_pending(object_t *o, pipe_t name, int (*f)(any_t, const stream_id_t *, pipe_t), any_t item)
+{
+    stream_group_t *g = stream_group(o->ptr, name);
+    stream_ref_t *ref;
+    pipe_t refs;
+    int status = HB_OK;
+    size_t i;
+
+    if (g == NULL) return HB_OK;
+
+    refs = stream_pending_sorted(g, NULL, NULL);
+    for (i = 0, ref = (stream_ref_t *) refs; i < pipe_len(refs) / sizeof(stream_ref_t) && status == HB_OK; i++)
+        status = f(item, &ref[i].id, ref[i].pending->consumer);
+    pipe_free(refs);
+
+    return status;
+}
+
+/* A group, its last delivered id and its pending entries */
+static int stream_dump_group(any_t item, char *key, any_t data)
+{
+    stream_walk_t *w = item;
+    stream_group_t *g = data;
+    stream_ref_t *ref;
+    pipe_t refs = stream_pending_sorted(g, NULL, NULL);
+    size_t i, n = pipe_len(refs) / sizeof(stream_ref_t);
+
+    w->out = stream_put(w->out, pipe_len(key));
+    w->out = pipe_catlen(w->out, key, pipe_len(key));
+    w->out = stream_put(stream_put(w->out, g->last.ms), g->last.seq);
+    w->out = stream_put(w->out, n);
+    for (i = 0, ref = (stream_ref_t *) refs; i < n; i++) {
+        w->out = stream_put(stream_put(w->out, ref[i].id.ms), ref[i].id.seq);
+        w->out = stream_put(w->out, pipe_len(ref[i].pending->consumer));
+        w->out = pipe_catlen(w->out, ref[i].pending->consumer, pipe_len(ref[i].pending->consumer));
+        w->out = stream_put(stream_put(w->out, ref[i].pending->deliveries), ref[i].pending->time);
+    }
+    pipe_free(refs);
+
+    return HB_OK;
+}
+
+/* The last id, the blocks with their first and last ids, then the groups */
+pipe_t stream_dump(object_t *o)
+{
+    stream_t *st = o->ptr;
+    stream_walk_t w;
+    size_t i;
+
+    memset(&w, 0, sizeof(w));
+    w.out = stream_put(stream_put(pipe_empty(), st->last.ms), st->last.seq);
+    w.out = stream_put(w.out, st->nblocks);
+    for (i = 0; i < st->nblocks; i++) {
+        stream_block_t *b = &st->blocks[i];
+
+        w.out = stream_put(stream_put(w.out, b->first.ms), b->first.seq);
+        w.out = stream_put(stream_put(w.out, b->last.ms), b->last.seq);
+        w.out = stream_put(w.out, b->count);
+        w.out = stream_put(w.out, pipe_len(b->data));
+        w.out = pipe_catlen(w.out, b->data, pipe_len(b->data));
+    }
+
+    w.out = stream_put(w.out, st->groups != NULL ? map_length(st->groups) : 0);
+    if (st->groups != NULL && map_length(st->groups) > 0) map_iterate(st->groups, stream_dump_group, &w);
+
+    return w.out;
+}
+
+/* Every entry is decoded once, ids must grow across the blocks and match
+ * what the blocks claim */
+object_t *stream_load(const char *buf, size_t size)
+{
+    const unsigned char *p = (const unsigned char *) buf, *end = p + size;
+    object_t *o = stream_new();
+    stream_t *st = o->ptr;
+    stream_id_t prev = { 0, 0 }, id;
+    uint64_t n, i, count, len, fields, groups;
+    stream_block_t *b;
+
+    p = stream_get(stream_get(p, end, &st->last.ms), end, &st->last.seq);
+    if ((p = stream_get(p, end, &n)) == NULL || n > (uint64_t) (end - p)) goto err;
+
+    st->size = n;
+    st->blocks = calloc(n ? n : 1, sizeof(stream_block_t));
+    for (i = 0; i < n; i++) {
+        const unsigned char *q, *qend;
+
+        b = &st->blocks[i];
+        p = stream_get(stream_get(p, end, &b->first.ms), end, &b->first.seq);
+        p = stream_get(stream_get(p, end, &b->last.ms), end, &b->last.seq);
+        p = stream_get(stream_get(p, end, &count), end, &len);
+        if (p == NULL || len > (uint64_t) (end - p) || count == 0 || count > len) goto err;
+        if (st->nblocks > 0 && stream_cmp(&b->first, &prev) <= 0) goto err;
+
+        b->data = pipe_newlen(p, len);
+        b->count = count;
+        st->nblocks++;
+        p += len;
+
+        for (q = (const unsigned char *) b->data, qend = q + len, id = b->first; q < qend; count--) {
+            if (count == 0 || (q = stream_decode(q, qend, &id, &fields)) == NULL) goto err;
+            if ((q = stream_skip(q, qend, fields)) == NULL) goto err;
+            if (count == b->count ? stream_cmp(&id, &b->first) != 0 : stream_cmp(&id, &prev) <= 0) goto err;
+            prev = id;
+        }
+        if (count != 0 || stream_cmp(&prev, &b->last) != 0) goto err;
+        st->length += b->count;
+    }
+    if (st->nblocks > 0 && stream_cmp(&st->last, &prev) < 0) goto err;
+
+    if ((p = stream_get(p, end, &groups)) == NULL) goto err;
+    for (i = 0; i < groups; i++) {
+        stream_group_t *g;
+        pipe_t name, consumer;
+
+        if ((p = stream_get(p, end, &len)) == NULL || len > (uint64_t) (end - p)) goto err;
+        name = pipe_newlen(p, len);
+        p = stream_get(stream_get(p + len, end, &id.ms), end, &id.seq);
+        if (p == NULL || stream_group_create(o, name, &id) == HB_ERR) {
+            pipe_free(name);
+            goto err;
+        }
+        g = stream_group(st, name);
+        pipe_free(name);
+
+        if ((p = stream_get(p, end, &n)) == NULL || n > (uint64_t) (end - p)) goto err;
+        while (n-- > 0) {
+            stream_pending_t *pending;
+
+            p = stream_get(stream_get(p, end, &id.ms), end, &id.seq);
+            if ((p = stream_get(p, end, &len)) == NULL || len > (uint64_t) (end - p)) goto err;
+            consumer = pipe_newlen(p, len);
+            stream_pending_put(g, &id, consumer, 0);
+            pipe_free(consumer);
+
+            name = stream_catid(pipe_empty(), &id);
+            map_get(g->pending, name, (any_t *) &pending);
+            pipe_free(name);
+            if ((p = stream_get(stream_get(p + len, end, &pending->deliveries), end, &pending->time)) == NULL) goto err;
+        }
+    }
+    if (p != end) goto err;
+
+    return o;
+
+err:
+    object_decr(o);
+    return NULL;
+}
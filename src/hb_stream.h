@@ -0,0 +1,154 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+
+
+#ifndef _HB_STREAM_H_
+#define _HB_STREAM_H_
+
+/* A stream is a log of entries, each a list of fields and values under
+ * an id of milliseconds and a sequence number that only grows. Entries
+ * are packed into blocks of about HB_STREAM_BLOCK bytes, each one the id
+ * as the difference from the one before (the sequence whole if the
+ * milliseconds changed), the number of fields and values, and those as
+ * varint lengths and bytes. The blocks are an array in id order: an
+ * append goes to the last one, a range bisects to its first block and
+ * reads on from there. A consumer group keeps the last id it delivered
+ * and the entries delivered but not acknowledged, with their consumer. */
+#define HB_STREAM_MAX_ID    UINT64_MAX
+
+typedef struct _stream_id {
+    uint64_t  ms;
+    uint64_t  seq;
+} stream_id_t;
+
+typedef struct _stream_block {
+    stream_id_t first;
+    stream_id_t last;
+    uint32_t  count;
+    pipe_t    data;
+} stream_block_t;
+
+typedef struct _stream {
+    stream_block_t *blocks;
+    size_t    nblocks;
+    size_t    size;                         /* Blocks allocated */
+    uint64_t  length;
+    stream_id_t last;                       /* Of the last entry added */
+    map_t    *groups;                       /* Name to stream_group_t, NULL until there is one */
+} stream_t;
+
+typedef struct _stream_group {
+    stream_id_t last;                       /* Last delivered */
+    map_t    *pending;                      /* "ms-seq" to stream_pending_t */
+} stream_group_t;
+
+typedef struct _stream_pending {
+    pipe_t    consumer;
+    uint64_t  deliveries;
+    uint64_t  time;                         /* Of the last delivery, ms since the epoch */
+} stream_pending_t;
+
+/* New empty stream object. */
+object_t *stream_new(void);
+
+/* Free a stream with its entries and groups. */
+void      stream_free(stream_t *);
+
+/* Parse "ms-seq", or "ms" with 'seq' for the sequence. HB_ERR if it is
+ * not an id. */
+int       stream_strtoid(const char *, size_t, uint64_t, stream_id_t *);
+
+pipe_t    stream_catid(pipe_t, const stream_id_t *);
+
+/* Step to the id right after, HB_ERR if there is none. */
+int       stream_next(stream_id_t *);
+
+/* Append an entry of 'count' fields and values. The id is taken from the
+ * clock if 'automatic' is set, and written to 'id'. HB_ERR if a given id
+ * is not above the last one. */
+int       stream_add(object_t *, stream_id_t *, int, pipe_t *, int);
+
+long long stream_length(object_t *);
+
+/* The id of the last entry added, 0-0 if none. */
+void      stream_last(object_t *, stream_id_t *);
+
+/* Append the entries from 'start' to 'end', at most 'count' of them if it
+ * is not negative, one a line: the id, the fields and the values, quoted,
+ * after 'prefix' if it is not NULL. Returns how many there were. */
+long long stream_catrange(pipe_t *, object_t *, const stream_id_t *, const stream_id_t *, long long, pipe_t);
+
+/* Create a group that delivered up to 'id'. HB_ERR if it exists. */
+int       stream_group_create(object_t *, pipe_t, const stream_id_t *);
+
+/* Returns 1 if the group was there. */
+int       stream_group_destroy(object_t *, pipe_t);
+
+/* Number of groups, and whether there is one of that name. */
+long long stream_groups(object_t *);
+int       stream_group_exists(object_t *, pipe_t);
+
+/* Deliver up to 'count' entries after the last delivered to a consumer,
+ * or with 'after' given read again its pending entries past it. Lines as
+ * stream_catrange(). Returns how many, HB_ERR if there is no such group. */
+long long stream_readgroup(pipe_t *, object_t *, pipe_t, pipe_t, const stream_id_t *, long long, pipe_t);
+
+/* 1 if there are entries past 'after' or, with a group, past the last
+ * one it delivered. */
+int       stream_ready(object_t *, const stream_id_t *, pipe_t);
+
+/* Acknowledge a pending entry, 1 if it was pending. HB_ERR if there is no
+ * such group. */
+int       stream_ack(object_t *, pipe_t, const stream_id_t *);
+
+/* Append the pending entries of a group by id, a line each: the id and
+ * the consumer quoted, the ms since the last delivery and the number of
+ * deliveries. NULL if there is no such group. */
+pipe_t    stream_catpending(pipe_t, object_t *, pipe_t);
+
+/* Give a pending entry idle for at least 'idle' ms to a consumer. With
+ * 'force' an entry that was delivered and acknowledged becomes pending
+ * again. 1 if it was claimed, HB_ERR if there is no such group. */
+int       stream_claim(object_t *, pipe_t, pipe_t, uint64_t, const stream_id_t *, int);
+
+/* Call 'f' with each entry, its fields and values in new pipes, until it
+ * does not return HB_OK. */
+int       stream_iterate(object_t *, int (*)(any_t, const stream_id_t *, pipe_t *, int), any_t);
+
+/* Call 'f' with each group and its last delivered id. */
+int       stream_iterate_groups(object_t *, int (*)(any_t, pipe_t, const stream_id_t *), any_t);
+
+/* Call 'f' with each pending entry of a group and its consumer. */
+int       stream_iterate_pending(object_t *, pipe_t, int (*)(any_t, const stream_id_t *, pipe_t), any_t);
+
+/* The whole stream in one pipe, blocks as they are, and back. NULL if
+ * the bytes are not a stream. */
+pipe_t    stream_dump(object_t *);
+object_t *stream_load(const char *, size_t);
+
+#endif
@@ -0,0 +1,389 @@
+/*
+ * TIER                   Cold values of the memory engine spilled to a value log.
+ *
+ * Version:                                     @(#)tier.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+extern map_t database;
+
+/* A value on its way to the log, or a reference being compacted */
+typedef struct _tier_item {
+    pipe_t key;                             /* Copy, the engine may free its own */
+    object_t *object;                       /* Referenced while the lock is dropped */
+    any_t ref;                              /* What a compacted object held */
+    unsigned int lru;
+    uint64_t offset;
+    uint32_t len;
+} tier_item_t;
+
+/* All of this is protected by the database lock. The thread writes to the
+ * log without it, 'generation' tells it whether the log was replaced in
+ * the meantime. */
+static int fd = HB_ERR;
+static uint64_t size;
+static uint64_t live;
+static uint64_t cold;
+static uint64_t generation;
+static int cursor;
+static uint64_t spilled;
+static uint64_t promoted;
+static uint64_t compactions;
+
+static void     tier_name(char *, const char *);
+static int      tier_open(const char *);
+static any_t    tier_ref(uint64_t, uint32_t, int);
+static pipe_t   tier_pread(int, any_t);
+static uint32_t tier_len(any_t);
+static uint64_t tier_offset(any_t);
+static map_bucket_t *tier_find(char *, object_t *);
+static int      tier_cmp(const void *, const void *);
+static void     tier_spill(void);
+static void     tier_compact(void);
+static void    *tier_loop(void *);
+
+static void tier_name(char *path, const char *ext)
+{
+    snprintf(path, PATH_MAX, "%s/hashbase.%s", server.dir, ext);
+}
+
+/* Always a new file: a forked snapshot child keeps reading the old one. */
+static int tier_open(const char *ext)
+{
+    char path[PATH_MAX];
+
+    tier_name(path, ext);
+    unlink(path);
+
+    return open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+}
+
+static any_t tier_ref(uint64_t offset, uint32_t len, int packed)
+{
+    return (any_t) (uintptr_t) (offset << (HB_TIER_LEN_BITS + 1) | (uint64_t) len << 1 | (packed ? 1 : 0));
+}
+
+static uint32_t tier_len(any_t ref)
+{
+    return HB_TIER_LEN(ref);
+}
+
+static uint64_t tier_offset(any_t ref)
+{
+    return (uintptr_t) ref >> (HB_TIER_LEN_BITS + 1);
+}
+
+/* The bucket of 'key' if it still holds 'o'. The object is referenced by
+ * the caller, so its address was not reused by another one. */
+static map_bucket_t *tier_find(char *key, object_t *o)
+{
+    int i, n;
+
+    for (i = map_home(&database, key, strlen(key)), n = 0; n < HB_MAP_LENGTH; i = (i + 1) % database.table_size, n++)
+        if (database.data[i].in_use && database.data[i].data == o) return &database.data[i];
+
+    return NULL;
+}
+
+static int tier_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) ((const tier_item_t *) a)->ref, y = (uintptr_t) ((const tier_item_t *) b)->ref;
+
+    return x < y ? -1 : x > y;
+}
+
+int tier_init(void)
+{
+    pthread_t thread_id;
+
+    if (mkdir(server.dir, 0755) == HB_ERR && errno != EEXIST) {
+        fprintf(stdout, "hb: %s could not create data directory [%s]\n", HB_LOG_ERR, server.dir);
+        return HB_ERR;
+    }
+    if ((fd = tier_open("tier")) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not open value log in [%s]: %s\n", HB_LOG_ERR, server.dir, strerror(errno));
+        return HB_ERR;
+    }
+
+    if (pthread_create(&thread_id, NULL, tier_loop, NULL) != HB_OK) {
+        fprintf(stdout, "hb: %s could not create tiering thread\n", HB_LOG_ERR);
+        return HB_ERR;
+    }
+    pthread_detach(thread_id);
+
+    fprintf(stdout, "hb: %s values idle for %ds go to [%s/hashbase.tier]\n", HB_LOG_INF, server.tier_after, server.dir);
+
+    return HB_OK;
+}
+
+static pipe_t tier_pread(int from, any_t ref)
+{
+    uint32_t len = tier_len(ref);
+    pipe_t value = pipe_newlen(NULL, len);
+
+    if (pread(from, value, len, tier_offset(ref)) != (ssize_t) len) {
+        fprintf(stdout, "hb: %s could not read value log: %s\n", HB_LOG_ERR, strerror(errno));
+        pipe_free(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+pipe_t tier_read(any_t ref)
+{
+    return tier_pread(fd, ref);
+}
+
+void tier_drop(any_t ref)
+{
+    live -= tier_len(ref);
+    cold--;
+}
+
+/* The read is made without the lock, like the write in tier_spill, and
+ * the value goes in only if the reference is the one that was read. A
+ * compaction in the meantime moves it, so the read is made again. */
+int tier_promote(pipe_t key, object_t *o)
+{
+    uint64_t gen;
+    any_t ref;
+    pipe_t value;
+    int from;
+
+    for (;;) {
+        ref = o->ptr;
+        gen = generation;
+        from = fd;
+
+        pthread_mutex_unlock(&server.mutex);
+        value = tier_pread(from, ref);
+        pthread_mutex_lock(&server.mutex);
+
+        /* Another read brought it back first */
+        if (o->encoding != HB_ENC_TIER) {
+            if (value) pipe_free(value);
+            return HB_OK;
+        }
+        if (gen == generation && o->ptr == ref) break;
+
+        if (value) pipe_free(value);
+        if (tier_find(key, o) == NULL) {
+            /* Deleted while the log was replaced, which forgot its reference */
+            o->encoding = HB_ENC_RAW;
+            o->ptr = pipe_empty();
+            return HB_ERR;
+        }
+    }
+
+    if (value == NULL) return HB_ERR;
+
+    tier_drop(ref);
+    o->encoding = HB_TIER_ISPACKED(ref) ? HB_ENC_LZF : HB_ENC_RAW;
+    o->ptr = value;
+    promoted++;
+
+    return HB_OK;
+}
+
+void tier_reset(void)
+{
+    int old = fd;
+
+    if ((fd = tier_open("tier")) == HB_ERR) {
+        fprintf(stdout, "hb: %s could not reopen value log: %s\n", HB_LOG_ERR, strerror(errno));
+        fd = old;
+        return;
+    }
+    close(old);
+
+    size = live = cold = 0;
+    generation++;
+}
+
+/* Copy the idle values of the next part of the table, write them out
+ * without the lock and swap in references for those that did not change
+ * in the meantime. Runs with the lock held. */
+static void tier_spill(void)
+{
+    pipe_t items = pipe_empty(), buf = pipe_empty();
+    tier_item_t item, *it;
+    uint64_t gen = generation, base = size;
+    int scanned;
+    ssize_t status;
+    pipe_t value;
+
+    for (scanned = 0; scanned < HB_TIER_SCAN && scanned < database.table_size && pipe_len(buf) < HB_TIER_BATCH; scanned++) {
+        map_bucket_t *b;
+        object_t *o;
+
+        if (cursor >= database.table_size) cursor = 0;
+        b = &database.data[cursor++];
+
+        if (!b->in_use || (o = b->data) == NULL || o->type != HB_OBJ_STRING) continue;
+        if (o->encoding != HB_ENC_RAW && o->encoding != HB_ENC_LZF) continue;
+        if (o->refcount != 1 || object_idle(o) < (unsigned int) server.tier_after) continue;
+
+        value = o->ptr;
+        if (pipe_len(value) < HB_TIER_MIN || pipe_len(value) >= 1U << HB_TIER_LEN_BITS) continue;
+        if (base + pipe_len(buf) + pipe_len(value) >= 1ULL << HB_TIER_OFF_BITS) break;
+
+        object_incr(o);
+        item.key = pipe_dup(b->key);
+        item.object = o;
+        item.lru = o->lru;
+        item.offset = base + pipe_len(buf);
+        item.len = pipe_len(value);
+        items = pipe_catlen(items, &item, sizeof(item));
+        buf = pipe_catlen(buf, value, item.len);
+    }
+
+    if (pipe_len(items) == 0) goto done;
+
+    pthread_mutex_unlock(&server.mutex);
+    status = util_pwrite(fd, buf, pipe_len(buf), base);
+    pthread_mutex_lock(&server.mutex);
+
+    if (status == HB_ERR) {
+        fprintf(stdout, "hb: %s could not write value log: %s\n", HB_LOG_ERR, strerror(errno));
+        goto done;
+    }
+    if (gen != generation) goto done;
+
+    size = base + pipe_len(buf);
+    for (it = (tier_item_t *) items; (char *) it < items + pipe_len(items); it++) {
+        object_t *o = it->object;
+
+        /* Replaced, deleted or read since it was copied, it stays. A reply
+         * still sending the pipe holds a reference of its own. */
+        if (tier_find(it->key, o) == NULL || o->lru != it->lru || o->refcount != 2) continue;
+
+        pipe_free(o->ptr);
+        o->ptr = tier_ref(it->offset, it->len, o->encoding == HB_ENC_LZF);
+        o->encoding = HB_ENC_TIER;
+
+        live += it->len;
+        cold++;
+        spilled++;
+    }
+
+done:
+    for (it = (tier_item_t *) items; (char *) it < items + pipe_len(items); it++) {
+        object_decr(it->object);
+        pipe_free(it->key);
+    }
+    pipe_free(items);
+    pipe_free(buf);
+}
+
+/* Copy what is still referenced to a new log once most of the old one is
+ * dead. Runs with the lock held, the copy is made without it. */
+static void tier_compact(void)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    pipe_t items = pipe_empty(), buf;
+    tier_item_t item, *it;
+    uint64_t gen = generation, offset = 0;
+    int i, nfd, status = HB_OK;
+
+    memset(&item, 0, sizeof(item));
+    for (i = 0; i < database.table_size; i++) {
+        object_t *o = database.data[i].data;
+
+        if (!database.data[i].in_use || o->encoding != HB_ENC_TIER) continue;
+        item.ref = o->ptr;
+        item.len = tier_len(item.ref);
+        item.offset = offset;
+        offset += item.len;
+        items = pipe_catlen(items, &item, sizeof(item));
+    }
+
+    if ((nfd = tier_open("tier.tmp")) == HB_ERR) {
+        pipe_free(items);
+        return;
+    }
+
+    pthread_mutex_unlock(&server.mutex);
+    buf = pipe_empty();
+    for (it = (tier_item_t *) items; (char *) it < items + pipe_len(items) && status == HB_OK; it++) {
+        buf = pipe_growzero(buf, it->len);
+        if (pread(fd, buf, it->len, tier_offset(it->ref)) != (ssize_t) it->len ||
+            util_pwrite(nfd, buf, it->len, it->offset) == HB_ERR)
+            status = HB_ERR;
+        pipe_clear(buf);
+    }
+    pipe_free(buf);
+    pthread_mutex_lock(&server.mutex);
+
+    tier_name(path, "tier");
+    tier_name(tmp, "tier.tmp");
+    if (status == HB_ERR || gen != generation || rename(tmp, path) == HB_ERR) {
+        close(nfd);
+        unlink(tmp);
+        pipe_free(items);
+        return;
+    }
+
+    close(fd);
+    fd = nfd;
+    size = offset;
+    live = cold = 0;
+
+    /* References are unique within a generation, the ones still in the
+     * table are looked up among the copied ones */
+    qsort(items, pipe_len(items) / sizeof(item), sizeof(item), tier_cmp);
+    for (i = 0; i < database.table_size; i++) {
+        object_t *o = database.data[i].data;
+
+        if (!database.data[i].in_use || o->encoding != HB_ENC_TIER) continue;
+
+        item.ref = o->ptr;
+        if ((it = bsearch(&item, items, pipe_len(items) / sizeof(item), sizeof(item), tier_cmp)) == NULL) continue;
+
+        o->ptr = tier_ref(it->offset, it->len, HB_TIER_ISPACKED(it->ref));
+        live += it->len;
+        cold++;
+    }
+    generation++;
+    compactions++;
+
+    pipe_free(items);
+}
+
+static void *tier_loop(void *arg)
+{
+    for (;;) {
+        sleep(1);
+
+        pthread_mutex_lock(&server.mutex);
+        tier_spill();
+        if (size - live >= HB_TIER_COMPACT_MIN && size - live > live) tier_compact();
+        pthread_mutex_unlock(&server.mutex);
+    }
+
+    return NULL;
+}
+
+pipe_t tier_catinfo(pipe_t s)
+{
+    if (fd == HB_ERR) return s;
+
+    s = pipe_catprintf(s, "tier_after_sec:%d\n", server.tier_after);
+    s = pipe_catprintf(s, "tier_cold_keys:%" PRIu64 "\n", cold);
+    s = pipe_catprintf(s, "tier_cold_bytes:%" PRIu64 "\n", live);
+    s = pipe_catprintf(s, "tier_log_bytes:%" PRIu64 "\n", size);
+    s = pipe_catprintf(s, "tier_spilled:%" PRIu64 "\n", spilled);
+    s = pipe_catprintf(s, "tier_promoted:%" PRIu64 "\n", promoted);
+    s = pipe_catprintf(s, "tier_compactions:%" PRIu64 "\n", compactions);
+
+    return s;
+}
@@ -0,0 +1,63 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+#ifndef _HB_TIER_H_
+#define _HB_TIER_H_
+
+/* Values of the memory engine that were not read or written for a while
+ * are moved to a value log in server.dir. Their object then holds a
+ * reference instead of the pipe: bit 0 set for a compressed value, the
+ * stored length in the next HB_TIER_LEN_BITS bits and the offset in the
+ * log above, so a reference costs no memory of its own. The log is only a
+ * spill area, it is started empty and persistence stays with the append
+ * only file or snapshots. */
+#define HB_TIER_LEN_BITS    22
+#define HB_TIER_OFF_BITS    40
+#define HB_TIER_ISPACKED(p) (((uintptr_t) (p)) & 1)
+#define HB_TIER_LEN(p)      ((((uintptr_t) (p)) >> 1) & ((1U << HB_TIER_LEN_BITS) - 1))
+
+/* Open an empty value log and start the thread moving values out. */
+int     tier_init(void);
+
+/* Read the bytes behind a reference into a new pipe, still compressed if
+ * the value was, NULL on error. */
+pipe_t  tier_read(any_t);
+
+/* The value behind a reference was replaced or deleted. */
+void    tier_drop(any_t);
+
+/* Bring the value of an object back to memory. The database lock is
+ * dropped for the read, the caller holds a reference to the object and
+ * must not rely on anything else staying put. Return HB_OK or HB_ERR. */
+int     tier_promote(pipe_t, object_t *);
+
+/* Forget every reference, the database was cleared. */
+void    tier_reset(void);
+
+pipe_t  tier_catinfo(pipe_t);
+
+#endif
@@ -39,4 +39,20 @@
 
 #define COUNT(a) 		(sizeof(a) / sizeof(*(a)))
 
+#define HB_UTIL_VARINT  10              /* Longest 64-bit varint */
+
+unsigned long util_crc32(unsigned long, const void *, size_t);
+uint64_t util_hash64(const void *, size_t, uint64_t);
+int      util_varint_put(unsigned char *, uint64_t);
+int      util_varint_get(const unsigned char *, const unsigned char *, uint64_t *);
+void     util_put32(unsigned char *, uint32_t);
+void     util_put64(unsigned char *, uint64_t);
+uint32_t util_get32(const unsigned char *);
+uint64_t util_get64(const unsigned char *);
+int      util_pwrite(int, const void *, size_t, uint64_t);
+int      util_send(int, const void *, size_t);
+uint64_t util_zigzag(int64_t);
+int64_t  util_unzigzag(uint64_t);
+int      util_strtoll(const char *, size_t, long long *);
+
 #endif
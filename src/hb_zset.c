@@ -0,0 +1,548 @@
+/*
+ * ZSET                    Sorted sets, skiplists with spans and a member index.
+ *
+ * Version:                                     @(#)zset.c    0.0.1    09/07/14
+ * Authors:             Maciej A. Czyzewski, <maciejanthonyczyzewski@gmail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <hb_core.h>
+
+extern struct server server;
+
+static int          zset_cmp(double, const char *, size_t, double, const char *, size_t);
+static int          zset_node_cmp(zset_node_t *, zset_node_t *);
+static int          zset_height(void);
+static zset_node_t *zset_node_new(int, double, pipe_t);
+static void         zset_link(zset_t *, zset_node_t *);
+static void         zset_unlink(zset_t *, zset_node_t *);
+static zset_node_t *zset_node_at(zset_t *, unsigned long);
+static unsigned long zset_node_rank(zset_t *, zset_node_t *);
+static zset_t      *zset_skiplist(void);
+static unsigned char *zset_packed_next(unsigned char *, unsigned char *, double *, const char **, uint64_t *);
+static unsigned char *zset_packed_find(pipe_t, const char *, size_t, double *, unsigned char **, long long *);
+static pipe_t       zset_packed_insert(pipe_t, double, const char *, size_t);
+static void         zset_packed_remove(pipe_t, unsigned char *, unsigned char *);
+static void         zset_convert(object_t *);
+static int          zset_inrange(double, zset_range_t *, int);
+static pipe_t       zset_catone(pipe_t, const char *, size_t, double, int);
+
+static int zset_cmp(double s1, const char *m1, size_t l1, double s2, const char *m2, size_t l2)
+{
+    int c;
+
+    if (s1 != s2) return s1 < s2 ? -1 : 1;
+    if ((c = memcmp(m1, m2, MIN(l1, l2))) != 0) return c;
+
+    return (l1 > l2) - (l1 < l2);
+}
+
+static int zset_node_cmp(zset_node_t *a, zset_node_t *b)
+{
+    return zset_cmp(a->score, a->member, pipe_len(a->member), b->score, b->member, pipe_len(b->member));
+}
+
+/* Every level has a quarter of the nodes of the one below. rand() is safe
+ * to call from the threads that load a snapshot. */
+static int zset_height(void)
+{
+    int height = 1;
+
+    while (height < HB_ZSET_LEVELS && (rand() & 3) == 0) height++;
+
+    return height;
+}
+
+static zset_node_t *zset_node_new(int height, double score, pipe_t member)
+{
+    zset_node_t *node = calloc(1, sizeof(zset_node_t) + height * sizeof(struct _zset_link));
+
+    node->member = member;
+    node->score = score;
+    node->height = height;
+
+    return node;
+}
+
+static zset_t *zset_skiplist(void)
+{
+    zset_t *z = calloc(1, sizeof(zset_t));
+
+    z->index = map_new();
+    z->header = zset_node_new(HB_ZSET_LEVELS, 0, NULL);
+    z->level = 1;
+
+    return z;
+}
+
+void zset_free(zset_t *z)
+{
+    zset_node_t *node = z->header->level[0].forward, *next;
+
+    for (; node != NULL; node = next) {
+        next = node->level[0].forward;
+        pipe_free(node->member);
+        free(node);
+    }
+    free(z->header);
+    map_free(z->index);
+    free(z);
+}
+
+/* Put a node, new or unlinked, at its place. 'rank' counts the nodes
+ * before the one each level is updated at. */
+static void zset_link(zset_t *z, zset_node_t *node)
+{
+    zset_node_t *update[HB_ZSET_LEVELS], *x = z->header;
+    unsigned long rank[HB_ZSET_LEVELS];
+    int i;
+
+    for (i = z->level - 1; i >= 0; i--) {
+        rank[i] = i == z->level - 1 ? 0 : rank[i + 1];
+        while (x->level[i].forward && zset_node_cmp(x->level[i].forward, node) < 0) {
+            rank[i] += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+    for (i = z->level; i < node->height; i++) {
+        rank[i] = 0;
+        update[i] = z->header;
+        update[i]->level[i].span = z->length;
+    }
+    if (node->height > z->level) z->level = node->height;
+
+    for (i = 0; i < node->height; i++) {
+        node->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = node;
+        node->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+        update[i]->level[i].span = rank[0] - rank[i] + 1;
+    }
+    for (i = node->height; i < z->level; i++)
+        update[i]->level[i].span++;
+
+    node->backward = update[0] == z->header ? NULL : update[0];
+    if (node->level[0].forward) node->level[0].forward->backward = node;
+    else z->tail = node;
+    z->length++;
+}
+
+/* Take a node out of the list, it is not freed. */
+static void zset_unlink(zset_t *z, zset_node_t *node)
+{
+    zset_node_t *update[HB_ZSET_LEVELS], *x = z->header;
+    int i;
+
+    for (i = z->level - 1; i >= 0; i--) {
+        while (x->level[i].forward && zset_node_cmp(x->level[i].forward, node) < 0)
+            x = x->level[i].forward;
+        update[i] = x;
+    }
+
+    for (i = 0; i < z->level; i++) {
+        if (update[i]->level[i].forward == node) {
+            update[i]->level[i].span += node->level[i].span - 1;
+            update[i]->level[i].forward = node->level[i].forward;
+        } else {
+            update[i]->level[i].span--;
+        }
+    }
+
+    if (node->level[0].forward) node->level[0].forward->backward = node->backward;
+    else z->tail = node->backward;
+    while (z->level > 1 && z->header->level[z->level - 1].forward == NULL) z->level--;
+    z->length--;
+}
+
+/* The node at a rank counted from 1, NULL past the end. */
+static zset_node_t *zset_node_at(zset_t *z, unsigned long rank)
+{
+    zset_node_t *x = z->header;
+    unsigned long traversed = 0;
+    int i;
+
+    for (i = z->level - 1; i >= 0; i--) {
+        while (x->level[i].forward && traversed + x->level[i].span <= rank) {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        if (traversed == rank) return x;
+    }
+
+    return NULL;
+}
+
+/* The rank of a node in the list, counted from 1. */
+static unsigned long zset_node_rank(zset_t *z, zset_node_t *node)
+{
+    zset_node_t *x = z->header;
+    unsigned long rank = 0;
+    int i;
+
+    for (i = z->level - 1; i >= 0; i--) {
+        while (x->level[i].forward && zset_node_cmp(x->level[i].forward, node) <= 0) {
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        if (x == node) return rank;
+    }
+
+    return 0;
+}
+
+/* The entry at 'p', returns where the next one starts. */
+static unsigned char *zset_packed_next(unsigned char *p, unsigned char *end, double *score, const char **member,
+                                       uint64_t *len)
+{
+    memcpy(score, p, sizeof(double));
+    p += sizeof(double);
+    p += util_varint_get(p, end, len);
+    *member = (const char *) p;
+
+    return p + *len;
+}
+
+/* The entry of a member in a packed set, its rank and where the entry
+ * after it starts, NULL if the member is not there. */
+static unsigned char *zset_packed_find(pipe_t s, const char *member, size_t len, double *score, unsigned char **next,
+                                       long long *rank)
+{
+    unsigned char *p = (unsigned char *) s, *end = p + pipe_len(s), *entry;
+    const char *m;
+    uint64_t mlen;
+    long long n;
+
+    for (n = 0; p < end; n++) {
+        entry = p;
+        p = zset_packed_next(p, end, score, &m, &mlen);
+        if (mlen == len && memcmp(m, member, len) == 0) {
+            *next = p;
+            if (rank) *rank = n;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Add an entry before the first one that sorts after it */
+static pipe_t zset_packed_insert(pipe_t s, double score, const char *member, size_t len)
+{
+    unsigned char head[HB_UTIL_VARINT], *p = (unsigned char *) s, *end = p + pipe_len(s), *at;
+    int n = util_varint_put(head, len);
+    size_t size = sizeof(double) + n + len, offset;
+    const char *m;
+    uint64_t mlen;
+    double sc;
+
+    for (at = p; at < end; at = p) {
+        p = zset_packed_next(at, end, &sc, &m, &mlen);
+        if (zset_cmp(sc, m, mlen, score, member, len) > 0) break;
+    }
+    offset = at - (unsigned char *) s;
+
+    s = pipe_MakeRoomFor(s, size);
+    at = (unsigned char *) s + offset;
+    memmove(at + size, at, pipe_len(s) - offset);
+    memcpy(at, &score, sizeof(double));
+    memcpy(at + sizeof(double), head, n);
+    memcpy(at + sizeof(double) + n, member, len);
+    pipe_IncrLen(s, size);
+
+    return s;
+}
+
+static void zset_packed_remove(pipe_t s, unsigned char *entry, unsigned char *next)
+{
+    memmove(entry, next, (unsigned char *) s + pipe_len(s) - next);
+    pipe_IncrLen(s, -(int) (next - entry));
+}
+
+/* Entries come in order, each node is linked after the last one */
+static void zset_convert(object_t *o)
+{
+    unsigned char *p = (unsigned char *) o->ptr, *end = p + pipe_len(o->ptr);
+    zset_t *z = zset_skiplist();
+    zset_node_t *node;
+    const char *member;
+    uint64_t len;
+    double score;
+
+    while (p < end) {
+        p = zset_packed_next(p, end, &score, &member, &len);
+        node = zset_node_new(zset_height(), score, pipe_newlen(member, len));
+        zset_link(z, node);
+        map_put(z->index, node->member, node);
+    }
+
+    pipe_free(o->ptr);
+    o->ptr = z;
+    o->encoding = HB_ENC_SKIPLIST;
+}
+
+object_t *zset_new(void)
+{
+    return object_new(HB_OBJ_ZSET, HB_ENC_PACKED, pipe_empty());
+}
+
+int zset_add(object_t *o, double score, const char *member, size_t len)
+{
+    unsigned char *entry, *next;
+    zset_node_t *node, *prev, *forward;
+    zset_t *z;
+    pipe_t key;
+    double old;
+
+    if (o->encoding == HB_ENC_PACKED) {
+        if ((entry = zset_packed_find(o->ptr, member, len, &old, &next, NULL)) != NULL) {
+            if (old == score) return 0;
+            zset_packed_remove(o->ptr, entry, next);
+            o->ptr = zset_packed_insert(o->ptr, score, member, len);
+            return 0;
+        }
+        if (len <= HB_ZSET_PACKED_VALUE && zset_length(o) < HB_ZSET_PACKED_MEMBERS) {
+            o->ptr = zset_packed_insert(o->ptr, score, member, len);
+            return 1;
+        }
+        zset_convert(o);
+    }
+
+    z = o->ptr;
+    key = pipe_newlen(member, len);
+    if (map_get(z->index, key, (any_t *) &node) == HB_OK) {
+        pipe_free(key);
+        if (node->score == score) return 0;
+
+        /* Stays where it is if it still sorts between its neighbours */
+        prev = node->backward;
+        forward = node->level[0].forward;
+        if ((prev == NULL || zset_cmp(prev->score, prev->member, pipe_len(prev->member), score, member, len) < 0) &&
+            (forward == NULL ||
+             zset_cmp(score, member, len, forward->score, forward->member, pipe_len(forward->member)) < 0)) {
+            node->score = score;
+            return 0;
+        }
+        zset_unlink(z, node);
+        node->score = score;
+        zset_link(z, node);
+        return 0;
+    }
+
+    node = zset_node_new(zset_height(), score, key);
+    zset_link(z, node);
+    map_put(z->index, key, node);
+
+    return 1;
+}
+
+int zset_rem(object_t *o, pipe_t member)
+{
+    unsigned char *entry, *next;
+    zset_node_t *node;
+    zset_t *z = o->ptr;
+    char *key;
+    double score;
+
+    if (o->encoding == HB_ENC_PACKED) {
+        if ((entry = zset_packed_find(o->ptr, member, pipe_len(member), &score, &next, NULL)) == NULL) return 0;
+        zset_packed_remove(o->ptr, entry, next);
+        return 1;
+    }
+
+    if (map_take(z->index, member, &key, (any_t *) &node) != HB_OK) return 0;
+    zset_unlink(z, node);
+    pipe_free(node->member);
+    free(node);
+
+    return 1;
+}
+
+int zset_score(object_t *o, pipe_t member, double *score)
+{
+    unsigned char *next;
+    zset_node_t *node;
+
+    if (o->encoding == HB_ENC_PACKED)
+        return zset_packed_find(o->ptr, member, pipe_len(member), score, &next, NULL) ? HB_OK : HB_ERR;
+
+    if (map_get(((zset_t *) o->ptr)->index, member, (any_t *) &node) != HB_OK) return HB_ERR;
+    *score = node->score;
+
+    return HB_OK;
+}
+
+long long zset_rank(object_t *o, pipe_t member)
+{
+    unsigned char *next;
+    zset_node_t *node;
+    long long rank;
+    double score;
+
+    if (o->encoding == HB_ENC_PACKED)
+        return zset_packed_find(o->ptr, member, pipe_len(member), &score, &next, &rank) ? rank : HB_ERR;
+
+    if (map_get(((zset_t *) o->ptr)->index, member, (any_t *) &node) != HB_OK) return HB_ERR;
+
+    return (long long) zset_node_rank(o->ptr, node) - 1;
+}
+
+long long zset_length(object_t *o)
+{
+    unsigned char *p, *end;
+    const char *member;
+    uint64_t len;
+    double score;
+    long long n = 0;
+
+    if (o->encoding == HB_ENC_SKIPLIST) return ((zset_t *) o->ptr)->length;
+
+    for (p = (unsigned char *) o->ptr, end = p + pipe_len(o->ptr); p < end; n++)
+        p = zset_packed_next(p, end, &score, &member, &len);
+
+    return n;
+}
+
+static pipe_t zset_catone(pipe_t s, const char *member, size_t len, double score, int withscores)
+{
+    if (pipe_len(s) > 0) s = pipe_catlen(s, "\n", 1);
+    s = pipe_catrepr(s, member, len);
+    if (withscores) {
+        s = pipe_catlen(s, "\n", 1);
+        s = zset_catscore(s, score);
+    }
+
+    return s;
+}
+
+pipe_t zset_catrange(pipe_t s, object_t *o, long long start, long long stop, int withscores)
+{
+    long long length = zset_length(o), n;
+    unsigned char *p, *end;
+    zset_node_t *node;
+    const char *member;
+    uint64_t len;
+    double score;
+
+    if (start < 0) start += length;
+    if (stop < 0) stop += length;
+    if (start < 0) start = 0;
+    if (stop >= length) stop = length - 1;
+    if (start > stop) return s;
+
+    if (o->encoding == HB_ENC_SKIPLIST) {
+        node = zset_node_at(o->ptr, start + 1);
+        for (n = stop - start + 1; n > 0; n--, node = node->level[0].forward)
+            s = zset_catone(s, node->member, pipe_len(node->member), node->score, withscores);
+        return s;
+    }
+
+    for (p = (unsigned char *) o->ptr, end = p + pipe_len(o->ptr), n = 0; n <= stop; n++) {
+        p = zset_packed_next(p, end, &score, &member, &len);
+        if (n >= start) s = zset_catone(s, member, len, score, withscores);
+    }
+
+    return s;
+}
+
+/* Whether a score is past the lower end, or before the upper one */
+static int zset_inrange(double score, zset_range_t *r, int upper)
+{
+    if (upper) return r->maxex ? score < r->max : score <= r->max;
+
+    return r->minex ? score > r->min : score >= r->min;
+}
+
+pipe_t zset_catrangebyscore(pipe_t s, object_t *o, zset_range_t *r, int withscores)
+{
+    unsigned char *p, *end;
+    zset_node_t *x;
+    const char *member;
+    uint64_t len;
+    double score;
+    int i;
+
+    if (o->encoding == HB_ENC_SKIPLIST) {
+        zset_t *z = o->ptr;
+
+        /* Down to the last node before the range, then along the bottom */
+        for (x = z->header, i = z->level - 1; i >= 0; i--)
+            while (x->level[i].forward && !zset_inrange(x->level[i].forward->score, r, 0))
+                x = x->level[i].forward;
+
+        for (x = x->level[0].forward; x != NULL && zset_inrange(x->score, r, 1); x = x->level[0].forward)
+            s = zset_catone(s, x->member, pipe_len(x->member), x->score, withscores);
+        return s;
+    }
+
+    for (p = (unsigned char *) o->ptr, end = p + pipe_len(o->ptr); p < end;) {
+        p = zset_packed_next(p, end, &score, &member, &len);
+        if (!zset_inrange(score, r, 1)) break;
+        if (zset_inrange(score, r, 0)) s = zset_catone(s, member, len, score, withscores);
+    }
+
+    return s;
+}
+
+int zset_iterate(object_t *o, int (*f)(any_t, const char *, size_t, double), any_t item)
+{
+    unsigned char *p, *end;
+    zset_node_t *node;
+    const char *member;
+    uint64_t len;
+    double score;
+    int status;
+
+    if (o->encoding == HB_ENC_SKIPLIST) {
+        for (node = ((zset_t *) o->ptr)->header->level[0].forward; node != NULL; node = node->level[0].forward)
+            if ((status = f(item, node->member, pipe_len(node->member), node->score)) != HB_OK) return status;
+        return HB_OK;
+    }
+
+    for (p = (unsigned char *) o->ptr, end = p + pipe_len(o->ptr); p < end;) {
+        p = zset_packed_next(p, end, &score, &member, &len);
+        if ((status = f(item, member, len, score)) != HB_OK) return status;
+    }
+
+    return HB_OK;
+}
+
+int zset_strtod(const char *p, size_t len, double *score)
+{
+    char buf[64], *end;
+
+    if (len == 0 || len >= sizeof(buf)) return HB_ERR;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+
+    /* -0 and 0 are the same score */
+    if ((*score = strtod(buf, &end)) == 0) *score = 0;
+
+    return *end != '\0' || isnan(*score) ? HB_ERR : HB_OK;
+}
+
+int zset_strtorange(pipe_t min, pipe_t max, zset_range_t *r)
+{
+    r->minex = min[0] == '(';
+    r->maxex = max[0] == '(';
+
+    if (zset_strtod(min + r->minex, pipe_len(min) - r->minex, &r->min) == HB_ERR ||
+        zset_strtod(max + r->maxex, pipe_len(max) - r->maxex, &r->max) == HB_ERR)
+        return HB_ERR;
+
+    return HB_OK;
+}
+
+pipe_t zset_catscore(pipe_t s, double score)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "%.15g", score);
+    if (strtod(buf, NULL) != score) snprintf(buf, sizeof(buf), "%.17g", score);
+
+    return pipe_cat(s, buf);
+}
@@ -0,0 +1,112 @@
+/*
+ * hashbase - https://github.com/MaciejCzyzewski/hashbase
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Maciej A. Czyzewski
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Author: Maciej A. Czyzewski <maciejanthonyczyzewski@gmail.com>
+ */
+
+
+#ifndef _HB_ZSET_H_
+#define _HB_ZSET_H_
+
+/* A sorted set orders members by score, then by their bytes. A small one
+ * is a pipe of entries in that order, each the score and a varint length
+ * and the member, scanned linearly. Once it gets more than
+ * HB_ZSET_PACKED_MEMBERS members or one longer than HB_ZSET_PACKED_VALUE
+ * bytes it becomes a skiplist whose links count the nodes they skip, so
+ * ranks are found in O(log n), and a map from member to node for the
+ * score. Members are map keys then, so they may not hold a NUL. */
+#define HB_ZSET_LEVELS      32
+
+typedef struct _zset_node {
+    pipe_t    member;                       /* Also the key of the index */
+    double    score;
+    struct _zset_node *backward;
+    int       height;
+    struct _zset_link {
+        struct _zset_node *forward;
+        unsigned long span;                 /* Nodes up to 'forward' */
+    } level[];
+} zset_node_t;
+
+typedef struct _zset {
+    map_t    *index;
+    zset_node_t *header;
+    zset_node_t *tail;
+    unsigned long length;
+    int       level;
+} zset_t;
+
+/* Scores from 'min' to 'max', the ends included unless marked */
+typedef struct _zset_range {
+    double    min;
+    double    max;
+    int       minex;
+    int       maxex;
+} zset_range_t;
+
+/* New empty sorted set object, in the packed encoding. */
+object_t *zset_new(void);
+
+/* Free a skiplist encoded set with its members. */
+void      zset_free(zset_t *);
+
+/* Add a member or change its score. Returns 1 if the member is new, 0 if
+ * it was there. */
+int       zset_add(object_t *, double, const char *, size_t);
+
+/* Remove a member, returns 1 if it was there. */
+int       zset_rem(object_t *, pipe_t);
+
+/* The score of a member, HB_ERR if there is no such member. */
+int       zset_score(object_t *, pipe_t, double *);
+
+/* The position of a member from the lowest score on, HB_ERR if there is
+ * no such member. */
+long long zset_rank(object_t *, pipe_t);
+
+long long zset_length(object_t *);
+
+/* Append the members from rank 'start' to 'stop' (both included,
+ * negative ones count from the highest score) to 's', one quoted per
+ * line, each followed by its score if asked to. Members go from the set
+ * straight into the reply. */
+pipe_t    zset_catrange(pipe_t, object_t *, long long, long long, int);
+
+/* The same for the members whose score is in a range. */
+pipe_t    zset_catrangebyscore(pipe_t, object_t *, zset_range_t *, int);
+
+/* Call 'f' with each member and its score, lowest first, until it does
+ * not return HB_OK. */
+int       zset_iterate(object_t *, int (*)(any_t, const char *, size_t, double), any_t);
+
+/* A score, HB_ERR unless the whole string is a number. */
+int       zset_strtod(const char *, size_t, double *);
+
+/* A range of scores, an end may be '(' for excluded and -inf or +inf. */
+int       zset_strtorange(pipe_t, pipe_t, zset_range_t *);
+
+/* Append a score in the shortest form that reads back the same. */
+pipe_t    zset_catscore(pipe_t, double);
+
+#endif
@@ -0,0 +1,23 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import glob
+import os
+import subprocess
+import sys
+
+# Run every test_*.py against one hashbase binary
+if len(sys.argv) != 2:
+    print("Usage: python all.py <path to hashbase>")
+    raise SystemExit(2)
+
+here = os.path.dirname(os.path.abspath(__file__))
+failed = []
+for test in sorted(glob.glob(os.path.join(here, "test_*.py"))):
+    name = os.path.basename(test)
+    status = subprocess.call([sys.executable, test, os.path.abspath(sys.argv[1])], cwd=here)
+    print(("ok     " if status == 0 else "FAILED ") + name)
+    if status != 0:
+        failed.append(name)
+
+print("%d failed" % len(failed) if failed else "all passed")
+raise SystemExit(1 if failed else 0)
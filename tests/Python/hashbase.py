@@ -6,6 +6,7 @@ class hashbase:
     def __init__(self):
         self.buffer = 1024
         self.socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.pending = b""
 
     def connect(self, host, port):
         self.host = str(host)
@@ -13,14 +14,32 @@ class hashbase:
 
         self.socket.connect((self.host, self.port))
 
+    def close(self):
+        self.socket.close()
+
+    # Every argument is quoted, the reply is read up to its CRLF
+    def command(self, *args):
+        self.send(*args)
+        return self.reply()
+
+    def send(self, *args):
+        line = " ".join("\"" + str(arg).replace("\\", "\\\\").replace("\"", "\\\"") + "\"" for arg in args)
+        self.socket.sendall(line.encode("utf-8") + b"\r\n")
+
+    def reply(self):
+        while b"\r\n" not in self.pending:
+            data = self.socket.recv(self.buffer)
+            if not data:
+                raise EOFError("connection closed")
+            self.pending += data
+        reply, self.pending = self.pending.split(b"\r\n", 1)
+        return reply.decode("utf-8")
+
     def set(self, key, value):
-        self.socket.send("set \"" + str(key) + "\" \"" + str(value) + "\"\r\n")
-        return self.socket.recv(self.buffer)[:-2]
+        return self.command("set", key, value)
 
     def get(self, key):
-        self.socket.send("get \"" + str(key) + "\"\r\n")
-        return self.socket.recv(self.buffer)[:-2]
+        return self.command("get", key)
 
     def delete(self, key): # del -> delete
-        self.socket.send("del \"" + str(key) + "\"\r\n")
-        return self.socket.recv(self.buffer)[:-2]
\ No newline at end of file
+        return self.command("del", key)
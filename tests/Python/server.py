@@ -0,0 +1,150 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import hashbase                                  # hashbase
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+# A port nothing listens on right now
+def free_port():
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.bind(("127.0.0.1", 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+def binary():
+    if len(sys.argv) != 2:
+        print("Usage: python " + os.path.basename(sys.argv[0]) + " <path to hashbase>")
+        raise SystemExit(2)
+    return os.path.abspath(sys.argv[1])
+
+# Wait until 'condition' holds, at most 'timeout' seconds
+def wait(condition, timeout=10):
+    end = time.time() + timeout
+    while time.time() < end:
+        if condition():
+            return True
+        time.sleep(0.05)
+    return condition()
+
+# A hashbase process of its own, with its snapshot, data directory and log
+# in 'directory'. Started again with the same options after stop or kill.
+class server:
+    def __init__(self, path, directory, *options):
+        self.path = path
+        self.directory = directory
+        self.port = free_port()
+        self.options = list(options)
+        self.process = None
+        self.clients = []
+        self.logfile = os.path.join(directory, "hashbase-%d.log" % self.port)
+
+        for name, value in (("--snapshot=", "hashbase.snap"), ("--dir=", "data")):
+            if not [o for o in self.options if o.startswith(name)]:
+                self.options.append(name + os.path.join(directory, value))
+
+    def start(self):
+        log = open(self.logfile, "a")
+        self.process = subprocess.Popen([self.path, "--port=%d" % self.port] + self.options,
+                                        stdout=log, stderr=subprocess.STDOUT, cwd=self.directory)
+        log.close()
+        if not wait(self.listening):
+            raise RuntimeError("hashbase did not start, see " + self.logfile)
+        return self
+
+    def listening(self):
+        if self.process.poll() is not None:
+            raise RuntimeError("hashbase exited, see " + self.logfile)
+        try:
+            socket.create_connection(("127.0.0.1", self.port), 1).close()
+            return True
+        except socket.error:
+            return False
+
+    def client(self):
+        hb = hashbase.hashbase()
+        hb.connect("127.0.0.1", self.port)
+        self.clients.append(hb)
+        return hb
+
+    # Clients hang up first, so the port is not left in TIME_WAIT for the
+    # next start
+    def hangup(self):
+        for hb in self.clients:
+            hb.close()
+        self.clients = []
+
+    # A clean shutdown, the way ^C stops it
+    def stop(self):
+        self.hangup()
+        if self.process and self.process.poll() is None:
+            self.process.send_signal(signal.SIGINT)
+            self.process.wait()
+        self.process = None
+
+    # As if it crashed
+    def kill(self):
+        self.hangup()
+        if self.process and self.process.poll() is None:
+            self.process.kill()
+            self.process.wait()
+        self.process = None
+
+    def log(self):
+        with open(self.logfile) as f:
+            return f.read()
+
+    # The log is written through stdio and flushed when a client hangs up,
+    # so one connects and hangs up while waiting for the line
+    def logged(self, text, timeout=5):
+        def found():
+            if text in self.log():
+                return True
+            if self.process and self.process.poll() is None:
+                try:
+                    socket.create_connection(("127.0.0.1", self.port), 1).close()
+                except socket.error:
+                    pass
+            return False
+        return wait(found, timeout)
+
+    # The fields of an inf section as a dict of strings
+    def info(self, section="all"):
+        hb = hashbase.hashbase()
+        hb.connect("127.0.0.1", self.port)
+        lines = hb.command("inf", section).split("\n")
+        hb.close()
+        return dict(line.split(":", 1) for line in lines if ":" in line and not line.startswith("#"))
+
+# A scratch directory removed afterwards, and the servers started in it
+class sandbox:
+    def __init__(self):
+        self.path = binary()
+        self.directory = tempfile.mkdtemp(prefix="hashbase-")
+        self.servers = []
+
+    def server(self, *options):
+        s = server(self.path, self.directory, *options)
+        self.servers.append(s)
+        return s.start()
+
+    def file(self, name):
+        return os.path.join(self.directory, name)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, kind, value, traceback):
+        for s in self.servers:
+            s.kill()
+        if kind is None:
+            shutil.rmtree(self.directory, True)
+        else:
+            print("logs kept in " + self.directory)
+        return False
@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+import signal
+import server                                    # hashbase
+
+# Acknowledged writes survive a crash and are replayed on startup
+with server.sandbox() as box:
+    aof = box.file("hashbase.aof")
+    s = box.server("--appendonly=" + aof, "--appendfsync=always")
+    hb = s.client()
+
+    for i in range(100):
+        hb.set("key%d" % i, "value %d" % i)
+    for i in range(0, 100, 3):
+        hb.delete("key%d" % i)
+    hb.command("rpush", "list", "a", "b", "c")
+    hb.command("lpop", "list")
+    hb.get("key1")
+    s.kill()
+
+    # Reads are not logged
+    with open(aof, "rb") as f:
+        log = f.read()
+    assert log.count(b"\r\n") == 100 + 34 + 2, log.count(b"\r\n")
+    assert b"\"get\"" not in log
+
+    s.start()
+    hb = s.client()
+    assert s.info("keyspace")["keys"] == "67"
+    assert hb.get("key1") == "value 1" and hb.get("key3") == "-1"
+    assert hb.command("lrange", "list", 0, -1) == "\"b\"\n\"c\""
+
+    # A command cut short by a crash is dropped from the end of the file
+    s.kill()
+    with open(aof, "ab") as f:
+        f.write(b"\"set\" \"torn\" \"val")
+    s.start()
+    hb = s.client()
+    assert hb.get("torn") == "-1"
+    assert s.logged("truncating append only file")
+    assert os.path.getsize(aof) == len(log)
+
+    # Writes go on after the truncated end
+    hb.set("after", "crash")
+    s.kill()
+    s.start()
+    assert s.client().get("after") == "crash"
+
+    # A complete line that is not a command is corruption, the server refuses
+    # to start and leaves the file, and the commands after it, alone
+    s.kill()
+    good = os.path.getsize(aof)
+    with open(aof, "ab") as f:
+        f.write(b"\"nosuch\" \"key\"\r\n\"set\" \"later\" \"value\"\r\n")
+    size = os.path.getsize(aof)
+    try:
+        s.start()
+        assert False, "started with a corrupt append only file"
+    except RuntimeError:
+        pass
+    assert "bad command in append only file at offset %d" % good in s.log()
+    assert os.path.getsize(aof) == size
+    with open(aof, "r+b") as f:
+        f.truncate(good)
+    s.start()
+    assert s.client().get("after") == "crash"
+
+    # The other policies log the same commands, a clean stop flushes them
+    for policy in ("everysec", "no"):
+        other = box.file("hashbase-%s.aof" % policy)
+        p = box.server("--appendonly=" + other, "--appendfsync=" + policy)
+        hb = p.client()
+        for i in range(50):
+            hb.set("key%d" % i, i)
+        assert p.info("persistence")["aof_fsync"] == policy
+        p.stop()
+        p.start()
+        assert p.client().get("key49") == "49"
+
+    # ^C in the middle of a pipelined flood stops between two commands, with
+    # everything acknowledged flushed and no torn command left behind
+    flood = box.file("hashbase-flood.aof")
+    p = box.server("--appendonly=" + flood, "--appendfsync=no")
+    hb = p.client()
+    for i in range(1000):
+        hb.set("acked%d" % i, i)
+    for i in range(20000):
+        hb.send("set", "flood%d" % i, i)
+    p.process.send_signal(signal.SIGINT)
+    assert server.wait(lambda: p.process.poll() is not None, 10)
+    assert "closing hashbase" in p.log()
+    p.kill()
+    p.start()
+    assert p.client().get("acked999") == "999"
+    assert p.logged("loaded") and "truncating" not in p.log()
+
+    print("ok")
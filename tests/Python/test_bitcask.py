@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import glob
+import os
+import server                                    # hashbase
+
+def cask(s):
+    return s.info("engine")
+
+# Values live in data files, only the key directory is in memory
+with server.sandbox() as box:
+    data = box.file("cask")
+    s = box.server("--engine=bitcask", "--dir=" + data)
+    hb = s.client()
+    assert cask(s)["engine"] == "bitcask"
+
+    for round in range(5):
+        for i in range(2000):
+            hb.set("key%d" % i, ("round %d " % round) * 20)
+    for i in range(0, 2000, 4):
+        hb.delete("key%d" % i)
+    hb.set("spaces", "a value with spaces")
+    assert hb.command("len") == "1501"
+
+    info = cask(s)
+    assert int(info["cask_dead_bytes"]) > int(info["cask_disk_bytes"]) // 2, info
+
+    # Collections need the memory engine
+    assert hb.command("rpush", "list", "a") == "-1"
+
+    # A merge drops the overwritten and deleted records and leaves a hint file
+    inputs = {}
+    for path in glob.glob(os.path.join(data, "*.cask")):
+        with open(path, "rb") as f:
+            inputs[path] = f.read()
+    assert hb.command("compact") == "0"
+    assert server.wait(lambda: cask(s)["cask_merging"] == "0" and cask(s)["cask_merges"] == "1")
+    info = cask(s)
+    assert info["cask_dead_bytes"] == "0", info
+    assert glob.glob(os.path.join(data, "*.hint"))
+    size = int(info["cask_disk_bytes"])
+
+    hb.set("after", "merge")
+    hb.delete("key1")
+
+    # The key directory is rebuilt from the hint and data files
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert hb.command("len") == "1501"
+    assert hb.get("key2") == "round 4 " * 20
+    assert hb.get("key0") == "-1" and hb.get("key1") == "-1"
+    assert hb.get("after") == "merge" and hb.get("spaces") == "a value with spaces"
+    assert int(cask(s)["cask_disk_bytes"]) >= size
+
+    # A crash after the merge committed but before its inputs were unlinked:
+    # the next start finishes the job instead of loading them again
+    s.kill()
+    with open(os.path.join(data, "merge"), "w") as f:
+        for path, content in inputs.items():
+            with open(path, "wb") as old:
+                old.write(content)
+            f.write(os.path.basename(path).split(".")[0] + "\n")
+    s.start()
+    hb = s.client()
+    assert s.logged("finished an interrupted merge of %d data files" % len(inputs))
+    assert not [path for path in inputs if os.path.exists(path)]
+    assert not os.path.exists(os.path.join(data, "merge"))
+    assert hb.command("len") == "1501"
+    assert hb.get("key0") == "-1" and hb.get("after") == "merge"
+
+    assert hb.command("clr") == "0"
+    assert hb.command("len") == "0"
+    s.stop()
+    s.start()
+    assert s.client().command("len") == "0"
+
+    print("ok")
@@ -0,0 +1,73 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import random
+import server                                    # hashbase
+
+# Strings read and written as bits, the most significant bit of a byte first
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+    assert s.info("server")["bitmap_kernel"] in ("scalar", "popcnt", "avx2")
+
+    assert hb.command("setbit", "bits", 7, 1) == "0"
+    assert hb.command("setbit", "bits", 7, 0) == "1"
+    assert hb.command("setbit", "bits", 7, 1) == "0"
+    assert hb.get("bits") == "\x01"
+    assert hb.command("getbit", "bits", 7) == "1" and hb.command("getbit", "bits", 8) == "0"
+    assert hb.command("getbit", "bits", 100000) == "0"
+    assert hb.command("setbit", "bits", "x", 1) == "-1"
+    assert hb.command("setbit", "bits", 1, 2) == "-1"
+    assert hb.command("setbit", "bits", -1, 1) == "-1"
+
+    # Ranges are in bytes, from the end when negative
+    hb.command("setbit", "bits", 100, 1)
+    assert hb.command("bitcount", "bits") == "2"
+    assert hb.command("bitcount", "bits", 0, 0) == "1" and hb.command("bitcount", "bits", -1, -1) == "1"
+    assert hb.command("bitpos", "bits", 1) == "7" and hb.command("bitpos", "bits", 0) == "0"
+    assert hb.command("bitpos", "bits", 1, 1) == "100"
+    assert hb.command("bitcount", "missing") == "0"
+    assert hb.command("bitpos", "missing", 0) == "0" and hb.command("bitpos", "missing", 1) == "-1"
+    hb.set("number", 12)
+    assert hb.command("bitcount", "number") == "6"
+
+    # The shorter operand counts as zeros
+    hb.set("abc", "abc")
+    hb.set("a", "a")
+    assert hb.command("bitop", "and", "dest", "abc", "a") == "3" and hb.get("dest") == "a\x00\x00"
+    assert hb.command("bitop", "or", "dest", "abc", "a") == "3" and hb.get("dest") == "abc"
+    assert hb.command("bitop", "xor", "dest", "abc", "abc") == "3" and hb.command("bitcount", "dest") == "0"
+    assert hb.command("bitop", "not", "dest", "a") == "1" and hb.command("bitcount", "dest") == "5"
+    assert hb.command("bitop", "not", "dest", "abc", "a") == "-1"
+    assert hb.command("bitop", "nand", "dest", "abc") == "-1"
+
+    # Long enough for the vector kernels, checked against a model
+    random.seed(11)
+    size = 4099 * 8
+    models = {}
+    for key in ("x", "y"):
+        models[key] = set(random.sample(range(size), 3000))
+        for bit in models[key]:
+            hb.command("setbit", key, bit, 1)
+    hb.command("setbit", "short", 5, 1)
+    models["short"] = set([5])
+
+    for key, bits in models.items():
+        assert hb.command("bitcount", key) == str(len(bits))
+        assert hb.command("bitpos", key, 1) == str(min(bits))
+    x = models["x"]
+    assert hb.command("bitcount", "x", 10, 2000) == str(len([b for b in x if 80 <= b < 2001 * 8]))
+    assert hb.command("bitpos", "x", 1, 3000) == str(min(b for b in x if b >= 3000 * 8))
+    assert hb.command("bitpos", "x", 0) == str(min(set(range(size)) - x))
+
+    last = max(models["x"] | models["y"]) // 8 + 1
+    for op, result in (("and", models["x"] & models["y"]), ("or", models["x"] | models["y"] | models["short"]),
+                       ("xor", models["x"] ^ models["y"])):
+        keys = ["x", "y", "short"] if op == "or" else ["x", "y"]
+        assert hb.command("bitop", op, "dest", *keys) == str(last)
+        assert hb.command("bitcount", "dest") == str(len(result))
+        for bit in random.sample(range(size), 200):
+            assert hb.command("getbit", "dest", bit) == ("1" if bit in result else "0")
+    hb.command("bitop", "not", "dest", "x")
+    assert hb.command("bitcount", "dest") == str((max(x) // 8 + 1) * 8 - len(x))
+
+    print("ok")
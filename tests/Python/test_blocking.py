@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import time
+import server                                    # hashbase
+
+def blocked(s, n):
+    return server.wait(lambda: s.info("clients")["blocked_clients"] == str(n))
+
+# Pops that wait for a push, served in the order the clients came
+with server.sandbox() as box:
+    aof = box.file("hashbase.aof")
+    s = box.server("--appendonly=" + aof, "--appendfsync=always")
+    hb = s.client()
+
+    # Something to pop right away
+    hb.command("rpush", "list", "a", "b")
+    assert hb.command("blpop", "list", 0) == "\"list\"\n\"a\""
+    assert hb.command("brpop", "missing", "list", 0) == "\"list\"\n\"b\""
+    assert hb.command("type", "list") == "none"
+
+    first, second, third = s.client(), s.client(), s.client()
+    first.send("blpop", "list", 0)
+    assert blocked(s, 1)
+    second.send("brpop", "other", "list", 0)
+    assert blocked(s, 2)
+    third.send("blpop", "other", 0)
+    assert blocked(s, 3)
+
+    # One element wakes the first waiter only
+    assert hb.command("rpush", "list", "x") == "1"
+    assert first.reply() == "\"list\"\n\"x\""
+    assert blocked(s, 2)
+    assert hb.command("rpush", "other", "y", "z") == "2"
+    assert second.reply() == "\"other\"\n\"z\""
+    assert third.reply() == "\"other\"\n\"y\""
+    assert blocked(s, 0)
+    assert hb.command("type", "other") == "none"
+
+    # Timeouts, and clients gone while they wait
+    start = time.time()
+    assert hb.command("blpop", "list", 0.3) == "-1"
+    assert time.time() - start >= 0.25
+    first.send("blpop", "list", 0)
+    assert blocked(s, 1)
+    s.clients.remove(first)
+    first.close()
+    assert blocked(s, 0)
+    info = s.info("clients")
+    assert info["blocked_served"] == "3" and info["blocked_timeouts"] == "1", info
+
+    assert hb.command("blpop", "list", -1) == "-1"
+    hb.set("string", "value")
+    assert hb.command("blpop", "string", 0) == "-1"
+
+    # Logged as the pops they were, a replay does not block
+    second.send("blpop", "last", 0)
+    assert blocked(s, 1)
+    hb.command("rpush", "last", "1", "2")
+    assert second.reply() == "\"last\"\n\"1\""
+    with open(aof) as f:
+        log = f.read()
+    assert "blpop" not in log and "brpop" not in log and "\"lpop\" \"last\"" in log, log
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert hb.command("lrange", "last", 0, -1) == "\"2\""
+    assert hb.command("type", "other") == "none"
+
+    print("ok")
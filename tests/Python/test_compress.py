@@ -0,0 +1,55 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import random
+import server                                    # hashbase
+
+def document(i):
+    return "{\"id\": %d, \"name\": \"user %d\", \"tags\": [%s]}" % (i, i, ", ".join("\"tag%d\"" % t for t in range(30)))
+
+# Values past the threshold are kept compressed when that pays off
+with server.sandbox() as box:
+    aof = box.file("hashbase.aof")
+    s = box.server("--compress-above=100", "--appendonly=" + aof, "--appendfsync=always")
+    hb = s.client()
+
+    random.seed(7)
+    noise = "".join(random.choice("abcdefghijklmnopqrstuvwxyz0123456789") for _ in range(400))
+    for i in range(200):
+        hb.set("doc%d" % i, document(i))
+    hb.set("noise", noise)
+    hb.set("small", "x" * 99)
+
+    assert hb.command("object", "encoding", "doc0") == "lzf"
+    assert hb.command("object", "encoding", "noise") == "raw"
+    assert hb.command("object", "encoding", "small") == "raw"
+    assert hb.get("doc7") == document(7) and hb.get("noise") == noise
+
+    info = s.info("engine")
+    assert info["compress_above"] == "100" and info["compressed_writes"] == "200", info
+    assert int(info["compressed_out_bytes"]) * 3 < int(info["compressed_in_bytes"]) * 2, info
+
+    # Changed in place as plain bytes
+    hb.command("setbit", "doc1", 5, 1)
+    assert hb.command("object", "encoding", "doc1") == "raw"
+    assert hb.get("doc1") == "\x7f" + document(1)[1:]
+
+    # The log has the plain commands, the snapshot the compressed bytes
+    with open(aof, "rb") as f:
+        assert document(5).encode("utf-8").replace(b"\"", b"\\\"") in f.read()
+    assert hb.command("save") == "0"
+    with open(box.file("hashbase.snap"), "rb") as f:
+        assert document(5).encode("utf-8") not in f.read()
+
+    # Started from the snapshot, without the log
+    s.kill()
+    p = box.server("--compress-above=100")
+    hb = p.client()
+    assert hb.command("object", "encoding", "doc9") == "lzf"
+    assert hb.get("doc9") == document(9)
+
+    # Off, everything is kept as it is
+    hb = box.server().client()
+    hb.set("doc", document(0))
+    assert hb.command("object", "encoding", "doc") == "raw"
+
+    print("ok")
@@ -0,0 +1,73 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+def flags(reply):
+    return [int(f) for f in reply.split("\n")]
+
+# Bloom and cuckoo filters kept in strings, no false negatives
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+
+    assert hb.command("bf.reserve", "bloom", 0.01, 10000) == "0"
+    assert hb.command("bf.reserve", "bloom", 0.01, 10000) == "-1"
+    assert hb.command("bf.reserve", "bad", 2, 100) == "-1"
+    assert hb.command("bf.reserve", "bad", 0.01, 0) == "-1"
+    assert hb.command("type", "bloom") == "string"
+    assert hb.command("bf.add", "bloom", "x") == "1" and hb.command("bf.add", "bloom", "x") == "0"
+    assert hb.command("bf.exists", "bloom", "x") == "1" and hb.command("bf.exists", "bloom", "y") == "0"
+    assert hb.command("bf.madd", "bloom", "a", "b", "x") == "1\n1\n0"
+    assert hb.command("bf.mexists", "bloom", "a", "q", "x") == "1\n0\n1"
+    assert hb.command("bf.exists", "missing", "x") == "0"
+    assert hb.command("bf.add", "created", "x") == "1" and hb.command("bf.exists", "created", "x") == "1"
+
+    # At capacity, about the rate it was made for
+    for i in range(0, 10000, 500):
+        hb.command("bf.madd", "bloom", *["member %d" % j for j in range(i, i + 500)])
+    for i in range(0, 10000, 500):
+        assert sum(flags(hb.command("bf.mexists", "bloom", *["member %d" % j for j in range(i, i + 500)]))) == 500
+    positives = 0
+    for i in range(0, 10000, 500):
+        positives += sum(flags(hb.command("bf.mexists", "bloom", *["other %d" % j for j in range(i, i + 500)])))
+    assert positives < 200, positives
+
+    # Cuckoo filters delete too, one copy per add
+    assert hb.command("cf.reserve", "cuckoo", 1000) == "0"
+    assert hb.command("cf.reserve", "cuckoo", 1000) == "-1"
+    assert hb.command("cf.add", "cuckoo", "x") == "1" and hb.command("cf.add", "cuckoo", "x") == "1"
+    assert hb.command("cf.mexists", "cuckoo", "x", "y") == "1\n0"
+    assert hb.command("cf.del", "cuckoo", "x") == "1" and hb.command("cf.exists", "cuckoo", "x") == "1"
+    assert hb.command("cf.del", "cuckoo", "x") == "1" and hb.command("cf.exists", "cuckoo", "x") == "0"
+    assert hb.command("cf.del", "cuckoo", "x") == "0"
+    assert hb.command("cf.del", "missing", "x") == "0"
+    assert hb.command("cf.add", "made", "x") == "1" and hb.command("cf.exists", "made", "x") == "1"
+
+    # Full once no kick finds a place, nothing added before is lost
+    added = 0
+    while hb.command("cf.add", "cuckoo", "item %d" % added) == "1":
+        added += 1
+        assert added < 100000
+    assert added >= 900, added
+    assert hb.command("cf.add", "cuckoo", "item %d" % added) == "-1"
+    assert sum(flags(hb.command("cf.mexists", "cuckoo", *["item %d" % i for i in range(added)]))) == added
+
+    # Until deletes make room for the fingerprint left out when it filled
+    for i in range(added):
+        assert hb.command("cf.del", "cuckoo", "item %d" % i) == "1"
+    assert sum(flags(hb.command("cf.mexists", "cuckoo", *["item %d" % i for i in range(added)]))) < 10
+    assert hb.command("cf.add", "cuckoo", "item 0") == "1"
+
+    hb.set("string", "value")
+    assert hb.command("bf.add", "string", "x") == "-1" and hb.command("cf.add", "string", "x") == "-1"
+    assert hb.command("bf.exists", "string", "x") == "-1" and hb.command("cf.exists", "string", "x") == "-1"
+
+    # Kept through the snapshot
+    assert hb.command("save") == "0"
+    s.stop()
+    s.start()
+    hb = s.client()
+    assert hb.command("bf.exists", "bloom", "member 9999") == "1"
+    assert hb.command("cf.exists", "cuckoo", "item 0") == "1"
+
+    print("ok")
@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+def pairs(reply):
+    items = [e[1:-1] for e in reply.split("\n")] if reply else []
+    return dict(zip(items[0::2], items[1::2]))
+
+# Small hashes are packed, large ones are maps
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+
+    assert hb.command("hset", "hash", "a", 1, "b", 2) == "2"
+    assert hb.command("hset", "hash", "a", 3) == "0"
+    assert hb.command("hget", "hash", "a") == "3" and hb.command("hget", "hash", "missing") == "-1"
+    assert hb.command("hlen", "hash") == "2"
+    assert pairs(hb.command("hgetall", "hash")) == {"a": "3", "b": "2"}
+    assert hb.command("object", "encoding", "hash") == "packed"
+    assert hb.command("hset", "hash", "odd") == "-1"
+
+    assert hb.command("hincrby", "hash", "a", 10) == "13"
+    assert hb.command("hincrby", "hash", "new", -5) == "-5"
+    assert hb.command("hincrby", "hash", "b", "x") == "-1"
+    hb.command("hset", "hash", "word", "value")
+    assert hb.command("hincrby", "hash", "word", 1) == "-1"
+    assert hb.command("hincrby", "limit", "n", 9223372036854775807) == "9223372036854775807"
+    assert hb.command("hincrby", "limit", "n", 1) == "-1"
+    assert hb.command("hget", "limit", "n") == "9223372036854775807"
+
+    # Gone with its last field
+    assert hb.command("hdel", "hash", "a", "missing") == "1"
+    assert hb.command("hdel", "hash", "b", "new", "word") == "3"
+    assert hb.command("type", "hash") == "none"
+    assert hb.command("hgetall", "hash") == "" and hb.command("hlen", "hash") == "0"
+
+    # Past 128 fields
+    expected = {}
+    for i in range(128):
+        hb.command("hset", "many", "field%d" % i, i)
+        expected["field%d" % i] = str(i)
+    assert hb.command("object", "encoding", "many") == "packed"
+    hb.command("hset", "many", "field128", 128)
+    expected["field128"] = "128"
+    assert hb.command("object", "encoding", "many") == "map"
+    assert pairs(hb.command("hgetall", "many")) == expected
+    assert hb.command("hincrby", "many", "field7", 1) == "8"
+    assert hb.command("hdel", "many", "field0") == "1" and hb.command("hlen", "many") == "128"
+
+    # Or one value past 64 bytes
+    hb.command("hset", "wide", "short", "x" * 64)
+    assert hb.command("object", "encoding", "wide") == "packed"
+    hb.command("hset", "wide", "long", "x" * 65)
+    assert hb.command("object", "encoding", "wide") == "map"
+    assert hb.command("hget", "wide", "long") == "x" * 65
+
+    # Both kept through the snapshot
+    assert hb.command("save") == "0"
+    s.stop()
+    s.start()
+    hb = s.client()
+    assert hb.command("hget", "many", "field7") == "8" and hb.command("hlen", "many") == "128"
+    assert hb.command("hget", "wide", "short") == "x" * 64
+    assert hb.command("hget", "limit", "n") == "9223372036854775807"
+
+    print("ok")
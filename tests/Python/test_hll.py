@@ -0,0 +1,80 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import socket
+import server                                    # hashbase
+
+# The stored string as bytes, read until the server has nothing more to send
+def raw(hb, key):
+    hb.send("get", key)
+    data = hb.pending
+    hb.socket.settimeout(0.5)
+    try:
+        while True:
+            data += hb.socket.recv(65536)
+    except socket.timeout:
+        pass
+    hb.socket.settimeout(None)
+    hb.pending = b""
+    assert data.endswith(b"\r\n")
+    return data[:-2]
+
+def encoding(hb, key):
+    value = raw(hb, key)
+    assert value[:4] == b"HYLL"
+    return "dense" if value[4:5] == b"\x01" else "sparse"
+
+def add(hb, key, elements):
+    for i in range(0, len(elements), 500):
+        hb.command("pfadd", key, *elements[i:i + 500])
+
+def close(estimate, exact, error=0.02):
+    return abs(int(estimate) - exact) <= exact * error
+
+# Counts of distinct elements in 12 KB at most, within about 1%
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+
+    assert hb.command("pfadd", "hll", "a", "b", "c") == "1"
+    assert hb.command("pfadd", "hll", "a") == "0"
+    assert hb.command("pfadd", "hll") == "0"
+    assert hb.command("pfcount", "hll") == "3"
+    assert hb.command("pfcount", "missing") == "0"
+    assert hb.command("type", "hll") == "string"
+    assert encoding(hb, "hll") == "sparse"
+    hb.set("string", "not a sketch")
+    assert hb.command("pfadd", "string", "x") == "-1"
+    assert hb.command("pfcount", "string") == "-1"
+    assert hb.command("pfmerge", "string", "hll") == "-1"
+
+    # Sparse while small, 12 KB of registers past that
+    add(hb, "large", ["element %d" % i for i in range(500)])
+    assert encoding(hb, "large") == "sparse" and close(hb.command("pfcount", "large"), 500)
+    add(hb, "large", ["element %d" % i for i in range(100000)])
+    assert encoding(hb, "large") == "dense"
+    assert len(raw(hb, "large")) < 12 * 1024 + 256
+    assert close(hb.command("pfcount", "large"), 100000)
+    add(hb, "large", ["element %d" % i for i in range(50000)])
+    assert close(hb.command("pfcount", "large"), 100000)
+    assert hb.command("pfadd", "large", "element 7") == "0"
+
+    # Unions, only counted or stored dense
+    add(hb, "other", ["element %d" % i for i in range(50000, 150000)])
+    add(hb, "few", ["element %d" % i for i in range(200000, 200010)])
+    assert close(hb.command("pfcount", "large", "other"), 150000)
+    assert close(hb.command("pfcount", "large", "few", "missing"), 100010)
+    assert hb.command("pfmerge", "union", "large", "other", "few", "missing") == "0"
+    assert close(hb.command("pfcount", "union"), 150010)
+    assert hb.command("pfmerge", "small", "few", "hll") == "0"
+    assert hb.command("pfcount", "small") == "13" and encoding(hb, "small") == "dense"
+    assert close(hb.command("pfcount", "large"), 100000)
+
+    # Kept through the snapshot
+    assert hb.command("save") == "0"
+    s.stop()
+    s.start()
+    hb = s.client()
+    assert close(hb.command("pfcount", "union"), 150010)
+    assert hb.command("pfcount", "hll") == "3"
+
+    print("ok")
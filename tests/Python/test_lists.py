@@ -0,0 +1,62 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+def elements(reply):
+    return [e[1:-1] for e in reply.split("\n")] if reply else []
+
+# Lists are chains of packed nodes, pushed and popped at both ends
+with server.sandbox() as box:
+    aof = box.file("hashbase.aof")
+    s = box.server("--appendonly=" + aof, "--appendfsync=always")
+    hb = s.client()
+
+    assert hb.command("rpush", "list", "a", "b", "c") == "3"
+    assert hb.command("lpush", "list", "z", "y") == "5"
+    assert elements(hb.command("lrange", "list", 0, -1)) == ["y", "z", "a", "b", "c"]
+    assert hb.command("llen", "list") == "5"
+    assert hb.command("lindex", "list", 0) == "y" and hb.command("lindex", "list", -1) == "c"
+    assert hb.command("lindex", "list", 5) == "-1"
+    assert elements(hb.command("lrange", "list", -2, -1)) == ["b", "c"]
+    assert elements(hb.command("lrange", "list", 3, 1)) == []
+    assert hb.command("lpop", "list") == "y" and hb.command("rpop", "list") == "c"
+    assert hb.command("object", "encoding", "list") == "chunks"
+
+    # Gone with its last element
+    hb.command("rpush", "single", "x")
+    assert hb.command("rpop", "single") == "x"
+    assert hb.command("type", "single") == "none"
+    assert hb.command("lpop", "single") == "-1" and hb.command("llen", "single") == "0"
+    assert hb.command("lrange", "single", 0, -1) == ""
+
+    # Many nodes, and one element larger than a node
+    for i in range(5000):
+        hb.command("rpush", "long", "element %05d" % i)
+    for i in range(5000):
+        hb.command("lpush", "long", "before %05d" % i)
+    hb.command("rpush", "long", "x" * 20000)
+    assert hb.command("llen", "long") == "10001"
+    assert hb.command("lindex", "long", 0) == "before 04999"
+    assert hb.command("lindex", "long", 5000) == "element 00000"
+    assert hb.command("lindex", "long", -2) == "element 04999"
+    assert hb.command("lindex", "long", -1) == "x" * 20000
+    assert elements(hb.command("lrange", "long", 4998, 5001)) == ["before 00001", "before 00000", "element 00000", "element 00001"]
+    for i in range(4000):
+        assert hb.command("lpop", "long") == "before %05d" % (4999 - i)
+    assert hb.command("rpop", "long") == "x" * 20000
+    assert hb.command("llen", "long") == "6000"
+
+    # Back from the log, then from the snapshot
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert elements(hb.command("lrange", "list", 0, -1)) == ["z", "a", "b"]
+    assert hb.command("llen", "long") == "6000" and hb.command("lindex", "long", 1000) == "element 00000"
+    assert hb.command("save") == "0"
+    s.stop()
+
+    hb = box.server().client()
+    assert hb.command("lindex", "long", -1) == "element 04999"
+    assert hb.command("type", "single") == "none"
+
+    print("ok")
@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import re
+import server                                    # hashbase
+
+KEYS = 60000
+
+# A snapshot of several chunks is checked and decoded on all cores
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+    for i in range(KEYS):
+        hb.set("key:%d" % i, "value of key number %d" % i if i % 3 else i)
+    hb.command("rpush", "list", *range(1000))
+    assert hb.command("save") == "0"
+    before = s.info("keyspace")
+
+    s.kill()
+    s.start()
+    assert s.logged("threads]")
+    loaded = re.search(r"loaded (\d+) keys from snapshot in [0-9.]+s \[(\d+) chunks, (\d+) threads\]", s.log())
+    assert loaded, s.log()
+    assert int(loaded.group(1)) == KEYS + 1 and int(loaded.group(2)) > 1 and int(loaded.group(3)) >= 1, loaded.groups()
+
+    # Sized up front for every key, no key lost between threads
+    after = s.info("keyspace")
+    assert after["keys"] == before["keys"]
+    assert int(after["table_size"]) >= KEYS and float(after["load_factor"]) <= 1, after
+    hb = s.client()
+    for i in list(range(0, KEYS, 997)) + [KEYS - 1]:
+        assert hb.get("key:%d" % i) == ("value of key number %d" % i if i % 3 else str(i)), i
+    assert hb.command("lindex", "list", 999) == "999"
+
+    print("ok")
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+def lsm(s):
+    return s.info("engine")
+
+# Files per level, empty levels are left out of inf
+def levels(s):
+    info = lsm(s)
+    return [int(info.get("lsm_level_%d" % i, "files=0").split(",")[0].split("=")[1]) for i in range(7)]
+
+with server.sandbox() as box:
+    data = box.file("lsm")
+    s = box.server("--engine=lsm", "--dir=" + data)
+    hb = s.client()
+
+    # In the memory table len is exact, a delete of a key that never
+    # existed hides nothing
+    hb.set("a", 1)
+    hb.set("b", 2)
+    hb.set("c", 3)
+    hb.delete("c")
+    hb.delete("never")
+    assert hb.command("len") == "2"
+    hb.delete("a")
+    hb.delete("b")
+    assert hb.command("len") == "0"
+
+    # Several memory tables' worth, flushed to table files
+    value = "v" * 1000
+    for i in range(12000):
+        hb.set("key%05d" % i, value)
+    assert server.wait(lambda: lsm(s)["lsm_flush_pending"] == "0" and int(lsm(s)["lsm_flushes"]) >= 2), lsm(s)
+    assert sum(levels(s)) >= 2, lsm(s)
+
+    # Deletes and overwrites over the tables
+    for i in range(0, 12000, 10):
+        hb.delete("key%05d" % i)
+    for i in range(1, 12000, 10):
+        hb.set("key%05d" % i, "new")
+    # Over the tables it is an estimate
+    assert abs(int(hb.command("len")) - 10800) <= 108
+    assert hb.get("key00000") == "-1" and hb.get("key00001") == "new" and hb.get("key00002") == value
+
+    # Missing keys are mostly ruled out by the bloom filters
+    for i in range(1000):
+        hb.get("missing%d" % i)
+    assert int(lsm(s)["lsm_bloom_skips"]) > 900, lsm(s)
+
+    # Merged in the background into one level below level 0, the deletes
+    # are gone and the count is right
+    assert hb.command("compact") == "0"
+    assert server.wait(lambda: lsm(s)["lsm_compaction_in_progress"] == "0" and
+                       levels(s)[0] == 0 and len([n for n in levels(s) if n]) == 1, 30), lsm(s)
+    assert hb.command("len") == "10800"
+
+    # The log replays what was not flushed yet
+    hb.set("late", "write")
+    hb.delete("key00002")
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert hb.get("late") == "write" and hb.get("key00002") == "-1"
+    assert hb.get("key00001") == "new" and hb.get("key00003") == value
+    assert hb.command("len") == "10800"
+
+    print("ok")
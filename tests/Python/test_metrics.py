@@ -0,0 +1,80 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+import socket
+
+def http(port, request):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(request.encode("utf-8"))
+    reply = b""
+    while True:
+        data = s.recv(65536)
+        if not data:
+            break
+        reply += data
+    s.close()
+    head, body = reply.decode("utf-8").split("\r\n\r\n", 1)
+    return head.split("\r\n"), body
+
+# Samples by name and labels, every family declared with a type
+def parse(body):
+    samples, types = {}, {}
+    for line in body.strip().split("\n"):
+        if line.startswith("# TYPE "):
+            name, kind = line[7:].split(" ")
+            types[name] = kind
+            continue
+        name, value = line.rsplit(" ", 1)
+        family = name.split("{")[0]
+        for suffix in ("_bucket", "_sum", "_count"):
+            if family.endswith(suffix) and family[:-len(suffix)] in types:
+                family = family[:-len(suffix)]
+        assert family in types, line
+        samples[name] = float(value)
+    return samples, types
+
+with server.sandbox() as box:
+    port = server.free_port()
+    # Written before the reply, so the log size is known at once
+    s = box.server("--metrics-port=%d" % port, "--appendonly=" + box.file("hashbase.aof"), "--appendfsync=always")
+    hb = s.client()
+    for i in range(20):
+        hb.set("key%d" % i, i)
+    hb.get("key1")
+
+    # The probe that saw the server start may be counted for a moment
+    request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n"
+    assert server.wait(lambda: parse(http(port, request)[1])[0]["hashbase_connected_clients"] == 1)
+    head, body = http(port, request)
+    assert head[0] == "HTTP/1.1 200 OK", head
+    assert "Content-Length: %d" % len(body.encode("utf-8")) in head, head
+    samples, types = parse(body)
+
+    assert samples["hashbase_keys"] == 20
+    assert samples["hashbase_map_buckets"] > 0
+    assert samples["hashbase_connected_clients"] == 1
+    assert samples["hashbase_commands_processed_total"] == 21
+    assert samples["hashbase_memory_rss_bytes"] > 0
+    assert samples["hashbase_aof_size_bytes"] > 0 and samples["hashbase_aof_rewrite_in_progress"] == 0
+    assert types["hashbase_command_duration_seconds"] == "histogram"
+    assert not [name for name in samples if name.startswith("hashbase_allocator")]
+
+    # Cumulative buckets up to +Inf, which is the count
+    buckets = [(name, value) for name, value in samples.items()
+               if name.startswith("hashbase_command_duration_seconds_bucket{cmd=\"set\"")]
+    finite = sorted((float(name.split("le=\"")[1].rstrip("\"}")), value) for name, value in buckets if "+Inf" not in name)
+    assert [v for _, v in finite] == sorted(v for _, v in finite)
+    assert samples["hashbase_command_duration_seconds_bucket{cmd=\"set\",le=\"+Inf\"}"] == 20
+    assert samples["hashbase_command_duration_seconds_count{cmd=\"set\"}"] == 20
+
+    # Blocks of exited connection threads are adopted, not dropped
+    for i in range(30):
+        c = s.client()
+        c.set("churn", i)
+        c.close()
+    assert server.wait(lambda: parse(http(port, request)[1])[0]["hashbase_commands_processed_total"] == 51)
+
+    assert http(port, "GET /other HTTP/1.1\r\n\r\n")[0][0] == "HTTP/1.1 404 Not Found"
+    assert http(port, "POST /metrics HTTP/1.1\r\n\r\n")[0][0] == "HTTP/1.1 405 Method Not Allowed"
+
+    print("ok")
@@ -0,0 +1,50 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+def pmap(s):
+    return s.info("engine")
+
+# The hash table is kept in mapped files and used as it is after a clean stop
+with server.sandbox() as box:
+    data = box.file("mmap")
+    s = box.server("--engine=mmap", "--dir=" + data)
+    hb = s.client()
+    assert pmap(s)["engine"] == "mmap"
+
+    for round in range(3):
+        for i in range(3000):
+            hb.set("key%d" % i, ("round %d " % round) * 10)
+    for i in range(0, 3000, 2):
+        hb.delete("key%d" % i)
+    assert hb.command("len") == "1500"
+
+    # Compaction drops overwritten and deleted records
+    used = int(pmap(s)["pmap_heap_used"])
+    assert hb.command("compact") == "0"
+    assert int(pmap(s)["pmap_heap_used"]) < used // 3, (used, pmap(s))
+
+    s.stop()
+    s.start()
+    hb = s.client()
+    assert pmap(s)["pmap_rebuilt_on_start"] == "0"
+    assert hb.command("len") == "1500"
+    assert hb.get("key1") == "round 2 " * 10 and hb.get("key0") == "-1"
+
+    # A crash leaves the header behind, the index is rebuilt from the heap
+    for i in range(3000, 3100):
+        hb.set("key%d" % i, "late")
+    hb.delete("key1")
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert pmap(s)["pmap_rebuilt_on_start"] == "1"
+    assert hb.command("len") == "1599"
+    assert hb.get("key3099") == "late" and hb.get("key1") == "-1" and hb.get("key3") == "round 2 " * 10
+
+    # Faulting the files in ahead of time changes nothing else
+    s.stop()
+    p = box.server("--engine=mmap", "--dir=" + data, "--prefault")
+    assert p.client().get("key3") == "round 2 " * 10
+
+    print("ok")
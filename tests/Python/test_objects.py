@@ -0,0 +1,67 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import time
+import server                                    # hashbase
+
+# Every value is an object with a type and the encoding it is kept in
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+
+    hb.set("number", 12)
+    hb.set("smallest", -9223372036854775808)
+    hb.set("padded", "007")
+    hb.set("past", "9223372036854775808")
+    hb.set("word", "hello")
+    assert hb.command("type", "number") == "string"
+    assert hb.command("object", "encoding", "number") == "int"
+    assert hb.command("object", "encoding", "smallest") == "int"
+    assert hb.command("object", "encoding", "padded") == "raw" and hb.get("padded") == "007"
+    assert hb.command("object", "encoding", "past") == "raw"
+    assert hb.command("object", "encoding", "word") == "raw"
+    assert hb.get("number") == "12" and hb.get("smallest") == "-9223372036854775808"
+    assert hb.command("object", "refcount", "word") == "1"
+
+    hb.command("rpush", "list", "a")
+    hb.command("hset", "hash", "field", "value")
+    hb.command("zadd", "zset", 1, "member")
+    hb.command("sadd", "set", 1)
+    hb.command("xadd", "stream", "*", "field", "value")
+    for key in ("list", "hash", "zset", "set", "stream"):
+        assert hb.command("type", key) == key
+
+    # Strings and the other types do not mix
+    assert hb.get("list") == "-1"
+    assert hb.command("rpush", "word", "a") == "-1"
+    assert hb.command("hset", "list", "field", "value") == "-1"
+    hb.set("list", "string again")
+    assert hb.command("type", "list") == "string"
+
+    assert hb.command("type", "missing") == "none"
+    assert hb.command("object", "encoding", "missing") == "-1"
+    assert hb.command("object", "unknown", "word") == "-1"
+
+    # Looking at the object does not touch it, reading it does
+    time.sleep(2.1)
+    assert int(hb.command("object", "idletime", "word")) >= 2
+    assert int(hb.command("object", "idletime", "word")) >= 2
+    hb.get("word")
+    assert hb.command("object", "idletime", "word") == "0"
+
+    # Kept as they were through the snapshot
+    assert hb.command("save") == "0"
+    s.stop()
+    s.start()
+    hb = s.client()
+    assert hb.command("object", "encoding", "number") == "int"
+    assert hb.command("object", "encoding", "padded") == "raw"
+    assert hb.command("type", "zset") == "zset" and hb.command("zscore", "zset", "member") == "1"
+
+    # The disk engines hold plain strings
+    hb = box.server("--engine=bitcask", "--dir=" + box.file("bitcask")).client()
+    hb.set("number", 12)
+    assert hb.command("type", "number") == "string"
+    assert hb.command("type", "missing") == "none"
+    assert hb.command("object", "encoding", "number") == "-1"
+
+    print("ok")
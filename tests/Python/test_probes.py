@@ -0,0 +1,31 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+import subprocess
+
+PROBES = ["net__recv", "net__reply", "command__start", "command__done", "map__put", "map__get",
+          "map__rehash__start", "map__rehash__done", "pipe__grow"]
+
+# The tracepoints are notes in the ELF file when built with <sys/sdt.h>
+with server.sandbox() as box:
+    try:
+        notes = subprocess.check_output(["readelf", "-n", box.path]).decode("utf-8", "replace")
+    except OSError:
+        notes = ""
+
+    if "NT_STAPSDT" in notes:
+        names = [line.split(":", 1)[1].strip() for line in notes.split("\n") if line.strip().startswith("Name:")]
+        providers = set(line.split(":", 1)[1].strip() for line in notes.split("\n") if line.strip().startswith("Provider:"))
+        assert providers == set(["hashbase"]), providers
+        for probe in PROBES:
+            assert probe in names, probe
+
+    # A probe is a nop, the hot paths behave the same with or without them;
+    # enough keys to rehash the map a few times
+    hb = box.server().client()
+    for i in range(5000):
+        hb.set("key%d" % i, "value%d" % i)
+    for i in range(0, 5000, 97):
+        assert hb.get("key%d" % i) == "value%d" % i
+
+    print("ok" if "NT_STAPSDT" in notes else "ok (built without probes)")
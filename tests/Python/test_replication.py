@@ -0,0 +1,135 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import socket
+import threading
+import server                                    # hashbase
+
+# Forwards connections to the primary and drops them on demand, the way
+# a flaky network would
+class link:
+    def __init__(self, port):
+        self.port = server.free_port()
+        self.target = port
+        self.up = True
+        self.greeting = b""
+        self.sockets = []
+        self.lock = threading.Lock()
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", self.port))
+        self.listener.listen(8)
+        thread = threading.Thread(target=self.accept)
+        thread.daemon = True
+        thread.start()
+
+    def accept(self):
+        while True:
+            near, _ = self.listener.accept()
+            if not self.up:
+                near.close()
+                continue
+            far = socket.create_connection(("127.0.0.1", self.target))
+            near.sendall(self.greeting)
+            with self.lock:
+                self.sockets += [near, far]
+            for a, b in ((near, far), (far, near)):
+                thread = threading.Thread(target=self.pump, args=(a, b))
+                thread.daemon = True
+                thread.start()
+
+    def pump(self, a, b):
+        try:
+            while True:
+                data = a.recv(65536)
+                if not data:
+                    break
+                b.sendall(data)
+        except socket.error:
+            pass
+        for s in (a, b):
+            try:
+                s.shutdown(socket.SHUT_RDWR)
+            except socket.error:
+                pass
+
+    def cut(self, stay_down=False):
+        self.up = not stay_down
+        with self.lock:
+            sockets, self.sockets = self.sockets, []
+        for s in sockets:
+            try:
+                s.shutdown(socket.SHUT_RDWR)
+            except socket.error:
+                pass
+            s.close()
+
+def repl(s):
+    return s.info("replication")
+
+def synced(primary, replica):
+    p, r = repl(primary), repl(replica)
+    return r["primary_link_status"] == "up" and r["repl_offset"] == p["repl_offset"] and p["repl_id"] == r["repl_id"]
+
+with server.sandbox() as box:
+    primary = box.server("--repl-backlog-size=1048576")
+    hb = primary.client()
+    for i in range(1000):
+        hb.set("before%d" % i, i)
+    hb.command("rpush", "list", "a", "b", "c")
+
+    net = link(primary.port)
+    replica = box.server("--replicaof=127.0.0.1:%d" % net.port, "--dir=" + box.file("replica"))
+    assert replica.logged("full resync from")
+    assert repl(replica)["role"] == "replica"
+
+    # The snapshot, then the stream of writes
+    for i in range(1000):
+        hb.set("after%d" % i, "value %d" % i)
+    hb.command("lpop", "list")
+    hb.delete("before0")
+    assert server.wait(lambda: synced(primary, replica)), (repl(primary), repl(replica))
+    r = replica.client()
+    assert r.get("before999") == "999" and r.get("after999") == "value 999"
+    assert r.get("before0") == "-1"
+    assert r.command("lrange", "list", 0, -1) == "\"b\"\n\"c\""
+    assert r.command("len") == hb.command("len")
+
+    # A replica refuses writes, reads are served
+    assert r.set("key", "value") == "-1"
+    assert r.delete("after1") == "-1" and r.get("after1") == "value 1"
+    assert r.command("rpush", "list", "d") == "-1"
+    assert r.command("blpop", "list", 1) == "-1"
+
+    # The link drops for a moment, writes go on meanwhile: the replica
+    # continues from its offset out of the backlog
+    net.cut(stay_down=True)
+    assert server.wait(lambda: repl(replica)["primary_link_status"] == "down")
+    for i in range(100):
+        hb.set("during%d" % i, i)
+    net.up = True
+    assert primary.logged("continues")
+    assert server.wait(lambda: synced(primary, replica))
+    assert r.get("during99") == "99"
+    info = repl(primary)
+    assert info["repl_full_syncs"] == "1" and info["repl_partial_syncs"] == "1", info
+
+    # Past the backlog a new snapshot is needed
+    net.cut(stay_down=True)
+    assert server.wait(lambda: repl(replica)["primary_link_status"] == "down")
+    for i in range(2000):
+        hb.set("large%d" % i, "x" * 1000)
+    net.up = True
+    assert server.wait(lambda: repl(primary)["repl_full_syncs"] == "2")
+    assert server.wait(lambda: synced(primary, replica), 20)
+    assert r.get("large1999") == "x" * 1000
+
+    # A restarted replica has no offset to continue from, the keepalives of
+    # a primary still writing the snapshot come before its header
+    net.greeting = b"\r\n\r\n"
+    replica.kill()
+    replica.start()
+    assert server.wait(lambda: repl(primary)["repl_full_syncs"] == "3")
+    assert server.wait(lambda: synced(primary, replica))
+    assert replica.client().get("during0") == "0"
+
+    print("ok")
@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+import server                                    # hashbase
+
+def rewriting(s):
+    return s.info("persistence")["aof_rewrite_in_progress"] == "1"
+
+# The rewritten log is the shortest one that rebuilds the data
+with server.sandbox() as box:
+    aof = box.file("hashbase.aof")
+    # 1 MB/s, so the rewrite of a few MB is still running while we write
+    s = box.server("--appendonly=" + aof, "--appendfsync=always", "--aof-rewrite-rate=1")
+    hb = s.client()
+
+    for round in range(10):
+        for i in range(200):
+            hb.set("key%d" % i, "round %d" % round)
+    for i in range(100):
+        hb.command("rpush", "list", i)
+    for i in range(50):
+        hb.command("lpop", "list")
+    hb.command("hset", "hash", "a", 1, "b", 2)
+    hb.command("hdel", "hash", "a")
+    hb.command("zadd", "zset", 1, "x", 2, "y")
+    hb.command("xgroup", "create", "stream", "group", "$", "mkstream")
+    hb.command("xadd", "stream", "1-1", "f", "v")
+    hb.command("xreadgroup", "group", "group", "consumer", "streams", "stream", ">")
+    for i in range(3000):
+        hb.set("padding%d" % i, "x" * 1000)
+    before = os.path.getsize(aof)
+
+    assert hb.command("bgrewriteaof") == "0"
+    assert server.wait(lambda: rewriting(s), 2)
+    # Only one at a time
+    assert hb.command("bgrewriteaof") == "-1"
+    hb.set("during", "rewrite")
+    hb.delete("padding0")
+    assert server.wait(lambda: not rewriting(s), 30)
+
+    info = s.info("persistence")
+    assert info["aof_rewrites"] == "1" and info["aof_last_rewrite_status"] == "ok", info
+    assert float(info["aof_last_rewrite_duration_sec"]) >= 1, info
+    after = os.path.getsize(aof)
+    assert after < before - 200 * 9 * 10, (before, after)
+    assert int(info["aof_base_size"]) <= after
+
+    # The rewritten log and the writes made meanwhile
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert s.info("keyspace")["keys"] == str(200 + 4 + 2999 + 1)
+    assert hb.get("key199") == "round 9"
+    assert hb.get("during") == "rewrite" and hb.get("padding0") == "-1"
+    assert hb.command("lrange", "list", 0, 0) == "\"50\"" and hb.command("llen", "list") == "50"
+    assert hb.command("hgetall", "hash") == "\"b\"\n\"2\""
+    assert hb.command("zscore", "zset", "y") == "2"
+    pending = hb.command("xpending", "stream", "group")
+    assert pending.startswith("\"1-1\" \"consumer\""), pending
+
+    print("ok")
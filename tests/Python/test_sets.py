@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import random
+import server                                    # hashbase
+
+def members(reply):
+    return [e[1:-1] for e in reply.split("\n")] if reply else []
+
+def strings(numbers):
+    return set(str(n) for n in numbers)
+
+# Integers are kept as sorted arrays, anything else as a map
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+
+    assert hb.command("sadd", "set", 3, 1, 2, 1) == "3"
+    assert hb.command("object", "encoding", "set") == "intset"
+    assert members(hb.command("smembers", "set")) == ["1", "2", "3"]
+    assert hb.command("scard", "set") == "3"
+    assert hb.command("sismember", "set", 2) == "1" and hb.command("sismember", "set", 9) == "0"
+    assert hb.command("srem", "set", 1, 9) == "1"
+    assert hb.command("sadd", "set", -5) == "1"
+    assert members(hb.command("smembers", "set")) == ["-5", "2", "3"]
+
+    # Gone with its last member
+    assert hb.command("srem", "set", 2, 3, -5) == "3"
+    assert hb.command("type", "set") == "none"
+    assert hb.command("smembers", "set") == "" and hb.command("scard", "set") == "0"
+
+    # Anything that is not a plain integer turns it into a map
+    for member in ("word", "007", "99999999999999999999"):
+        hb.command("sadd", member, 1, 2)
+        assert hb.command("object", "encoding", member) == "intset"
+        hb.command("sadd", member, member)
+        assert hb.command("object", "encoding", member) == "map"
+        assert set(members(hb.command("smembers", member))) == set(["1", "2", member])
+    assert hb.command("sismember", "007", 7) == "0" and hb.command("sismember", "007", "007") == "1"
+
+    # As does growing past 8192 members
+    for i in range(0, 8192, 512):
+        hb.command("sadd", "large", *range(i, i + 512))
+    assert hb.command("object", "encoding", "large") == "intset"
+    hb.command("sadd", "large", 8192)
+    assert hb.command("object", "encoding", "large") == "map"
+    assert hb.command("scard", "large") == "8193"
+
+    # Against a model, with both encodings on either side
+    random.seed(5)
+    models = {"a": set(random.sample(range(20000), 3000)), "b": set(random.sample(range(20000), 6000)),
+              "c": set(random.sample(range(0, 20000, 2), 5000)), "large": set(range(8193))}
+    for key in ("a", "b", "c"):
+        items = sorted(models[key])
+        for i in range(0, len(items), 500):
+            hb.command("sadd", key, *items[i:i + 500])
+    hb.command("sadd", "words", "x", 1, 2, 3)
+    models["words"] = set(["x", 1, 2, 3])
+    assert hb.command("object", "encoding", "a") == "intset"
+
+    for keys in (("a", "b"), ("b", "a", "c"), ("a", "large"), ("large", "c"), ("words", "a", "b"), ("a", "missing")):
+        sets = [models.get(k, set()) for k in keys]
+        assert set(members(hb.command("sinter", *keys))) == strings(set.intersection(*sets)), keys
+        assert set(members(hb.command("sunion", *keys))) == strings(set.union(*sets)), keys
+        assert set(members(hb.command("sdiff", *keys))) == strings(sets[0].difference(*sets[1:])), keys
+    assert members(hb.command("sinter", "a", "b"))[:3] == [str(m) for m in sorted(models["a"] & models["b"])[:3]]
+    assert hb.command("sinter", "missing", "a") == "" and hb.command("sdiff", "missing", "a") == ""
+
+    hb.set("string", "value")
+    assert hb.command("sadd", "string", 1) == "-1" and hb.command("sinter", "a", "string") == "-1"
+
+    # Kept through the snapshot in their encodings
+    assert hb.command("save") == "0"
+    s.stop()
+    s.start()
+    hb = s.client()
+    assert hb.command("object", "encoding", "a") == "intset" and hb.command("object", "encoding", "large") == "map"
+    assert set(members(hb.command("smembers", "b"))) == strings(models["b"])
+
+    print("ok")
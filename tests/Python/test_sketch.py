@@ -0,0 +1,59 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+def entries(reply):
+    return [(line.rsplit(" ", 1)[0], int(line.rsplit(" ", 1)[1])) for line in reply.split("\n") if line]
+
+# Every access is sampled, the skewed keys come out on top
+with server.sandbox() as box:
+    hb = box.server("--sketch-sample=1").client()
+
+    hb.set("hot", "1")
+    hb.set("warm", "2")
+    for i in range(500):
+        hb.set("cold%d" % i, "x")
+    for i in range(300):
+        hb.get("hot")
+    for i in range(100):
+        hb.get("warm")
+    for i in range(500):
+        hb.get("cold%d" % i)
+
+    hot = entries(hb.command("hot", 2))
+    assert [key for key, _ in hot] == ["\"hot\"", "\"warm\""], hot
+    # Count-min never underestimates
+    assert hot[0][1] >= 300 and hot[1][1] >= 100, hot
+
+    hb.set("big", "x" * 5000)
+    hb.set("mid", "y" * 500)
+    big = entries(hb.command("big", 2))
+    assert big[-2:] == [("\"big\"", 5000), ("\"mid\"", 500)], big
+    # The histogram counts every sampled write by size
+    histogram = dict(e for e in big if e[0].startswith("<="))
+    assert sum(histogram.values()) == 504, histogram
+
+    # Collections grow in place and are measured in elements on lookup
+    for i in range(100):
+        hb.command("rpush", "queue", *["item%d" % j for j in range(100)])
+    for i in range(200):
+        hb.command("hset", "profile", "field%d" % i, i)
+    hot = dict(entries(hb.command("hot")))
+    assert hot["\"queue\""] >= 100 and hot["\"profile\""] >= 200, hot
+    big = dict(entries(hb.command("big")))
+    assert big["\"queue\""] >= 9900 and big["\"profile\""] >= 199, big
+
+    # Deleted keys leave both rankings
+    hb.command("del", "queue")
+    hb.command("del", "big")
+    assert "\"queue\"" not in dict(entries(hb.command("hot")))
+    big = dict(entries(hb.command("big")))
+    assert "\"queue\"" not in big and "\"big\"" not in big and big["\"mid\""] == 500, big
+
+    # Sampling off
+    quiet = box.server().client()
+    quiet.set("key", "value")
+    quiet.get("key")
+    assert quiet.command("hot") == "" and quiet.command("big") == ""
+
+    print("ok")
@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+# Every command is slower than 0 microseconds, the ring keeps the last four
+with server.sandbox() as box:
+    s = box.server("--slowlog-slower-than=0", "--slowlog-max-len=4")
+    hb = s.client()
+
+    for i in range(6):
+        hb.set("key%d" % i, i)
+    assert hb.command("slowlog", "len") == "4"
+
+    # Newest first: the len above, then the last three sets
+    entries = hb.command("slowlog", "get").split("\n")
+    assert len(entries) == 4, entries
+    ids = [int(e.split(" ")[0]) for e in entries]
+    assert ids == sorted(ids, reverse=True) and ids[0] - ids[3] == 3, ids
+    assert entries[0].endswith(" \"slowlog\" \"len\""), entries[0]
+    assert entries[1].endswith(" \"set\" \"key5\" \"5\""), entries[1]
+    assert len(hb.command("slowlog", "get", 2).split("\n")) == 2
+
+    # Long arguments and long commands are cut
+    hb.set("long", "x" * 1000)
+    entry = hb.command("slowlog", "get", 1)
+    assert "(872 more bytes)" in entry, entry
+    hb.command("rpush", "many", *range(100))
+    entry = hb.command("slowlog", "get", 1)
+    assert "(71 more arguments)" in entry, entry
+
+    # Only the reset itself is left
+    assert hb.command("slowlog", "reset") == "0"
+    assert hb.command("slowlog", "len") == "1"
+
+    # Disabled
+    quiet = box.server("--slowlog-slower-than=-1").client()
+    quiet.set("key", "value")
+    assert quiet.command("slowlog", "len") == "0"
+    assert quiet.command("slowlog", "get") == ""
+
+    print("ok")
@@ -0,0 +1,77 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+def fill(hb):
+    for i in range(1000):
+        hb.set("string%d" % i, "value %d" % i)
+        hb.set("number%d" % i, i * 1000 - 7)
+    hb.command("rpush", "list", *["element%d" % i for i in range(300)])
+    hb.command("hset", "hash", "name", "hashbase", "year", 2014)
+    hb.command("zadd", "zset", 1.5, "one", -2, "two", 1e10, "three")
+    hb.command("sadd", "ints", 1, 70000, 5000000000)
+    hb.command("sadd", "words", "a", "b")
+    hb.command("xadd", "stream", "1-1", "field", "value")
+    hb.command("setbit", "bits", 1000, 1)
+
+def check(hb):
+    assert hb.get("string999") == "value 999"
+    assert hb.get("number0") == "-7" and hb.get("number999") == "998993"
+    assert hb.command("object", "encoding", "number5") == "int"
+    assert hb.command("llen", "list") == "300"
+    assert hb.command("lindex", "list", 299) == "element299"
+    assert hb.command("hget", "hash", "year") == "2014"
+    assert hb.command("zrange", "zset", 0, -1, "withscores") == "\"two\"\n-2\n\"one\"\n1.5\n\"three\"\n10000000000"
+    assert hb.command("smembers", "ints") == "\"1\"\n\"70000\"\n\"5000000000\""
+    assert hb.command("scard", "words") == "2"
+    assert hb.command("xrange", "stream", "-", "+") == "\"1-1\" \"field\" \"value\""
+    assert hb.command("bitcount", "bits") == "1" and hb.command("getbit", "bits", 1000) == "1"
+
+# Every type comes back from a snapshot as it was
+with server.sandbox() as box:
+    snapshot = box.file("hashbase.snap")
+    s = box.server()
+    hb = s.client()
+    fill(hb)
+    keys = s.info("keyspace")["keys"]
+
+    assert hb.command("save") == "0"
+    with open(snapshot, "rb") as f:
+        data = f.read()
+    assert data[:6] == b"HBSNAP" and data[6:7] == b"\x02", data[:8]
+    assert s.info("persistence")["snapshot_changes_since_last_save"] == "0"
+
+    s.kill()
+    s.start()
+    assert s.info("keyspace")["keys"] == keys
+    assert s.logged("loaded %s keys from snapshot" % keys)
+    check(s.client())
+
+    # The background save sees the data as of the fork, writes go on meanwhile
+    hb = s.client()
+    hb.set("before", "fork")
+    assert hb.command("bgsave") == "0"
+    hb.set("during", "save")
+    assert server.wait(lambda: s.info("persistence")["snapshot_bgsave_in_progress"] == "0")
+    assert s.info("persistence")["snapshot_last_status"] == "ok"
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert hb.get("before") == "fork"
+    check(hb)
+
+    # A flipped byte is caught by the checksums, the server refuses to start
+    s.kill()
+    with open(snapshot, "rb") as f:
+        data = bytearray(f.read())
+    data[len(data) // 2] ^= 0x20
+    with open(snapshot, "wb") as f:
+        f.write(bytes(data))
+    try:
+        s.start()
+        assert False, "started from a corrupt snapshot"
+    except RuntimeError:
+        pass
+    assert s.logged("snapshot is corrupt")
+
+    print("ok")
@@ -0,0 +1,39 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import time
+import server                                    # hashbase
+
+# Per-command call counts and latency percentiles in inf
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+
+    for i in range(100):
+        hb.set("key%d" % i, i)
+    for i in range(50):
+        hb.get("key%d" % i)
+    hb.get("missing")
+
+    info = s.info()
+    assert int(info["total_commands_processed"]) == 151, info["total_commands_processed"]
+    assert int(info["total_connections_received"]) >= 1
+    assert int(info["keys"]) == 100
+    assert int(info["total_net_input_bytes"]) > 0 and int(info["total_net_output_bytes"]) > 0
+
+    stats = dict(field.split("=") for field in info["cmd_get"].split(","))
+    assert int(stats["calls"]) == 51, stats
+    assert 0 < float(stats["p50"]) <= float(stats["p99"]) <= float(stats["p999"]) <= float(stats["max"]), stats
+    assert "cmd_set" in info and "cmd_del" not in info
+
+    # A section alone, which now counts the inf before it
+    section = s.info("commands")
+    assert set(section) == set(k for k in info if k.startswith("cmd_")) | set(["cmd_inf"]), section
+
+    # The rate is sampled every second, an idle server drops back to zero
+    for i in range(1000):
+        hb.get("key0")
+    assert server.wait(lambda: int(s.info("stats")["instantaneous_ops_per_sec"]) > 0, 5)
+    time.sleep(2.5)
+    assert int(s.info("stats")["instantaneous_ops_per_sec"]) == 0
+
+    print("ok")
@@ -0,0 +1,99 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import server                                    # hashbase
+
+# Id, consumer and deliveries of each pending entry, without the idle time
+def pending(reply):
+    return [(e[0][1:-1], e[1][1:-1], e[3]) for e in (line.split(" ") for line in reply.split("\n"))] if reply else []
+
+def blocked(s, n):
+    return server.wait(lambda: s.info("clients")["blocked_clients"] == str(n))
+
+# Append only logs of entries, read by range, by id or by consumer groups
+with server.sandbox() as box:
+    aof = box.file("hashbase.aof")
+    s = box.server("--appendonly=" + aof, "--appendfsync=always")
+    hb = s.client()
+
+    assert hb.command("xadd", "stream", "1-1", "a", 1) == "1-1"
+    assert hb.command("xadd", "stream", "1-1", "a", 2) == "-1"
+    assert hb.command("xadd", "stream", "0-5", "a", 2) == "-1"
+    assert hb.command("xadd", "stream", "1-2", "b", 2, "c", 3) == "1-2"
+    assert hb.command("xadd", "stream", 2, "a", 1) == "2-0"
+    assert hb.command("xadd", "stream", "x", "a", 1) == "-1" and hb.command("xadd", "stream", "*", "a") == "-1"
+    assert hb.command("xlen", "stream") == "3" and hb.command("type", "stream") == "stream"
+    assert hb.command("xrange", "stream", "-", "+") == "\"1-1\" \"a\" \"1\"\n\"1-2\" \"b\" \"2\" \"c\" \"3\"\n\"2-0\" \"a\" \"1\""
+    assert hb.command("xrange", "stream", "1-2", "+", "count", 1) == "\"1-2\" \"b\" \"2\" \"c\" \"3\""
+    assert hb.command("xread", "streams", "stream", "1-1") == "\"stream\" \"1-2\" \"b\" \"2\" \"c\" \"3\"\n\"stream\" \"2-0\" \"a\" \"1\""
+    assert hb.command("xread", "count", 1, "streams", "stream", "missing", 0, 0) == "\"stream\" \"1-1\" \"a\" \"1\""
+    assert hb.command("xread", "streams", "stream", "$") == "-1"
+
+    # Ids from the clock keep growing
+    last = hb.command("xadd", "stream", "*", "d", 4)
+    assert int(last.split("-")[0]) > 2
+    assert hb.command("xadd", "stream", "*", "e", 5) > last
+
+    # Many blocks, read back in order
+    for i in range(3000):
+        hb.command("xadd", "long", "%d-0" % (i + 1), "field", "value %d" % i)
+    assert hb.command("xlen", "long") == "3000"
+    assert hb.command("xrange", "long", "1500", "1501") == "\"1500-0\" \"field\" \"value 1499\"\n\"1501-0\" \"field\" \"value 1500\""
+    assert len(hb.command("xrange", "long", "-", "+").split("\n")) == 3000
+    assert hb.command("xread", "count", 1, "streams", "long", "2999-0") == "\"long\" \"3000-0\" \"field\" \"value 2999\""
+
+    # Waiting for an append past the last id
+    reader = s.client()
+    reader.send("xread", "block", 0, "streams", "stream", "$")
+    assert blocked(s, 1)
+    hb.command("xadd", "stream", "9999999999999-0", "f", "g")
+    assert reader.reply() == "\"stream\" \"9999999999999-0\" \"f\" \"g\""
+    assert hb.command("xread", "block", 200, "streams", "stream", "$") == "-1"
+
+    # Each new entry to one consumer of a group, pending until acknowledged
+    assert hb.command("xgroup", "create", "stream", "group", 0) == "0"
+    assert hb.command("xgroup", "create", "stream", "group", 0) == "-1"
+    assert hb.command("xgroup", "create", "new", "group", "$") == "-1"
+    assert hb.command("xgroup", "create", "new", "group", "$", "mkstream") == "0"
+    assert hb.command("type", "new") == "stream"
+    assert hb.command("xreadgroup", "group", "group", "alice", "count", 2, "streams", "stream", ">") == \
+        "\"stream\" \"1-1\" \"a\" \"1\"\n\"stream\" \"1-2\" \"b\" \"2\" \"c\" \"3\""
+    assert hb.command("xreadgroup", "group", "group", "bob", "count", 1, "streams", "stream", ">") == "\"stream\" \"2-0\" \"a\" \"1\""
+    assert pending(hb.command("xpending", "stream", "group")) == [("1-1", "alice", "1"), ("1-2", "alice", "1"), ("2-0", "bob", "1")]
+    assert hb.command("xack", "stream", "group", "1-1", "9-9") == "1"
+    assert hb.command("xreadgroup", "group", "group", "alice", "streams", "stream", 0) == "\"stream\" \"1-2\" \"b\" \"2\" \"c\" \"3\""
+    assert hb.command("xclaim", "stream", "group", "bob", 0, "1-2") == "\"1-2\" \"b\" \"2\" \"c\" \"3\""
+    assert hb.command("xclaim", "stream", "group", "carol", 100000, "2-0") == ""
+    assert pending(hb.command("xpending", "stream", "group")) == [("1-2", "bob", "2"), ("2-0", "bob", "1")]
+
+    reader.send("xreadgroup", "group", "group", "dave", "block", 0, "streams", "new", ">")
+    assert blocked(s, 1)
+    hb.command("xadd", "new", "5-0", "h", "i")
+    assert reader.reply() == "\"new\" \"5-0\" \"h\" \"i\""
+    assert pending(hb.command("xpending", "new", "group")) == [("5-0", "dave", "1")]
+
+    hb.set("string", "value")
+    assert hb.command("xadd", "string", "*", "a", 1) == "-1" and hb.command("xrange", "string", "-", "+") == "-1"
+
+    # Groups and what they delivered come back from the log
+    s.kill()
+    s.start()
+    hb = s.client()
+    assert hb.command("xlen", "stream") == "6" and hb.command("xlen", "long") == "3000"
+    assert pending(hb.command("xpending", "stream", "group")) == [("1-2", "bob", "2"), ("2-0", "bob", "1")]
+    assert pending(hb.command("xpending", "new", "group")) == [("5-0", "dave", "1")]
+    assert hb.command("xreadgroup", "group", "group", "alice", "count", 1, "streams", "stream", ">").startswith("\"stream\" " + "\"" + last)
+    assert hb.command("xgroup", "destroy", "stream", "group") == "1"
+    assert hb.command("xgroup", "destroy", "stream", "group") == "0"
+
+    # Replicas read, but neither deliver nor wait
+    replica = box.server("--replicaof=127.0.0.1:%d" % s.port, "--dir=" + box.file("replica"))
+    assert replica.logged("following primary")
+    assert server.wait(lambda: replica.info("replication")["repl_offset"] == s.info("replication")["repl_offset"])
+    r = replica.client()
+    assert r.command("xread", "count", 1, "streams", "long", "2999-0") == "\"long\" \"3000-0\" \"field\" \"value 2999\""
+    assert r.command("xread", "block", 100, "streams", "long", "$") == "-1"
+    assert r.command("xreadgroup", "group", "group", "erin", "streams", "new", ">") == "-1"
+    assert r.command("xadd", "long", "*", "a", 1) == "-1"
+    assert r.command("xlen", "long") == "3000"
+
+    print("ok")
@@ -0,0 +1,70 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import threading
+import server                                    # hashbase
+
+N = 2000
+
+def value(i, round=0):
+    return ("value %d of round %d " % (i, round)) * 4
+
+def tier(s):
+    return s.info("engine")
+
+# Values idle for a few seconds go to the value log, keys stay in memory
+with server.sandbox() as box:
+    s = box.server("--tier-after=3", "--dir=" + box.file("tier"))
+    hb = s.client()
+    for i in range(N):
+        hb.set("key%d" % i, value(i))
+    hb.set("short", "under 64 bytes")
+    hb.set("number", 12345)
+
+    assert server.wait(lambda: tier(s)["tier_cold_keys"] == str(N), 20), tier(s)
+    info = tier(s)
+    assert int(info["tier_cold_bytes"]) == sum(len(value(i)) for i in range(N)), info
+    assert hb.command("object", "encoding", "key0") == "tier"
+    assert hb.command("object", "encoding", "short") == "raw"
+    assert hb.command("object", "encoding", "number") == "int"
+    assert hb.command("type", "key0") == "string"
+
+    # A read brings the value back
+    assert hb.get("key0") == value(0)
+    assert hb.command("object", "encoding", "key0") == "raw"
+    assert tier(s)["tier_promoted"] == "1" and tier(s)["tier_cold_keys"] == str(N - 1)
+
+    # Readers promoting values while writers replace and delete them
+    wrong = []
+    def reader(first):
+        c = s.client()
+        for i in range(first, N, 4):
+            got = c.get("key%d" % i)
+            if got not in (value(i), value(i, 1), "-1"):
+                wrong.append((i, got))
+    def writer():
+        c = s.client()
+        for i in range(0, N, 7):
+            c.set("key%d" % i, value(i, 1))
+        for i in range(3, N, 11):
+            c.delete("key%d" % i)
+    threads = [threading.Thread(target=reader, args=(t,)) for t in range(4)] + [threading.Thread(target=writer)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert not wrong, wrong[:3]
+
+    # Every spilled value was promoted, replaced or deleted exactly once,
+    # none has been idle long enough to go again
+    info = tier(s)
+    assert info["tier_cold_keys"] == "0" and info["tier_cold_bytes"] == "0", info
+    assert hb.get("key7") == value(7, 1) and hb.get("key3") == "-1"
+
+    # Cleared, the log starts over
+    hb.set("again", value(0))
+    assert server.wait(lambda: tier(s)["tier_cold_keys"] != "0", 20)
+    assert hb.command("clr") == "0"
+    info = tier(s)
+    assert info["tier_cold_keys"] == "0" and info["tier_log_bytes"] == "0", info
+
+    print("ok")
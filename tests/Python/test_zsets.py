@@ -0,0 +1,75 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import random
+import server                                    # hashbase
+
+def members(reply):
+    return [e[1:-1] for e in reply.split("\n")] if reply else []
+
+# Members ordered by score then by name, small sets packed
+with server.sandbox() as box:
+    s = box.server()
+    hb = s.client()
+
+    assert hb.command("zadd", "zset", 1, "a", 2, "b", 3, "c") == "3"
+    assert hb.command("zadd", "zset", 1.5, "a") == "0"
+    assert hb.command("zscore", "zset", "a") == "1.5" and hb.command("zcard", "zset") == "3"
+    assert hb.command("zrank", "zset", "a") == "0" and hb.command("zrank", "zset", "c") == "2"
+    assert hb.command("zrank", "zset", "missing") == "-1"
+    assert members(hb.command("zrange", "zset", 0, -1)) == ["a", "b", "c"]
+    assert hb.command("zrange", "zset", 0, -1, "withscores") == "\"a\"\n1.5\n\"b\"\n2\n\"c\"\n3"
+    assert hb.command("zrange", "zset", -1, -1, "WITHSCORES") == "\"c\"\n3"
+    assert members(hb.command("zrangebyscore", "zset", "-inf", "+inf")) == ["a", "b", "c"]
+    assert members(hb.command("zrangebyscore", "zset", "(1.5", 3)) == ["b", "c"]
+    assert members(hb.command("zrangebyscore", "zset", 1.5, "(3")) == ["a", "b"]
+    assert hb.command("zrangebyscore", "zset", 2, 1) == ""
+    assert hb.command("zrangebyscore", "zset", "x", 3) == "-1"
+    assert hb.command("zadd", "zset", "x", "a") == "-1" and hb.command("zadd", "zset", 1, "a", 2) == "-1"
+    assert hb.command("object", "encoding", "zset") == "packed"
+
+    hb.command("zadd", "ties", 1, "b", 1, "a", "1e3", "c", -0.25, "d")
+    assert hb.command("zrange", "ties", 0, -1, "withscores") == "\"d\"\n-0.25\n\"a\"\n1\n\"b\"\n1\n\"c\"\n1000"
+
+    # Gone with its last member
+    assert hb.command("zrem", "zset", "a", "missing") == "1"
+    assert hb.command("zrem", "zset", "b", "c") == "2"
+    assert hb.command("type", "zset") == "none"
+
+    # Past 128 members a skiplist, checked against a model of the set
+    random.seed(3)
+    model = {}
+    for i in range(2000):
+        member, score = "member%d" % random.randint(0, 999), random.randint(-500, 500)
+        hb.command("zadd", "large", score, member)
+        model[member] = score
+        if i == 100:
+            assert hb.command("object", "encoding", "large") == "packed"
+    for member in random.sample(sorted(model), 100):
+        assert hb.command("zrem", "large", member) == "1"
+        del model[member]
+    assert hb.command("object", "encoding", "large") == "skiplist"
+
+    order = sorted(model, key=lambda m: (model[m], m))
+    assert hb.command("zcard", "large") == str(len(order))
+    assert members(hb.command("zrange", "large", 0, -1)) == order
+    assert members(hb.command("zrange", "large", 100, 199)) == order[100:200]
+    for member in order[::37]:
+        assert hb.command("zrank", "large", member) == str(order.index(member))
+        assert hb.command("zscore", "large", member) == str(model[member])
+    assert members(hb.command("zrangebyscore", "large", -100, "(100")) == [m for m in order if -100 <= model[m] < 100]
+
+    # Or a member past 64 bytes
+    hb.command("zadd", "wide", 1, "x" * 64)
+    assert hb.command("object", "encoding", "wide") == "packed"
+    hb.command("zadd", "wide", 2, "y" * 65)
+    assert hb.command("object", "encoding", "wide") == "skiplist"
+
+    # Kept through the snapshot
+    assert hb.command("save") == "0"
+    s.stop()
+    s.start()
+    hb = s.client()
+    assert members(hb.command("zrange", "large", 0, -1)) == order
+    assert hb.command("zrank", "wide", "y" * 65) == "1"
+
+    print("ok")